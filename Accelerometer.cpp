@@ -1,7 +1,9 @@
 #include "Accelerometer.h"
 
 // resolution 14 bit
-Accelerometer::Accelerometer(I2C &i2c_instance) : i2c(i2c_instance)
+Accelerometer::Accelerometer(I2CBus &bus)
+    : device(bus, MMA8451_I2C_ADDRESS, "MMA8451"), queue(nullptr), irq(nullptr), intEnable(0),
+      motionIsFreefall(false), retryTimestamp(0), fifoBusy(false), fifoCount(0)
 {
     
 }
@@ -34,30 +36,219 @@ float Accelerometer::getAccZ() {
 }
 
 
+// FIFO einrichten: Konfiguration nur im Standby möglich
+bool Accelerometer::enableFifo(InterruptIn &irq, EventQueue &queue, uint8_t rate, uint8_t watermark,
+                               Callback<void(const AccSample *, int)> handler) {
+    if (watermark < 1 || watermark > MMA8451_FIFO_SIZE) {
+        return false;
+    }
+    fifoHandler = handler;
+    intEnable |= INT_SRC_FIFO;
+
+    bool ok = writeReg(REG_CTRL_REG_1, 0x00)                        // Standby
+              && writeReg(REG_F_SETUP, F_SETUP_CIRCULAR | watermark); // Ringpuffer + Watermark
+    return ok && attachInterrupt(irq, queue, rate);
+}
+
+bool Accelerometer::enableEvents(InterruptIn &irq, EventQueue &queue, uint8_t rate,
+                                 const AccEventConfig &config, Callback<void(AccEvent)> handler) {
+    if (config.transientThreshold > ACC_THS_MAX || config.motionThreshold > ACC_THS_MAX) {
+        return false;
+    }
+    eventHandler = handler;
+    motionIsFreefall = config.freefall;
+
+    bool ok = writeReg(REG_CTRL_REG_1, 0x00); // Standby
+    if (ok && config.transientThreshold) {
+        // Hochpass bleibt an, so zählt nur die Änderung und nicht die Schwerkraft
+        ok = writeReg(REG_TRANSIENT_CFG, TRANSIENT_CFG_ELE | TRANSIENT_CFG_XYZ)
+             && writeReg(REG_TRANSIENT_THS, THS_DBCNTM | config.transientThreshold)
+             && writeReg(REG_TRANSIENT_COUNT, config.transientCount);
+        intEnable |= INT_SRC_TRANS;
+    }
+    if (ok && config.motionThreshold) {
+        ok = writeReg(REG_FF_MT_CFG, FF_MT_CFG_ELE | (config.freefall ? 0 : FF_MT_CFG_OAE) | FF_MT_CFG_XYZ)
+             && writeReg(REG_FF_MT_THS, THS_DBCNTM | config.motionThreshold)
+             && writeReg(REG_FF_MT_COUNT, config.motionCount);
+        intEnable |= INT_SRC_FF_MT;
+    }
+    if (ok && config.orientation) {
+        ok = writeReg(REG_PL_CFG, THS_DBCNTM | PL_CFG_PL_EN)
+             && writeReg(REG_PL_COUNT, config.orientationCount);
+        intEnable |= INT_SRC_LNDPRT;
+    }
+    return ok && attachInterrupt(irq, queue, rate);
+}
+
+// Gemeinsamer Teil: Quellen freigeben, alle auf INT1 legen und wieder aktiv schalten
+bool Accelerometer::attachInterrupt(InterruptIn &irq, EventQueue &queue, uint8_t rate) {
+    this->queue = &queue;
+    this->irq = &irq;
+    bool ok = writeReg(REG_CTRL_REG_3, 0x00)          // Interrupt active low, push-pull
+              && writeReg(REG_CTRL_REG_4, intEnable)
+              && writeReg(REG_CTRL_REG_5, intEnable);
+    if (!ok) {
+        return false;
+    }
+    irq.fall(callback(this, &Accelerometer::onInterrupt));
+    return writeReg(REG_CTRL_REG_1, (rate << 3) | CTRL_REG1_ACTIVE); // ODR setzen, aktiv
+}
+
+// Lesen von F_STATUS löscht den Interrupt, danach ein Burst über alle Samples
+void Accelerometer::startFifoRead() {
+    fifoCommand = REG_F_STATUS;
+    fifoBusy = device.submit(&fifoCommand, 1, reinterpret_cast<char *>(&fifoStatus), 1,
+                             callback(this, &Accelerometer::fifoStatusRead));
+}
+
+void Accelerometer::fifoStatusRead(int result) {
+    int count = fifoStatus & F_STATUS_CNT_MASK;
+    if (result != 0 || count == 0) {
+        fifoReadDone();
+        return;
+    }
+    if (count > MMA8451_FIFO_SIZE) {
+        count = MMA8451_FIFO_SIZE;
+    }
+    // Im FIFO-Modus springt der Adresszeiger nach OUT_Z_LSB zurück auf OUT_X_MSB,
+    // ein Burst liefert also count Samples hintereinander
+    fifoCount = count;
+    fifoCommand = REG_OUT_X_MSB;
+    if (!device.submit(&fifoCommand, 1, reinterpret_cast<char *>(fifoRaw), count * 6,
+                       callback(this, &Accelerometer::fifoDataRead))) {
+        fifoReadDone();
+    }
+}
+
+void Accelerometer::fifoDataRead(int result) {
+    if (result == 0) {
+        for (int i = 0; i < fifoCount; i++) {
+            const uint8_t *p = &fifoRaw[i * 6];
+            // 14 bit linksbündig, arithmetischer Shift behält das Vorzeichen
+            fifoSamples[i].x = static_cast<int16_t>((p[0] << 8) | p[1]) >> 2;
+            fifoSamples[i].y = static_cast<int16_t>((p[2] << 8) | p[3]) >> 2;
+            fifoSamples[i].z = static_cast<int16_t>((p[4] << 8) | p[5]) >> 2;
+        }
+        if (fifoHandler) {
+            fifoHandler(fifoSamples, fifoCount);
+        }
+    }
+    fifoReadDone();
+}
+
+void Accelerometer::fifoReadDone() {
+    fifoBusy = false;
+    // Während des Lesens neu dazugekommene Quellen halten INT1 weiter low
+    if (irq->read() == 0) {
+        const uint32_t timestamp = Kernel::Clock::now().time_since_epoch().count();
+        if (!queue->call(this, &Accelerometer::serviceInterrupt, timestamp)) {
+            retryInterrupt(timestamp);
+        }
+    }
+}
+
+// Läuft im Interrupt-Kontext: kein I2C hier, nur Zeitstempel nehmen und in die Queue verschieben
+void Accelerometer::onInterrupt() {
+    retryTimestamp = Kernel::Clock::now().time_since_epoch().count();
+    postInterrupt();
+}
+
+void Accelerometer::postInterrupt() {
+    if (!queue->call(this, &Accelerometer::serviceInterrupt, retryTimestamp)) {
+        // Queue voll: ohne neue Flanke käme INT1 sonst nie mehr dran
+        retryTimeout.attach(callback(this, &Accelerometer::postInterrupt), 5ms);
+    }
+}
+
+void Accelerometer::retryInterrupt(uint32_t timestamp) {
+    if (!queue->call_in(5ms, this, &Accelerometer::serviceInterrupt, timestamp)) {
+        // Auch dafür kein Platz: der Timer braucht keinen
+        retryTimestamp = timestamp;
+        retryTimeout.attach(callback(this, &Accelerometer::postInterrupt), 5ms);
+    }
+}
+
+void Accelerometer::serviceInterrupt(uint32_t timestamp) {
+    uint8_t source;
+    if (!readRegs(REG_INT_SOURCE, &source, 1)) {
+        // Bus-Queue voll oder NACK: INT1 bleibt low, also später erneut lesen
+        retryInterrupt(timestamp);
+        return;
+    }
+    // Jede Quelle bleibt gesetzt, bis ihr Statusregister gelesen wurde
+    if (source & INT_SRC_TRANS) {
+        reportEvent(timestamp, ACC_EVENT_TRANSIENT, REG_TRANSIENT_SRC);
+    }
+    if (source & INT_SRC_FF_MT) {
+        reportEvent(timestamp, motionIsFreefall ? ACC_EVENT_FREEFALL : ACC_EVENT_MOTION, REG_FF_MT_SRC);
+    }
+    if (source & INT_SRC_LNDPRT) {
+        reportEvent(timestamp, ACC_EVENT_ORIENTATION, REG_PL_STATUS);
+    }
+    if ((source & INT_SRC_FIFO) && !fifoBusy) {
+        startFifoRead();
+        if (!fifoBusy) {
+            // Bus-Queue voll: später erneut versuchen, ein sofortiges Neu-Einreihen
+            // würde bei low gehaltenem INT1 nur im Kreis laufen
+            retryInterrupt(timestamp);
+            return;
+        }
+    }
+
+    // INT1 ist eine gemeinsame Leitung: kam während des Auslesens eine weitere Quelle dazu,
+    // bleibt sie low und es gibt keine neue fallende Flanke. Läuft noch ein FIFO-Read,
+    // prüft dessen Ende die Leitung.
+    if (!fifoBusy && irq->read() == 0 && !queue->call(this, &Accelerometer::serviceInterrupt, timestamp)) {
+        retryInterrupt(timestamp);
+    }
+}
+
+void Accelerometer::reportEvent(uint32_t timestamp, AccEventSource source, uint8_t statusReg) {
+    AccEvent event;
+    event.timestamp = timestamp;
+    event.source = source;
+    event.status = 0;
+    // Lesen des Statusregisters löscht die Quelle
+    if (readRegs(statusReg, &event.status, 1) && eventHandler) {
+        eventHandler(event);
+    }
+}
+
 // Lesen und Schreiben von Registern des Sensors über den I2C-Bus.
-void Accelerometer::readRegs(int addr, uint8_t *data, int len) {
+bool Accelerometer::readRegs(int addr, uint8_t *data, int len) {
     char t[1] = {static_cast<char>(addr)}; // addr vom sensor für x,y,z register
-    i2c.write(MMA8451_I2C_ADDRESS, t, 1, true); //  1 = (1 Byte) sendet adrrese vom register damit sensor bescheid weis
-    //Das true-Argument steht für einen "repeated start" auf dem I2C-Bus. kein stop signal, weiterer datenaustausch möglich
-    i2c.read(MMA8451_I2C_ADDRESS, reinterpret_cast<char *>(data), len);
+    // sendet adresse vom register, dann "repeated start" ohne stop signal und lesen
+    return device.writeRead(t, 1, reinterpret_cast<char *>(data), len) == 0;
 }
 
 // für init wichtig
-void Accelerometer::writeRegs(uint8_t *data, int len) {
-    i2c.write(MMA8451_I2C_ADDRESS, reinterpret_cast<char *>(data), len);
+bool Accelerometer::writeRegs(uint8_t *data, int len) {
+    return device.write(reinterpret_cast<char *>(data), len) == 0;
+}
+
+bool Accelerometer::writeReg(uint8_t reg, uint8_t value) {
+    uint8_t data[2] = {reg, value};
+    return writeRegs(data, 2);
 }
 
 // get rohdata (int)
 int16_t Accelerometer::getAccAxis(uint8_t addr) {
-    int16_t acc;
-    uint8_t res[2]; // 2 byte Puffer (res[0]) die oberen 8 Bits enthält (res[1]) enthält die unteren 6 Bits.
+    uint8_t res[2] = {0, 0}; // 2 byte Puffer (res[0]) die oberen 8 Bits enthält (res[1]) enthält die unteren 6 Bits.
     readRegs(addr, res, 2); // zwei Bytes aus den Registern des Sensors lesen
 
-    acc = (res[0] << 6) | (res[1] >> 2); // um ein 14-Bit-Ergebnis (acc) zu erhalten.
-    if (acc > UINT14_MAX / 2) { // if the first bit is positive it means negativ
-        acc -= UINT14_MAX;
+    // 14 bit linksbündig im Zweierkomplement, arithmetischer Shift behält das Vorzeichen.
+    return static_cast<int16_t>((res[0] << 8) | res[1]) >> 2;
+}
+
+bool Accelerometer::readAxes(AccSample &sample) {
+    uint8_t raw[6];
+    if (!readRegs(REG_OUT_X_MSB, raw, sizeof(raw))) {
+        return false;
     }
-    return acc;
+    sample.x = static_cast<int16_t>((raw[0] << 8) | raw[1]) >> 2;
+    sample.y = static_cast<int16_t>((raw[2] << 8) | raw[3]) >> 2;
+    sample.z = static_cast<int16_t>((raw[4] << 8) | raw[5]) >> 2;
+    return true;
 }
 
 
@@ -1,29 +1,156 @@
 #include "mbed.h"
 #include <cstdint>
+#include "i2c_bus.h"
 
 #define MMA8451_I2C_ADDRESS (0x1d << 1)
+#define REG_F_STATUS        0x00
+#define REG_F_SETUP         0x09
+#define REG_INT_SOURCE      0x0C
 #define REG_WHO_AM_I        0x0D
+#define REG_XYZ_DATA_CFG    0x0E
+#define REG_PL_STATUS       0x10
+#define REG_PL_CFG          0x11
+#define REG_PL_COUNT        0x12
+#define REG_FF_MT_CFG       0x15
+#define REG_FF_MT_SRC       0x16
+#define REG_FF_MT_THS       0x17
+#define REG_FF_MT_COUNT     0x18
+#define REG_TRANSIENT_CFG   0x1D
+#define REG_TRANSIENT_SRC   0x1E
+#define REG_TRANSIENT_THS   0x1F
+#define REG_TRANSIENT_COUNT 0x20
 #define REG_CTRL_REG_1      0x2A
+#define REG_CTRL_REG_3      0x2C
+#define REG_CTRL_REG_4      0x2D
+#define REG_CTRL_REG_5      0x2E
 #define REG_OUT_X_MSB       0x01
 #define REG_OUT_Y_MSB       0x03
 #define REG_OUT_Z_MSB       0x05
 #define UINT14_MAX          16383
 
+#define F_STATUS_CNT_MASK   0x3F   // Anzahl Samples im FIFO
+#define F_SETUP_CIRCULAR    0x40   // F_MODE 01: FIFO als Ringpuffer
+#define CTRL_REG1_ACTIVE    0x01
+#define INT_SRC_FIFO        0x40   // gleiche Bitposition in INT_SOURCE, CTRL_REG4 und CTRL_REG5
+#define INT_SRC_TRANS       0x20
+#define INT_SRC_LNDPRT      0x10
+#define INT_SRC_FF_MT       0x04
+#define MMA8451_FIFO_SIZE   32
+
+#define FF_MT_CFG_ELE       0x80   // Event-Flag bis zum Lesen von FF_MT_SRC halten
+#define FF_MT_CFG_OAE       0x40   // 1: Bewegung (ODER über Achsen), 0: Freifall (UND)
+#define FF_MT_CFG_XYZ       0x38
+#define TRANSIENT_CFG_ELE   0x10
+#define TRANSIENT_CFG_XYZ   0x0E
+#define PL_CFG_PL_EN        0x40
+#define THS_DBCNTM          0x80   // Entprellzähler bei Unterschreiten löschen statt runterzählen
+#define ACC_THS_MAX         0x7F   // 0.063 g pro LSB
+
+// Output Data Rate, Bits DR in CTRL_REG1
+#define ACC_ODR_800HZ       0
+#define ACC_ODR_400HZ       1
+#define ACC_ODR_200HZ       2
+#define ACC_ODR_100HZ       3
+#define ACC_ODR_50HZ        4
+#define ACC_ODR_12HZ5       5
+#define ACC_ODR_6HZ25       6
+#define ACC_ODR_1HZ56       7
+
+// Ein Sample aus dem FIFO, 14 bit Rohwerte (2g: 4096 pro g)
+struct AccSample {
+    int16_t x, y, z;
+};
+
+// Quelle eines Events der internen Erkennung
+enum AccEventSource : uint8_t {
+    ACC_EVENT_TRANSIENT,   // Stoß: Hochpass-gefilterte Beschleunigung über Schwelle
+    ACC_EVENT_MOTION,      // Beschleunigung auf einer Achse über Schwelle
+    ACC_EVENT_FREEFALL,    // Beschleunigung auf allen Achsen unter Schwelle
+    ACC_EVENT_ORIENTATION  // Hoch-/Querformat oder Vorder-/Rückseite hat gewechselt
+};
+
+struct AccEvent {
+    uint32_t timestamp;    // Kernel-Uhr in ms beim Interrupt
+    AccEventSource source;
+    uint8_t status;        // TRANSIENT_SRC, FF_MT_SRC bzw. PL_STATUS: Achse, Richtung, Lage
+};
+
+// Schwellen in 0.063 g pro LSB (max. ACC_THS_MAX), 0 schaltet die Erkennung ab.
+// Entprellung in Samples der eingestellten Datenrate.
+struct AccEventConfig {
+    uint8_t transientThreshold;
+    uint8_t transientCount;
+    uint8_t motionThreshold;   // FF_MT-Engine, bei freefall die Unterschreitungsschwelle
+    uint8_t motionCount;
+    bool freefall;             // FF_MT als Freifall- statt Bewegungserkennung (nur eins geht)
+    bool orientation;
+    uint8_t orientationCount;
+};
+
 class Accelerometer {
 private:
-    I2C &i2c; // Referenz auf die gemeinsame I2C-Instanz
+    I2CDevice device; // am gemeinsamen Bus
 
     float valx,valy,valz;
-    void readRegs(int addr, uint8_t *data, int len);
-    void writeRegs(uint8_t *data, int len);
+
+    // FIFO- und Event-Betrieb, beide teilen sich INT1
+    EventQueue *queue;
+    InterruptIn *irq;
+    uint8_t intEnable;       // CTRL_REG4/5: aktive Interrupt-Quellen, alle auf INT1
+    bool motionIsFreefall;
+    Callback<void(const AccSample *, int)> fifoHandler;
+    Callback<void(AccEvent)> eventHandler;
+    // Ist die Queue voll, versucht es der Timer weiter, sonst ginge INT1 verloren (bleibt low)
+    Timeout retryTimeout;
+    uint32_t retryTimestamp;
+
+    // FIFO wird asynchron über die Queue des Busses gelesen, Puffer leben bis zum Callback
+    bool fifoBusy;
+    char fifoCommand;
+    uint8_t fifoStatus;
+    int fifoCount;
+    uint8_t fifoRaw[MMA8451_FIFO_SIZE * 6];
+    AccSample fifoSamples[MMA8451_FIFO_SIZE];
+
+    bool readRegs(int addr, uint8_t *data, int len);
+    bool writeRegs(uint8_t *data, int len);
+    bool writeReg(uint8_t reg, uint8_t value);
     int16_t getAccAxis(uint8_t addr);
 
+    bool attachInterrupt(InterruptIn &irq, EventQueue &queue, uint8_t rate);
+    void onInterrupt();                        // ISR, nur Zeitstempel und weiterreichen
+    void postInterrupt();                      // Interrupt-Kontext (INT1 oder retryTimeout)
+    void serviceInterrupt(uint32_t timestamp); // aus der EventQueue
+    void retryInterrupt(uint32_t timestamp);   // serviceInterrupt in 5 ms erneut
+    void reportEvent(uint32_t timestamp, AccEventSource source, uint8_t statusReg);
+    void startFifoRead();
+    void fifoStatusRead(int result);
+    void fifoDataRead(int result);
+    void fifoReadDone();
+
 public:
-    Accelerometer(I2C &i2c_instance); // Konstruktor mit I2C-Referenz
+    Accelerometer(I2CBus &bus); // Konstruktor mit dem gemeinsamen Bus
     void initialize();
     uint8_t getWhoAmI();
     float getAccX();
     float getAccY();
     float getAccZ();
 
+    // Alle drei Achsen in einem Burst, 14 bit Rohwerte (4096 pro g). Für die
+    // Umrechnung ohne Gleitkomma siehe mma8451_acceleration_steps().
+    bool readAxes(AccSample &sample);
+
+    // Dauerbetrieb mit FIFO: der Sensor sammelt mit rate (ACC_ODR_*) bis zu 32 Samples,
+    // ab watermark Samples zieht er INT1 (irq) auf low. Der Treiber leert den FIFO dann
+    // mit einem Burst-Read (max. 32 * 6 = 192 Bytes) über die Queue des Busses, ohne
+    // queue solange zu blockieren, und ruft handler mit den Samples auf.
+    bool enableFifo(InterruptIn &irq, EventQueue &queue, uint8_t rate, uint8_t watermark,
+                    Callback<void(const AccSample *, int)> handler);
+
+    // Interne Erkennung von Stoß, Bewegung/Freifall und Lageänderung. Der Sensor meldet
+    // über INT1, handler bekommt pro Quelle ein AccEvent aus queue. Kann mit enableFifo()
+    // kombiniert werden, die zuletzt gesetzte rate gilt für beide.
+    bool enableEvents(InterruptIn &irq, EventQueue &queue, uint8_t rate,
+                      const AccEventConfig &config, Callback<void(AccEvent)> handler);
+
 };
@@ -5,7 +5,11 @@
 // Konstruktor, der GPS-Komponenten initialisiert
 GPS::GPS(PinName tx, PinName rx, PinName enablePin)
 
-    : gpsSerial(tx, rx, 9600), pc_serial(USBTX, USBRX, 115200), gpsEnable(enablePin) {
+    : gpsSerial(tx, rx, 9600), pc_serial(USBTX, USBRX, 115200), gpsEnable(enablePin),
+      queue(nullptr), drainPending(false), rxOverruns(0), hasFix(false), ackCount(0),
+      baud(GPS_DEFAULT_BAUD), dutyCycle(false), powered(false), fixSincePowerOn(false), switchedOff(false),
+      measureTtff(false), powerOnAt(0),
+      powerOnEvent(0), timeoutEvent(0) {
     num_satellites = 0;
     latitude = 0.0;
     longitude = 0.0;
@@ -14,76 +18,327 @@ GPS::GPS(PinName tx, PinName rx, PinName enablePin)
     parallel = ' ';
     measurement = ' ';
     memset(gps_time, 0, sizeof(gps_time));
-    memset(gps_data, 0, sizeof(gps_data));
+    memset(&fix, 0, sizeof(fix));
+    memset(&powerStats, 0, sizeof(powerStats));
+    powerStats.leadTime = GPS_LEAD_TIME_INIT;
+    gpsSerial.attach(callback(this, &GPS::onRx), SerialBase::RxIrq);
 }
 
 // Initialisiert das GPS-Modul
-void GPS::initialize() {
+bool GPS::initialize(int updateIntervalMs, int baudRate) {
     printf("Starting GPS\n");
-    gpsEnable = 1; // GPS-Modul aktivieren
-}
-
-// Verarbeitet NMEA-Satz und aktualisiert GPS-Daten
-void GPS::parseData(char* nmea_sentence) {
-    if (strstr(nmea_sentence, "$GPGGA")) { // Sucht nach GPGGA-Datensatz
-        char* token = strtok(nmea_sentence, ","); // Zerlegt die Zeichenkette
-        int fieldIndex = 0;
-        while (token != NULL) {
-            switch (fieldIndex) {
-                case 1:
-                    snprintf(gps_time, sizeof(gps_time), "%.2s:%.2s:%.2s", token, token + 2, token + 4); // Zeitstempel
-                    break;
-                case 2:
-                    latitude = atof(token) / 100; //  String in einen Float 4916.45 für 49° 16.45'). Um diese in Dezimalgrad zu konvertieren, wird der Wert mit 100
-                    break;
-                case 3:
-                    parallel = token[0];
-                    break;
-                case 4:
-                    longitude = atof(token) / 100;
-                    break;
-                case 5:
-                    meridian = token[0];
-                    break;
-                case 7:
-                    num_satellites = atoi(token);
-                    break;
-                case 9:
-                    altitude = atof(token);
-                    break;
-                case 10:
-                    measurement = token[0] + 32; // A für gültig und V für ungültig 
-                    // 32 erhöht, was dem ASCII-Wert von a entspricht, falls A als Zeichen übergeben wird (dies bedeutet, dass der Wert von Großbuchstaben in Kleinbuchstaben geändert wird).
-                    break;
+    powerOn(); // GPS-Modul aktivieren
+
+    // Nur GGA (Position, Satelliten) und RMC (Status) ausgeben, GSA/GSV/VTG werden nicht
+    // gebraucht und kosten nur UART-Interrupts. Reihenfolge: GLL, RMC, VTG, GGA, GSA, GSV, ...
+    bool ok = sendAndWaitForAck("PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0", 314);
+
+    char body[24];
+    snprintf(body, sizeof(body), "PMTK220,%d", updateIntervalMs);
+    ok = sendAndWaitForAck(body, 220) && ok;
+    if (!ok) {
+        printf("GPS: configuration not acknowledged\n");
+    }
+
+    if (baudRate == baud) {
+        return ok;
+    }
+    // PMTK251 wird nicht bestätigt, das Modul schaltet sofort um. Erfolg sieht man nur
+    // daran, dass mit der neuen Rate wieder gültige Sätze ankommen.
+    snprintf(body, sizeof(body), "PMTK251,%d", baudRate);
+    sendCommand(body);
+    ThisThread::sleep_for(20ms); // letztes Byte muss raus sein, bevor wir umschalten
+    gpsSerial.baud(baudRate);
+    parser.reset();
+    if (waitForSentence(GPS_BAUD_TIMEOUT)) {
+        baud = baudRate;
+        return ok;
+    }
+    printf("GPS: no response at %d baud, staying at %d\n", baudRate, baud);
+    gpsSerial.baud(baud);
+    parser.reset();
+    return false;
+}
+
+bool GPS::sendCommand(const char *body) {
+    uint8_t checksum = 0;
+    for (const char *p = body; *p; p++) {
+        checksum ^= static_cast<uint8_t>(*p);
+    }
+    char sentence[NMEA_MAX_SENTENCE + 1];
+    int length = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+    if (length < 0 || length >= static_cast<int>(sizeof(sentence))) {
+        return false;
+    }
+    return gpsSerial.write(sentence, length) == length;
+}
+
+// Vor start() läuft noch keine Queue, daher wird der Ringpuffer hier selbst geleert
+bool GPS::sendAndWaitForAck(const char *body, uint16_t command) {
+    uint32_t acks = ackCount;
+    if (!sendCommand(body)) {
+        return false;
+    }
+    auto deadline = Kernel::Clock::now() + GPS_ACK_TIMEOUT;
+    while (Kernel::Clock::now() < deadline) {
+        readAndProcessGPSData();
+        if (ackCount != acks && parser.data().ackCommand == command) {
+            return parser.data().ackFlag == 3;
+        }
+        ThisThread::sleep_for(10ms);
+    }
+    return false;
+}
+
+bool GPS::waitForSentence(std::chrono::milliseconds timeout) {
+    uint32_t sentences = parser.stats().sentences;
+    auto deadline = Kernel::Clock::now() + timeout;
+    while (Kernel::Clock::now() < deadline) {
+        readAndProcessGPSData();
+        if (parser.stats().sentences != sentences) {
+            return true;
+        }
+        ThisThread::sleep_for(10ms);
+    }
+    return false;
+}
+
+void GPS::start(EventQueue &queue) {
+    this->queue = &queue;
+    if (!rxRing.empty() && !core_util_atomic_exchange_bool(&drainPending, true)) {
+        if (queue.call(this, &GPS::drain) == 0) {
+            core_util_atomic_store_bool(&drainPending, false);
+        }
+    }
+}
+
+// RX-Interrupt: nur Zeichen in den Ring, pro Satzende (oder halb vollem Ring) ein Event
+void GPS::onRx() {
+    char c;
+    bool lineEnd = false;
+    while (gpsSerial.readable() && gpsSerial.read(&c, 1) == 1) {
+        if (!rxRing.push(c)) {
+            rxOverruns++;
+        }
+        lineEnd |= c == '\n';
+    }
+    // drain() setzt und löscht drainPending atomar; die ISR selbst wird von drain() nicht
+    // unterbrochen, hier reicht also einfaches Lesen und Setzen
+    if (queue && !drainPending && (lineEnd || rxRing.count() >= GPS_RX_RING_SIZE / 2)) {
+        drainPending = true;
+        if (queue->call(this, &GPS::drain) == 0) {
+            drainPending = false; // Queue voll, beim nächsten Zeichen wieder versuchen
+        }
+    }
+}
+
+void GPS::drain() {
+    char c;
+    for (int n = 0; n < GPS_DRAIN_SLICE && rxRing.pop(c); n++) {
+        process(c);
+    }
+    if (!rxRing.empty()) {
+        // Rest im nächsten Event, andere kommen dazwischen
+        if (queue->call(this, &GPS::drain) == 0) {
+            // Queue voll: freigeben, damit die ISR beim nächsten Satzende wieder ein Event stellt
+            core_util_atomic_store_bool(&drainPending, false);
+        }
+        return;
+    }
+    core_util_atomic_store_bool(&drainPending, false);
+    // Kam zwischen empty() und dem Löschen noch ein Satzende, hat die ISR kein Event gestellt
+    if (!rxRing.empty() && !core_util_atomic_exchange_bool(&drainPending, true)) {
+        if (queue->call(this, &GPS::drain) == 0) {
+            core_util_atomic_store_bool(&drainPending, false);
+        }
+    }
+}
+
+void GPS::process(char c) {
+    NmeaSentence sentence = parser.feed(c);
+    if (sentence == NMEA_PMTK_ACK) {
+        ackCount++;
+        return;
+    }
+    if (sentence == NMEA_NONE || sentence == NMEA_OTHER) {
+        return;
+    }
+    updateFromParser();
+    const NmeaData &nmea = parser.data();
+    if (sentence == NMEA_GGA && nmea.quality > 0) {
+        fix.latitude = nmea.latitude;
+        fix.longitude = nmea.longitude;
+        fix.altitude = nmea.altitude;
+        fix.satellites = nmea.satellites;
+        fix.timestamp = Kernel::Clock::now().time_since_epoch().count();
+        hasFix = true;
+        if (powered && !fixSincePowerOn) {
+            onFirstFix(fix.timestamp);
+        }
+    }
+}
+
+void GPS::enableDutyCycle(bool enable) {
+    dutyCycle = enable;
+    if (!enable && !powered) {
+        powerOn();
+    }
+}
+
+void GPS::powerOn() {
+    if (!powered) {
+        powered = true;
+        fixSincePowerOn = false;
+        measureTtff = switchedOff; // beim Booten war das Modul evtl. schon an
+        powerOnAt = Kernel::Clock::now().time_since_epoch().count();
+        parser.reset(); // Reste von vor dem Ausschalten verwerfen
+        gpsEnable = 1;
+    }
+    if (dutyCycle && queue && !timeoutEvent) {
+        timeoutEvent = queue->call_in(GPS_MAX_ON_TIME, this, &GPS::onFixTimeout);
+    }
+    powerOnEvent = 0;
+}
+
+void GPS::powerOff() {
+    if (!powered) {
+        return;
+    }
+    gpsEnable = 0; // Backup-Versorgung hält Ephemeriden, nächster Start ist ein Hot Start
+    powered = false;
+    switchedOff = true;
+    uint32_t onTime = static_cast<uint32_t>(Kernel::Clock::now().time_since_epoch().count()) - powerOnAt;
+    powerStats.lastOnTime = onTime;
+    powerStats.totalOnTime += onTime;
+    if (timeoutEvent) {
+        queue->cancel(timeoutEvent);
+        timeoutEvent = 0;
+    }
+}
+
+// Erster Fix nach dem Einschalten: TTFF messen, Vorlaufzeit nachführen, wieder aus
+void GPS::onFirstFix(uint32_t now) {
+    fixSincePowerOn = true;
+    if (measureTtff) {
+        uint32_t ttff = now - powerOnAt;
+        powerStats.lastTtff = ttff;
+        powerStats.avgTtff = powerStats.fixes ? (3 * powerStats.avgTtff + ttff) / 4 : ttff;
+        powerStats.fixes++;
+
+        uint32_t lead = powerStats.avgTtff * 3 / 2 + GPS_LEAD_MARGIN;
+        powerStats.leadTime = lead < GPS_LEAD_TIME_MIN ? GPS_LEAD_TIME_MIN
+                              : lead > GPS_LEAD_TIME_MAX ? GPS_LEAD_TIME_MAX : lead;
+    }
+    if (dutyCycle) {
+        powerOff();
+    }
+}
+
+void GPS::onFixTimeout() {
+    timeoutEvent = 0;
+    if (!powered || fixSincePowerOn) {
+        return;
+    }
+    // Kein Fix: nächstes Mal früher einschalten
+    powerStats.timeouts++;
+    powerStats.leadTime = powerStats.leadTime * 2 > GPS_LEAD_TIME_MAX ? GPS_LEAD_TIME_MAX
+                          : powerStats.leadTime * 2;
+    if (dutyCycle) {
+        powerOff();
+    }
+}
+
+void GPS::planNextFix(uint32_t untilNeededMs) {
+    if (!dutyCycle || !queue) {
+        return;
+    }
+    if (powerOnEvent) {
+        queue->cancel(powerOnEvent);
+        powerOnEvent = 0;
+    }
+    if (powered) {
+        if (!fixSincePowerOn) {
+            // sucht noch, Fix oder Timeout schalten ab
+            if (!timeoutEvent) {
+                timeoutEvent = queue->call_in(GPS_MAX_ON_TIME, this, &GPS::onFixTimeout);
             }
-            token = strtok(NULL, ",");
-            fieldIndex++;
+            return;
         }
-        //sprintf(gps_data, "GPS: #Sats: %d Lat(UTC): %.6f %c Long(UTC): %.6f %c Altitude: %.1f %c GPT time: %s",
-        //        num_satellites, latitude, parallel, longitude, meridian, altitude, measurement, gps_time);
-        //printf("%s\n\n", gps_data);
-        
-        //printf("GPS: #Sats: %d Lat(UTC): %.6f %c Long(UTC): %.6f %c Altitude: %.1f %c GPT time: %s\n\n",
-       //num_satellites, latitude, parallel, longitude, meridian, altitude, measurement, gps_time);
+        powerOff(); // z.B. Fix schon während initialize(), vor dem Energiesparbetrieb
+    }
+    if (untilNeededMs <= powerStats.leadTime) {
+        powerOn();
+    } else {
+        powerOnEvent = queue->call_in(std::chrono::milliseconds(untilNeededMs - powerStats.leadTime),
+                                      this, &GPS::powerOn);
+    }
+}
+
+void GPS::skipNextFix() {
+    if (!dutyCycle || !queue) {
+        return;
+    }
+    if (powerOnEvent) {
+        queue->cancel(powerOnEvent);
+        powerOnEvent = 0;
+    }
+    if (powered && fixSincePowerOn) {
+        powerOff();
+    }
+}
+
+bool GPS::isPowered() { return powered; }
+const GpsPowerStats &GPS::getPowerStats() { return powerStats; }
 
+// Verarbeitet NMEA-Zeichen und aktualisiert GPS-Daten nach jedem gültigen Satz
+void GPS::parseData(const char* data, int length) {
+    for (int i = 0; i < length; i++) {
+        process(data[i]);
     }
 }
 
-// Methode, um GPS-Daten zu lesen und zu verarbeiten
+void GPS::updateFromParser() {
+    const NmeaData &nmea = parser.data();
+    latitude = nmea.latitude / 1000000.0f;   // Dezimalgrad, Süden negativ
+    longitude = nmea.longitude / 1000000.0f; // Dezimalgrad, Westen negativ
+    parallel = latitude < 0 ? 'S' : 'N';
+    meridian = longitude < 0 ? 'W' : 'E';
+    num_satellites = nmea.quality ? nmea.satellites : 0;
+    altitude = nmea.altitude / 100.0f;
+    measurement = nmea.altitudeUnit ? nmea.altitudeUnit + 32 : ' '; // 'M' -> 'm'
+    // hh:mm:ss von Hand, jedes Feld zweistellig (die Stunde mit % 100 begrenzt)
+    const unsigned fields[3] = {(unsigned)(nmea.time / 10000 % 100), (unsigned)(nmea.time / 100 % 100),
+                                (unsigned)(nmea.time % 100)};
+    for (int i = 0; i < 3; i++) {
+        gps_time[3 * i] = '0' + fields[i] / 10;
+        gps_time[3 * i + 1] = '0' + fields[i] % 10;
+        gps_time[3 * i + 2] = i < 2 ? ':' : '\0';
+    }
+}
+
+// Verarbeitet synchron alles, was noch im Ringpuffer liegt
 void GPS::readAndProcessGPSData() {
-    char buffer[256];
-    //while (true) {
-        if (gpsSerial.readable()) {
-            int bytesRead = gpsSerial.read(buffer, sizeof(buffer));
-            if (bytesRead > 0) {
-                buffer[bytesRead] = '\0';
-                parseData(buffer); // Verarbeitet den empfangenen GPS-Datenpuffer
-            }
-        //}
-        //ThisThread::sleep_for(2000ms); // Kleiner Schlaf, um die CPU zu entlasten
+    char c;
+    while (rxRing.pop(c)) {
+        process(c);
+    }
+}
+
+bool GPS::getLatestFix(GpsFix &latest) {
+    latest = fix;
+    return hasFix;
+}
+
+uint32_t GPS::getFixAge() {
+    if (!hasFix) {
+        return UINT32_MAX;
     }
+    return static_cast<uint32_t>(Kernel::Clock::now().time_since_epoch().count()) - fix.timestamp;
 }
 
+uint32_t GPS::getRxOverruns() { return rxOverruns; }
+int GPS::getBaud() { return baud; }
+
 // Getter-Methoden zur Rückgabe der GPS-Daten
 int GPS::getNumSatellites()  { return num_satellites; }
 float GPS::getLatitude()  { return latitude; }
@@ -93,4 +348,5 @@ char GPS::getMeridian()  { return meridian; }
 float GPS::getAltitude()  { return altitude; }
 char* GPS::getGPSTime()  { return gps_time; }
 char GPS::getMeasurement() {return measurement;}
+const NmeaStats &GPS::getStats() { return parser.stats(); }
 
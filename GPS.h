@@ -2,12 +2,47 @@
 #include "mbed.h"
 #include <cstring>
 #include <cstdlib>
+#include "nmea.h"
+#include "spsc_ring.h"
+
+#define GPS_RX_RING_SIZE    512  // gut eine Sekunde NMEA bei 9600 Baud
+#define GPS_DRAIN_SLICE     64   // Zeichen pro Event, damit die Queue nicht lange blockiert
+#define GPS_DEFAULT_BAUD    9600 // Werkseinstellung der MTK-Module
+#define GPS_ACK_TIMEOUT     1000ms
+#define GPS_BAUD_TIMEOUT    3000ms // so lange muss nach dem Umschalten ein gültiger Satz kommen
+
+// Energiesparbetrieb: Vorlaufzeit vor dem Uplink, an die gemessene TTFF angepasst
+#define GPS_LEAD_TIME_INIT  5000    // ms, bis die erste TTFF gemessen ist
+#define GPS_LEAD_TIME_MIN   2000
+#define GPS_LEAD_TIME_MAX   60000
+#define GPS_LEAD_MARGIN     1000    // ms zusätzlich zu 1.5 * mittlere TTFF
+#define GPS_MAX_ON_TIME     120s    // ohne Fix danach trotzdem ausschalten
+
+// Letzte gültige Position, mit Zeitstempel für das Alter
+struct GpsFix {
+    int32_t latitude;    // 1e-6 Grad, Süden negativ
+    int32_t longitude;   // 1e-6 Grad, Westen negativ
+    int32_t altitude;    // cm
+    uint8_t satellites;
+    uint32_t timestamp;  // Kernel-Uhr in ms beim Empfang des GGA-Satzes
+};
+
+// Kennzahlen des Energiesparbetriebs, Zeiten in ms
+struct GpsPowerStats {
+    uint32_t lastTtff;   // Einschalten bis zum ersten gültigen GGA im letzten Zyklus
+    uint32_t avgTtff;    // gleitender Mittelwert, daraus ergibt sich leadTime
+    uint32_t lastOnTime; // Einschaltdauer im letzten Zyklus
+    uint32_t totalOnTime;
+    uint32_t leadTime;   // so lange vor dem Uplink wird eingeschaltet
+    uint32_t fixes;
+    uint32_t timeouts;   // Zyklen ohne Fix innerhalb GPS_MAX_ON_TIME
+};
 
 class GPS {
 
     private:
     // GPS-Komponenten
-    BufferedSerial gpsSerial;
+    UnbufferedSerial gpsSerial;
     BufferedSerial pc_serial;
     DigitalOut gpsEnable;
 
@@ -21,18 +56,78 @@ class GPS {
     char measurement;
     char gps_time[10];
 
-    // Puffer für GPS-Daten
-    char gps_data[256];
+    // Zustand bleibt zwischen den Aufrufen erhalten, Sätze dürfen über mehrere Reads verteilt sein
+    NmeaParser parser;
+
+    // Empfang im Interrupt: RX-ISR schreibt, drain() aus der EventQueue liest
+    SpscRing<char, GPS_RX_RING_SIZE> rxRing;
+    EventQueue *queue;
+    volatile bool drainPending;
+    volatile uint32_t rxOverruns;
+
+    GpsFix fix;
+    bool hasFix;
+    uint32_t ackCount;   // Anzahl empfangener PMTK001
+    int baud;
+
+    // Energiesparbetrieb
+    bool dutyCycle;
+    bool powered;
+    bool fixSincePowerOn;
+    bool switchedOff;    // erst nach dem ersten Ausschalten ist die TTFF ein Hot Start
+    bool measureTtff;
+    uint32_t powerOnAt;  // Kernel-Uhr in ms
+    int powerOnEvent;
+    int timeoutEvent;
+    GpsPowerStats powerStats;
+
+    void powerOn();
+    void powerOff();
+    void onFixTimeout();
+    void onFirstFix(uint32_t now);
+
+    bool sendCommand(const char *body);
+    bool sendAndWaitForAck(const char *body, uint16_t command);
+    bool waitForSentence(std::chrono::milliseconds timeout);
+
+    void onRx();   // ISR
+    void drain();  // aus der EventQueue, höchstens GPS_DRAIN_SLICE Zeichen
+    void process(char c);
+    void updateFromParser();
 
 public:
     // Konstruktor
     GPS(PinName tx, PinName rx, PinName enablePin);
 
-    // Initialisiert das GPS-Modul
-    void initialize();
+    // Schaltet das Modul ein und konfiguriert es: nur GGA und RMC, Update-Intervall in ms,
+    // danach Wechsel auf baudRate. Antwortet das Modul mit der neuen Rate nicht, geht es
+    // mit GPS_DEFAULT_BAUD weiter. Blockiert bis zu einige Sekunden, also vor start() aufrufen.
+    bool initialize(int updateIntervalMs = 1000, int baudRate = GPS_DEFAULT_BAUD);
+    int getBaud();
+
+    // Ab jetzt wird der Ringpuffer im Hintergrund aus queue geleert, ohne queue nur
+    // bei readAndProcessGPSData()
+    void start(EventQueue &queue);
+
+    // Letzte gültige Position in O(1), ohne zu blockieren. false wenn es noch keine gab.
+    bool getLatestFix(GpsFix &latest);
+    // Alter der letzten gültigen Position in ms, UINT32_MAX wenn es keine gibt
+    uint32_t getFixAge();
+    // Zeichen, die verloren gingen, weil der Ringpuffer voll war
+    uint32_t getRxOverruns();
+
+    // Energiesparbetrieb: das Modul wird nach jedem Fix ausgeschaltet und per planNextFix()
+    // rechtzeitig vor dem nächsten Bedarf wieder eingeschaltet. Braucht start().
+    void enableDutyCycle(bool enable);
+    // Nächste Position wird in untilNeededMs gebraucht, Einschalten um leadTime vorher
+    void planNextFix(uint32_t untilNeededMs);
+    // Vorerst keine neue Position nötig: geplantes Einschalten verwerfen, ein Modul mit Fix abschalten
+    void skipNextFix();
+    bool isPowered();
+    const GpsPowerStats &getPowerStats();
 
-    // NMEA-Satz verarbeiten und GPS-Daten aktualisieren
-    void parseData(char* nmea_sentence);
+    // Empfangene NMEA-Zeichen verarbeiten und GPS-Daten aktualisieren, muss kein ganzer Satz sein
+    void parseData(const char* data, int length);
 
     // Getter-Methoden
     int getNumSatellites();
@@ -43,9 +138,10 @@ public:
     float getAltitude();
     char* getGPSTime();
     char getMeasurement();
+    const NmeaStats &getStats();
 
     
-    // Methode, um GPS-Daten einzulesen und zu verarbeiten (ohne Thread)
+    // Verarbeitet alles, was noch im Ringpuffer liegt (ohne Thread)
     void readAndProcessGPSData();
 
 };
@@ -0,0 +1,61 @@
+#include "adc_oversampler.h"
+
+uint16_t adc_median(uint16_t *values, int count)
+{
+    for (int i = 1; i < count; i++) {
+        uint16_t value = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > value; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+    if (count % 2) {
+        return values[count / 2];
+    }
+    return static_cast<uint16_t>((values[count / 2 - 1] + values[count / 2] + 1u) / 2);
+}
+
+AdcOversampler::AdcOversampler(AnalogIn &input, int groups, int decimation, int interval)
+    : _input(input),
+      _queue(nullptr),
+      _groups(groups < 1 ? 1 : groups > MAX_GROUPS ? MAX_GROUPS : groups),
+      _decimation(decimation < 1 ? 1 : decimation),
+      _interval(interval),
+      _taken(0),
+      _running(false),
+      _shortened(0)
+{
+}
+
+bool AdcOversampler::start(EventQueue &queue, Callback<void(uint16_t)> done)
+{
+    if (busy()) {
+        return false;
+    }
+    _queue = &queue;
+    _done = done;
+    _taken = 0;
+    _running = true;
+    sampleGroup();
+    return true;
+}
+
+void AdcOversampler::sampleGroup()
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < _decimation; i++) {
+        sum += _input.read_u16();
+    }
+    _means[_taken++] = adc_decimate(sum, _decimation);
+
+    if (_taken < _groups) {
+        if (_queue->call_in(std::chrono::milliseconds(_interval), this, &AdcOversampler::sampleGroup)) {
+            return;
+        }
+        _shortened++;
+    }
+    // done may start the next reading
+    _running = false;
+    _done(adc_median(_means, _taken));
+}
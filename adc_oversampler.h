@@ -0,0 +1,70 @@
+#ifndef APP_ADC_OVERSAMPLER_H_
+#define APP_ADC_OVERSAMPLER_H_
+
+#include <cstdint>
+#include "mbed.h"
+
+/** Mean of count samples whose sum is sum, rounded to nearest */
+inline uint16_t adc_decimate(uint32_t sum, int count)
+{
+    return static_cast<uint16_t>((sum + count / 2) / count);
+}
+
+/**
+ * Median of count values, the rounded mean of the middle two for an even
+ * count. Sorts values in place; meant for the few group means of one
+ * reading, so a plain insertion sort.
+ */
+uint16_t adc_median(uint16_t *values, int count);
+
+/**
+ * Oversampled reading of an analog input in the background.
+ *
+ * A reading takes groups bursts of decimation read_u16() samples each,
+ * interval ms apart. Each burst is averaged into one value, and the
+ * reading is the median of these. The mean takes out the white noise of
+ * the ADC, the median single spikes and short interference that hit only
+ * some of the bursts.
+ *
+ * Every burst is its own event on the queue, so other events run in
+ * between and a burst blocks the queue only for decimation conversions.
+ * AnalogIn takes a mutex, which rules out sampling from a Ticker
+ * interrupt. groups 1 and decimation 1 is a single read_u16().
+ *
+ * start() must come from the queue's thread.
+ */
+class AdcOversampler {
+public:
+    static const int MAX_GROUPS = 15;
+
+    AdcOversampler(AnalogIn &input, int groups, int decimation, int interval);
+
+    /**
+     * Starts a reading, done gets the filtered 16-bit code on the queue.
+     * Returns false if a reading is still running; done is not called
+     * then. If the queue is full before all bursts are taken, done gets
+     * the median of the bursts so far.
+     */
+    bool start(EventQueue &queue, Callback<void(uint16_t)> done);
+
+    bool busy() const { return _running; }
+
+    /** Readings cut short because the queue was full */
+    uint32_t shortened() const { return _shortened; }
+
+private:
+    void sampleGroup();
+
+    AnalogIn &_input;
+    EventQueue *_queue;
+    Callback<void(uint16_t)> _done;
+    int _groups;
+    int _decimation;
+    int _interval;
+    int _taken;
+    bool _running;
+    uint16_t _means[MAX_GROUPS];
+    uint32_t _shortened;
+};
+
+#endif /* APP_ADC_OVERSAMPLER_H_ */
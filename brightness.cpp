@@ -1,5 +1,6 @@
 #include "brightness.h"
 #include "mbed.h"
+#include "sensor_units.h"
 AnalogIn brightness_sensor(A2);
 
 
@@ -11,6 +12,16 @@ float Brightness::read()
     return brightness_val;
 }
 
+int32_t Brightness::readSteps()
+{
+    return adc_percent_steps(brightness_sensor.read_u16());
+}
+
+AnalogIn &Brightness::input()
+{
+    return brightness_sensor;
+}
+
 
 
 
@@ -1,3 +1,6 @@
+#include <cstdint>
+#include "mbed.h"
+
 
 class Brightness
 {
@@ -8,6 +11,8 @@ private:
 public:
     
     float read();
+    int32_t readSteps(); // in 0.1 % ohne Gleitkomma, siehe adc_percent_steps()
+    AnalogIn &input();   // für das Oversampling im Hintergrund (adc_oversampler.h)
 };
 
 
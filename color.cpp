@@ -5,52 +5,92 @@
 // Der IR-Blockfilter reduziert den Einfluss 
 // von Infrarotlicht. Dadurch werden die Messungen genauer und weniger von Umgebungslicht beeinflusst.
 
-// Konstruktor zur Initialisierung der I2C-Referenz und LED-Pin
-ColorSensor::ColorSensor(I2C &i2c_instance) : i2c(i2c_instance), redCount(0), greenCount(0), blueCount(0) {
+// Konstruktor: meldet den Sensor am Bus an
+ColorSensor::ColorSensor(I2CBus &bus)
+    : device(bus, TCS34725_ADDRESS, "TCS34725"), redCount(0), greenCount(0), blueCount(0), ready(false),
+      clear(0), red(0), green(0), blue(0) {
     // Optional: Weitere Initialisierungen
 }
 
 // Schreiben Register
-void ColorSensor::writeRegister(uint8_t reg, uint8_t value) {
+bool ColorSensor::writeRegister(uint8_t reg, uint8_t value) {
     char data[2] = { (char)(TCS34725_COMMAND_BIT | reg), (char)value }; // spezifiziert registeradresse fürl ese/schreib cmd
 
     // COMMAND Bit 0x80 im Register von COMMAND muss 7 Bit auf 1 sein --> signalisiert befehl
-    i2c.write(TCS34725_ADDRESS, data, 2); // Daten ins Register schreiben
+    return device.write(data, 2) == 0; // Daten ins Register schreiben
 }
 
-// Funktion zum Lesen eines 16-Bit-Werts von einem bestimmten Register
-uint16_t ColorSensor::read16(uint8_t reg) {
-    char cmd = TCS34725_COMMAND_BIT | reg;
-    char data[2];
-    i2c.write(TCS34725_ADDRESS, &cmd, 1); // Leseanfrage senden
-    i2c.read(TCS34725_ADDRESS, data, 2); // Daten lesen
-    return (data[1] << 8) | data[0]; // Bytes zusammenführen
+// Mehrere Register ab reg am Stück lesen (Auto-Increment)
+bool ColorSensor::readRegisters(uint8_t reg, char *data, int len) {
+    char cmd = TCS34725_COMMAND_BIT | TCS34725_COMMAND_AUTO_INC | reg;
+    return device.writeRead(&cmd, 1, data, len) == 0; // Leseanfrage senden, repeated start, Daten lesen
 }
 
 // Funktion zum Initialisieren des TCS34725-Sensors
-void ColorSensor::init() {
-    writeRegister(TCS34725_ENABLE, TCS34725_ENABLE_PON); // PON power On --> 0
-    ThisThread::sleep_for(3ms);
-    writeRegister(TCS34725_ENABLE, TCS34725_ENABLE_PON | TCS34725_ENABLE_AEN); // ADC aktivieren
-    writeRegister(TCS34725_ATIME, 0xC0); // Max Integrationszeit  // 0xF6 helles licht, 0x00 für schwaches Licht, 0xC0 normale Bedingungen
-    // dunkle Umgebungen --> lange Integrationszeit (0x00), helle Umgebungen genügt eine kurze Zeit (0xF6)
-    writeRegister(TCS34725_CONTROL, 0x01); // Gain auf 4x
-}
-
-// Funktion zum Lesen der Farbdaten
-void ColorSensor::readColorData(uint16_t &clear, uint16_t &red, uint16_t &green, uint16_t &blue) {
-    clear = read16(TCS34725_CDATAL); // without ir filter
-    red = read16(TCS34725_RDATAL);
-    green = read16(TCS34725_GDATAL);
-    blue = read16(TCS34725_BDATAL);
-    clear = clear;
-    red = red;
-    green = green;
-    blue = blue;
-}
+bool ColorSensor::init() {
+    if (ready) {
+        return true; // Integration nicht neu starten
+    }
 
+    char id;
+    if (!readRegisters(TCS34725_ID, &id, 1) || (id != 0x44 && id != 0x4D)) {
+        return false; // kein TCS34725/TCS34727 am Bus
+    }
 
+    // Erst konfigurieren, dann einschalten: AEN startet die erste Integration
+    ready = writeRegister(TCS34725_ATIME, 0xC0) // Max Integrationszeit  // 0xF6 helles licht, 0x00 für schwaches Licht, 0xC0 normale Bedingungen
+        // dunkle Umgebungen --> lange Integrationszeit (0x00), helle Umgebungen genügt eine kurze Zeit (0xF6)
+        && writeRegister(TCS34725_CONTROL, 0x01) // Gain auf 4x
+        && writeRegister(TCS34725_ENABLE, TCS34725_ENABLE_PON); // PON power On --> 0
+    if (!ready) {
+        return false;
+    }
+    ThisThread::sleep_for(3ms); // 2.4 ms Aufwärmzeit nach PON
+    ready = writeRegister(TCS34725_ENABLE, TCS34725_ENABLE_PON | TCS34725_ENABLE_AEN); // ADC aktivieren
+    return ready;
+}
 
+// Funktion zum Lesen der Farbdaten
+bool ColorSensor::readColorData(uint16_t &clear, uint16_t &red, uint16_t &green, uint16_t &blue) {
+    // STATUS und CDATAL..BDATAH liegen hintereinander: 9 Bytes in einer Transaktion,
+    // so stammen alle Kanäle aus derselben Integration
+    char data[9];
+    bool valid = ready && readRegisters(TCS34725_STATUS, data, sizeof(data))
+                 && (data[0] & TCS34725_STATUS_AVALID);
 
+    if (valid) {
+        this->clear = (data[2] << 8) | data[1]; // without ir filter
+        this->red = (data[4] << 8) | data[3];
+        this->green = (data[6] << 8) | data[5];
+        this->blue = (data[8] << 8) | data[7];
+    }
+    clear = this->clear;
+    red = this->red;
+    green = this->green;
+    blue = this->blue;
+    return valid;
+}
 
+// Gleiche Transaktion wie readColorData(), nur über die Queue des Busses
+bool ColorSensor::startRead(Callback<void(bool)> done) {
+    if (!ready) {
+        return false;
+    }
+    readCommand = TCS34725_COMMAND_BIT | TCS34725_COMMAND_AUTO_INC | TCS34725_STATUS;
+    readDone = done;
+    return device.submit(&readCommand, 1, readBuffer, sizeof(readBuffer),
+                         callback(this, &ColorSensor::colorDataRead));
+}
 
+void ColorSensor::colorDataRead(int result) {
+    bool valid = result == 0 && (readBuffer[0] & TCS34725_STATUS_AVALID);
+    if (valid) {
+        clear = (readBuffer[2] << 8) | readBuffer[1];
+        red = (readBuffer[4] << 8) | readBuffer[3];
+        green = (readBuffer[6] << 8) | readBuffer[5];
+        blue = (readBuffer[8] << 8) | readBuffer[7];
+    }
+    if (readDone) {
+        readDone(valid);
+    }
+}
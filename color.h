@@ -1,15 +1,20 @@
 #include "mbed.h"
+#include "i2c_bus.h"
 
 // TCS34725 Address
 #define TCS34725_ADDRESS 0x29 << 1 // Shifted left for 8-bit format (0x29 becomes 0x52)
 
 // TCS34725 Registers
 #define TCS34725_COMMAND_BIT 0x80 // Command bit for the sensor's registers
+#define TCS34725_COMMAND_AUTO_INC 0x20 // Auto-increment protocol (type bits 01)
 #define TCS34725_ENABLE 0x00       // Enable register address
 #define TCS34725_ENABLE_PON 0x01   // Power ON command
 #define TCS34725_ENABLE_AEN 0x02   // Enable the ADC
 #define TCS34725_ATIME 0x01        // Integration time register address
 #define TCS34725_CONTROL 0x0F      // Control register address
+#define TCS34725_ID 0x12            // Device ID register address
+#define TCS34725_STATUS 0x13        // Status register address
+#define TCS34725_STATUS_AVALID 0x01 // RGBC integration cycle completed
 #define TCS34725_CDATAL 0x14       // Clear data register address
 #define TCS34725_RDATAL 0x16       // Red data register address
 #define TCS34725_GDATAL 0x18       // Green data register address
@@ -17,19 +22,40 @@
 
 class ColorSensor {
 private:
-    I2C &i2c; // Referenz auf die gemeinsame I2C-Instanz
+    I2CDevice device; // am gemeinsamen Bus
     int redCount, greenCount, blueCount; // Color counters for last hour
 
-    void writeRegister(uint8_t reg, uint8_t value);
-    uint16_t read16(uint8_t reg);
+    bool ready; // einmal eingeschaltet und konfiguriert
 
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t reg, char *data, int len);
+
+    // Asynchrones Lesen: Puffer leben bis zum Callback
+    char readCommand;
+    char readBuffer[9];
+    Callback<void(bool)> readDone;
+    void colorDataRead(int result);
     
     uint16_t clear, red, green, blue;
     
 public:
-    ColorSensor(I2C &i2c_instance); // Konstruktor mit I2C-Referenz
-    void init();
-    void readColorData(uint16_t &clear, uint16_t &red, uint16_t &green, uint16_t &blue);
+    ColorSensor(I2CBus &bus); // Konstruktor mit dem gemeinsamen Bus
+
+    // Einmalig beim Start: einschalten und konfigurieren, danach läuft die
+    // Integration durch. Weitere Aufrufe tun nichts, solange der Sensor bereit ist.
+    bool init();
+    bool isReady(){return ready;}
+
+    // Liest alle vier Kanäle in einer Transaktion. false, wenn noch keine
+    // Integration fertig ist (AVALID) oder der Sensor nicht antwortet; dann
+    // bleiben die alten Werte stehen.
+    bool readColorData(uint16_t &clear, uint16_t &red, uint16_t &green, uint16_t &blue);
+
+    // Wie oben, aber als Transaktion in der Queue des Busses: done(valid) kommt
+    // aus der Bus-Queue, die Werte dann über die Getter. false, wenn der Sensor
+    // nicht bereit ist oder die Bus-Queue voll; done wird dann nicht aufgerufen.
+    bool startRead(Callback<void(bool)> done);
+    int getClear(){return clear;}
     int getRed(){return red;}
     int getGreen(){return green;}
     int getBlue(){return blue;}
@@ -0,0 +1,75 @@
+#include "deferred_log.h"
+#include "mpsc_ring.h"
+
+namespace {
+
+MpscRing<MBED_CONF_APP_DEFERRED_LOG_SIZE> ring;
+mbed::Callback<void()> wakeup;
+uint32_t reported_dropped;  // consumer side
+
+char *put_hex(char *out, uint32_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    int shift = 28;
+    while (shift > 0 && !(value >> shift)) {
+        shift -= 4;
+    }
+    for (; shift >= 0; shift -= 4) {
+        *out++ = digits[(value >> shift) & 0xf];
+    }
+    return out;
+}
+
+} // namespace
+
+bool deferred_log_write(const uint32_t *record, uint32_t words)
+{
+    if (!ring.write(record, words)) {
+        return false;
+    }
+    if (wakeup) {
+        wakeup();
+    }
+    return true;
+}
+
+void deferred_log_attach(mbed::Callback<void()> callback)
+{
+    wakeup = callback;
+}
+
+int deferred_log_next(uint32_t *record)
+{
+    const uint32_t dropped = ring.dropped();
+    if (dropped != reported_dropped) {
+        record[0] = LOG_DROPPED;
+        record[1] = dropped - reported_dropped;
+        reported_dropped = dropped;
+        return 2;
+    }
+    return ring.read(record, LOG_RECORD_MAX_WORDS);
+}
+
+uint32_t deferred_log_dropped()
+{
+    return ring.dropped();
+}
+
+size_t deferred_log_line(const uint32_t *record, uint32_t words, char *line, size_t size)
+{
+    // Marker, up to 8 digits and a separator per word, newline and zero
+    if (size < 3 + 9 * static_cast<size_t>(words)) {
+        return 0;
+    }
+    char *out = line;
+    *out++ = LOG_LINE_MARKER;
+    for (uint32_t i = 0; i < words; i++) {
+        if (i > 0) {
+            *out++ = ' ';
+        }
+        out = put_hex(out, record[i]);
+    }
+    *out++ = '\n';
+    *out = '\0';
+    return static_cast<size_t>(out - line);
+}
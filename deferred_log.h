@@ -0,0 +1,166 @@
+#ifndef APP_DEFERRED_LOG_H_
+#define APP_DEFERRED_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "mbed.h"
+
+/**
+ * Messages of the acquisition path. The device only stores the id and
+ * the raw arguments; the format strings are compiled into the host
+ * decoder (host/log_format.cpp), which also does all of the formatting.
+ *
+ * Arguments are integers of up to 32 bit and strings of up to
+ * LOG_STRING_MAX characters, which are copied. A %.Nf conversion takes
+ * an integer in steps of 10^-N, e.g. %.6f the position in 1e-6 degrees.
+ * Ids are part of the serial format: append new messages at the end.
+ */
+#define LOG_FORMATS(X)                                                                                       \
+    X(LOG_DROPPED, "Log: %lu messages lost to a full ring")                                                  \
+    X(LOG_SENSOR_HEADER, "\n--- Sensor Data ---")                                                            \
+    X(LOG_GPS, "GPS: Satellites: %d, Latitude: %.6f, Longitude: %.6f, Age: %lu ms%s")                        \
+    X(LOG_GPS_POWER, "GPS power: TTFF %lu ms (avg %lu), on %lu ms, lead %lu ms, timeouts %lu")               \
+    X(LOG_CLIMATE, "Temperature: %.1f °C, Humidity: %.1f %%")                                                \
+    X(LOG_LIGHT, "Brightness: %.1f")                                                                         \
+    X(LOG_SOIL, "Soil Moisture: %.1f")                                                                       \
+    X(LOG_COLOR, "Color: Clear: %d, Red: %d, Green: %d, Blue: %d")                                           \
+    X(LOG_ACCEL, "Accelerometer: X: %.2f, Y: %.2f, Z: %.2f")                                                 \
+    X(LOG_ACCEL_FLAGS, "Accelerometer events since last uplink: 0x%02x")                                     \
+    X(LOG_ACCEL_EVENT, "Accelerometer %s at %lu ms (0x%02x)")                                                \
+    X(LOG_I2C, "I2C %s: %lu transactions, %lu NACKs, latency avg %lu us, max %lu us")                        \
+    X(LOG_LATENCY, "Latency %s: %lu, min %lu us, avg %lu us, p50 %lu us, p99 %lu us, max %lu us")
+
+#define LOG_FORMAT_ID(id, format) id,
+enum LogFormat {
+    LOG_FORMATS(LOG_FORMAT_ID)
+    LOG_FORMAT_COUNT
+};
+#undef LOG_FORMAT_ID
+
+/** Longer strings are cut */
+const uint32_t LOG_STRING_MAX = 16;
+
+/** Longest record in words: the id and 15 argument words */
+const uint32_t LOG_RECORD_MAX_WORDS = 16;
+
+/** First character of a record line on the serial port */
+const char LOG_LINE_MARKER = '~';
+
+namespace deferred_log_detail {
+
+template <typename T>
+struct Words {
+    static const uint32_t max = 1;
+};
+
+template <>
+struct Words<const char *> {
+    static const uint32_t max = 1 + (LOG_STRING_MAX + 3) / 4;
+};
+
+template <>
+struct Words<char *> : Words<const char *> {
+};
+
+template <typename... Args>
+struct MaxWords;
+
+template <>
+struct MaxWords<> {
+    static const uint32_t value = 0;
+};
+
+template <typename T, typename... Rest>
+struct MaxWords<T, Rest...> {
+    static const uint32_t value = Words<T>::max + MaxWords<Rest...>::value;
+};
+
+/** Length word, then the characters four to a word, first in the low byte */
+inline void put(uint32_t *&out, const char *text)
+{
+    uint32_t length = 0;
+    while (length < LOG_STRING_MAX && text[length]) {
+        length++;
+    }
+    *out++ = length;
+    for (uint32_t i = 0; i < length; i += 4) {
+        uint32_t word = 0;
+        for (uint32_t n = 0; n < 4 && i + n < length; n++) {
+            word |= static_cast<uint32_t>(static_cast<uint8_t>(text[i + n])) << (8 * n);
+        }
+        *out++ = word;
+    }
+}
+
+inline void put(uint32_t *&out, char *text)
+{
+    put(out, static_cast<const char *>(text));
+}
+
+template <typename T>
+inline void put(uint32_t *&out, T value)
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "only integers and strings can be logged");
+    static_assert(sizeof(T) <= 4, "64 bit arguments are not supported");
+    *out++ = static_cast<uint32_t>(value);
+}
+
+inline void put_all(uint32_t *&)
+{
+}
+
+template <typename T, typename... Rest>
+inline void put_all(uint32_t *&out, T first, Rest... rest)
+{
+    put(out, first);
+    put_all(out, rest...);
+}
+
+} // namespace deferred_log_detail
+
+/** Queues a record, false if the ring is full (then it is counted as dropped) */
+bool deferred_log_write(const uint32_t *record, uint32_t words);
+
+/**
+ * Queues format with its arguments, from any thread or interrupt
+ * handler. Does not block and does not format anything.
+ */
+template <typename... Args>
+bool deferred_log(LogFormat format, Args... args)
+{
+    static_assert(1 + deferred_log_detail::MaxWords<Args...>::value <= LOG_RECORD_MAX_WORDS,
+                  "too many arguments for one record");
+    uint32_t record[1 + deferred_log_detail::MaxWords<Args...>::value];
+    uint32_t *out = record;
+    *out++ = format;
+    deferred_log_detail::put_all(out, args...);
+    return deferred_log_write(record, static_cast<uint32_t>(out - record));
+}
+
+/**
+ * Called after every queued record, e.g. to set a flag of the draining
+ * thread. Runs in the context of the writer, which may be an interrupt.
+ */
+void deferred_log_attach(mbed::Callback<void()> wakeup);
+
+/**
+ * Consumer side, one thread only: the next record into record (at least
+ * LOG_RECORD_MAX_WORDS), its length in words or -1 if there is none. A
+ * LOG_DROPPED record comes first whenever records were lost since the
+ * last call.
+ */
+int deferred_log_next(uint32_t *record);
+
+/** Records lost to a full ring since the start */
+uint32_t deferred_log_dropped();
+
+/**
+ * Serial form of a record: LOG_LINE_MARKER, then the words in hex
+ * separated by spaces and a newline. Returns the length without the
+ * terminating zero, 0 if size is too small.
+ */
+size_t deferred_log_line(const uint32_t *record, uint32_t words, char *line, size_t size);
+
+#endif /* APP_DEFERRED_LOG_H_ */
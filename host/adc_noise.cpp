@@ -0,0 +1,247 @@
+/*
+ * Noise rejection of the oversampled ADC readings (adc_oversampler.h).
+ *
+ * Feeds synthetic signals into a mock analog pin and takes readings at
+ * random points in virtual time, once as a single read_u16() as the
+ * drivers used to and once through AdcOversampler with the configuration
+ * from mbed_app.json. The signals are a constant level with white noise,
+ * with rare large spikes on single samples, with 50 Hz pickup, and with
+ * all of that together. It prints the RMS and worst error in payload
+ * steps (0.1 %) against the noise-free level. --groups, --decimation and
+ * --interval-ms try other configurations.
+ *
+ * --self-test also checks adc_median() and adc_decimate() against a
+ * sorted copy and exact rounding, that groups 1 and decimation 1 is a
+ * single sample, and fails if the oversampled readings are not clearly
+ * better than single samples on every signal.
+ *
+ *   adc-noise [--self-test] [--readings N] [--seed S] [--groups N] [--decimation N]
+ *             [--interval-ms MS]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "mbed.h"
+#include "mock_hal.h"
+#include "adc_oversampler.h"
+#include "sensor_units.h"
+
+namespace {
+
+const PinName PIN = A1;
+const double PI = 3.14159265358979323846;
+
+/** Noise-free level and what is added on top of it */
+struct Signal {
+    const char *name;
+    double noise;       // standard deviation in codes
+    double spikeRate;   // share of samples hit by a spike
+    double mains;       // amplitude of the 50 Hz pickup in codes
+};
+
+const Signal SIGNALS[] = {
+    { "white noise", 400, 0, 0 },
+    { "spikes", 100, 0.01, 0 },
+    { "50 Hz pickup", 100, 0, 1500 },
+    { "all of it", 400, 0.01, 1500 },
+};
+
+double gaussian()
+{
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return std::sqrt(-2 * std::log(u)) * std::cos(2 * PI * v);
+}
+
+uint16_t sample(const Signal &signal, double level)
+{
+    double value = level + signal.noise * gaussian()
+                   + signal.mains * std::sin(2 * PI * 50 * host::now_us() / 1e6);
+    if (rand() < signal.spikeRate * RAND_MAX) {
+        value += rand() % 2 ? 30000 : -30000;
+    }
+    return static_cast<uint16_t>(value < 0 ? 0 : value > 65535 ? 65535 : value);
+}
+
+struct Errors {
+    double squares;
+    int32_t worst;
+    int readings;
+
+    void add(int32_t error)
+    {
+        error = error < 0 ? -error : error;
+        squares += static_cast<double>(error) * error;
+        worst = error > worst ? error : worst;
+        readings++;
+    }
+
+    double rms() const { return readings ? std::sqrt(squares / readings) : 0; }
+};
+
+/** Errors of single samples and of oversampled readings of signal */
+void measure(const Signal &signal, int readings, int groups, int decimation, int interval,
+             Errors &single, Errors &oversampled)
+{
+    double level = 0;
+    host::set_adc(PIN, [&] { return sample(signal, level); });
+    AnalogIn input(PIN);
+    AdcOversampler sampler(input, groups, decimation, interval);
+    EventQueue queue;
+
+    for (int i = 0; i < readings; i++) {
+        level = 5000 + rand() % 55000;
+        const int32_t expected = adc_percent_steps(static_cast<uint16_t>(level));
+        queue.dispatch_for(std::chrono::milliseconds(1 + rand() % 1000));
+
+        single.add(adc_percent_steps(input.read_u16()) - expected);
+
+        bool done = false;
+        uint16_t code = 0;
+        sampler.start(queue, [&](uint16_t result) {
+            code = result;
+            done = true;
+        });
+        for (int ms = 0; !done && ms < 1000; ms++) {
+            queue.dispatch_for(std::chrono::milliseconds(1));
+        }
+        if (done) {
+            oversampled.add(adc_percent_steps(code) - expected);
+        } else {
+            oversampled.add(INT32_MAX / 2);
+        }
+    }
+}
+
+int failures;
+
+void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    failures++;
+}
+
+void check_filters()
+{
+    uint16_t values[AdcOversampler::MAX_GROUPS];
+    uint16_t sorted[AdcOversampler::MAX_GROUPS];
+    for (int round = 0; round < 100000; round++) {
+        const int count = 1 + rand() % AdcOversampler::MAX_GROUPS;
+        for (int i = 0; i < count; i++) {
+            values[i] = static_cast<uint16_t>(rand() % 4 ? rand() % 65536 : (i ? values[i - 1] : 0));
+            sorted[i] = values[i];
+        }
+        std::sort(sorted, sorted + count);
+        uint32_t middle = count % 2 ? sorted[count / 2]
+                          : (sorted[count / 2 - 1] + sorted[count / 2] + 1u) / 2;
+        if (adc_median(values, count) != middle) {
+            fail("adc_median() differs from a sorted copy");
+            return;
+        }
+    }
+    for (int round = 0; round < 100000; round++) {
+        const int count = 1 + rand() % 256;
+        uint32_t sum = 0;
+        for (int i = 0; i < count; i++) {
+            sum += rand() % 65536;
+        }
+        if (adc_decimate(sum, count) != static_cast<uint16_t>(std::floor(sum / double(count) + 0.5))) {
+            fail("adc_decimate() is not rounded to nearest");
+            return;
+        }
+    }
+
+    // groups 1, decimation 1 is exactly one sample
+    uint16_t next = 1234;
+    host::set_adc(PIN, [&] { return next++; });
+    AnalogIn input(PIN);
+    AdcOversampler single(input, 1, 1, 7);
+    EventQueue queue;
+    int calls = 0;
+    uint16_t code = 0;
+    single.start(queue, [&](uint16_t result) {
+        code = result;
+        calls++;
+    });
+    queue.dispatch_for(std::chrono::milliseconds(10));
+    if (calls != 1 || code != 1234 || next != 1235) {
+        fail("groups 1 and decimation 1 is not a single read_u16()");
+    }
+
+    // A second start() while a reading runs is refused
+    AdcOversampler sampler(input, 3, 2, 7);
+    calls = 0;
+    bool first = sampler.start(queue, [&](uint16_t result) { calls++; });
+    bool second = sampler.start(queue, [&](uint16_t result) { calls++; });
+    queue.dispatch_for(std::chrono::milliseconds(50));
+    if (!first || second || calls != 1 || sampler.busy()) {
+        fail("start() while busy");
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    int readings = 500;
+    unsigned seed = 1;
+    int groups = MBED_CONF_APP_ADC_GROUPS;
+    int decimation = MBED_CONF_APP_ADC_DECIMATION;
+    int interval = MBED_CONF_APP_ADC_GROUP_INTERVAL_MS;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--self-test")) {
+            test = true;
+        } else if (!strcmp(argv[i], "--readings") && i + 1 < argc) {
+            readings = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--groups") && i + 1 < argc) {
+            groups = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--decimation") && i + 1 < argc) {
+            decimation = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--interval-ms") && i + 1 < argc) {
+            interval = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--self-test] [--readings N] [--seed S] [--groups N] [--decimation N] "
+                    "[--interval-ms MS]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    if (test) {
+        check_filters();
+    }
+
+    printf("%d groups of %d samples, %d ms apart; error in 0.1 %% steps over %d readings\n",
+           groups, decimation, interval, readings);
+    printf("%-14s %12s %12s %12s %12s\n", "signal", "single rms", "single max", "filtered rms", "filtered max");
+    for (const Signal &signal : SIGNALS) {
+        Errors single = {};
+        Errors oversampled = {};
+        measure(signal, readings, groups, decimation, interval, single, oversampled);
+        printf("%-14s %12.2f %12ld %12.2f %12ld\n", signal.name, single.rms(), static_cast<long>(single.worst),
+               oversampled.rms(), static_cast<long>(oversampled.worst));
+
+        // With a sensible configuration the filtered error is a fraction of the single one
+        if (test && !(oversampled.rms() * 2 < single.rms() && oversampled.worst * 2 < single.worst)) {
+            printf("FAIL: %s: oversampling does not halve the error\n", signal.name);
+            failures++;
+        }
+    }
+
+    if (test) {
+        if (failures) {
+            printf("%d failures\n", failures);
+            return 1;
+        }
+        printf("ok\n");
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <cstring>
+
+#include "blockdevice/HeapBlockDevice.h"
+
+namespace mbed {
+
+HeapBlockDevice::HeapBlockDevice(bd_size_t size, bd_size_t read, bd_size_t program, bd_size_t erase)
+    : _data(size, 0xff),
+      _eraseCounts(size / erase, 0),
+      _readSize(read),
+      _programSize(program),
+      _eraseSize(erase),
+      _initialized(false),
+      _stats()
+{
+}
+
+int HeapBlockDevice::init()
+{
+    _initialized = true;
+    return BD_ERROR_OK;
+}
+
+int HeapBlockDevice::deinit()
+{
+    _initialized = false;
+    return BD_ERROR_OK;
+}
+
+int HeapBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!_initialized || !is_valid_read(addr, size)) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    memcpy(buffer, &_data[addr], size);
+    _stats.reads++;
+    _stats.readBytes += size;
+    return BD_ERROR_OK;
+}
+
+int HeapBlockDevice::program(const void *buffer, bd_addr_t addr, bd_size_t size)
+{
+    if (!_initialized || !is_valid_program(addr, size)) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(buffer);
+    for (bd_size_t i = 0; i < size; i++) {
+        _data[addr + i] &= bytes[i];
+    }
+    _stats.programs++;
+    _stats.programBytes += size;
+    return BD_ERROR_OK;
+}
+
+int HeapBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+    if (!_initialized || !is_valid_erase(addr, size)) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    memset(&_data[addr], 0xff, size);
+    for (bd_addr_t unit = addr / _eraseSize; unit < (addr + size) / _eraseSize; unit++) {
+        _eraseCounts[unit]++;
+        _stats.erases++;
+    }
+    return BD_ERROR_OK;
+}
+
+} // namespace mbed
@@ -0,0 +1,68 @@
+#ifndef APP_HOST_HEAP_BLOCK_DEVICE_H_
+#define APP_HOST_HEAP_BLOCK_DEVICE_H_
+
+#include <vector>
+
+#include "blockdevice/BlockDevice.h"
+
+namespace mbed {
+
+/**
+ * Host stand-in for HeapBlockDevice that behaves like NOR flash, which
+ * makes it stricter than the Mbed one: erase sets the bytes to 0xff and
+ * program can only clear bits. The contents survive deinit() and init(),
+ * like flash across a reset.
+ *
+ * On top of the Mbed interface it counts the operations and the erases
+ * per erase unit, for benchmarks and wear statistics.
+ */
+class HeapBlockDevice : public BlockDevice {
+public:
+    struct Stats {
+        uint64_t reads;
+        uint64_t readBytes;
+        uint64_t programs;
+        uint64_t programBytes;
+        uint64_t erases;     // erase units
+    };
+
+    HeapBlockDevice(bd_size_t size, bd_size_t read, bd_size_t program, bd_size_t erase);
+
+    int init() override;
+    int deinit() override;
+    int read(void *buffer, bd_addr_t addr, bd_size_t size) override;
+    int program(const void *buffer, bd_addr_t addr, bd_size_t size) override;
+    int erase(bd_addr_t addr, bd_size_t size) override;
+
+    bd_size_t get_read_size() const override { return _readSize; }
+    bd_size_t get_program_size() const override { return _programSize; }
+    bd_size_t get_erase_size() const override { return _eraseSize; }
+    bd_size_t get_erase_size(bd_addr_t addr) const override { return _eraseSize; }
+    int get_erase_value() const override { return 0xff; }
+    bd_size_t size() const override { return _data.size(); }
+    const char *get_type() const override { return "HEAP"; }
+
+    const Stats &stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    /** Erase count of each erase unit since construction */
+    const std::vector<uint32_t> &eraseCounts() const { return _eraseCounts; }
+
+    /** The raw contents, for fault injection */
+    uint8_t *data() { return _data.data(); }
+
+private:
+    std::vector<uint8_t> _data;
+    std::vector<uint32_t> _eraseCounts;
+    bd_size_t _readSize;
+    bd_size_t _programSize;
+    bd_size_t _eraseSize;
+    bool _initialized;
+    Stats _stats;
+};
+
+} // namespace mbed
+
+using mbed::HeapBlockDevice;
+
+#endif /* APP_HOST_HEAP_BLOCK_DEVICE_H_ */
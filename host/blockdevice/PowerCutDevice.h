@@ -0,0 +1,88 @@
+#ifndef APP_HOST_POWER_CUT_DEVICE_H_
+#define APP_HOST_POWER_CUT_DEVICE_H_
+
+#include <cstdlib>
+
+#include "blockdevice/HeapBlockDevice.h"
+
+/**
+ * Forwards to a HeapBlockDevice until the power is cut after a number of
+ * program and erase calls. The call that is cut is done partially, every
+ * later call fails until powerOn().
+ */
+class PowerCutDevice : public BlockDevice {
+public:
+    explicit PowerCutDevice(HeapBlockDevice &flash) : _flash(flash), _budget(-1), _off(false) {}
+
+    /** Cuts the power during the operation after the next operations ones, -1 never */
+    void cutAfter(long operations)
+    {
+        _budget = operations;
+    }
+    void powerOn()
+    {
+        _off = false;
+        _budget = -1;
+    }
+    bool off() const { return _off; }
+
+    int init() override { return _off ? BD_ERROR_DEVICE_ERROR : _flash.init(); }
+    int deinit() override { return _flash.deinit(); }
+    int read(void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        return _off ? BD_ERROR_DEVICE_ERROR : _flash.read(buffer, addr, size);
+    }
+
+    int program(const void *buffer, bd_addr_t addr, bd_size_t size) override
+    {
+        if (!cut()) {
+            return _off ? BD_ERROR_DEVICE_ERROR : _flash.program(buffer, addr, size);
+        }
+        bd_size_t done = rand() % (size + 1);
+        for (bd_size_t i = 0; i < done; i++) {
+            _flash.data()[addr + i] &= static_cast<const uint8_t *>(buffer)[i];
+        }
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    int erase(bd_addr_t addr, bd_size_t size) override
+    {
+        if (!cut()) {
+            return _off ? BD_ERROR_DEVICE_ERROR : _flash.erase(addr, size);
+        }
+        // The units before the cut are erased, the one it hit holds garbage
+        bd_size_t unit = _flash.get_erase_size();
+        bd_size_t units = rand() % (size / unit);
+        if (units) {
+            _flash.erase(addr, units * unit);
+        }
+        for (bd_size_t i = 0; i < unit; i++) {
+            _flash.data()[addr + units * unit + i] = static_cast<uint8_t>(rand());
+        }
+        return BD_ERROR_DEVICE_ERROR;
+    }
+
+    bd_size_t get_read_size() const override { return _flash.get_read_size(); }
+    bd_size_t get_program_size() const override { return _flash.get_program_size(); }
+    bd_size_t get_erase_size() const override { return _flash.get_erase_size(); }
+    bd_size_t get_erase_size(bd_addr_t addr) const override { return _flash.get_erase_size(addr); }
+    int get_erase_value() const override { return _flash.get_erase_value(); }
+    bd_size_t size() const override { return _flash.size(); }
+    const char *get_type() const override { return "POWERCUT"; }
+
+private:
+    bool cut()
+    {
+        if (_off || _budget < 0 || _budget-- > 0) {
+            return false;
+        }
+        _off = true;
+        return true;
+    }
+
+    HeapBlockDevice &_flash;
+    long _budget;
+    bool _off;
+};
+
+#endif /* APP_HOST_POWER_CUT_DEVICE_H_ */
@@ -0,0 +1,100 @@
+#include <algorithm>
+
+#include "mbed.h"
+#include "events/EventQueue.h"
+
+namespace events {
+
+EventQueue::EventQueue(unsigned size, unsigned char *buffer)
+    : _capacity(size / EVENTS_EVENT_SIZE), _next_id(1), _break(false), _longest_us(0)
+{
+}
+
+int EventQueue::post(int delay_ms, int period_ms, std::function<void()> func)
+{
+    if (_events.size() >= _capacity) {
+        return 0;
+    }
+
+    Event event = { _next_id++, host::now_us() + delay_ms * 1000ULL, period_ms, func };
+    // Keep the list ordered by due time, FIFO among equal times
+    auto it = _events.begin();
+    while (it != _events.end() && it->due_us <= event.due_us) {
+        ++it;
+    }
+    _events.insert(it, event);
+    return event.id;
+}
+
+bool EventQueue::cancel(int id)
+{
+    for (auto it = _events.begin(); it != _events.end(); ++it) {
+        if (it->id == id) {
+            _events.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void EventQueue::dispatch_for(duration ms)
+{
+    const uint64_t deadline = host::now_us() + ms.count() * 1000ULL;
+    _break = false;
+
+    while (!_break) {
+        if (_events.empty() || _events.front().due_us > host::now_us()) {
+            if (host::now_us() >= deadline) {
+                break;
+            }
+            // Stop at the next interrupt, its handler may post an event
+            uint64_t next = std::min(deadline, host::next_irq_us());
+            if (!_events.empty() && _events.front().due_us < next) {
+                next = _events.front().due_us;
+            }
+            host::advance_us(next > host::now_us() ? next - host::now_us() : 0);
+            continue;
+        }
+
+        Event event = _events.front();
+        _events.pop_front();
+        if (event.period_ms >= 0) {
+            Event next = event;
+            next.due_us += event.period_ms * 1000ULL;
+            auto it = _events.begin();
+            while (it != _events.end() && it->due_us <= next.due_us) {
+                ++it;
+            }
+            _events.insert(it, next);
+        }
+        const uint64_t start = host::now_us();
+        event.func();
+        if (host::now_us() - start > _longest_us) {
+            _longest_us = host::now_us() - start;
+        }
+    }
+}
+
+void EventQueue::dispatch_once()
+{
+    dispatch_for(duration(0));
+}
+
+void EventQueue::break_dispatch()
+{
+    _break = true;
+}
+
+unsigned EventQueue::pending() const
+{
+    return _events.size();
+}
+
+uint64_t EventQueue::longest_event_us()
+{
+    uint64_t longest = _longest_us;
+    _longest_us = 0;
+    return longest;
+}
+
+} // namespace events
@@ -0,0 +1,96 @@
+#ifndef APP_HOST_EVENTQUEUE_H_
+#define APP_HOST_EVENTQUEUE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+
+/** Bytes per event, only used to derive the queue capacity */
+#define EVENTS_EVENT_SIZE 64
+
+namespace events {
+
+/**
+ * Single threaded stand-in for events::EventQueue running on the host's
+ * virtual clock. Like the real queue it is bounded: posting to a full
+ * queue fails and returns 0.
+ */
+class EventQueue {
+public:
+    using duration = std::chrono::duration<int, std::milli>;
+
+    EventQueue(unsigned size = 32 * EVENTS_EVENT_SIZE, unsigned char *buffer = nullptr);
+
+    template <typename F, typename... ArgTs>
+    int call(F f, ArgTs... args)
+    {
+        return post(0, -1, std::bind(f, args...));
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call(T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post(0, -1, std::bind(method, obj, args...));
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_in(duration ms, F f, ArgTs... args)
+    {
+        return post(ms.count(), -1, std::bind(f, args...));
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call_in(duration ms, T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post(ms.count(), -1, std::bind(method, obj, args...));
+    }
+
+    template <typename F, typename... ArgTs>
+    int call_every(duration ms, F f, ArgTs... args)
+    {
+        return post(ms.count(), ms.count(), std::bind(f, args...));
+    }
+
+    template <typename T, typename R, typename... BoundTs, typename... ArgTs>
+    int call_every(duration ms, T *obj, R(T::*method)(BoundTs...), ArgTs... args)
+    {
+        return post(ms.count(), ms.count(), std::bind(method, obj, args...));
+    }
+
+    bool cancel(int id);
+
+    /** Runs due events for ms of virtual time, then returns */
+    void dispatch_for(duration ms);
+
+    /** Runs the events that are due right now */
+    void dispatch_once();
+
+    void break_dispatch();
+
+    /** Number of queued events, for the profiler */
+    unsigned pending() const;
+
+    /** Longest virtual time a single event ran since the last call */
+    uint64_t longest_event_us();
+
+private:
+    struct Event {
+        int id;
+        uint64_t due_us;
+        int period_ms;
+        std::function<void()> func;
+    };
+
+    int post(int delay_ms, int period_ms, std::function<void()> func);
+
+    std::list<Event> _events;
+    unsigned _capacity;
+    int _next_id;
+    bool _break;
+    uint64_t _longest_us;
+};
+
+} // namespace events
+
+#endif /* APP_HOST_EVENTQUEUE_H_ */
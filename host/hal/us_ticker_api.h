@@ -0,0 +1,37 @@
+#ifndef APP_HOST_US_TICKER_API_H_
+#define APP_HOST_US_TICKER_API_H_
+
+#include <cstdint>
+
+#include "mbed.h"
+
+/*
+ * Host stand-in for hal/us_ticker_api.h on the virtual clock. Like on the
+ * target, us_ticker_read() gives the raw counter of the HAL timer, whose
+ * width and frequency depend on the target; here it is 16 bits wide, as
+ * on STM32L0. Durations come from ticker_read_us(), which extends the
+ * counter to 64-bit microseconds.
+ */
+
+typedef uint64_t us_timestamp_t;
+
+struct ticker_data_t {
+};
+
+inline const ticker_data_t *get_us_ticker_data()
+{
+    static const ticker_data_t data = {};
+    return &data;
+}
+
+inline us_timestamp_t ticker_read_us(const ticker_data_t *)
+{
+    return host::now_us();
+}
+
+inline uint32_t us_ticker_read()
+{
+    return static_cast<uint32_t>(host::now_us() & 0xffff);
+}
+
+#endif /* APP_HOST_US_TICKER_API_H_ */
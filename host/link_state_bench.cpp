@@ -0,0 +1,457 @@
+/*
+ * Recovery test of the link state store and simulation of the joins of a
+ * fleet after a common reset (link_state.h).
+ *
+ * --self-test checks the round trip and the wear of LinkStateStore on two
+ * flash geometries, cuts the power at random points of random save()
+ * sequences and checks that every remount finds the last saved state or
+ * the one whose save was cut, never an older one, and checks the bounds
+ * of link_join_delay_ms().
+ *
+ * Without it, the tool simulates --nodes nodes in range of one gateway
+ * that are all reset at the same moment, under three join strategies:
+ * the single connect() the application did before, a plain retry a minute
+ * after each JOIN_FAILURE, and the jitter and backoff of link_state.h
+ * with the values of mbed_config.h or the options. The model is the EU868 worst case:
+ *
+ *   - every join request at DR0 (SF12), 23 bytes, on one of the three
+ *     default channels; two that overlap on a channel are both lost
+ *   - connect() sends up to three requests, spaced by the RX windows and
+ *     the join duty cycle (1% in the first hour after the reset, 0.1% up
+ *     to the eleventh hour, 0.01% after), then reports JOIN_FAILURE
+ *   - the gateway answers in RX1 (5 s, 1% sub-band) or RX2 (6 s, 869.525
+ *     MHz at SF12, 10%) if its duty cycle allows, and it cannot receive
+ *     while it transmits
+ *
+ * It reports how many nodes joined after 10 minutes, 1 hour and at the
+ * end, the median and 90th percentile of the time to join (for the first
+ * uplink add its duty cycle wait), and the airtime spent on join requests.
+ *
+ *   link-state-bench [--self-test] [--nodes N] [--hours H] [--jitter S]
+ *                    [--backoff-min S] [--backoff-max S] [--cuts N] [--seed S]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "mbed_config.h"
+#include "blockdevice/HeapBlockDevice.h"
+#include "blockdevice/PowerCutDevice.h"
+#include "link_state.h"
+
+namespace {
+
+const bd_size_t DEVICE_SIZE = 8 * 1024;
+
+struct Geometry {
+    const char *name;
+    bd_size_t program;
+    bd_size_t erase;
+};
+
+const Geometry GEOMETRIES[] = {
+    { "STM32L0 (128 B pages)", 4, 128 },
+    { "K64F (4 KB sectors)", 8, 4096 },
+};
+
+int failures;
+
+void fail(const char *what, long detail = 0)
+{
+    if (failures++ < 10) {
+        printf("FAIL: %s (%ld)\n", what, detail);
+    }
+}
+
+LinkState random_state()
+{
+    LinkState state;
+    state.boots = static_cast<uint32_t>(rand());
+    state.joins = static_cast<uint32_t>(rand());
+    state.failedJoins = static_cast<uint16_t>(rand());
+    state.dataRate = static_cast<uint8_t>(rand() % 8);
+    state.joinMs = static_cast<uint32_t>(rand());
+    state.firstUplinkMs = static_cast<uint32_t>(rand());
+    return state;
+}
+
+bool same_state(const LinkState &a, const LinkState &b)
+{
+    return a.boots == b.boots && a.joins == b.joins && a.failedJoins == b.failedJoins
+           && a.dataRate == b.dataRate && a.joinMs == b.joinMs && a.firstUplinkMs == b.firstUplinkMs;
+}
+
+void check_basics(const Geometry &geometry)
+{
+    HeapBlockDevice flash(DEVICE_SIZE, 1, geometry.program, geometry.erase);
+    LinkStateStore store(flash);
+    LinkState state = random_state();
+    if (store.mount(state) || state.boots != 0 || state.failedJoins != 0) {
+        fail("mount of an empty device");
+        return;
+    }
+
+    // Many saves go round the whole ring, the last one is found after every remount
+    const int saves = 2000;
+    LinkState saved;
+    for (int i = 0; i < saves; i++) {
+        saved = random_state();
+        if (!store.save(saved)) {
+            fail("save", i);
+        }
+        if (i % 97 == 0) {
+            LinkStateStore again(flash);
+            LinkState found;
+            if (again.mount(found) || !same_state(found, saved) || again.stats().corrupt) {
+                fail("state after remount", i);
+            }
+        }
+    }
+    LinkStateStore again(flash);
+    LinkState found;
+    if (again.mount(found) || !same_state(found, saved)) {
+        fail("state after the last save");
+    }
+    // and the next save after the remount goes on from there
+    saved = random_state();
+    again.save(saved);
+    LinkStateStore third(flash);
+    if (third.mount(found) || !same_state(found, saved)) {
+        fail("save after remount");
+    }
+
+    uint32_t least = UINT32_MAX;
+    uint32_t most = 0;
+    for (uint32_t count : flash.eraseCounts()) {
+        least = count < least ? count : least;
+        most = count > most ? count : most;
+    }
+    if (most - least > 1) {
+        fail("erases not spread over the device", most - least);
+    }
+    printf("%s: %d saves, %.3f erases per save and unit\n", geometry.name, saves + 1,
+           static_cast<double>(most) / (saves + 1));
+}
+
+void check_power_cuts(const Geometry &geometry, int cuts)
+{
+    HeapBlockDevice flash(2 * LinkStateStore::MIN_SECTOR_SIZE > geometry.erase * 2
+                          ? 2 * LinkStateStore::MIN_SECTOR_SIZE : geometry.erase * 2,
+                          1, geometry.program, geometry.erase);
+    PowerCutDevice device(flash);
+    bool haveSaved = false;
+    LinkState saved{};   // last save that returned true
+    bool haveCut = false;
+    LinkState cut{};     // save the power cut, may have landed
+
+    for (int round = 0; round < cuts; round++) {
+        device.powerOn();
+        LinkStateStore store(device);
+        LinkState found;
+        if (store.mount(found)) {
+            fail("mount after a power cut", round);
+            return;
+        }
+        const bool empty = found.boots == 0 && found.joins == 0 && found.joinMs == 0;
+        if (haveSaved || haveCut) {
+            bool known = (haveSaved && same_state(found, saved)) || (haveCut && same_state(found, cut));
+            if (!known) {
+                fail("older or damaged state after a power cut", round);
+            }
+        } else if (!empty) {
+            fail("state on a device that never saved", round);
+        }
+        if (haveCut && same_state(found, cut)) {
+            saved = cut;
+            haveSaved = true;
+        }
+        haveCut = false;
+
+        device.cutAfter(rand() % 40);
+        while (!device.off()) {
+            LinkState state = random_state();
+            if (store.save(state) && !device.off()) {
+                saved = state;
+                haveSaved = true;
+            } else {
+                cut = state;
+                haveCut = true;
+            }
+        }
+    }
+}
+
+void check_join_delay()
+{
+    const uint32_t jitter = 30000;
+    const uint32_t low = 60000;
+    const uint32_t high = 3600000;
+    uint32_t lowest = UINT32_MAX;
+    uint32_t highest = 0;
+    for (uint32_t i = 0; i < 100000; i++) {
+        uint32_t delay = link_join_delay_ms(0, jitter, low, high, link_mix(i));
+        lowest = delay < lowest ? delay : lowest;
+        highest = delay > highest ? delay : highest;
+    }
+    if (highest > jitter || lowest > jitter / 100 || highest < jitter - jitter / 100) {
+        fail("first join not spread over the jitter", highest);
+    }
+    if (link_join_delay_ms(0, 0, low, high, 12345) != 0) {
+        fail("delay without jitter");
+    }
+    for (uint16_t failed = 1; failed < 40; failed++) {
+        uint64_t ceiling = failed < 32 ? static_cast<uint64_t>(low) << (failed - 1) : high;
+        ceiling = ceiling > high ? high : ceiling;
+        for (uint32_t random : { 0u, 1u, 0x7fffffffu, 0xffffffffu, link_mix(failed) }) {
+            uint32_t delay = link_join_delay_ms(failed, jitter, low, high, random);
+            if (delay > ceiling || delay < ceiling - ceiling / 2) {
+                fail("backoff outside the upper half of its ceiling", failed);
+            }
+        }
+    }
+    if (link_join_delay_ms(3, jitter, 10000, 5000, 0) > 5000) {
+        fail("backoff above its maximum");
+    }
+}
+
+/** Time on air in ms of an EU868 LoRa frame of bytes at BW125, CR 4/5, explicit header, CRC */
+double airtime_ms(int sf, int bytes)
+{
+    const double symbol = std::ldexp(1.0, sf) / 125.0;
+    const int de = sf >= 11 ? 1 : 0;
+    const double n = std::ceil((8.0 * bytes - 4 * sf + 28 + 16) / (4.0 * (sf - 2 * de)));
+    return (12.25 + 8 + std::max(n, 0.0) * 5) * symbol;
+}
+
+enum Strategy {
+    ONCE,
+    RETRY,
+    BACKOFF
+};
+
+struct Node {
+    int trial;            // request of the current connect(), 0..2
+    uint16_t failed;      // connect() that ended in JOIN_FAILURE
+    double dutyFree;      // earliest start of the next request (join duty cycle)
+    double joined;        // -1 until joined
+};
+
+struct Request {
+    int node;
+    int channel;
+    double start;
+    double end;
+    bool lost;
+};
+
+struct Event {
+    double time;
+    int kind;     // 0: node starts a request, 1: gateway decides on request index
+    int index;
+    bool operator<(const Event &other) const { return time > other.time; }
+};
+
+struct Result {
+    int joined10min;
+    int joined1h;
+    int joined;
+    double median;
+    double p90;
+    long requests;
+    long lost;
+};
+
+struct Backoff {
+    uint32_t jitterMs;
+    uint32_t minMs;
+    uint32_t maxMs;
+};
+
+Result simulate(Strategy strategy, const Backoff &backoff, int nodes, double hours, unsigned seed)
+{
+    const double requestMs = airtime_ms(12, 23);
+    const double acceptMs = airtime_ms(12, 33);
+    const double horizon = hours * 3600000.0;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    std::vector<Node> node(nodes);
+    std::vector<Request> requests;
+    std::vector<std::pair<double, double>> downlinks;
+    double rx1Free = 0;   // duty cycle of the gateway per sub-band
+    double rx2Free = 0;
+    std::priority_queue<Event> events;
+
+    auto connect = [&](int i, double time) {
+        node[i].trial = 0;
+        events.push({ std::max(time, node[i].dutyFree), 0, i });
+    };
+    for (int i = 0; i < nodes; i++) {
+        node[i] = { 0, 0, 0, -1 };
+        // Boot and sensor setup until main() calls connect()
+        double boot = 500 + 1500 * uniform(random);
+        if (strategy == BACKOFF) {
+            boot += link_join_delay_ms(0, backoff.jitterMs, backoff.minMs, backoff.maxMs, random());
+        }
+        connect(i, boot);
+    }
+
+    while (!events.empty() && events.top().time < horizon) {
+        const Event event = events.top();
+        events.pop();
+        if (event.kind == 0) {
+            const int i = event.index;
+            Request request = { i, static_cast<int>(random() % 3), event.time, event.time + requestMs, false };
+            for (size_t r = requests.size(); r-- > 0 && requests[r].start > request.start - requestMs;) {
+                if (requests[r].channel == request.channel && requests[r].end > request.start) {
+                    requests[r].lost = true;
+                    request.lost = true;
+                }
+            }
+            // Duty cycle of the join requests in the first hour, the next ten and after
+            const double factor = event.time < 3600000.0 ? 100 : event.time < 39600000.0 ? 1000 : 10000;
+            node[i].dutyFree = event.time + requestMs * factor;
+            requests.push_back(request);
+            events.push({ request.end + 5000, 1, static_cast<int>(requests.size() - 1) });
+            continue;
+        }
+
+        Request &request = requests[event.index];
+        Node &n = node[request.node];
+        for (const auto &downlink : downlinks) {
+            if (downlink.first < request.end && downlink.second > request.start) {
+                request.lost = true; // the gateway was transmitting
+            }
+        }
+        double acceptEnd = -1;
+        if (!request.lost) {
+            const double rx1 = request.end + 5000;
+            const double rx2 = request.end + 6000;
+            bool radioFree1 = downlinks.empty() || downlinks.back().second <= rx1;
+            bool radioFree2 = downlinks.empty() || downlinks.back().second <= rx2;
+            if (radioFree1 && rx1Free <= rx1) {
+                downlinks.push_back({ rx1, rx1 + acceptMs });
+                rx1Free = rx1 + acceptMs * 100;
+                acceptEnd = rx1 + acceptMs;
+            } else if (radioFree2 && rx2Free <= rx2) {
+                downlinks.push_back({ rx2, rx2 + acceptMs });
+                rx2Free = rx2 + acceptMs * 10;
+                acceptEnd = rx2 + acceptMs;
+            }
+        }
+        if (acceptEnd >= 0) {
+            n.joined = acceptEnd;
+            continue;
+        }
+        // RX2 closed without an accept
+        const double retry = request.end + 7000;
+        if (++n.trial < 3) {
+            events.push({ std::max(retry, n.dutyFree), 0, request.node });
+            continue;
+        }
+        n.failed++;
+        if (strategy == RETRY) {
+            connect(request.node, retry + 60000);
+        } else if (strategy == BACKOFF) {
+            connect(request.node, retry + link_join_delay_ms(n.failed, backoff.jitterMs, backoff.minMs,
+                                                             backoff.maxMs, random()));
+        }
+    }
+
+    Result result = {};
+    std::vector<double> times;
+    for (const Node &n : node) {
+        if (n.joined >= 0 && n.joined < horizon) {
+            times.push_back(n.joined);
+            result.joined10min += n.joined < 600000.0;
+            result.joined1h += n.joined < 3600000.0;
+        }
+    }
+    std::sort(times.begin(), times.end());
+    result.joined = static_cast<int>(times.size());
+    result.median = times.empty() ? 0 : times[times.size() / 2];
+    result.p90 = times.empty() ? 0 : times[times.size() * 9 / 10];
+    for (const Request &request : requests) {
+        result.requests += request.start < horizon;
+        result.lost += request.lost && request.start < horizon;
+    }
+    return result;
+}
+
+void print_result(const char *name, const Result &result, int nodes)
+{
+    printf("  %-18s %5.1f%% %5.1f%% %5.1f%%  %7.1f  %7.1f  %6ld  %5.1f%%  %6.1f\n", name,
+           100.0 * result.joined10min / nodes, 100.0 * result.joined1h / nodes, 100.0 * result.joined / nodes,
+           result.median / 60000, result.p90 / 60000, result.requests,
+           result.requests ? 100.0 * result.lost / result.requests : 0.0,
+           result.requests * airtime_ms(12, 23) / 1000);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    int nodes = 100;
+    double hours = 12;
+    int cuts = 2000;
+    unsigned seed = 1;
+    Backoff backoff = { MBED_CONF_APP_JOIN_JITTER * 1000, MBED_CONF_APP_JOIN_BACKOFF_MIN * 1000,
+                        MBED_CONF_APP_JOIN_BACKOFF_MAX * 1000
+                      };
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--self-test")) {
+            test = true;
+        } else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+            nodes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--hours") && i + 1 < argc) {
+            hours = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--cuts") && i + 1 < argc) {
+            cuts = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--jitter") && i + 1 < argc) {
+            backoff.jitterMs = strtoul(argv[++i], nullptr, 10) * 1000;
+        } else if (!strcmp(argv[i], "--backoff-min") && i + 1 < argc) {
+            backoff.minMs = strtoul(argv[++i], nullptr, 10) * 1000;
+        } else if (!strcmp(argv[i], "--backoff-max") && i + 1 < argc) {
+            backoff.maxMs = strtoul(argv[++i], nullptr, 10) * 1000;
+        } else {
+            fprintf(stderr, "usage: %s [--self-test] [--nodes N] [--hours H] [--jitter S] [--backoff-min S]"
+                    " [--backoff-max S] [--cuts N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    if (test) {
+        for (const Geometry &geometry : GEOMETRIES) {
+            check_basics(geometry);
+            check_power_cuts(geometry, cuts);
+        }
+        check_join_delay();
+        if (failures) {
+            printf("%d failures\n", failures);
+            return 1;
+        }
+        printf("self-test passed\n");
+        return 0;
+    }
+
+    printf("%d nodes reset together, one gateway, joins at SF12, %.0f h (jitter %lu s, backoff %lu to %lu s):\n",
+           nodes, hours, static_cast<unsigned long>(backoff.jitterMs / 1000),
+           static_cast<unsigned long>(backoff.minMs / 1000), static_cast<unsigned long>(backoff.maxMs / 1000));
+    printf("  %-18s %6s %6s %6s  %7s  %7s  %6s  %6s  %6s\n", "strategy", "10 min", "1 h", "joined",
+           "p50 min", "p90 min", "joinreq", "lost", "air s");
+    print_result("one connect()", simulate(ONCE, backoff, nodes, hours, seed), nodes);
+    print_result("retry after 60 s", simulate(RETRY, backoff, nodes, hours, seed), nodes);
+    print_result("jitter, backoff", simulate(BACKOFF, backoff, nodes, hours, seed), nodes);
+    return 0;
+}
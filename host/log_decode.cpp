@@ -0,0 +1,330 @@
+/*
+ * Host decoder of the deferred log (deferred_log.h).
+ *
+ * Reads the serial output of the node on stdin and prints it with every
+ * record line formatted, all other lines pass through unchanged:
+ *
+ *   mbed sterm | log-decode
+ *
+ * --self-test checks that every format string only uses conversions the
+ * decoder supports and takes exactly the words its arguments produce,
+ * round-trips records from deferred_log() through the serial line form,
+ * and stresses MpscRing with several producer threads against one
+ * consumer: every record must arrive intact and in order per producer,
+ * and every one that did not fit must be counted as dropped. It also
+ * compares the cost of a record with snprintf of the same line and the
+ * bytes each puts on the UART.
+ *
+ *   log-decode [--self-test [--producers N] [--records N] [--seed S]]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "deferred_log.h"
+#include "log_format.h"
+#include "mpsc_ring.h"
+
+namespace {
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int decode(FILE *in)
+{
+    char line[1024];
+    uint32_t record[LOG_RECORD_MAX_WORDS * 2];
+    while (fgets(line, sizeof(line), in)) {
+        const int words = log_parse_line(line, record, sizeof(record) / sizeof(record[0]));
+        if (words < 0) {
+            fputs(line, stdout);
+            continue;
+        }
+        printf("%s\n", log_format(record, static_cast<uint32_t>(words)).c_str());
+    }
+    return 0;
+}
+
+/** Arguments in the form a record of format has, one per conversion */
+bool synthesize(uint32_t id, std::vector<uint32_t> &record)
+{
+    record.assign(1, id);
+    for (const char *p = log_format_string(id); *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            continue;
+        }
+        p += strspn(p, "-+ #0123456789.hlzjt");
+        if (*p == 's') {
+            record.push_back(3);
+            record.push_back('a' | 'b' << 8 | 'c' << 16);
+        } else if (*p && strchr("diuxXocf", *p)) {
+            record.push_back(42);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool expect(const uint32_t *record, uint32_t words, const char *expected)
+{
+    char line[3 + 9 * LOG_RECORD_MAX_WORDS];
+    uint32_t parsed[LOG_RECORD_MAX_WORDS];
+    const size_t length = deferred_log_line(record, words, line, sizeof(line));
+    const int count = log_parse_line(line, parsed, LOG_RECORD_MAX_WORDS);
+    bool ok = false;
+    const std::string text = count > 0 ? log_format(parsed, static_cast<uint32_t>(count), &ok) : "";
+    if (!length || count != static_cast<int>(words) || !ok || text != expected) {
+        printf("FAIL: \"%s\" from %.*s, expected \"%s\"\n", text.c_str(), static_cast<int>(length ? length - 1 : 0),
+               line, expected);
+        return false;
+    }
+    return true;
+}
+
+/** Takes the next record of the global log and checks its text */
+bool expect_next(const char *expected)
+{
+    uint32_t record[LOG_RECORD_MAX_WORDS];
+    const int words = deferred_log_next(record);
+    if (words < 0) {
+        printf("FAIL: no record, expected \"%s\"\n", expected);
+        return false;
+    }
+    return expect(record, static_cast<uint32_t>(words), expected);
+}
+
+bool format_test()
+{
+    for (uint32_t id = 0; id < LOG_FORMAT_COUNT; id++) {
+        std::vector<uint32_t> record;
+        bool ok = false;
+        if (!synthesize(id, record)) {
+            printf("FAIL: format %lu uses an unsupported conversion\n", static_cast<unsigned long>(id));
+            return false;
+        }
+        log_format(record.data(), static_cast<uint32_t>(record.size()), &ok);
+        if (!ok || record.size() > LOG_RECORD_MAX_WORDS) {
+            printf("FAIL: format %lu \"%s\" does not take its arguments\n", static_cast<unsigned long>(id),
+                   log_format_string(id));
+            return false;
+        }
+    }
+
+    bool ok = true;
+    deferred_log(LOG_GPS, 7, -33456789, 151234567, 1234u, " (cached)");
+    ok &= expect_next("GPS: Satellites: 7, Latitude: -33.456789, Longitude: 151.234567, Age: 1234 ms (cached)");
+    deferred_log(LOG_CLIMATE, static_cast<int32_t>(-5), static_cast<int16_t>(999));
+    ok &= expect_next("Temperature: -0.5 °C, Humidity: 99.9 %");
+    deferred_log(LOG_ACCEL, -981, 0, 1);
+    ok &= expect_next("Accelerometer: X: -9.81, Y: 0.00, Z: 0.01");
+    deferred_log(LOG_ACCEL_EVENT, "a name longer than sixteen", 4000000000u, static_cast<uint8_t>(0x0c));
+    ok &= expect_next("Accelerometer a name longer th at 4000000000 ms (0x0c)");
+    deferred_log(LOG_I2C, "", 1, 2, 3, 4);
+    ok &= expect_next("I2C : 1 transactions, 2 NACKs, latency avg 3 us, max 4 us");
+    deferred_log(LOG_SENSOR_HEADER);
+    ok &= expect_next("\n--- Sensor Data ---");
+
+    // A full ring drops and reports it once
+    long written = 0;
+    while (deferred_log(LOG_LIGHT, 1)) {
+        written++;
+    }
+    deferred_log(LOG_LIGHT, 1);
+    ok &= expect_next("Log: 2 messages lost to a full ring");
+    for (long i = 0; i < written; i++) {
+        ok &= expect_next("Brightness: 0.1");
+    }
+    uint32_t record[LOG_RECORD_MAX_WORDS];
+    if (deferred_log_next(record) != -1 || written != MBED_CONF_APP_DEFERRED_LOG_SIZE / 3) {
+        printf("FAIL: %ld records in a ring of %d words\n", written, MBED_CONF_APP_DEFERRED_LOG_SIZE);
+        ok = false;
+    }
+
+    // Damaged lines are not records
+    uint32_t words[4];
+    ok &= log_parse_line("~", words, 4) == -1 && log_parse_line("~1 g", words, 4) == -1
+          && log_parse_line("~1 2 3 4 5", words, 4) == -1 && log_parse_line("~ 1", words, 4) == -1
+          && log_parse_line("~100000000", words, 4) == -1 && log_parse_line("GPS", words, 4) == -1
+          && log_parse_line("~1 ffffffff\r\n", words, 4) == 2 && words[1] == UINT32_MAX;
+    // Unknown ids and extra words are shown, not dropped
+    const uint32_t unknown[] = { LOG_FORMAT_COUNT, 5 };
+    const uint32_t extra[] = { LOG_LIGHT, 5, 6 };
+    bool complete = true;
+    char expected[40];
+    snprintf(expected, sizeof(expected), "<unknown message %d> <5>", static_cast<int>(LOG_FORMAT_COUNT));
+    ok &= log_format(unknown, 2, &complete) == expected && !complete;
+    ok &= log_format(extra, 3, &complete) == "Brightness: 0.5 <6>" && !complete;
+    if (!ok) {
+        printf("FAIL: damaged records\n");
+    }
+    return ok;
+}
+
+/**
+ * Producers write records of 2 to 15 words: producer, sequence and a
+ * pattern derived from both. The consumer runs concurrently.
+ */
+bool stress_test(int producers, long records, unsigned seed, double &dropped_share)
+{
+    static MpscRing<256> ring;
+    std::atomic<int> running(producers);
+    std::vector<long> sent(producers), failed(producers);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            uint32_t state = seed * 7919u + p;
+            for (long n = 0; n < records; n++) {
+                state = state * 1103515245u + 12345u;
+                uint32_t words[15] = {};
+                const uint32_t count = 2 + (state >> 16) % 14;
+                words[0] = static_cast<uint32_t>(p);
+                words[1] = static_cast<uint32_t>(n);
+                for (uint32_t i = 2; i < count; i++) {
+                    words[i] = words[1] * 31 + i * 0x9e3779b9u + words[0];
+                }
+                if (ring.write(words, count)) {
+                    sent[p]++;
+                } else {
+                    failed[p]++;
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        });
+    }
+
+    std::vector<long> next(producers, 0);
+    long received = 0;
+    bool ok = true;
+    while (ok) {
+        uint32_t words[16] = {};
+        const bool done = running == 0;
+        const int count = ring.read(words, 16);
+        if (count < 0) {
+            if (done) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        const uint32_t p = words[0];
+        const long n = static_cast<long>(words[1]);
+        if (count < 2 || p >= static_cast<uint32_t>(producers) || n < next[p]) {
+            printf("FAIL: record %ld of producer %lu out of order\n", n, static_cast<unsigned long>(p));
+            ok = false;
+            break;
+        }
+        for (int i = 2; i < count; i++) {
+            if (words[i] != words[1] * 31 + i * 0x9e3779b9u + words[0]) {
+                printf("FAIL: record %ld of producer %lu damaged\n", n, static_cast<unsigned long>(p));
+                ok = false;
+            }
+        }
+        next[p] = n + 1;
+        received++;
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    long total_sent = 0, total_failed = 0;
+    for (int p = 0; p < producers; p++) {
+        total_sent += sent[p];
+        total_failed += failed[p];
+    }
+    if (ok && (received != total_sent || static_cast<long>(ring.dropped()) != total_failed || ring.used() != 0)) {
+        printf("FAIL: %ld sent, %ld received, %ld failed, %lu dropped\n", total_sent, received, total_failed,
+               static_cast<unsigned long>(ring.dropped()));
+        ok = false;
+    }
+    dropped_share = static_cast<double>(total_failed) / (static_cast<double>(producers) * records);
+    return ok;
+}
+
+void bench()
+{
+    const int rounds = 100000;
+    uint32_t record[LOG_RECORD_MAX_WORDS];
+    char line[160];
+    size_t record_bytes = 0, text_bytes = 0;
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < rounds; i++) {
+        deferred_log(LOG_GPS, 7, -33456789 + i, 151234567, 1234u, " (cached)");
+        const int words = deferred_log_next(record);
+        record_bytes = deferred_log_line(record, static_cast<uint32_t>(words), line, sizeof(line));
+    }
+    const double log_ns = static_cast<double>(now_ns() - start) / rounds;
+
+    volatile float latitude = -33.456789f, longitude = 151.234567f;
+    start = now_ns();
+    for (int i = 0; i < rounds; i++) {
+        text_bytes = snprintf(line, sizeof(line), "GPS: Satellites: %d, Latitude: %.6f, Longitude: %.6f, Age: %lu ms%s\n",
+                              7, latitude + i * 1e-6f, longitude, 1234ul, " (cached)");
+    }
+    const double printf_ns = static_cast<double>(now_ns() - start) / rounds;
+
+    // 10 bits per byte on the UART
+    printf("GPS line: record and line %.0f ns, %zu bytes (%.1f ms at 115200 baud); "
+           "snprintf %.0f ns, %zu bytes (%.1f ms)\n", log_ns, record_bytes, record_bytes * 10 / 115.2,
+           printf_ns, text_bytes, text_bytes * 10 / 115.2);
+}
+
+int self_test(int producers, long records, unsigned seed)
+{
+    bool ok = format_test();
+    printf("%d formats, records round-trip through the serial line\n", static_cast<int>(LOG_FORMAT_COUNT));
+
+    double dropped_share = 0;
+    if (ok && !stress_test(producers, records, seed, dropped_share)) {
+        ok = false;
+    }
+    printf("%d producers x %ld records against one consumer: in order and intact, %.1f %% dropped and counted\n",
+           producers, records, dropped_share * 100);
+
+    bench();
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    int producers = 4;
+    long records = 200000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--self-test")) {
+            test = true;
+        } else if (!strcmp(argv[i], "--producers") && i + 1 < argc) {
+            producers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--records") && i + 1 < argc) {
+            records = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--self-test [--producers N] [--records N] [--seed S]]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (test) {
+        return self_test(producers > 0 ? producers : 1, records, seed);
+    }
+    return decode(stdin);
+}
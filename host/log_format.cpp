@@ -0,0 +1,183 @@
+#include "log_format.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "deferred_log.h"
+
+namespace {
+
+#define LOG_FORMAT_STRING(id, format) format,
+const char *const formats[LOG_FORMAT_COUNT] = {
+    LOG_FORMATS(LOG_FORMAT_STRING)
+};
+#undef LOG_FORMAT_STRING
+
+/** Reads the next argument word, false if the record is exhausted */
+bool next(const uint32_t *record, uint32_t words, uint32_t &index, uint32_t &value)
+{
+    if (index >= words) {
+        return false;
+    }
+    value = record[index++];
+    return true;
+}
+
+template <typename T>
+std::string format_with(const std::string &spec, T value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), spec.c_str(), value);
+    return text;
+}
+
+} // namespace
+
+const char *log_format_string(uint32_t id)
+{
+    return id < LOG_FORMAT_COUNT ? formats[id] : nullptr;
+}
+
+std::string log_format(const uint32_t *record, uint32_t words, bool *ok)
+{
+    bool complete = true;
+    std::string out;
+    const char *format = words > 0 ? log_format_string(record[0]) : nullptr;
+    uint32_t index = 1;
+    if (!format) {
+        char text[32];
+        snprintf(text, sizeof(text), "<unknown message %lu>", words ? static_cast<unsigned long>(record[0]) : 0ul);
+        out = text;
+        complete = false;
+    }
+
+    for (const char *p = format; p && *p; p++) {
+        if (*p != '%') {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p++;
+            continue;
+        }
+        // Flags, width and precision are kept, the length modifier is replaced
+        std::string spec = "%";
+        p++;
+        while (*p && strchr("-+ #0", *p)) {
+            spec += *p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            spec += *p++;
+        }
+        int precision = -1;
+        if (*p == '.') {
+            spec += *p++;
+            precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                precision = precision * 10 + (*p - '0');
+                spec += *p++;
+            }
+        }
+        while (*p && strchr("hlzjt", *p)) {
+            p++;
+        }
+        if (!*p) {
+            complete = false;
+            break;
+        }
+
+        uint32_t value;
+        if (!next(record, words, index, value)) {
+            out += "<?>";
+            complete = false;
+            continue;
+        }
+        switch (*p) {
+            case 'd':
+            case 'i':
+                out += format_with(spec + "ld", static_cast<long>(static_cast<int32_t>(value)));
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                out += format_with(spec + "l" + *p, static_cast<unsigned long>(value));
+                break;
+            case 'c':
+                out += format_with(spec + "c", static_cast<int>(value));
+                break;
+            case 'f': {
+                // Steps of 10^-precision
+                double scaled = static_cast<int32_t>(value);
+                for (int n = 0; n < (precision < 0 ? 6 : precision); n++) {
+                    scaled /= 10;
+                }
+                out += format_with(spec + "f", scaled);
+                break;
+            }
+            case 's': {
+                std::string text;
+                const uint32_t length = value < LOG_STRING_MAX ? value : LOG_STRING_MAX;
+                for (uint32_t n = 0; n < length; n += 4) {
+                    uint32_t chars;
+                    if (!next(record, words, index, chars)) {
+                        complete = false;
+                        break;
+                    }
+                    for (uint32_t b = 0; b < 4 && n + b < length; b++) {
+                        text += static_cast<char>((chars >> (8 * b)) & 0xff);
+                    }
+                }
+                complete &= value <= LOG_STRING_MAX;
+                out += format_with(spec + "s", text.c_str());
+                break;
+            }
+            default:
+                out += "<?>";
+                complete = false;
+                break;
+        }
+    }
+
+    if (index < words) {
+        out += " <";
+        for (; index < words; index++) {
+            char text[12];
+            snprintf(text, sizeof(text), index + 1 < words ? "%lx " : "%lx", static_cast<unsigned long>(record[index]));
+            out += text;
+        }
+        out += ">";
+        complete = false;
+    }
+    if (ok) {
+        *ok = complete;
+    }
+    return out;
+}
+
+int log_parse_line(const char *line, uint32_t *record, uint32_t max)
+{
+    if (*line != LOG_LINE_MARKER) {
+        return -1;
+    }
+    const char *p = line + 1;
+    uint32_t words = 0;
+    while (*p && *p != '\n' && *p != '\r') {
+        if (!isxdigit(static_cast<unsigned char>(*p))) {
+            return -1;
+        }
+        char *end;
+        errno = 0;
+        const unsigned long value = strtoul(p, &end, 16);
+        if (end == p || errno || value > UINT32_MAX || words >= max || (*end && !strchr(" \r\n", *end))) {
+            return -1;
+        }
+        record[words++] = static_cast<uint32_t>(value);
+        p = *end == ' ' ? end + 1 : end;
+    }
+    return words > 0 ? static_cast<int>(words) : -1;
+}
@@ -0,0 +1,28 @@
+#ifndef APP_HOST_LOG_FORMAT_H_
+#define APP_HOST_LOG_FORMAT_H_
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Host side of deferred_log.h: the format strings and the formatting the
+ * device leaves out.
+ */
+
+/** Format string of a message id, nullptr if unknown */
+const char *log_format_string(uint32_t id);
+
+/**
+ * Formats a record like printf would have on the device. Missing
+ * arguments come out as <?>, unused words and unknown ids are shown in
+ * hex; ok (if given) is false in these cases.
+ */
+std::string log_format(const uint32_t *record, uint32_t words, bool *ok = nullptr);
+
+/**
+ * Parses a record line of deferred_log_line(), with or without the
+ * newline. Returns the number of words, -1 if line is not a record line.
+ */
+int log_parse_line(const char *line, uint32_t *record, uint32_t max);
+
+#endif /* APP_HOST_LOG_FORMAT_H_ */
@@ -0,0 +1,234 @@
+#ifndef APP_HOST_MBED_H_
+#define APP_HOST_MBED_H_
+
+/*
+ * Host stand-in for "mbed.h".
+ *
+ * Provides just the subset of the Mbed OS API used by the sensor drivers,
+ * backed by the scriptable mock devices in mock_hal.h. Time is virtual:
+ * sleeps and bus transfers advance host::now_us() instead of blocking, so
+ * a profiling run is deterministic and as fast as the host allows.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/types.h>
+
+#include "mbed_config.h"
+#include "platform/Callback.h"
+#include "platform/mbed_atomic.h"
+
+#define MBED_ASSERT(expr) ((expr) ? (void)0 : std::abort())
+
+#define MBED_CONF_PLATFORM_DEFAULT_SERIAL_BAUD_RATE 115200
+
+/**
+ * Pins used by the application. The values only have to be unique, the
+ * mock registry uses them as keys.
+ */
+typedef enum {
+    PA_8 = 0x08, PA_9, PA_10, PA_11, PA_12,
+    PB_6 = 0x16, PB_7,
+    A0 = 0x40, A1, A2, A3, A4, A5,
+    D2 = 0x50, D3, D4, D5, D6, D7, D8,
+    D12 = 0x5C, D13, D14, D15,
+    USBTX = 0x70, USBRX,
+    NC = -1
+} PinName;
+
+namespace host {
+
+/** Current virtual time in microseconds */
+uint64_t now_us();
+
+/** Advances the virtual clock, used for sleeps and bus transfer time */
+void advance_us(uint64_t us);
+
+/** Virtual time of the next device interrupt, UINT64_MAX if none */
+uint64_t next_irq_us();
+
+} // namespace host
+
+namespace rtos {
+
+namespace Kernel {
+
+/** Virtual kernel clock with the same interface as rtos::Kernel::Clock */
+struct Clock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<Clock>;
+    static constexpr bool is_steady = true;
+    static time_point now()
+    {
+        return time_point(duration(host::now_us() / 1000));
+    }
+};
+
+} // namespace Kernel
+
+namespace ThisThread {
+
+void sleep_for(std::chrono::milliseconds rel_time);
+
+} // namespace ThisThread
+
+} // namespace rtos
+
+namespace mbed {
+
+class I2C {
+public:
+    I2C(PinName sda, PinName scl);
+
+    void frequency(int hz);
+    int read(int address, char *data, int length, bool repeated = false);
+    int write(int address, const char *data, int length, bool repeated = false);
+
+private:
+    int _hz;
+};
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin, float vref = 3.3f);
+
+    float read();
+    unsigned short read_u16();
+    operator float()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin);
+    DigitalOut(PinName pin, int value);
+
+    void write(int value);
+    int read();
+    DigitalOut &operator=(int value)
+    {
+        write(value);
+        return *this;
+    }
+    operator int()
+    {
+        return read();
+    }
+
+private:
+    PinName _pin;
+};
+
+class InterruptIn {
+public:
+    InterruptIn(PinName pin);
+    ~InterruptIn();
+
+    int read();
+    void rise(Callback<void()> func);
+    void fall(Callback<void()> func);
+    operator int()
+    {
+        return read();
+    }
+
+    /** Called by host::drive_pin() on a level change, in "interrupt context" */
+    void edge(int level);
+
+private:
+    PinName _pin;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+};
+
+/**
+ * One-shot timer on the virtual clock. The callback runs once the clock
+ * passes the deadline, in "interrupt context" like a device interrupt.
+ */
+class Timeout {
+public:
+    Timeout();
+    ~Timeout();
+
+    void attach(Callback<void()> func, std::chrono::microseconds t);
+    void detach();
+
+    /** Deadline in virtual microseconds, UINT64_MAX if not attached */
+    uint64_t due_us() const
+    {
+        return _due_us;
+    }
+
+    /** Called by the mock HAL at the deadline */
+    void fire();
+
+private:
+    Callback<void()> _func;
+    uint64_t _due_us;
+};
+
+class BufferedSerial {
+public:
+    BufferedSerial(PinName tx, PinName rx,
+                   int baud = MBED_CONF_PLATFORM_DEFAULT_SERIAL_BAUD_RATE);
+
+    ssize_t read(void *buffer, size_t length);
+    ssize_t write(const void *buffer, size_t length);
+    bool readable() const;
+    bool writable() const;
+    void set_baud(int baud);
+
+private:
+    PinName _tx;
+};
+
+class SerialBase {
+public:
+    enum IrqType {
+        RxIrq = 0,
+        TxIrq,
+        IrqCnt
+    };
+};
+
+/**
+ * Like on the target the receive side holds a single byte: the RX
+ * interrupt handler has to read it before the next one arrives.
+ */
+class UnbufferedSerial : public SerialBase {
+public:
+    UnbufferedSerial(PinName tx, PinName rx,
+                     int baud = MBED_CONF_PLATFORM_DEFAULT_SERIAL_BAUD_RATE);
+
+    ssize_t read(void *buffer, size_t length);
+    ssize_t write(const void *buffer, size_t length);
+    bool readable();
+    bool writable();
+    void baud(int baudrate);
+    void attach(Callback<void()> func, IrqType type = RxIrq);
+
+private:
+    PinName _tx;
+};
+
+} // namespace mbed
+
+#include "events/EventQueue.h"
+
+using namespace events;
+using namespace mbed;
+using namespace rtos;
+using namespace std;
+
+#endif /* APP_HOST_MBED_H_ */
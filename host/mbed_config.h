@@ -0,0 +1,46 @@
+#ifndef APP_HOST_MBED_CONFIG_H_
+#define APP_HOST_MBED_CONFIG_H_
+
+/*
+ * Host counterpart of the generated mbed_config.h. Mirrors the "config"
+ * section of mbed_app.json, with the optional hardware features enabled
+ * so that the profiler exercises them. Keep in sync with mbed_app.json.
+ */
+
+#define MBED_CONF_APP_PAYLOAD_KEYFRAME_INTERVAL     10
+#define MBED_CONF_APP_SAMPLE_INTERVAL               60
+#define MBED_CONF_APP_BATCH_CAPACITY                32
+#define MBED_CONF_APP_PAYLOAD_COMPRESSION           1
+#define MBED_CONF_APP_SAMPLE_LOG                    1
+#define MBED_CONF_APP_SAMPLE_LOG_SIZE               65536
+#define MBED_CONF_APP_LINK_STATE                    1
+#define MBED_CONF_APP_LINK_STATE_SIZE               8192
+#define MBED_CONF_APP_JOIN_JITTER                   120
+#define MBED_CONF_APP_JOIN_BACKOFF_MIN              300
+#define MBED_CONF_APP_JOIN_BACKOFF_MAX              3600
+#define MBED_CONF_APP_LATENCY_DUMP_INTERVAL         10
+#define MBED_CONF_APP_DIAGNOSTICS_INTERVAL          10
+#define MBED_CONF_APP_DIAGNOSTICS_PORT              200
+#define MBED_CONF_APP_DEFERRED_LOG_SIZE             512
+#define MBED_CONF_APP_SENSOR_CLIMATE                1
+#define MBED_CONF_APP_SENSOR_LIGHT                  1
+#define MBED_CONF_APP_SENSOR_SOIL                   1
+#define MBED_CONF_APP_SENSOR_COLOR                  1
+#define MBED_CONF_APP_SENSOR_ACCEL                  1
+#define MBED_CONF_APP_CLIMATE_PERIOD                60
+#define MBED_CONF_APP_LIGHT_PERIOD                  60
+#define MBED_CONF_APP_SOIL_PERIOD                   600
+#define MBED_CONF_APP_COLOR_PERIOD                  60
+#define MBED_CONF_APP_ACCEL_PERIOD_MS               60000
+#define MBED_CONF_APP_ADC_GROUPS                    9
+#define MBED_CONF_APP_ADC_DECIMATION                8
+#define MBED_CONF_APP_ADC_GROUP_INTERVAL_MS         9
+#define MBED_CONF_APP_GPS_BAUD                      38400
+#define MBED_CONF_APP_GPS_UPDATE_INTERVAL           1000
+#define MBED_CONF_APP_GPS_DUTY_CYCLE                1
+#define MBED_CONF_APP_GPS_MOTION_GATED              1
+#define MBED_CONF_APP_ACCEL_FIFO                    1
+#define MBED_CONF_APP_ACCEL_EVENTS                  1
+#define MBED_CONF_APP_ACCEL_INT1_PIN                PA_8
+
+#endif /* APP_HOST_MBED_CONFIG_H_ */
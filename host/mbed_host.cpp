@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <vector>
+
+#include "mbed.h"
+#include "mock_hal.h"
+
+namespace host {
+
+namespace {
+
+/**
+ * All mock state lives in function-local statics so that drivers
+ * constructed as globals can register before main() runs.
+ */
+struct HalState {
+    uint64_t now_us = 0;
+    uint64_t sleep_us = 0;
+    std::map<uint8_t, MockI2CDevice *> i2c_devices;
+    std::map<uint8_t, I2CStats> i2c_stats;
+    std::map<int, std::function<uint16_t()>> adc;
+    std::map<int, int> pins;
+    std::map<int, uint64_t> pin_changes;
+    std::map<int, MockUart> uarts;
+    std::map<int, mbed::InterruptIn *> irq_pins;
+    std::vector<IrqSource *> irq_sources;
+    std::vector<mbed::Timeout *> timeouts;
+    bool in_irq = false;
+};
+
+HalState &state()
+{
+    static HalState hal;
+    return hal;
+}
+
+/** Start, address byte, data bytes and stop at 9 clocks per byte */
+uint64_t i2c_bus_us(int length, int hz)
+{
+    uint64_t bits = 2 + 9 * (1 + static_cast<uint64_t>(length));
+    return (bits * 1000000 + hz - 1) / hz;
+}
+
+int i2c_transfer(int address, uint8_t *data, int length, bool is_read, int hz)
+{
+    HalState &hal = state();
+    uint8_t addr7 = static_cast<uint8_t>(address >> 1);
+    I2CStats &stats = hal.i2c_stats[addr7];
+
+    auto start = std::chrono::steady_clock::now();
+    bool ack = false;
+    auto it = hal.i2c_devices.find(addr7);
+    if (it != hal.i2c_devices.end()) {
+        ack = is_read ? it->second->read(data, length)
+                      : it->second->write(data, length);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    // An address NACK ends the transaction after the first byte
+    uint64_t bus_us = i2c_bus_us(ack ? length : 0, hz);
+    stats.transactions++;
+    stats.bytes += ack ? length : 0;
+    stats.nacks += ack ? 0 : 1;
+    stats.bus_us += bus_us;
+    stats.wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+    advance_us(bus_us);
+
+    return ack ? 0 : 1;
+}
+
+} // namespace
+
+uint64_t now_us()
+{
+    return state().now_us;
+}
+
+void advance_us(uint64_t us)
+{
+    HalState &hal = state();
+    const uint64_t target = hal.now_us + us;
+
+    // Fire device interrupts that fall into the interval in time order.
+    // Handlers may advance time themselves, those nested calls just move
+    // the clock.
+    while (!hal.in_irq) {
+        IrqSource *next = nullptr;
+        uint64_t next_us = target;
+        for (IrqSource *source : hal.irq_sources) {
+            uint64_t at = source->next_irq_us();
+            if (at <= next_us) {
+                next = source;
+                next_us = at;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        hal.now_us = std::max(hal.now_us, next_us);
+        hal.in_irq = true;
+        next->fire();
+        hal.in_irq = false;
+    }
+    hal.now_us = std::max(hal.now_us, target);
+}
+
+uint64_t next_irq_us()
+{
+    uint64_t next = UINT64_MAX;
+    for (IrqSource *source : state().irq_sources) {
+        next = std::min(next, source->next_irq_us());
+    }
+    return next;
+}
+
+void add_irq_source(IrqSource *source)
+{
+    state().irq_sources.push_back(source);
+}
+
+void drive_pin(PinName pin, int level)
+{
+    HalState &hal = state();
+    level = level ? 1 : 0;
+    int old = pin_level(pin);
+    hal.pins[pin] = level;
+    if (old != level) {
+        hal.pin_changes[pin] = hal.now_us;
+    }
+    auto it = hal.irq_pins.find(pin);
+    if (old != level && it != hal.irq_pins.end()) {
+        it->second->edge(level);
+    }
+}
+
+void attach_i2c(uint8_t address, MockI2CDevice *device)
+{
+    state().i2c_devices[address] = device;
+}
+
+const std::map<uint8_t, I2CStats> &i2c_stats()
+{
+    return state().i2c_stats;
+}
+
+uint64_t sleep_us()
+{
+    return state().sleep_us;
+}
+
+void reset_stats()
+{
+    state().i2c_stats.clear();
+    state().sleep_us = 0;
+}
+
+void set_adc(PinName pin, std::function<uint16_t()> source)
+{
+    state().adc[pin] = source;
+}
+
+int pin_level(PinName pin)
+{
+    auto it = state().pins.find(pin);
+    return it == state().pins.end() ? -1 : it->second;
+}
+
+uint64_t pin_changed_us(PinName pin)
+{
+    auto it = state().pin_changes.find(pin);
+    return it == state().pin_changes.end() ? 0 : it->second;
+}
+
+MockUart &uart(PinName tx)
+{
+    return state().uarts[tx];
+}
+
+MockUart::MockUart(size_t rx_capacity)
+    : baud(9600), overruns(0), received(0), _capacity(rx_capacity), _source(nullptr),
+      _irq_registered(false)
+{
+}
+
+void MockUart::attach(MockUartSource *source)
+{
+    _source = source;
+}
+
+void MockUart::attach_rx_irq(mbed::Callback<void()> handler)
+{
+    _rx_irq = handler;
+    if (!_irq_registered) {
+        add_irq_source(this);
+        _irq_registered = true;
+    }
+}
+
+void MockUart::set_rx_capacity(size_t capacity)
+{
+    _capacity = capacity;
+}
+
+uint64_t MockUart::next_irq_us()
+{
+    if (!_rx_irq || !_source) {
+        return UINT64_MAX;
+    }
+    return std::max(now_us(), _source->next_byte_us(*this));
+}
+
+void MockUart::fire()
+{
+    if (available() > 0) {
+        _rx_irq();
+    }
+}
+
+void MockUart::inject(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (_rx.size() >= _capacity) {
+            overruns++;
+            continue;
+        }
+        _rx.push_back(data[i]);
+        received++;
+    }
+}
+
+size_t MockUart::available()
+{
+    if (_source) {
+        _source->pump(*this, now_us());
+    }
+    return _rx.size();
+}
+
+size_t MockUart::read(uint8_t *data, size_t length)
+{
+    size_t count = std::min(length, available());
+    std::copy(_rx.begin(), _rx.begin() + count, data);
+    _rx.erase(_rx.begin(), _rx.begin() + count);
+    return count;
+}
+
+void MockUart::write(const uint8_t *data, size_t length)
+{
+    tx_log.append(reinterpret_cast<const char *>(data), length);
+    // The driver blocks until the bytes are on the wire
+    advance_us(length * 10 * 1000000ULL / baud);
+    if (_source) {
+        _source->transmit(*this, data, length);
+    }
+}
+
+} // namespace host
+
+namespace rtos {
+namespace ThisThread {
+
+void sleep_for(std::chrono::milliseconds rel_time)
+{
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(rel_time).count();
+    host::state().sleep_us += us;
+    host::advance_us(us);
+}
+
+} // namespace ThisThread
+} // namespace rtos
+
+namespace mbed {
+
+I2C::I2C(PinName sda, PinName scl) : _hz(100000)
+{
+}
+
+void I2C::frequency(int hz)
+{
+    _hz = hz;
+}
+
+int I2C::read(int address, char *data, int length, bool repeated)
+{
+    return host::i2c_transfer(address, reinterpret_cast<uint8_t *>(data), length, true, _hz);
+}
+
+int I2C::write(int address, const char *data, int length, bool repeated)
+{
+    return host::i2c_transfer(address, reinterpret_cast<uint8_t *>(const_cast<char *>(data)),
+                              length, false, _hz);
+}
+
+AnalogIn::AnalogIn(PinName pin, float vref) : _pin(pin)
+{
+}
+
+unsigned short AnalogIn::read_u16()
+{
+    auto it = host::state().adc.find(_pin);
+    return it == host::state().adc.end() ? 0 : it->second();
+}
+
+float AnalogIn::read()
+{
+    return read_u16() / 65535.0f;
+}
+
+DigitalOut::DigitalOut(PinName pin) : _pin(pin)
+{
+}
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin)
+{
+    write(value);
+}
+
+void DigitalOut::write(int value)
+{
+    value = value ? 1 : 0;
+    if (host::pin_level(_pin) != value) {
+        host::state().pin_changes[_pin] = host::now_us();
+    }
+    host::state().pins[_pin] = value;
+}
+
+int DigitalOut::read()
+{
+    return host::pin_level(_pin) > 0;
+}
+
+InterruptIn::InterruptIn(PinName pin) : _pin(pin)
+{
+    host::state().irq_pins[pin] = this;
+    if (host::pin_level(pin) < 0) {
+        host::state().pins[pin] = 1; // pull-up
+    }
+}
+
+InterruptIn::~InterruptIn()
+{
+    host::state().irq_pins.erase(_pin);
+}
+
+int InterruptIn::read()
+{
+    return host::pin_level(_pin) > 0;
+}
+
+void InterruptIn::rise(Callback<void()> func)
+{
+    _rise = func;
+}
+
+void InterruptIn::fall(Callback<void()> func)
+{
+    _fall = func;
+}
+
+void InterruptIn::edge(int level)
+{
+    if (level && _rise) {
+        _rise();
+    } else if (!level && _fall) {
+        _fall();
+    }
+}
+
+namespace {
+
+/** All Timeouts as one interrupt source, the earliest deadline first */
+class TimeoutSource : public host::IrqSource {
+public:
+    uint64_t next_irq_us() override
+    {
+        uint64_t next = UINT64_MAX;
+        for (Timeout *timeout : host::state().timeouts) {
+            next = std::min(next, timeout->due_us());
+        }
+        return next;
+    }
+
+    void fire() override
+    {
+        for (Timeout *timeout : host::state().timeouts) {
+            if (timeout->due_us() <= host::now_us()) {
+                timeout->fire();
+                return;
+            }
+        }
+    }
+};
+
+} // namespace
+
+Timeout::Timeout() : _due_us(UINT64_MAX)
+{
+    static TimeoutSource source;
+    static bool added = false;
+    if (!added) {
+        host::add_irq_source(&source);
+        added = true;
+    }
+    host::state().timeouts.push_back(this);
+}
+
+Timeout::~Timeout()
+{
+    std::vector<Timeout *> &timeouts = host::state().timeouts;
+    timeouts.erase(std::remove(timeouts.begin(), timeouts.end(), this), timeouts.end());
+}
+
+void Timeout::attach(Callback<void()> func, std::chrono::microseconds t)
+{
+    _func = func;
+    _due_us = host::now_us() + t.count();
+}
+
+void Timeout::detach()
+{
+    _due_us = UINT64_MAX;
+}
+
+void Timeout::fire()
+{
+    // The callback may attach again
+    _due_us = UINT64_MAX;
+    if (_func) {
+        _func();
+    }
+}
+
+BufferedSerial::BufferedSerial(PinName tx, PinName rx, int baud) : _tx(tx)
+{
+    host::uart(_tx).baud = baud;
+}
+
+ssize_t BufferedSerial::read(void *buffer, size_t length)
+{
+    return host::uart(_tx).read(static_cast<uint8_t *>(buffer), length);
+}
+
+ssize_t BufferedSerial::write(const void *buffer, size_t length)
+{
+    host::uart(_tx).write(static_cast<const uint8_t *>(buffer), length);
+    return length;
+}
+
+bool BufferedSerial::readable() const
+{
+    return host::uart(_tx).available() > 0;
+}
+
+bool BufferedSerial::writable() const
+{
+    return true;
+}
+
+void BufferedSerial::set_baud(int baud)
+{
+    host::uart(_tx).baud = baud;
+}
+
+UnbufferedSerial::UnbufferedSerial(PinName tx, PinName rx, int baud) : _tx(tx)
+{
+    host::uart(_tx).baud = baud;
+    host::uart(_tx).set_rx_capacity(1);
+}
+
+ssize_t UnbufferedSerial::read(void *buffer, size_t length)
+{
+    return host::uart(_tx).read(static_cast<uint8_t *>(buffer), length);
+}
+
+ssize_t UnbufferedSerial::write(const void *buffer, size_t length)
+{
+    host::uart(_tx).write(static_cast<const uint8_t *>(buffer), length);
+    return length;
+}
+
+bool UnbufferedSerial::readable()
+{
+    return host::uart(_tx).available() > 0;
+}
+
+bool UnbufferedSerial::writable()
+{
+    return true;
+}
+
+void UnbufferedSerial::baud(int baudrate)
+{
+    host::uart(_tx).baud = baudrate;
+}
+
+void UnbufferedSerial::attach(Callback<void()> func, IrqType type)
+{
+    if (type == RxIrq) {
+        host::uart(_tx).attach_rx_irq(func);
+    }
+}
+
+} // namespace mbed
@@ -0,0 +1,594 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "mock_devices.h"
+
+namespace host {
+
+namespace {
+
+uint8_t si7021_crc(const uint8_t *data, int length)
+{
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x31) : static_cast<uint8_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint16_t to_code(double value)
+{
+    value = std::max(0.0, std::min(65535.0, value));
+    return static_cast<uint16_t>(value) & 0xFFFC;
+}
+
+std::string nmea(const std::string &body)
+{
+    uint8_t sum = 0;
+    for (char c : body) {
+        sum ^= static_cast<uint8_t>(c);
+    }
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", sum);
+    return "$" + body + tail;
+}
+
+std::string nmea_coordinate(double value, int degree_digits, char positive, char negative)
+{
+    double magnitude = std::fabs(value);
+    int degrees = static_cast<int>(magnitude);
+    double minutes = (magnitude - degrees) * 60.0;
+    char out[24];
+    snprintf(out, sizeof(out), "%0*d%07.4f,%c", degree_digits, degrees, minutes,
+             value < 0 ? negative : positive);
+    return out;
+}
+
+} // namespace
+
+MockSi7021::MockSi7021()
+    : temperature(21.5f), humidity(45.0f), conversions(0),
+      _result(0), _last_temp_code(0), _has_result(false), _ready_us(0)
+{
+}
+
+bool MockSi7021::write(const uint8_t *data, int length)
+{
+    if (length < 1) {
+        return true;
+    }
+
+    uint16_t t_code = to_code((temperature + 46.85) * 65536.0 / 175.72);
+    switch (data[0]) {
+        case 0xE5: // measure RH, hold master
+        case 0xF5: // measure RH, no hold master
+            _result = to_code((humidity + 6.0) * 65536.0 / 125.0);
+            _last_temp_code = t_code;
+            _ready_us = now_us() + RH_CONVERSION_US;
+            conversions++;
+            break;
+        case 0xE3: // measure temperature, hold master
+        case 0xF3: // measure temperature, no hold master
+            _result = t_code;
+            _last_temp_code = t_code;
+            _ready_us = now_us() + T_CONVERSION_US;
+            conversions++;
+            break;
+        case 0xE0: // temperature of the previous RH measurement
+            _result = _last_temp_code;
+            _ready_us = now_us();
+            break;
+        case 0xFE: // reset
+            _has_result = false;
+            return true;
+        default:
+            return true;
+    }
+
+    // Hold master commands stretch the clock instead of NACKing
+    if (data[0] == 0xE5 || data[0] == 0xE3) {
+        advance_us(_ready_us - now_us());
+    }
+    _has_result = true;
+    return true;
+}
+
+bool MockSi7021::read(uint8_t *data, int length)
+{
+    if (!_has_result || now_us() < _ready_us) {
+        return false;
+    }
+
+    uint8_t frame[3] = { static_cast<uint8_t>(_result >> 8), static_cast<uint8_t>(_result), 0 };
+    frame[2] = si7021_crc(frame, 2);
+    for (int i = 0; i < length; i++) {
+        data[i] = i < 3 ? frame[i] : 0xFF;
+    }
+    return true;
+}
+
+MockTcs34725::MockTcs34725()
+    : clear(1200), red(420), green(510), blue(330), integrations_started(0),
+      _pointer(0), _integration_start_us(0)
+{
+    std::fill(_regs, _regs + sizeof(_regs), 0);
+    _regs[0x01] = 0xFF; // ATIME
+    _regs[0x12] = 0x44; // ID
+}
+
+void MockTcs34725::update()
+{
+    const uint8_t enable = _regs[0x00];
+    if ((enable & 0x03) != 0x03) {
+        return;
+    }
+
+    uint64_t integration_us = (256 - _regs[0x01]) * 2400ULL;
+    uint64_t elapsed = now_us() - _integration_start_us;
+    double fraction = std::min(1.0, static_cast<double>(elapsed) / integration_us);
+    uint16_t counts[4] = { clear, red, green, blue };
+    for (int i = 0; i < 4; i++) {
+        uint16_t value = static_cast<uint16_t>(counts[i] * fraction);
+        _regs[0x14 + 2 * i] = static_cast<uint8_t>(value);
+        _regs[0x15 + 2 * i] = static_cast<uint8_t>(value >> 8);
+    }
+    if (elapsed >= integration_us) {
+        _regs[0x13] |= 0x01; // AVALID
+    }
+}
+
+bool MockTcs34725::write(const uint8_t *data, int length)
+{
+    if (length < 1 || !(data[0] & 0x80)) {
+        return false;
+    }
+    _pointer = data[0] & 0x1F;
+
+    for (int i = 1; i < length; i++) {
+        uint8_t reg = _pointer++ & 0x1F;
+        if (reg == 0x00) {
+            bool was_running = (_regs[0x00] & 0x03) == 0x03;
+            bool powering_up = !(_regs[0x00] & 0x01) && (data[i] & 0x01);
+            _regs[0x00] = data[i];
+            if (!was_running && (data[i] & 0x03) == 0x03) {
+                // Integration restarts, after the 2.4 ms warm-up when powering up
+                _integration_start_us = now_us() + (powering_up ? 2400 : 0);
+                _regs[0x13] &= ~0x01;
+                integrations_started++;
+            }
+        } else if (reg < 0x12) {
+            _regs[reg] = data[i];
+        }
+    }
+    return true;
+}
+
+bool MockTcs34725::read(uint8_t *data, int length)
+{
+    update();
+    for (int i = 0; i < length; i++) {
+        data[i] = _regs[_pointer++ & 0x1F];
+    }
+    return true;
+}
+
+MockMma8451::MockMma8451(PinName int1)
+    : g{0.0f, 0.0f, 1.0f}, samples_read(0), _pointer(0), _int1(int1), _asserted(false),
+      _events(0),
+      _overflow(false), _origin_us(0), _consumed(0), _status_produced(0), _sample_byte(0)
+{
+    std::fill(_regs, _regs + sizeof(_regs), 0);
+    std::fill(_event_status, _event_status + 8, 0);
+    _regs[0x0D] = 0x1A; // WHO_AM_I
+    if (_int1 != NC) {
+        drive_pin(_int1, 1);
+        add_irq_source(this);
+    }
+}
+
+uint64_t MockMma8451::periodUs() const
+{
+    static const uint64_t periods[8] = { 1250, 2500, 5000, 10000, 20000, 80000, 160000, 640000 };
+    return periods[(_regs[0x2A] >> 3) & 0x07];
+}
+
+void MockMma8451::restartSampling()
+{
+    _origin_us = now_us();
+    _consumed = 0;
+    _status_produced = 0;
+    _overflow = false;
+    _sample_byte = 0;
+}
+
+uint32_t MockMma8451::fifoCount()
+{
+    if (!(_regs[0x2A] & 0x01) || !(_regs[0x09] & 0xC0)) {
+        return 0;
+    }
+    uint64_t produced = (now_us() - _origin_us) / periodUs();
+    if (produced - _consumed > 32) {
+        // Circular buffer mode: the oldest samples are overwritten
+        _overflow = true;
+        _consumed = produced - 32;
+    }
+    return static_cast<uint32_t>(produced - _consumed);
+}
+
+void MockMma8451::latch(uint8_t *out)
+{
+    const int counts_per_g = 4096 >> (_regs[0x0E] & 0x03);
+    for (int axis = 0; axis < 3; axis++) {
+        int value = static_cast<int>(std::lround(g[axis] * counts_per_g));
+        value = std::max(-8192, std::min(8191, value));
+        uint16_t left = static_cast<uint16_t>(value << 2);
+        out[2 * axis] = static_cast<uint8_t>(left >> 8);
+        out[2 * axis + 1] = static_cast<uint8_t>(left);
+    }
+}
+
+bool MockMma8451::fifoInterruptPending()
+{
+    uint8_t watermark = _regs[0x09] & 0x3F;
+    return (_regs[0x2D] & 0x40) && ((watermark && fifoCount() >= watermark) || _overflow);
+}
+
+void MockMma8451::updatePin()
+{
+    if (_int1 != NC) {
+        const bool events = _events & _regs[0x2D] & _regs[0x2E];
+        drive_pin(_int1, (_asserted || events) ? 0 : 1);
+    }
+}
+
+void MockMma8451::raise_event(uint8_t source, uint8_t status)
+{
+    for (int bit = 0; bit < 8; bit++) {
+        if (source & (1 << bit)) {
+            _event_status[bit] = status;
+        }
+    }
+    _events |= source;
+    updatePin();
+}
+
+uint64_t MockMma8451::next_irq_us()
+{
+    uint8_t watermark = _regs[0x09] & 0x3F;
+    if (_int1 == NC || _asserted || !(_regs[0x2A] & 0x01) || !(_regs[0x09] & 0xC0)
+            || !(_regs[0x2D] & 0x40) || !(_regs[0x2E] & 0x40) || !watermark) {
+        return UINT64_MAX;
+    }
+    fifoCount();
+    // After F_STATUS was read the flag can only be set again by a new sample
+    uint64_t sample = std::max(_consumed + watermark, _status_produced + 1);
+    return std::max(now_us(), _origin_us + sample * periodUs());
+}
+
+void MockMma8451::fire()
+{
+    _asserted = true;
+    updatePin();
+}
+
+uint8_t MockMma8451::readRegister(uint8_t reg)
+{
+    const bool fifo_mode = _regs[0x09] & 0xC0;
+
+    if (reg == 0x00 && fifo_mode) {
+        // F_STATUS, reading it clears the FIFO interrupt
+        uint32_t count = fifoCount();
+        uint8_t watermark = _regs[0x09] & 0x3F;
+        uint8_t status = static_cast<uint8_t>((_overflow ? 0x80 : 0)
+                                              | (watermark && count >= watermark ? 0x40 : 0) | count);
+        _overflow = false;
+        _asserted = false;
+        _status_produced = _consumed + count;
+        updatePin();
+        return status;
+    }
+    if (reg >= 0x01 && reg <= 0x06) {
+        if (!fifo_mode) {
+            uint8_t now[6];
+            latch(now);
+            return (_regs[0x2A] & 0x01) ? now[reg - 1] : 0;
+        }
+        if (_sample_byte == 0) {
+            if (fifoCount() > 0) {
+                latch(_sample);
+                _consumed++;
+                samples_read++;
+            } else {
+                std::fill(_sample, _sample + 6, 0);
+            }
+        }
+        uint8_t value = _sample[_sample_byte];
+        _sample_byte = (_sample_byte + 1) % 6;
+        return value;
+    }
+    if (reg == 0x0C) {
+        // SRC_FIFO stays latched until F_STATUS is read
+        return ((_asserted || fifoInterruptPending()) ? 0x40 : 0x00) | _events;
+    }
+    // Reading an event source register clears its INT_SOURCE bit
+    static const struct { uint8_t reg; uint8_t bit; } event_regs[] = {
+        { 0x1E, 5 }, // TRANSIENT_SRC
+        { 0x10, 4 }, // PL_STATUS
+        { 0x16, 2 }, // FF_MT_SRC
+    };
+    for (const auto &e : event_regs) {
+        if (reg == e.reg && (_events & (1 << e.bit))) {
+            _events &= ~(1 << e.bit);
+            updatePin();
+            return _event_status[e.bit];
+        }
+    }
+    return reg < sizeof(_regs) ? _regs[reg] : 0;
+}
+
+void MockMma8451::writeRegister(uint8_t reg, uint8_t value)
+{
+    if (reg >= sizeof(_regs) || reg == 0x0D) {
+        return;
+    }
+    bool activating = !(_regs[0x2A] & 0x01) && (value & 0x01);
+    _regs[reg] = value;
+    if ((reg == 0x2A && activating) || reg == 0x09) {
+        restartSampling();
+    }
+}
+
+bool MockMma8451::write(const uint8_t *data, int length)
+{
+    if (length < 1) {
+        return true;
+    }
+    _pointer = data[0];
+    _sample_byte = 0;
+    for (int i = 1; i < length; i++) {
+        writeRegister(_pointer++, data[i]);
+    }
+    return true;
+}
+
+bool MockMma8451::read(uint8_t *data, int length)
+{
+    const bool fifo_mode = _regs[0x09] & 0xC0;
+    uint8_t snapshot[6];
+    latch(snapshot);
+
+    for (int i = 0; i < length; i++) {
+        uint8_t reg = _pointer;
+        if (!fifo_mode && reg >= 0x01 && reg <= 0x06) {
+            // Outside FIFO mode a burst returns one consistent sample
+            data[i] = (_regs[0x2A] & 0x01) ? snapshot[reg - 1] : 0;
+        } else {
+            data[i] = readRegister(reg);
+        }
+        // In FIFO mode the pointer wraps from OUT_Z_LSB back to OUT_X_MSB
+        _pointer = (fifo_mode && reg == 0x06) ? 0x01 : reg + 1;
+    }
+    return true;
+}
+
+MockNmeaGps::MockNmeaGps(PinName enable)
+    : latitude(40.405), longitude(-3.839), altitude(655.0f), satellites(8), fix(true),
+      accepts_baud_change(true), sentences(0), commands(0), baud(9600), hot_ttff_ms(1500),
+      cold_ttff_ms(32000), power_ups(0), _delivered(0), _burst_start_us(0),
+      _next_burst_us(0), _interval_ms(1000), _utc_ms(12 * 3600 * 1000), _enable(enable),
+      _powered(true), _power_change_us(0), _fix_at_us(0), _on_us(0)
+{
+    // MTK default: GLL off, RMC, VTG, GGA, GSA and GSV on
+    std::fill(_output, _output + 19, false);
+    for (int i = 1; i <= 5; i++) {
+        _output[i] = true;
+    }
+}
+
+bool MockNmeaGps::powered()
+{
+    const bool on = _enable == NC || pin_level(_enable) != 0; // enable has a pull-up
+    if (on != _powered) {
+        const uint64_t at = pin_changed_us(_enable);
+        if (on) {
+            const uint64_t off_us = at - _power_change_us;
+            const uint64_t ttff_ms = off_us < 2 * 3600 * 1000000ULL ? hot_ttff_ms : cold_ttff_ms;
+            _fix_at_us = at + ttff_ms * 1000;
+            _next_burst_us = at + _interval_ms * 1000ULL;
+            power_ups++;
+        } else {
+            _on_us += at - _power_change_us;
+            _pending.clear();
+            _delivered = 0;
+        }
+        _powered = on;
+        _power_change_us = at;
+    }
+    return _powered;
+}
+
+uint64_t MockNmeaGps::on_time_us()
+{
+    const bool on = powered();
+    return _on_us + (on ? now_us() - _power_change_us : 0);
+}
+
+std::string MockNmeaGps::burst()
+{
+    const uint32_t seconds = _utc_ms / 1000;
+    char time[16];
+    snprintf(time, sizeof(time), "%02u%02u%02u.%03u", (seconds / 3600) % 24, (seconds / 60) % 60,
+             seconds % 60, _utc_ms % 1000);
+    const bool fix = this->fix && _next_burst_us >= _fix_at_us;
+    const std::string lat = fix ? nmea_coordinate(latitude, 2, 'N', 'S') : ",";
+    const std::string lon = fix ? nmea_coordinate(longitude, 3, 'E', 'W') : ",";
+    char buf[160];
+    std::string out;
+    uint32_t count = 0;
+
+    if (_output[3]) {
+        snprintf(buf, sizeof(buf), "GPGGA,%s,%s,%s,%d,%02d,0.9,%.1f,M,46.9,M,,", time, lat.c_str(),
+                 lon.c_str(), fix ? 1 : 0, fix ? satellites : 0, altitude);
+        out += nmea(buf);
+        count++;
+    }
+    if (_output[4]) {
+        snprintf(buf, sizeof(buf), "GPGSA,A,%d,04,05,09,12,18,21,24,25,,,,,2.5,1.3,2.1", fix ? 3 : 1);
+        out += nmea(buf);
+        count++;
+    }
+    if (_output[5]) {
+        out += nmea("GPGSV,3,1,11,04,15,270,38,05,40,083,41,09,26,160,35,12,61,293,44");
+        out += nmea("GPGSV,3,2,11,18,05,041,30,21,12,212,33,24,33,315,40,25,71,102,45");
+        out += nmea("GPGSV,3,3,11,26,03,168,,29,08,357,,31,02,011,");
+        count += 3;
+    }
+    if (_output[1]) {
+        snprintf(buf, sizeof(buf), "GPRMC,%s,%c,%s,%s,0.02,31.66,170926,,,A", time, fix ? 'A' : 'V',
+                 lat.c_str(), lon.c_str());
+        out += nmea(buf);
+        count++;
+    }
+    if (_output[2]) {
+        out += nmea("GPVTG,31.66,T,,M,0.02,N,0.04,K,A");
+        count++;
+    }
+    sentences += count;
+    _utc_ms += _interval_ms;
+    return out;
+}
+
+uint64_t MockNmeaGps::next_byte_us(const MockUart &uart)
+{
+    // Byte n of a burst is complete n * 10 bit times after the burst started
+    const uint64_t bit_scale = 10 * 1000000ULL;
+    if (!powered()) {
+        return UINT64_MAX;
+    }
+    if (_delivered < _pending.size()) {
+        return _burst_start_us + ((_delivered + 1) * bit_scale + baud - 1) / baud;
+    }
+    return _next_burst_us + (bit_scale + baud - 1) / baud;
+}
+
+void MockNmeaGps::pump(MockUart &uart, uint64_t now_us)
+{
+    if (!powered()) {
+        return;
+    }
+    while (true) {
+        if (_delivered == _pending.size()) {
+            if (now_us < _next_burst_us) {
+                return;
+            }
+            _pending = burst();
+            _delivered = 0;
+            _burst_start_us = _next_burst_us;
+            _next_burst_us += _interval_ms * 1000ULL;
+        }
+
+        uint64_t on_wire = (now_us - _burst_start_us) * baud / 10 / 1000000;
+        size_t due = std::min<size_t>(_pending.size(), on_wire);
+        for (; _delivered < due; _delivered++) {
+            uint8_t byte = static_cast<uint8_t>(_pending[_delivered]);
+            if (uart.baud != baud) {
+                byte = static_cast<uint8_t>(~byte); // framing errors, nothing valid gets through
+            }
+            uart.inject(&byte, 1);
+        }
+        if (_delivered < _pending.size()) {
+            return;
+        }
+    }
+}
+
+void MockNmeaGps::reply(MockUart &uart, const std::string &sentence)
+{
+    pump(uart, now_us());
+    if (_delivered == _pending.size()) {
+        // Line idle: the reply goes out right away
+        _pending.clear();
+        _delivered = 0;
+        _burst_start_us = now_us();
+    }
+    _pending += sentence;
+}
+
+void MockNmeaGps::transmit(MockUart &uart, const uint8_t *data, size_t length)
+{
+    if (!powered()) {
+        return;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char c = static_cast<char>(data[i]);
+        if (c == '$') {
+            _rx_line.clear();
+        }
+        _rx_line += c;
+        if (c != '\n') {
+            continue;
+        }
+        // Only commands sent at the module's baud rate with a valid checksum count
+        size_t star = _rx_line.find('*');
+        if (uart.baud == baud && _rx_line[0] == '$' && star != std::string::npos
+                && nmea(_rx_line.substr(1, star - 1)) == _rx_line) {
+            command(uart, _rx_line.substr(1, star - 1));
+        }
+        _rx_line.clear();
+    }
+}
+
+void MockNmeaGps::command(MockUart &uart, const std::string &body)
+{
+    commands++;
+    int type = 0;
+    if (sscanf(body.c_str(), "PMTK%d", &type) != 1) {
+        return;
+    }
+    const char *args = strchr(body.c_str(), ',');
+    int flag = 3;
+
+    if (type == 314 && args) {
+        for (int i = 0; i < 19; i++) {
+            _output[i] = false;
+        }
+        int index = 0;
+        for (const char *p = args; *p && index < 19; p++) {
+            if (*p == ',') {
+                _output[index] = p[1] != '0';
+                index++;
+            }
+        }
+    } else if (type == 220 && args) {
+        int interval = atoi(args + 1);
+        if (interval >= 100 && interval <= 10000) {
+            _interval_ms = interval;
+        } else {
+            flag = 2;
+        }
+    } else if (type == 251 && args) {
+        // No acknowledge, the module switches right away
+        int rate = atoi(args + 1);
+        if (accepts_baud_change && rate >= 4800 && rate <= 115200) {
+            pump(uart, now_us());
+            _pending.erase(0, _delivered);
+            _delivered = 0;
+            _burst_start_us = now_us();
+            baud = rate;
+        }
+        return;
+    } else {
+        flag = 1;
+    }
+
+    char ack[32];
+    snprintf(ack, sizeof(ack), "PMTK001,%d,%d", type, flag);
+    reply(uart, nmea(ack));
+}
+
+} // namespace host
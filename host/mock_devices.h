@@ -0,0 +1,183 @@
+#ifndef APP_HOST_MOCK_DEVICES_H_
+#define APP_HOST_MOCK_DEVICES_H_
+
+#include <string>
+
+#include "mock_hal.h"
+
+namespace host {
+
+/**
+ * Si7021 humidity/temperature sensor (7-bit address 0x40).
+ *
+ * Models the no-hold measurement commands: reading before the
+ * conversion has finished is NACKed, as on the real part.
+ */
+class MockSi7021 : public MockI2CDevice {
+public:
+    static const uint8_t ADDRESS = 0x40;
+    static const uint32_t RH_CONVERSION_US = 17000; // RH including temperature, typical
+    static const uint32_t T_CONVERSION_US = 7000;
+
+    MockSi7021();
+
+    bool write(const uint8_t *data, int length) override;
+    bool read(uint8_t *data, int length) override;
+
+    float temperature;  // degree Celsius
+    float humidity;     // percent
+    uint32_t conversions;
+
+private:
+    uint16_t _result;
+    uint16_t _last_temp_code;
+    bool _has_result;
+    uint64_t _ready_us;
+};
+
+/**
+ * TCS34725 colour sensor (7-bit address 0x29).
+ *
+ * Integration restarts whenever AEN goes from 0 to 1. Until the first
+ * integration completes AVALID is clear and the data registers only
+ * hold the fraction of the counts integrated so far.
+ */
+class MockTcs34725 : public MockI2CDevice {
+public:
+    static const uint8_t ADDRESS = 0x29;
+
+    MockTcs34725();
+
+    bool write(const uint8_t *data, int length) override;
+    bool read(uint8_t *data, int length) override;
+
+    uint16_t clear, red, green, blue; // counts of a complete integration
+    uint32_t integrations_started;
+
+private:
+    void update();
+
+    uint8_t _regs[0x20];
+    uint8_t _pointer;
+    uint64_t _integration_start_us;
+};
+
+/**
+ * MMA8451Q accelerometer (7-bit address 0x1D), register map with
+ * auto-incrementing reads.
+ *
+ * Samples are produced at the configured ODR while ACTIVE is set. With
+ * F_MODE set they go into the 32-sample FIFO, the watermark interrupt
+ * pulls int1 low (active low, INT1 routing only) until F_STATUS is read.
+ * The transient, freefall/motion and orientation engines are not
+ * simulated, raise_event() latches their output instead.
+ */
+class MockMma8451 : public MockI2CDevice, public IrqSource {
+public:
+    static const uint8_t ADDRESS = 0x1D;
+
+    explicit MockMma8451(PinName int1 = NC);
+
+    bool write(const uint8_t *data, int length) override;
+    bool read(uint8_t *data, int length) override;
+    uint64_t next_irq_us() override;
+    void fire() override;
+
+    /**
+     * Latches an embedded-function event: source is its INT_SOURCE bit
+     * (0x20 transient, 0x10 orientation, 0x04 freefall/motion), status
+     * the value of its source register, which clears it when read.
+     */
+    void raise_event(uint8_t source, uint8_t status);
+
+    float g[3]; // acceleration in g for X, Y, Z
+    uint32_t samples_read;
+
+private:
+    uint8_t readRegister(uint8_t reg);
+    void writeRegister(uint8_t reg, uint8_t value);
+    void restartSampling();
+    uint64_t periodUs() const;
+    uint32_t fifoCount();
+    void latch(uint8_t *out);
+    bool fifoInterruptPending();
+    void updatePin();
+
+    uint8_t _regs[0x32];
+    uint8_t _pointer;
+    PinName _int1;
+    bool _asserted;
+    uint8_t _events;
+    uint8_t _event_status[8];
+    bool _overflow;
+    uint64_t _origin_us;
+    uint64_t _consumed;
+    uint64_t _status_produced;
+    uint8_t _sample[6];
+    int _sample_byte;
+};
+
+/**
+ * MTK GPS module on a mock UART, emitting the default sentence set (GGA,
+ * GSA, 3x GSV, RMC, VTG) once per update interval at the line rate.
+ *
+ * Understands PMTK314 (sentence selection), PMTK220 (update interval) and
+ * PMTK251 (baud rate), and acknowledges commands with PMTK001. While the
+ * UART and the module disagree on the baud rate the MCU only receives
+ * garbage.
+ *
+ * With an enable pin the module is silent while the pin is low. After
+ * power-up it reports no fix until the time to first fix has passed: a
+ * hot start if it was off for less than two hours (ephemeris kept by the
+ * backup supply), a cold start otherwise. Power-up at boot is hot.
+ */
+class MockNmeaGps : public MockUartSource {
+public:
+    explicit MockNmeaGps(PinName enable = NC);
+
+    void pump(MockUart &uart, uint64_t now_us) override;
+    void transmit(MockUart &uart, const uint8_t *data, size_t length) override;
+    uint64_t next_byte_us(const MockUart &uart) override;
+
+    /** Output of one update interval, advances the UTC time */
+    std::string burst();
+
+    double latitude;   // decimal degrees, negative for south
+    double longitude;  // decimal degrees, negative for west
+    float altitude;    // metres
+    int satellites;
+    bool fix;
+    bool accepts_baud_change; // false models a module that ignores PMTK251
+    uint32_t sentences;
+    uint32_t commands;
+    int baud;          // the module's side of the link
+    uint32_t hot_ttff_ms;
+    uint32_t cold_ttff_ms;
+    uint32_t power_ups;
+
+    /** Total powered time so far */
+    uint64_t on_time_us();
+
+private:
+    bool powered();
+    void command(MockUart &uart, const std::string &body);
+    void reply(MockUart &uart, const std::string &sentence);
+
+    std::string _pending;
+    std::string _rx_line;
+    size_t _delivered;
+    uint64_t _burst_start_us;
+    uint64_t _next_burst_us;
+    uint32_t _interval_ms;
+    uint32_t _utc_ms;
+    bool _output[19];
+    PinName _enable;
+    bool _powered;
+    uint64_t _power_change_us;
+    uint64_t _fix_at_us;
+    uint64_t _on_us;  // PMTK314 order: GLL, RMC, VTG, GGA, GSA, GSV, ...
+};
+
+} // namespace host
+
+#endif /* APP_HOST_MOCK_DEVICES_H_ */
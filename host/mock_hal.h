@@ -0,0 +1,137 @@
+#ifndef APP_HOST_MOCK_HAL_H_
+#define APP_HOST_MOCK_HAL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "mbed.h"
+
+namespace host {
+
+/**
+ * A device on the mock I2C bus. Returning false from write() or read()
+ * makes the transaction fail with a NACK.
+ */
+class MockI2CDevice {
+public:
+    virtual ~MockI2CDevice() {}
+    virtual bool write(const uint8_t *data, int length) = 0;
+    virtual bool read(uint8_t *data, int length) = 0;
+};
+
+/**
+ * Per-device transaction counters. bus_us is the modelled time on the
+ * wire at the configured bus frequency, wall_ns the host time spent in
+ * the driver call including the mock device model.
+ */
+struct I2CStats {
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t nacks;
+    uint64_t bus_us;
+    uint64_t wall_ns;
+};
+
+/** Places a device on the bus under its 7-bit address */
+void attach_i2c(uint8_t address, MockI2CDevice *device);
+
+/** Transaction counters of every address seen since the last reset */
+const std::map<uint8_t, I2CStats> &i2c_stats();
+
+/** Time spent in ThisThread::sleep_for() since the last reset */
+uint64_t sleep_us();
+
+void reset_stats();
+
+/** Sets the 16-bit sample source of an analog pin */
+void set_adc(PinName pin, std::function<uint16_t()> source);
+
+/** Current level of a DigitalOut pin, -1 if it was never written */
+int pin_level(PinName pin);
+
+/** Virtual time of the last level change of a pin, 0 if it never changed */
+uint64_t pin_changed_us(PinName pin);
+
+/** Drives an input pin, calling InterruptIn handlers on edges */
+void drive_pin(PinName pin, int level);
+
+/**
+ * Something that raises interrupts on its own, like a sensor's INT pin.
+ * Whenever virtual time advances past next_irq_us(), fire() is called at
+ * that point in time.
+ */
+class IrqSource {
+public:
+    virtual ~IrqSource() {}
+    virtual uint64_t next_irq_us() = 0;
+    virtual void fire() = 0;
+};
+
+void add_irq_source(IrqSource *source);
+
+class MockUart;
+
+/**
+ * Produces the RX side of a mock UART. pump() is called with the current
+ * virtual time whenever the driver polls the port and should inject
+ * every byte that would have arrived on the wire by then.
+ */
+class MockUartSource {
+public:
+    virtual ~MockUartSource() {}
+    virtual void pump(MockUart &uart, uint64_t now_us) = 0;
+    virtual void transmit(MockUart &uart, const uint8_t *data, size_t length)
+    {
+    }
+
+    /** When the next byte is complete on the wire, for RX interrupts */
+    virtual uint64_t next_byte_us(const MockUart &uart)
+    {
+        return UINT64_MAX;
+    }
+};
+
+/**
+ * Mock UART with the bounded RX FIFO of BufferedSerial: bytes arriving
+ * while the FIFO is full are dropped and counted as overruns. With an RX
+ * interrupt handler attached the handler is called for every byte as it
+ * arrives, in virtual time.
+ */
+class MockUart : public IrqSource {
+public:
+    explicit MockUart(size_t rx_capacity = 256);
+
+    void attach(MockUartSource *source);
+    void attach_rx_irq(mbed::Callback<void()> handler);
+    void set_rx_capacity(size_t capacity);
+    void inject(const uint8_t *data, size_t length);
+    size_t available();
+    size_t read(uint8_t *data, size_t length);
+    void write(const uint8_t *data, size_t length);
+
+    uint64_t next_irq_us() override;
+    void fire() override;
+
+    int baud;
+    uint32_t overruns;
+    uint32_t received;
+    std::string tx_log;
+
+private:
+    size_t _capacity;
+    std::deque<uint8_t> _rx;
+    MockUartSource *_source;
+    mbed::Callback<void()> _rx_irq;
+    bool _irq_registered;
+};
+
+/** UART behind the serial port whose TX pin is tx */
+MockUart &uart(PinName tx);
+
+} // namespace host
+
+#endif /* APP_HOST_MOCK_HAL_H_ */
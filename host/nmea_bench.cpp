@@ -0,0 +1,89 @@
+/*
+ * Throughput benchmark for NmeaParser.
+ *
+ * Feeds the sentence mix of the mock GPS module (GGA, GSA, 3x GSV, RMC,
+ * VTG) through the parser in chunks of random size, as they would come
+ * out of the UART, and reports sentences and bytes per second of host
+ * time. Exits with an error if a sentence is lost or the parsed fix does
+ * not match what the mock encoded.
+ *
+ *   nmea-bench [--seconds N] [--chunk MAX]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "mock_devices.h"
+#include "nmea.h"
+
+int main(int argc, char **argv)
+{
+    int bursts = 3600; // one hour of GPS output per pass
+    int max_chunk = 64;
+    double seconds = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+            max_chunk = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--seconds N] [--chunk MAX]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (max_chunk < 1) {
+        max_chunk = 1;
+    }
+
+    host::MockNmeaGps gps;
+    std::string stream;
+    for (int i = 0; i < bursts; i++) {
+        stream += gps.burst();
+    }
+    const uint32_t per_pass = gps.sentences;
+
+    NmeaParser parser;
+    srand(1);
+    uint64_t passes = 0;
+    uint64_t sentences = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+
+    do {
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            size_t chunk = std::min<size_t>(stream.size() - pos, 1 + rand() % max_chunk);
+            sentences += parser.feed(stream.data() + pos, static_cast<int>(chunk));
+            pos += chunk;
+        }
+        passes++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < seconds);
+
+    const NmeaData &fix = parser.data();
+    const NmeaStats &stats = parser.stats();
+    printf("%llu sentences, %llu bytes in %.3f s: %.0f sentences/s, %.1f MB/s, %.1f ns/byte\n",
+           static_cast<unsigned long long>(sentences),
+           static_cast<unsigned long long>(passes * stream.size()), elapsed.count(),
+           sentences / elapsed.count(), passes * stream.size() / elapsed.count() / 1e6,
+           elapsed.count() * 1e9 / (passes * stream.size()));
+    printf("last fix: %ld.%06ld %ld.%06ld alt %ld cm, %u sats, %06lu\n",
+           static_cast<long>(fix.latitude / 1000000), labs(fix.latitude % 1000000),
+           static_cast<long>(fix.longitude / 1000000), labs(fix.longitude % 1000000),
+           static_cast<long>(fix.altitude), fix.satellites, static_cast<unsigned long>(fix.time));
+
+    bool ok = sentences == passes * per_pass && stats.checksumErrors == 0 && stats.malformed == 0
+              && stats.overlong == 0 && fix.latitude == 40405000 && fix.longitude == -3839000
+              && fix.altitude == 65500 && fix.satellites == 8 && fix.fixType == 3 && fix.status == 'A';
+    if (!ok) {
+        printf("FAIL: expected %llu sentences and the mock's fix (checksum %u, malformed %u, overlong %u)\n",
+               static_cast<unsigned long long>(passes * per_pass), stats.checksumErrors,
+               stats.malformed, stats.overlong);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Fuzz target for NmeaParser.
+ *
+ * With clang the target is built for libFuzzer (APP_LIBFUZZER). Otherwise
+ * main() below acts as a simple mutation driver: it corrupts valid mock
+ * GPS output with bit flips, dropped, duplicated and random bytes, and
+ * checks that the parser never accepts a sentence whose single-byte
+ * corruption the checksum must catch. Both report the sentence rate.
+ *
+ *   nmea-fuzz [--iterations N] [--seed S]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "nmea.h"
+
+namespace {
+
+/** Invariants that must hold for any input */
+void check(const NmeaParser &parser)
+{
+    const NmeaData &fix = parser.data();
+    if (fix.latitude < -181000000 || fix.latitude > 181000000
+            || fix.longitude < -181000000 || fix.longitude > 181000000) {
+        fprintf(stderr, "coordinate out of range: %ld %ld\n", static_cast<long>(fix.latitude),
+                static_cast<long>(fix.longitude));
+        abort();
+    }
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    NmeaParser parser;
+    for (size_t i = 0; i < size; i++) {
+        parser.feed(static_cast<char>(data[i]));
+        check(parser);
+    }
+    return 0;
+}
+
+#ifndef APP_LIBFUZZER
+
+#include "mock_devices.h"
+
+int main(int argc, char **argv)
+{
+    long iterations = 200000;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--iterations N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host::MockNmeaGps gps;
+    const std::string burst = gps.burst();
+    const uint32_t per_burst = gps.sentences;
+    srand(seed);
+
+    uint64_t sentences = 0;
+    uint64_t bytes = 0;
+    long false_accepts = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (long it = 0; it < iterations; it++) {
+        std::string input = burst;
+        int mutation = rand() % 5;
+        size_t pos = rand() % input.size();
+        bool single_byte_change = false;
+
+        switch (mutation) {
+            case 0: // one flipped bit
+                input[pos] ^= static_cast<char>(1 << (rand() % 8));
+                single_byte_change = true;
+                break;
+            case 1: // dropped byte
+                input.erase(pos, 1);
+                break;
+            case 2: // duplicated byte
+                input.insert(pos, 1, input[pos]);
+                break;
+            case 3: // random garbage
+                for (int n = rand() % 16; n >= 0 && pos < input.size(); n--, pos++) {
+                    input[pos] = static_cast<char>(rand());
+                }
+                break;
+            default: // truncated, then the whole burst again
+                input.resize(pos);
+                input += burst;
+                break;
+        }
+
+        NmeaParser parser;
+        int accepted = 0;
+        for (char c : input) {
+            if (parser.feed(c) != NMEA_NONE) {
+                accepted++;
+            }
+            check(parser);
+        }
+        sentences += accepted;
+        bytes += input.size();
+
+        // A flipped bit in a sentence body or checksum always changes the XOR. Only
+        // flips that turn the checksum into the other hex case keep the value.
+        if (single_byte_change && accepted == static_cast<int>(per_burst)) {
+            char before = burst[pos];
+            char after = input[pos];
+            bool hex_case = (before ^ after) == 0x20 && ((before | 0x20) >= 'a' && (before | 0x20) <= 'f');
+            bool outside = before == '\r' || before == '\n' || after == '\r' || after == '\n';
+            if (!hex_case && !outside) {
+                false_accepts++;
+                fprintf(stderr, "accepted corrupted burst at %zu: 0x%02x -> 0x%02x\n", pos,
+                        static_cast<uint8_t>(before), static_cast<uint8_t>(after));
+            }
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%ld inputs, %llu bytes, %llu sentences accepted in %.3f s: %.0f sentences/s\n",
+           iterations, static_cast<unsigned long long>(bytes),
+           static_cast<unsigned long long>(sentences), elapsed.count(),
+           sentences / elapsed.count());
+
+    if (false_accepts) {
+        printf("FAIL: %ld corrupted bursts passed the checksum\n", false_accepts);
+        return 1;
+    }
+    return 0;
+}
+
+#endif /* APP_LIBFUZZER */
@@ -0,0 +1,338 @@
+/*
+ * Compression benchmark for the uplink payload.
+ *
+ * Records a trace by running the real acquisition against the mock
+ * devices, with a synthetic day profile on the sensors (temperature and
+ * humidity following the sun, light and colour counts with clouds, slowly
+ * drying soil, the node at rest), or reads one from a CSV file with one
+ * sample per line: the time in seconds followed by the schema fields in
+ * schema steps (payload-decode --schema). Lines starting with # are
+ * skipped.
+ *
+ * The trace is then sent through PayloadPolicy at the EU868 payload sizes
+ * 51 and 222 bytes, as keyframes only, as deadband batch frames and with
+ * lossless history frames, and the history frames are decoded and checked
+ * bit-exact against the trace. Reported are bytes per sample, the ratio to
+ * keyframes and the encode time per sample (TSC cycles on x86, ns
+ * otherwise). The synthetic profile is smooth by construction, real
+ * traces compress less.
+ *
+ *   payload-bench [--samples N] [--interval-s S] [--trace FILE] [--dump]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "mbed.h"
+#include "mock_devices.h"
+#include "payload_history.h"
+#include "payload_policy.h"
+#include "sensors.h"
+
+namespace {
+
+struct TraceSample {
+    uint32_t timestamp; // ms
+    PayloadValues values;
+};
+
+/** Time stamp for the encode loop, cycles where the CPU has a TSC */
+uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+const char *const TICK_UNIT = "cycles";
+#else
+const char *const TICK_UNIT = "ns";
+#endif
+
+double noise()
+{
+    return (rand() % 1001 - 500) / 1000.0;
+}
+
+std::vector<TraceSample> record(int samples, int interval_s)
+{
+    host::MockSi7021 si7021;
+    host::MockTcs34725 tcs34725;
+    host::MockMma8451 mma8451(MBED_CONF_APP_ACCEL_INT1_PIN);
+    host::MockNmeaGps gps_module(PA_12);
+    host::attach_i2c(host::MockSi7021::ADDRESS, &si7021);
+    host::attach_i2c(host::MockTcs34725::ADDRESS, &tcs34725);
+    host::attach_i2c(host::MockMma8451::ADDRESS, &mma8451);
+    host::uart(PA_9).attach(&gps_module);
+
+    srand(1);
+    double sun = 0;
+    double soil = 42000;
+    host::set_adc(A0, [&] { return static_cast<uint16_t>(soil + rand() % 64); });
+    host::set_adc(A2, [&] { return static_cast<uint16_t>(2000 + sun * 50000 + rand() % 64); });
+
+    // The acquisition prints every sample, keep that out of the report
+    fflush(stdout);
+    const int console = dup(STDOUT_FILENO);
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    EventQueue queue;
+    init_sensors(queue);
+    std::vector<TraceSample> trace;
+    double clouds = 1;
+    for (int n = 0; n < samples; n++) {
+        queue.dispatch_for(std::chrono::seconds(interval_s));
+
+        const double hours = fmod(static_cast<double>(host::now_us()) / 3.6e9 + 6, 24);
+        clouds += 0.05 * noise();
+        clouds = clouds < 0.3 ? 0.3 : clouds > 1 ? 1 : clouds;
+        sun = hours > 6 && hours < 20 ? sin((hours - 6) / 14 * M_PI) * clouds : 0;
+        soil -= 0.5 + noise();
+        si7021.temperature = static_cast<float>(12 + 8 * sin((hours - 9) / 24 * 2 * M_PI) + 0.05 * noise());
+        si7021.humidity = static_cast<float>(70 - 20 * sun + 0.3 * noise());
+        tcs34725.clear = static_cast<uint16_t>(50 + 30000 * sun + 20 * noise());
+        tcs34725.red = static_cast<uint16_t>(20 + 9000 * sun + 10 * noise());
+        tcs34725.green = static_cast<uint16_t>(20 + 11000 * sun + 10 * noise());
+        tcs34725.blue = static_cast<uint16_t>(20 + 8000 * sun + 10 * noise());
+
+        bool done = false;
+        start_sensor_acquisition(queue, [&] { done = true; });
+        for (int ms = 0; !done && ms < 1000; ms++) {
+            queue.dispatch_for(std::chrono::milliseconds(1));
+        }
+        trace.push_back({static_cast<uint32_t>(host::now_us() / 1000), mySensor_data});
+    }
+
+    fflush(stdout);
+    dup2(console, STDOUT_FILENO);
+    close(null);
+    close(console);
+    return trace;
+}
+
+bool load(const char *path, std::vector<TraceSample> &trace)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[512];
+    int number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        TraceSample sample = {};
+        char *p = line;
+        double seconds = strtod(p, &p);
+        sample.timestamp = static_cast<uint32_t>(seconds * 1000);
+        for (const PayloadField &field : payload_schema) {
+            if (*p != ',') {
+                fprintf(stderr, "%s:%d: expected %d fields after the time\n", path, number, PAYLOAD_FIELD_COUNT);
+                fclose(file);
+                return false;
+            }
+            sample.values.field[field.id] = static_cast<int32_t>(strtol(p + 1, &p, 10));
+        }
+        trace.push_back(sample);
+    }
+    fclose(file);
+    return true;
+}
+
+/** Values as the encoder sends them, clamped to the schema range */
+PayloadValues clamped(const PayloadValues &values)
+{
+    PayloadValues out = values;
+    for (const PayloadField &field : payload_schema) {
+        int32_t &value = out.field[field.id];
+        value = value < field.min ? field.min : value > field.max ? field.max : value;
+    }
+    return out;
+}
+
+struct Result {
+    size_t frames;
+    size_t bytes;
+    size_t historyFrames;
+    bool exact;
+};
+
+/**
+ * Sends the whole trace, a frame every uplink_s seconds with all samples
+ * taken so far, and checks history frames against the trace.
+ */
+Result send(const std::vector<TraceSample> &trace, size_t max_len, bool history, int uplink_s)
+{
+    std::vector<PayloadSample> storage(trace.size() + 1);
+    PayloadBatch batch(storage.data(), static_cast<uint16_t>(storage.size()));
+    PayloadPolicy policy(MBED_CONF_APP_PAYLOAD_KEYFRAME_INTERVAL, history);
+    Result result = {0, 0, 0, true};
+    PayloadValues server = {};
+
+    size_t next = 0;
+    uint32_t now = trace.front().timestamp;
+    while (next < trace.size() || !batch.empty()) {
+        now += static_cast<uint32_t>(uplink_s) * 1000;
+        while (next < trace.size() && static_cast<int32_t>(now - trace[next].timestamp) >= 0) {
+            batch.push(trace[next].timestamp, trace[next].values);
+            next++;
+        }
+        while (!batch.empty()) {
+            uint8_t frame[256];
+            size_t length = policy.encode(batch, now, frame, max_len);
+            if (!length) {
+                result.exact = false;
+                return result;
+            }
+            if (frame[0] & PAYLOAD_HEADER_HISTORY) {
+                PayloadDecodedSample decoded[PAYLOAD_BATCH_MAX_SAMPLES];
+                int count = payload_decode_history(frame, length, server, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+                result.exact = result.exact && count == policy.lastSamples();
+                for (int i = 0; result.exact && i < count; i++) {
+                    PayloadValues expected = clamped(batch.at(static_cast<uint16_t>(i)).values);
+                    result.exact = memcmp(&decoded[i].values, &expected, sizeof(expected)) == 0;
+                }
+                result.historyFrames++;
+            } else if (frame[0] & PAYLOAD_HEADER_BATCH) {
+                PayloadDecodedSample decoded[PAYLOAD_BATCH_MAX_SAMPLES];
+                payload_decode_batch(frame, length, server, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+            } else {
+                payload_decode(frame, length, server);
+            }
+            policy.commit();
+            batch.dropThrough(policy.lastSequence());
+            result.frames++;
+            result.bytes += length;
+            // A single frame per uplink while the samples keep up, a backlog drains completely
+            if (next < trace.size()) {
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+/** Encode cost of a history delta frame from the start of the trace, per sample */
+double encode_ticks(const std::vector<TraceSample> &trace, size_t max_len)
+{
+    std::vector<PayloadSample> storage(trace.size());
+    PayloadBatch batch(storage.data(), static_cast<uint16_t>(storage.size()));
+    for (const TraceSample &sample : trace) {
+        batch.push(sample.timestamp, sample.values);
+    }
+    const uint32_t now = trace.back().timestamp;
+    const PayloadValues reference = trace.front().values;
+    const uint16_t count = payload_history_fit(batch, now, max_len, &reference);
+    if (count == 0) {
+        return 0;
+    }
+    uint8_t frame[256];
+    const int rounds = 2000;
+    uint64_t start = ticks();
+    size_t sink = 0;
+    for (int r = 0; r < rounds; r++) {
+        sink += payload_encode_history(batch, count, now, &reference, frame, max_len);
+    }
+    uint64_t elapsed = ticks() - start;
+    return sink ? static_cast<double>(elapsed) / rounds / count : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int samples = 288;
+    int interval_s = MBED_CONF_APP_SAMPLE_INTERVAL * 5;
+    const char *trace_path = nullptr;
+    bool dump = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--interval-s") && i + 1 < argc) {
+            interval_s = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--dump")) {
+            dump = true;
+        } else {
+            fprintf(stderr, "usage: %s [--samples N] [--interval-s S] [--trace FILE] [--dump]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<TraceSample> trace;
+    if (trace_path) {
+        if (!load(trace_path, trace)) {
+            fprintf(stderr, "%s: cannot read trace\n", trace_path);
+            return 2;
+        }
+    } else {
+        trace = record(samples, interval_s);
+    }
+    if (trace.size() < 2 || trace.size() > 60000) {
+        fprintf(stderr, "need 2 to 60000 samples, have %zu\n", trace.size());
+        return 2;
+    }
+    if (dump) {
+        for (const TraceSample &sample : trace) {
+            printf("%.3f", sample.timestamp / 1000.0);
+            for (const PayloadField &field : payload_schema) {
+                printf(",%ld", static_cast<long>(sample.values.field[field.id]));
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    size_t keyframe_bytes = 0;
+    for (const TraceSample &sample : trace) {
+        keyframe_bytes += payload_size(static_cast<uint8_t>(clamped(sample.values).field[PAYLOAD_FLAGS]));
+    }
+    const double n = static_cast<double>(trace.size());
+    const int span = static_cast<int>((trace.back().timestamp - trace.front().timestamp) / 1000);
+    const int sample_s = span / static_cast<int>(trace.size() - 1);
+    printf("%zu samples over %d s (%s)\n", trace.size(), span,
+           trace_path ? trace_path : "synthetic day profile");
+    printf("keyframes only: %.2f bytes per sample\n", keyframe_bytes / n);
+
+    bool ok = true;
+    // Regular uplinks, and a backlog as after a gateway outage
+    for (int per_uplink : {6, 60}) {
+        printf("an uplink every %d samples:\n", per_uplink);
+        for (size_t max_len : {51, 222}) {
+            Result batch = send(trace, max_len, false, sample_s * per_uplink);
+            Result history = send(trace, max_len, true, sample_s * per_uplink);
+            ok = ok && batch.exact && history.exact;
+            printf("  frames of at most %3zu bytes: deadband batches %5.2f bytes per sample (%4.1fx, %3zu frames), "
+                   "lossless %5.2f bytes per sample (%4.1fx, %3zu frames, %3zu history)%s\n", max_len,
+                   batch.bytes / n, keyframe_bytes / static_cast<double>(batch.bytes), batch.frames,
+                   history.bytes / n, keyframe_bytes / static_cast<double>(history.bytes), history.frames,
+                   history.historyFrames, history.exact ? "" : " NOT EXACT");
+        }
+    }
+    for (size_t max_len : {51, 222}) {
+        printf("history encode into %zu bytes: %.0f %s per sample\n", max_len, encode_ticks(trace, max_len),
+               TICK_UNIT);
+    }
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,710 @@
+/*
+ * Host side of the uplink payload codec in payload.h.
+ *
+ * Decodes frames given as hex strings and prints every field in its unit.
+ * Several frames are applied in order like on the network server, fields
+ * missing from a delta frame keep their earlier value and are marked.
+ * --self-test round-trips the schema limits and random values through
+ * the keyframe and delta codecs for every flags value, checks clamping,
+ * quantization and rejection of damaged frames, and runs PayloadPolicy
+ * over slowly drifting readings with lost transmissions, reporting the
+ * average frame size, and over batches of jittered samples for the EU868
+ * payload sizes, checking sample times, values and that unsent samples
+ * roll over into the next frame, with and without history compression.
+ * History frames are also round-tripped from random walks up to the full
+ * field ranges and must come back bit-exact. --schema prints the field
+ * table with the computed bit widths and frame sizes.
+ *
+ * Diagnostics frames (latency.h, diagnostics-port) are recognized by
+ * their first byte and printed as one line per span. The self-test checks
+ * the bucket boundaries, the quantiles against sorted random durations
+ * and the round trip of the frame as well.
+ *
+ *   payload-decode HEX...
+ *   payload-decode --self-test [--iterations N] [--seed S]
+ *   payload-decode --schema
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "latency.h"
+#include "payload.h"
+#include "payload_history.h"
+#include "payload_policy.h"
+
+namespace {
+
+bool parse_hex(const char *text, uint8_t *out, size_t size, size_t &length)
+{
+    length = 0;
+    std::string hex;
+    for (const char *p = text; *p; p++) {
+        if (*p != ' ' && *p != ':') {
+            hex += *p;
+        }
+    }
+    if (hex.size() % 2 || hex.size() / 2 > size) {
+        return false;
+    }
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        char byte[3] = {hex[i], hex[i + 1], '\0'};
+        char *end;
+        out[length++] = static_cast<uint8_t>(strtoul(byte, &end, 16));
+        if (*end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_values(const PayloadValues &values, PayloadFieldMask present)
+{
+    for (const PayloadField &field : payload_schema) {
+        const char *kept = (present & (1ul << field.id)) ? "" : " (kept)";
+        int32_t value = values.field[field.id];
+        int decimals = 0;
+        for (int32_t s = field.scale; s > 1; s /= 10) {
+            decimals++;
+        }
+        if (field.id == PAYLOAD_FLAGS) {
+            printf("  %-6s 0x%02lx\n", field.name, static_cast<unsigned long>(value));
+        } else {
+            printf("  %-6s %.*f %s%s\n", field.name, decimals, static_cast<double>(value) / field.scale,
+                   field.unit, kept);
+        }
+    }
+}
+
+void print_schema()
+{
+    printf("version %d\n", PAYLOAD_VERSION);
+    printf("  %-6s %12s %12s %8s %8s %5s %s\n", "field", "min", "max", "scale", "deadband", "bits", "unit");
+    for (const PayloadField &field : payload_schema) {
+        printf("  %-6s %12ld %12ld %8ld %8ld %5u %s%s\n", field.name, static_cast<long>(field.min),
+               static_cast<long>(field.max), static_cast<long>(field.scale),
+               static_cast<long>(field.deadband), payload_field_bits(field), field.unit,
+               field.omitIf ? " (optional)" : "");
+    }
+    printf("frame: %u bits, %zu bytes\n", payload_bits(0), payload_size(0));
+    printf("cached position: %u bits, %zu bytes\n", payload_bits(PAYLOAD_FLAG_GPS_CACHED),
+           payload_size(PAYLOAD_FLAG_GPS_CACHED));
+    printf("delta frame: %zu bytes without changes, %zu with every field\n", payload_delta_size(0),
+           payload_delta_size(PAYLOAD_ALL_FIELDS));
+}
+
+int32_t random_in(const PayloadField &field)
+{
+    int64_t span = static_cast<int64_t>(field.max) - field.min + 1;
+    int64_t r = (static_cast<int64_t>(rand()) << 31) ^ rand();
+    return static_cast<int32_t>(field.min + r % span);
+}
+
+// Fields the decoder must not touch keep this value
+const int32_t UNTOUCHED = 0x5a5a5a5a;
+
+bool expect_roundtrip(const PayloadValues &in, PayloadFieldMask delta, const char *what)
+{
+    uint8_t frame[PAYLOAD_MAX_SIZE];
+    const uint8_t flags = static_cast<uint8_t>(in.field[PAYLOAD_FLAGS]);
+    PayloadFieldMask expected_fields = 1ul << PAYLOAD_FLAGS;
+    size_t length;
+    if (delta) {
+        length = payload_encode_delta(in, delta, frame, sizeof(frame));
+        expected_fields |= delta & PAYLOAD_ALL_FIELDS;
+    } else {
+        length = payload_encode(in, frame, sizeof(frame));
+        for (const PayloadField &field : payload_schema) {
+            if (!(field.omitIf & flags)) {
+                expected_fields |= 1ul << field.id;
+            }
+        }
+    }
+
+    PayloadValues out;
+    for (int32_t &value : out.field) {
+        value = UNTOUCHED;
+    }
+    PayloadFieldMask present = 0;
+    if (!length || !payload_decode(frame, length, out, &present)) {
+        printf("FAIL: %s: frame of %zu bytes not accepted\n", what, length);
+        return false;
+    }
+    if (present != expected_fields) {
+        printf("FAIL: %s: fields 0x%04lx decoded, 0x%04lx expected\n", what,
+               static_cast<unsigned long>(present), static_cast<unsigned long>(expected_fields));
+        return false;
+    }
+    for (const PayloadField &field : payload_schema) {
+        int32_t expected = (expected_fields & (1ul << field.id)) ? in.field[field.id] : UNTOUCHED;
+        if (out.field[field.id] != expected) {
+            printf("FAIL: %s: %s encoded %ld, decoded %ld\n", what, field.name,
+                   static_cast<long>(expected), static_cast<long>(out.field[field.id]));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Readings drift slowly like soil and temperature data; the server state
+ * built from the frames must stay within the deadbands of the last
+ * committed readings. One in ten transmissions is lost and not committed.
+ */
+bool policy_test(long frames, double &average_size)
+{
+    const uint16_t interval = 10;
+    PayloadPolicy policy(interval);
+    PayloadValues truth = {};
+    PayloadValues committed = {};
+    PayloadValues server = {};
+    for (const PayloadField &field : payload_schema) {
+        truth.field[field.id] = field.id == PAYLOAD_FLAGS ? 0 : (field.min + field.max) / 2;
+    }
+
+    uint64_t bytes = 0;
+    long keyframes = 0;
+    long since_keyframe = 0;
+    for (long i = 0; i < frames; i++) {
+        for (const PayloadField &field : payload_schema) {
+            if (field.id == PAYLOAD_FLAGS) {
+                continue;
+            }
+            // Mostly noise within the deadband, now and then a jump
+            int32_t step = rand() % 50 ? rand() % (field.deadband + 1) - field.deadband / 2
+                           : rand() % (4 * field.deadband + 2) - 2 * field.deadband;
+            int64_t value = static_cast<int64_t>(truth.field[field.id]) + step;
+            truth.field[field.id] = static_cast<int32_t>(value < field.min ? field.min : value > field.max ? field.max : value);
+        }
+        truth.field[PAYLOAD_FLAGS] = rand() % 4 ? PAYLOAD_FLAG_GPS_CACHED : 0;
+
+        uint8_t frame[PAYLOAD_MAX_SIZE];
+        size_t length = policy.encode(truth, frame, sizeof(frame));
+        if (!length) {
+            printf("FAIL: policy produced no frame\n");
+            return false;
+        }
+        bytes += length;
+        if (!policy.lastWasKeyframe() && since_keyframe + 1 >= interval) {
+            printf("FAIL: no keyframe within %u frames\n", interval);
+            return false;
+        }
+        if (rand() % 10 == 0) {
+            continue; // lost, no TX_DONE
+        }
+        if (policy.lastWasKeyframe()) {
+            keyframes++;
+            since_keyframe = 0;
+        } else {
+            since_keyframe++;
+        }
+        if (!payload_decode(frame, length, server)) {
+            printf("FAIL: policy frame %ld not decodable\n", i);
+            return false;
+        }
+        policy.commit();
+        for (const PayloadField &field : payload_schema) {
+            if (!(field.omitIf & truth.field[PAYLOAD_FLAGS])) {
+                committed.field[field.id] = truth.field[field.id];
+            }
+        }
+        for (const PayloadField &field : payload_schema) {
+            int64_t diff = static_cast<int64_t>(server.field[field.id]) - committed.field[field.id];
+            if (diff > field.deadband || -diff > field.deadband) {
+                printf("FAIL: frame %ld: server has %s %ld, reading was %ld\n", i, field.name,
+                       static_cast<long>(server.field[field.id]), static_cast<long>(committed.field[field.id]));
+                return false;
+            }
+        }
+    }
+    average_size = static_cast<double>(bytes) / frames;
+    return keyframes >= frames / interval / 2;
+}
+
+/**
+ * Samples arrive in bursts with jittered timestamps and are sent in batch
+ * frames limited to max_len bytes. Every decoded sample must match its
+ * reading within the deadbands, with the right age; lost frames are sent
+ * again with the next uplink.
+ */
+bool batch_test(long frames, size_t max_len, bool history, double &samples_per_frame,
+                unsigned &backlog_per_frame)
+{
+    // At 51 bytes the load is close to what the frames carry, the backlog swings widely
+    const uint16_t capacity = 256;
+    static PayloadSample storage[capacity];
+    PayloadBatch batch(storage, capacity);
+    PayloadPolicy policy(10, history);
+    PayloadValues truth = {};
+    PayloadValues server = {};
+    for (const PayloadField &field : payload_schema) {
+        truth.field[field.id] = field.id == PAYLOAD_FLAGS ? 0 : (field.min + field.max) / 2;
+    }
+
+    uint32_t now = 0x7fff0000; // wraps during the test
+    uint32_t expected_next = 1;  // sequence of the oldest unsent sample
+    long samples = 0;
+    long sent_frames = 0;
+    for (long f = 0; f < frames; f++) {
+        for (int n = 1 + rand() % 8; n > 0; n--) {
+            now += 60000 + rand() % 2001 - 1000;
+            for (const PayloadField &field : payload_schema) {
+                if (field.id != PAYLOAD_FLAGS) {
+                    int64_t value = truth.field[field.id] + rand() % (2 * field.deadband + 1) - field.deadband;
+                    truth.field[field.id] = static_cast<int32_t>(value < field.min ? field.min : value > field.max ? field.max : value);
+                }
+            }
+            batch.push(now, truth);
+        }
+        if (batch.overflows()) {
+            printf("FAIL: batch of %u overflowed\n", capacity);
+            return false;
+        }
+        now += rand() % 5000;
+
+        uint8_t frame[256];
+        size_t length = policy.encode(batch, now, frame, max_len);
+        if (!length || length > max_len || policy.lastSamples() == 0) {
+            printf("FAIL: no frame from %u samples in %zu bytes\n", batch.count(), max_len);
+            return false;
+        }
+        if (batch.at(0).sequence != expected_next) {
+            printf("FAIL: batch starts at sample %lu, %lu not sent yet\n",
+                   static_cast<unsigned long>(batch.at(0).sequence), static_cast<unsigned long>(expected_next));
+            return false;
+        }
+        if (rand() % 10 == 0) {
+            continue; // lost, no TX_DONE
+        }
+
+        PayloadDecodedSample decoded[PAYLOAD_BATCH_MAX_SAMPLES];
+        int count;
+        if (frame[0] & PAYLOAD_HEADER_HISTORY) {
+            count = payload_decode_history(frame, length, server, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+        } else if (frame[0] & PAYLOAD_HEADER_BATCH) {
+            count = payload_decode_batch(frame, length, server, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+        } else {
+            count = payload_decode(frame, length, server) ? 1 : -1;
+            decoded[0].values = server;
+            decoded[0].age = (now - batch.at(0).timestamp + 500) / 1000;
+        }
+        if (count != policy.lastSamples()) {
+            printf("FAIL: %d samples decoded, %u encoded\n", count, policy.lastSamples());
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            const PayloadSample &sample = batch.at(i);
+            uint32_t age = (now - sample.timestamp + 500) / 1000;
+            if (decoded[i].age != age) {
+                printf("FAIL: sample %d decoded with age %lu s, is %lu s\n", i,
+                       static_cast<unsigned long>(decoded[i].age), static_cast<unsigned long>(age));
+                return false;
+            }
+            for (const PayloadField &field : payload_schema) {
+                int64_t diff = static_cast<int64_t>(decoded[i].values.field[field.id]) - sample.values.field[field.id];
+                int32_t tolerance = (frame[0] & PAYLOAD_HEADER_HISTORY) ? 0 : field.deadband;
+                if (diff > tolerance || -diff > tolerance) {
+                    printf("FAIL: sample %d: %s decoded %ld, was %ld\n", i, field.name,
+                           static_cast<long>(decoded[i].values.field[field.id]),
+                           static_cast<long>(sample.values.field[field.id]));
+                    return false;
+                }
+            }
+        }
+        policy.commit();
+        batch.dropThrough(policy.lastSequence());
+        expected_next = policy.lastSequence() + 1;
+        samples += count;
+        sent_frames++;
+    }
+    samples_per_frame = sent_frames ? static_cast<double>(samples) / sent_frames : 0;
+
+    // Backlog, e.g. after a gateway outage: how many fit into one frame
+    while (batch.count() < capacity) {
+        now += 60000;
+        batch.push(now, truth);
+    }
+    uint8_t frame[256];
+    policy.encode(batch, now, frame, max_len);
+    backlog_per_frame = policy.lastSamples();
+    return true;
+}
+
+/**
+ * Random walks with steps from a few units up to the whole field range,
+ * through history frames of random sample counts, must decode bit-exact.
+ */
+bool history_test(long frames, double &bits_per_sample)
+{
+    const uint16_t capacity = PAYLOAD_BATCH_MAX_SAMPLES;
+    static PayloadSample storage[capacity];
+    long samples = 0;
+    long bits = 0;
+    for (long f = 0; f < frames; f++) {
+        PayloadBatch batch(storage, capacity);
+        PayloadValues values;
+        for (const PayloadField &field : payload_schema) {
+            values.field[field.id] = random_in(field);
+        }
+        // Steps of up to 2^shift, from flat to jumping between the limits
+        const int shift = rand() % 34;
+        uint32_t now = static_cast<uint32_t>(rand()) * 7919u;
+        const uint16_t count = static_cast<uint16_t>(1 + rand() % capacity);
+        for (uint16_t n = 0; n < count; n++) {
+            for (const PayloadField &field : payload_schema) {
+                if (shift > 31) {
+                    values.field[field.id] = rand() % 2 ? field.min : field.max;
+                    continue;
+                }
+                int64_t step = (static_cast<int64_t>(rand()) << 1 | (rand() & 1)) % ((1ll << shift) + 1);
+                int64_t value = values.field[field.id] + (rand() % 2 ? step : -step);
+                values.field[field.id] = static_cast<int32_t>(value < field.min ? field.min : value > field.max ? field.max : value);
+            }
+            now += static_cast<uint32_t>(rand() % 120000);
+            batch.push(now, values);
+        }
+        now += static_cast<uint32_t>(rand() % 10000);
+
+        // Every other frame relative to a random baseline
+        PayloadValues reference;
+        for (const PayloadField &field : payload_schema) {
+            reference.field[field.id] = random_in(field);
+        }
+        const PayloadValues *relative = f % 2 ? &reference : nullptr;
+        PayloadValues state = reference;
+
+        uint8_t frame[2048];
+        size_t length = payload_encode_history(batch, count, now, relative, frame, sizeof(frame));
+        PayloadDecodedSample decoded[PAYLOAD_BATCH_MAX_SAMPLES];
+        int decodedCount = payload_decode_history(frame, length, state, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+        if (!length || length != 1 + (payload_history_bits(batch, count, now, relative) + 7) / 8
+                || decodedCount != count || memcmp(&state, &batch.at(count - 1).values, sizeof(state)) != 0) {
+            printf("FAIL: history frame of %u samples: %zu bytes, %d decoded\n", count, length, decodedCount);
+            return false;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            if (memcmp(&decoded[i].values, &batch.at(i).values, sizeof(PayloadValues)) != 0
+                    || decoded[i].age != payload_age_seconds(now, batch.at(i).timestamp)) {
+                printf("FAIL: history sample %u of %u not restored exactly\n", i, count);
+                return false;
+            }
+        }
+        // A frame one byte short must not fit that many samples
+        uint16_t fit = payload_history_fit(batch, now, length, relative);
+        if (count <= PAYLOAD_BATCH_MAX_SAMPLES && fit != count) {
+            printf("FAIL: %u samples fit into their own %zu byte frame, expected %u\n", fit, length, count);
+            return false;
+        }
+        if (payload_decode_history(frame, length - 1, state, decoded, PAYLOAD_BATCH_MAX_SAMPLES) >= 0
+                || payload_decode_history(frame, length + 1, state, decoded, PAYLOAD_BATCH_MAX_SAMPLES) >= 0) {
+            printf("FAIL: truncated or overlong history frame accepted\n");
+            return false;
+        }
+        samples += count;
+        bits += static_cast<long>(length) * 8;
+    }
+    bits_per_sample = samples ? static_cast<double>(bits) / samples : 0;
+    return true;
+}
+
+/**
+ * Latency buckets: contiguous, at most 25 % wide, quantiles within one
+ * bucket of the exact value, diagnostics frames round-trip
+ */
+bool latency_test(long samples)
+{
+    for (unsigned b = 0; b + 1 < LATENCY_BUCKETS; b++) {
+        const uint32_t floor = latency_bucket_floor(b);
+        const uint32_t next = latency_bucket_floor(b + 1);
+        if (latency_bucket(floor) != b || latency_bucket(next - 1) != b
+                || (b >= 4 && (next - floor) * 4 > floor)) {
+            printf("FAIL: latency bucket %u covers %lu..%lu\n", b, static_cast<unsigned long>(floor),
+                   static_cast<unsigned long>(next - 1));
+            return false;
+        }
+    }
+    if (latency_bucket(UINT32_MAX) != LATENCY_BUCKETS - 1) {
+        printf("FAIL: latency bucket of the longest duration\n");
+        return false;
+    }
+
+    latency_reset();
+    std::vector<uint32_t> durations;
+    for (long i = 0; i < samples; i++) {
+        // Log-uniform from 1 us to 1 s with a few outliers, like a span with waits
+        uint32_t us = static_cast<uint32_t>(exp(static_cast<double>(rand()) / RAND_MAX * log(1e6)));
+        if (rand() % 100 == 0) {
+            us *= 50;
+        }
+        durations.push_back(us);
+        latency_record_us(LATENCY_PACK, us);
+    }
+    std::sort(durations.begin(), durations.end());
+    const LatencyStats &stats = latency_stats(LATENCY_PACK);
+    for (unsigned permille : {500u, 900u, 990u}) {
+        const uint32_t exact = durations[(durations.size() * permille + 999) / 1000 - 1];
+        const uint32_t estimate = latency_quantile(stats, permille);
+        if (latency_bucket(estimate) != latency_bucket(exact)) {
+            printf("FAIL: p%u %lu us, exact %lu us\n", permille / 10, static_cast<unsigned long>(estimate),
+                   static_cast<unsigned long>(exact));
+            return false;
+        }
+    }
+
+    latency_record_us(LATENCY_SEND, 2500000);
+    uint8_t frame[64];
+    LatencyReport reports[LATENCY_SPAN_COUNT];
+    const size_t length = latency_encode(frame, sizeof(frame));
+    const int spans = latency_decode(frame, length, reports, LATENCY_SPAN_COUNT);
+    if (length != 15 || spans != 2 || reports[0].span != LATENCY_PACK
+            || reports[0].count != (samples > UINT16_MAX ? UINT16_MAX : samples)
+            || reports[0].minUs != latency_bucket_floor(latency_bucket(durations.front()))
+            || reports[0].maxUs != latency_bucket_floor(latency_bucket(durations.back()))
+            || reports[1].span != LATENCY_SEND || reports[1].maxUs != latency_bucket_floor(latency_bucket(2500000))) {
+        printf("FAIL: diagnostics frame round trip\n");
+        return false;
+    }
+    // Only whole spans fit, damaged frames are rejected
+    if (latency_encode(frame, 14) != 8 || latency_decode(frame, 7, reports, LATENCY_SPAN_COUNT) != -1) {
+        printf("FAIL: diagnostics frame truncation\n");
+        return false;
+    }
+    frame[6] = LATENCY_BUCKETS;
+    if (latency_decode(frame, 8, reports, LATENCY_SPAN_COUNT) != -1) {
+        printf("FAIL: diagnostics frame with a foreign bucket accepted\n");
+        return false;
+    }
+    latency_reset();
+    return latency_encode(frame, sizeof(frame)) == 1;
+}
+
+void print_diagnostics(const char *hex, const LatencyReport *reports, int count)
+{
+    for (int n = 0; n < count; n++) {
+        const LatencyReport &report = reports[n];
+        const char *name = report.span < LATENCY_SPAN_COUNT ? latency_span_names[report.span] : "?";
+        printf("%s: %-8s %5u, min %lu us, avg %lu us, p99 %lu us, max %lu us\n", hex, name,
+               report.count, static_cast<unsigned long>(report.minUs),
+               static_cast<unsigned long>(report.avgUs), static_cast<unsigned long>(report.p99Us),
+               static_cast<unsigned long>(report.maxUs));
+    }
+}
+
+int self_test(long iterations, unsigned seed)
+{
+    srand(seed);
+    const uint8_t max_flags = static_cast<uint8_t>(payload_schema[PAYLOAD_FLAGS].max);
+    long checks = 0;
+    bool ok = true;
+
+    // Schema limits, one field at a time at min and max
+    for (unsigned flags = 0; flags <= max_flags && ok; flags++) {
+        for (const PayloadField &field : payload_schema) {
+            if (field.id == PAYLOAD_FLAGS) {
+                continue;
+            }
+            for (int32_t limit : {field.min, field.max}) {
+                PayloadValues values = {};
+                values.field[PAYLOAD_FLAGS] = flags;
+                for (const PayloadField &other : payload_schema) {
+                    if (other.id != PAYLOAD_FLAGS) {
+                        values.field[other.id] = other.min;
+                    }
+                }
+                values.field[field.id] = limit;
+                ok = ok && expect_roundtrip(values, 0, "limit");
+                ok = ok && expect_roundtrip(values, 1ul << field.id, "delta limit");
+                checks++;
+            }
+        }
+    }
+
+    // Random values in range
+    for (long i = 0; i < iterations && ok; i++) {
+        PayloadValues values;
+        for (const PayloadField &field : payload_schema) {
+            values.field[field.id] = random_in(field);
+        }
+        ok = expect_roundtrip(values, 0, "random");
+        PayloadFieldMask delta = static_cast<PayloadFieldMask>(rand()) & PAYLOAD_ALL_FIELDS & ~(1ul << PAYLOAD_FLAGS);
+        ok = ok && expect_roundtrip(values, delta ? delta : 1ul << PAYLOAD_TEMP, "random delta");
+        checks++;
+    }
+
+    // Out-of-range values are clamped, quantize rounds to the nearest step
+    for (const PayloadField &field : payload_schema) {
+        PayloadValues values = {};
+        values.field[field.id] = field.id == PAYLOAD_FLAGS ? 0 : INT32_MAX;
+        uint8_t frame[PAYLOAD_MAX_SIZE];
+        PayloadValues out;
+        size_t length = payload_encode(values, frame, sizeof(frame));
+        if (field.id != PAYLOAD_FLAGS && (!payload_decode(frame, length, out) || out.field[field.id] != field.max)) {
+            printf("FAIL: %s not clamped to max\n", field.name);
+            ok = false;
+        }
+        float half_step = 0.5f / field.scale;
+        float unit_min = static_cast<float>(field.min) / field.scale;
+        if (payload_quantize(field.id, -1e30f) != field.min || payload_quantize(field.id, 1e30f) != field.max
+                || payload_quantize(field.id, NAN) < field.min
+                || payload_quantize(field.id, unit_min + half_step * 0.9f) != field.min) {
+            printf("FAIL: payload_quantize(%s) does not round or clamp\n", field.name);
+            ok = false;
+        }
+        checks++;
+    }
+
+    // Damaged frames are rejected
+    {
+        PayloadValues values = {};
+        uint8_t frame[PAYLOAD_MAX_SIZE + 1];
+        PayloadValues out;
+        size_t length = payload_encode(values, frame, sizeof(frame));
+        bool short_ok = payload_decode(frame, length - 1, out);
+        bool long_ok = payload_decode(frame, length + 1, out);
+        frame[0] = PAYLOAD_VERSION + 1;
+        bool version_ok = payload_decode(frame, length, out);
+        bool small_buffer = payload_encode(values, frame, length - 1) == 0;
+        if (short_ok || long_ok || version_ok || !small_buffer) {
+            printf("FAIL: truncated, overlong or foreign frames accepted\n");
+            ok = false;
+        }
+        checks++;
+    }
+
+    // Random bytes must be rejected or decoded without reading past the frame
+    for (long i = 0; i < iterations / 10; i++) {
+        uint8_t frame[64];
+        size_t length = 1 + rand() % sizeof(frame);
+        for (size_t n = 0; n < length; n++) {
+            frame[n] = static_cast<uint8_t>(rand());
+        }
+        static const uint8_t headers[] = {0, PAYLOAD_HEADER_DELTA, PAYLOAD_HEADER_BATCH, PAYLOAD_HEADER_HISTORY};
+        frame[0] = PAYLOAD_VERSION | headers[rand() % 4];
+        PayloadValues state = {};
+        PayloadDecodedSample decoded[PAYLOAD_BATCH_MAX_SAMPLES];
+        payload_decode(frame, length, state);
+        payload_decode_batch(frame, length, state, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+        payload_decode_history(frame, length, state, decoded, PAYLOAD_BATCH_MAX_SAMPLES);
+        checks++;
+    }
+
+    double average_size = 0;
+    if (ok && !policy_test(iterations / 10 + 100, average_size)) {
+        ok = false;
+    }
+
+    printf("%ld round-trip checks, frame %zu bytes (%zu with cached position), "
+           "send-on-change average %.1f bytes\n", checks, payload_size(0),
+           payload_size(PAYLOAD_FLAG_GPS_CACHED), average_size);
+
+    // Maximum EU868 payload at DR0-2, DR3 and DR4-7
+    for (bool history : {false, true}) {
+        for (size_t max_len : {51, 115, 222}) {
+            double per_frame = 0;
+            unsigned backlog = 0;
+            if (ok && !batch_test(iterations / 100 + 100, max_len, history, per_frame, backlog)) {
+                ok = false;
+            }
+            printf("%s of at most %zu bytes: %.1f samples per frame, %u from a backlog\n",
+                   history ? "history frames" : "batches", max_len, per_frame, backlog);
+        }
+    }
+
+    double history_bits = 0;
+    if (ok && !history_test(iterations / 100 + 100, history_bits)) {
+        ok = false;
+    }
+    printf("history frames from random walks: %.1f bits per sample, bit-exact\n", history_bits);
+
+    if (ok && !latency_test(iterations / 10 + 1000)) {
+        ok = false;
+    }
+    printf("latency buckets at most 25 %% wide, quantiles and diagnostics frames\n");
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s HEX... | --self-test [--iterations N] [--seed S] | --schema\n", argv[0]);
+        return 2;
+    }
+    if (!strcmp(argv[1], "--schema")) {
+        print_schema();
+        return 0;
+    }
+    if (!strcmp(argv[1], "--self-test")) {
+        long iterations = 100000;
+        unsigned seed = 1;
+        for (int i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+                iterations = atol(argv[++i]);
+            } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+                seed = strtoul(argv[++i], nullptr, 10);
+            } else {
+                fprintf(stderr, "usage: %s --self-test [--iterations N] [--seed S]\n", argv[0]);
+                return 2;
+            }
+        }
+        return self_test(iterations, seed);
+    }
+
+    int status = 0;
+    PayloadValues values = {};
+    for (int i = 1; i < argc; i++) {
+        uint8_t frame[256];
+        size_t length;
+        PayloadFieldMask present;
+        PayloadDecodedSample samples[PAYLOAD_BATCH_MAX_SAMPLES];
+        LatencyReport reports[LATENCY_SPAN_COUNT + 32];
+        int count;
+        if (!parse_hex(argv[i], frame, sizeof(frame), length)) {
+            printf("%s: not a hex string\n", argv[i]);
+            status = 1;
+        } else if (length > 0 && frame[0] == LATENCY_FRAME_VERSION) {
+            count = latency_decode(frame, length, reports, sizeof(reports) / sizeof(reports[0]));
+            if (count < 0) {
+                printf("%s: not a diagnostics frame\n", argv[i]);
+                status = 1;
+            }
+            print_diagnostics(argv[i], reports, count);
+        } else if (length > 0 && (frame[0] & PAYLOAD_HEADER_HISTORY)) {
+            count = payload_decode_history(frame, length, values, samples, PAYLOAD_BATCH_MAX_SAMPLES);
+            if (count < 0) {
+                printf("%s: not a version %d history frame\n", argv[i], PAYLOAD_VERSION);
+                status = 1;
+            }
+            for (int n = 0; n < count; n++) {
+                printf("%s: sample %d of %d, %lu s old, history %s\n", argv[i], n + 1, count,
+                       static_cast<unsigned long>(samples[n].age), samples[n].keyframe ? "keyframe" : "delta");
+                print_values(samples[n].values, samples[n].present);
+            }
+        } else if (length > 0 && (frame[0] & PAYLOAD_HEADER_BATCH)) {
+            count = payload_decode_batch(frame, length, values, samples, PAYLOAD_BATCH_MAX_SAMPLES);
+            if (count < 0) {
+                printf("%s: not a version %d batch frame\n", argv[i], PAYLOAD_VERSION);
+                status = 1;
+            }
+            for (int n = 0; n < count; n++) {
+                printf("%s: sample %d of %d, %lu s old, %s\n", argv[i], n + 1, count,
+                       static_cast<unsigned long>(samples[n].age), samples[n].keyframe ? "keyframe" : "delta");
+                print_values(samples[n].values, samples[n].present);
+            }
+        } else if (!payload_decode(frame, length, values, &present)) {
+            printf("%s: not a version %d frame\n", argv[i], PAYLOAD_VERSION);
+            status = 1;
+        } else {
+            printf("%s: %s\n", argv[i], (frame[0] & PAYLOAD_HEADER_DELTA) ? "delta" : "keyframe");
+            print_values(values, present);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,89 @@
+#ifndef APP_HOST_CALLBACK_H_
+#define APP_HOST_CALLBACK_H_
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+
+namespace mbed {
+
+/**
+ * Host stand-in for mbed::Callback, a thin wrapper around std::function
+ * with the constructors and callback() helpers the application uses.
+ */
+template <typename F>
+class Callback;
+
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> {
+public:
+    Callback()
+    {
+    }
+
+    Callback(std::nullptr_t)
+    {
+    }
+
+    Callback(R(*func)(ArgTs...))
+    {
+        if (func) {
+            _func = func;
+        }
+    }
+
+    template <typename T, typename U>
+    Callback(U *obj, R(T::*method)(ArgTs...))
+        : _func([obj, method](ArgTs... args) {
+        return (obj->*method)(args...);
+    })
+    {
+    }
+
+    template <typename F, typename = typename std::enable_if <
+                  !std::is_pointer<F>::value &&
+                  !std::is_same<typename std::decay<F>::type, Callback>::value >::type >
+    Callback(F func) : _func(func)
+    {
+    }
+
+    R call(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    R operator()(ArgTs... args) const
+    {
+        return _func(args...);
+    }
+
+    explicit operator bool() const
+    {
+        return static_cast<bool>(_func);
+    }
+
+private:
+    std::function<R(ArgTs...)> _func;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R(*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(U *obj, R(T::*method)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(obj, method);
+}
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(const Callback<R(ArgTs...)> &func)
+{
+    return func;
+}
+
+} // namespace mbed
+
+#endif /* APP_HOST_CALLBACK_H_ */
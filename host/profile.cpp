@@ -0,0 +1,174 @@
+/*
+ * Host profiler for the acquisition path.
+ *
+ * Runs start_sensor_acquisition() against the mock devices on a host
+ * event queue and reports, per cycle, the virtual time until the data is
+ * ready, the longest time a single event blocked the queue (which the
+ * LoRaWAN stack shares) and the I2C traffic per device over the whole
+ * period, including background work between uplinks and an accelerometer
+ * shock injected halfway through every other period. After each
+ * acquisition the scheduled sensor reads are held for 3 s as during the
+ * uplink's RX windows. The sensor printouts of the deferred log are
+ * formatted as log-decode would after each cycle. At the end the span
+ * histograms of latency.h are printed; the I2C span is in virtual time, the others in host CPU time
+ * as the host has no cycle counter. With --budget-us
+ * the exit code is non-zero if any event blocks the queue for longer than
+ * the budget, which is what CI checks.
+ *
+ *   sensor-profile [--cycles N] [--period-s S] [--budget-us US]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "deferred_log.h"
+#include "latency.h"
+#include "log_format.h"
+#include "mbed.h"
+#include "mock_devices.h"
+#include "payload_policy.h"
+#include "sensors.h"
+
+namespace {
+
+const char *device_name(uint8_t address)
+{
+    switch (address) {
+        case host::MockSi7021::ADDRESS:
+            return "Si7021";
+        case host::MockTcs34725::ADDRESS:
+            return "TCS34725";
+        case host::MockMma8451::ADDRESS:
+            return "MMA8451";
+        default:
+            return "?";
+    }
+}
+
+/** Formats what the sensors logged since the last call */
+void print_log()
+{
+    uint32_t record[LOG_RECORD_MAX_WORDS];
+    int words;
+    while ((words = deferred_log_next(record)) >= 0) {
+        printf("%s\n", log_format(record, static_cast<uint32_t>(words)).c_str());
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int cycles = 5;
+    int period_s = 60;
+    uint64_t budget_us = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--period-s") && i + 1 < argc) {
+            period_s = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--budget-us") && i + 1 < argc) {
+            budget_us = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--cycles N] [--period-s S] [--budget-us US]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host::MockSi7021 si7021;
+    host::MockTcs34725 tcs34725;
+    host::MockMma8451 mma8451(MBED_CONF_APP_ACCEL_INT1_PIN);
+    host::MockNmeaGps gps_module(PA_12);
+    host::attach_i2c(host::MockSi7021::ADDRESS, &si7021);
+    host::attach_i2c(host::MockTcs34725::ADDRESS, &tcs34725);
+    host::attach_i2c(host::MockMma8451::ADDRESS, &mma8451);
+    host::uart(PA_9).attach(&gps_module);
+
+    // Soil and light sensors with a little noise on the ADC
+    srand(1);
+    host::set_adc(A0, [] { return static_cast<uint16_t>(30000 + rand() % 512); });
+    host::set_adc(A2, [] { return static_cast<uint16_t>(42000 + rand() % 512); });
+
+    EventQueue queue;
+    init_sensors(queue);
+    uint64_t worst_us = 0;
+    uint64_t total_us = 0;
+    PayloadPolicy policy(MBED_CONF_APP_PAYLOAD_KEYFRAME_INTERVAL);
+
+    for (int cycle = 0; cycle < cycles; cycle++) {
+        // Background work between uplinks (FIFO drains etc.) counts as well
+        queue.longest_event_us();
+        host::reset_stats();
+        uint32_t overruns = host::uart(PA_9).overruns;
+        uint32_t received = host::uart(PA_9).received;
+        uint64_t gps_on_us = gps_module.on_time_us();
+        queue.dispatch_for(std::chrono::milliseconds(period_s * 500));
+#if MBED_CONF_APP_ACCEL_EVENTS
+        if (cycle % 2) {
+            mma8451.raise_event(0x20, 0x62); // a shock on Z, the node was moved
+        }
+#endif
+        queue.dispatch_for(std::chrono::milliseconds(period_s * 500));
+
+        bool done = false;
+        uint64_t start = host::now_us();
+        uint64_t ready = start;
+        start_sensor_acquisition(queue, [&] {
+            done = true;
+            ready = host::now_us();
+        });
+        uint64_t blocked = host::now_us() - start;
+        for (int ms = 0; !done && ms < 1000; ms++) {
+            queue.dispatch_for(std::chrono::milliseconds(1));
+        }
+        uint64_t longest = queue.longest_event_us();
+        blocked = longest > blocked ? longest : blocked;
+
+        worst_us = blocked > worst_us ? blocked : worst_us;
+        total_us += blocked;
+
+        uint8_t payload[PAYLOAD_MAX_SIZE];
+        size_t payload_len = policy.encode(mySensor_data, payload, sizeof(payload));
+        hold_sensor_reads();
+        queue.dispatch_for(std::chrono::milliseconds(3000));
+        policy.commit();
+        release_sensor_reads();
+
+        print_log();
+        printf("\ncycle %d: data %s after %llu us, queue blocked for at most %llu us "
+               "(sleeping %llu us), GPS on %llu ms, UART %u bytes at %d baud, overruns %u, payload %zu bytes (%s)\n", cycle,
+               done ? "ready" : "NOT ready",
+               static_cast<unsigned long long>(ready - start),
+               static_cast<unsigned long long>(blocked),
+               static_cast<unsigned long long>(host::sleep_us()),
+               static_cast<unsigned long long>((gps_module.on_time_us() - gps_on_us) / 1000),
+               host::uart(PA_9).received - received, host::uart(PA_9).baud,
+               host::uart(PA_9).overruns - overruns, payload_len,
+               policy.lastWasKeyframe() ? "keyframe" : "delta");
+        printf("  %-9s %6s %6s %6s %9s %9s\n", "device", "xfers", "bytes", "nacks", "bus_us", "host_ns");
+        for (const auto &entry : host::i2c_stats()) {
+            const host::I2CStats &s = entry.second;
+            printf("  %-9s %6u %6u %6u %9llu %9llu\n", device_name(entry.first), s.transactions,
+                   s.bytes, s.nacks, static_cast<unsigned long long>(s.bus_us),
+                   static_cast<unsigned long long>(s.wall_ns));
+        }
+        if (!done) {
+            worst_us = UINT64_MAX;
+        }
+    }
+
+    printf("\n%d cycles: queue blocked avg %llu us, max %llu us\n", cycles,
+           static_cast<unsigned long long>(cycles ? total_us / cycles : 0),
+           static_cast<unsigned long long>(worst_us));
+    latency_dump();
+    print_log();
+
+    if (budget_us && worst_us > budget_us) {
+        printf("FAIL: event queue blocked longer than budget of %llu us\n",
+               static_cast<unsigned long long>(budget_us));
+        return 1;
+    }
+    return 0;
+}
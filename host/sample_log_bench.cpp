@@ -0,0 +1,333 @@
+/*
+ * Benchmark and recovery test of the flash sample log (sample_log.h).
+ *
+ * The benchmark appends samples to a 64 KB HeapBlockDevice with the
+ * geometry of two FlashIAP targets (STM32L0: 128 byte pages programmed in
+ * words; STM32L4: 2 KB pages programmed in double words) and acknowledges
+ * them six at a time as the uplinks would. It reports the host time per
+ * append, ack, fill and mount, the flash bytes programmed and erased per
+ * sample, and how evenly the erases are spread over the pages. The host
+ * figures only cover the bookkeeping; on the target the flash operations
+ * dominate.
+ *
+ * --self-test checks the round trip, the order and the overflow handling,
+ * then cuts the power at random points of random append and ack
+ * sequences and checks after every remount that no acknowledged sample
+ * comes back and no stored one is lost. A cut program leaves a random
+ * prefix of its bytes, a cut erase leaves garbage in the unit.
+ *
+ *   sample-log-bench [--self-test] [--samples N] [--cuts N] [--seed S]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "blockdevice/HeapBlockDevice.h"
+#include "blockdevice/PowerCutDevice.h"
+#include "payload_batch.h"
+#include "sample_log.h"
+
+namespace {
+
+const bd_size_t DEVICE_SIZE = 64 * 1024;
+
+struct Geometry {
+    const char *name;
+    bd_size_t program;
+    bd_size_t erase;
+};
+
+const Geometry GEOMETRIES[] = {
+    { "STM32L0 (128 B pages)", 4, 128 },
+    { "STM32L4 (2 KB pages)", 8, 2048 },
+};
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Random values inside the schema, without the flag that omits the position */
+PayloadValues random_values()
+{
+    PayloadValues values;
+    for (const PayloadField &field : payload_schema) {
+        uint32_t span = static_cast<uint32_t>(static_cast<int64_t>(field.max) - field.min);
+        uint32_t r = (static_cast<uint32_t>(rand()) << 16) ^ static_cast<uint32_t>(rand());
+        values.field[field.id] = static_cast<int32_t>(field.min + static_cast<int64_t>(r % (span + 1ull)));
+    }
+    values.field[PAYLOAD_FLAGS] &= ~PAYLOAD_FLAG_GPS_CACHED;
+    return values;
+}
+
+bool same_values(const PayloadValues &a, const PayloadValues &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+int failures;
+
+void fail(const char *what, long detail = 0)
+{
+    if (failures++ < 10) {
+        printf("FAIL: %s (%ld)\n", what, detail);
+    }
+}
+
+/** All unsent samples of log, oldest first */
+std::vector<PayloadSample> unsent(SampleLog &log)
+{
+    std::vector<PayloadSample> storage(log.pending() + 1);
+    PayloadBatch batch(storage.data(), static_cast<uint16_t>(storage.size()));
+    log.fill(batch);
+    std::vector<PayloadSample> samples;
+    for (uint16_t i = 0; i < batch.count(); i++) {
+        samples.push_back(batch.at(i));
+    }
+    return samples;
+}
+
+void check_basics(const Geometry &geometry)
+{
+    HeapBlockDevice flash(DEVICE_SIZE, 1, geometry.program, geometry.erase);
+    SampleLog log(flash);
+    if (log.mount() || log.pending() != 0) {
+        fail("mount of an empty device");
+        return;
+    }
+
+    std::vector<PayloadValues> appended;
+    for (int i = 0; i < 100; i++) {
+        appended.push_back(random_values());
+        if (!log.append(1000 * i, appended.back())) {
+            fail("append", i);
+        }
+    }
+    PayloadSample storage[32];
+    PayloadBatch batch(storage, 32);
+    if (log.fill(batch) != 32 || batch.at(0).sequence != 1 || batch.at(31).sequence != 32
+            || !same_values(batch.at(5).values, appended[5]) || batch.at(5).timestamp != 5000) {
+        fail("fill() does not return the oldest samples");
+    }
+    log.acknowledge(32);
+    if (log.pending() != 68) {
+        fail("pending after acknowledge()", log.pending());
+    }
+
+    // After a reset the same state, new samples continue the sequence
+    SampleLog again(flash);
+    if (again.mount() || again.pending() != 68 || again.lastTimestamp() != 99000) {
+        fail("state after remount", again.pending());
+    }
+    again.fill(batch);
+    if (batch.at(0).sequence != 33 || !same_values(batch.at(0).values, appended[32])) {
+        fail("first unsent sample after remount", batch.at(0).sequence);
+    }
+    again.append(100000, appended[0]);
+    std::vector<PayloadSample> rest = unsent(again);
+    if (rest.size() != 69 || rest.back().sequence != 101) {
+        fail("sequence after remount", rest.empty() ? 0 : rest.back().sequence);
+    }
+
+    // Overflow: the oldest unsent samples go, the rest stays in order
+    HeapBlockDevice small(4 * SampleLog::MIN_SECTOR_SIZE, 1, geometry.program, geometry.erase);
+    SampleLog full(small);
+    full.mount();
+    const uint32_t total = full.capacity() * 3;
+    for (uint32_t i = 0; i < total; i++) {
+        full.append(i, appended[i % appended.size()]);
+    }
+    rest = unsent(full);
+    if (full.stats().lost + full.pending() != total || rest.size() != full.pending()
+            || rest.back().sequence != total || full.pending() < full.capacity()) {
+        fail("overflow", full.stats().lost);
+    }
+    for (size_t i = 1; i < rest.size(); i++) {
+        if (rest[i].sequence != rest[i - 1].sequence + 1) {
+            fail("gap after overflow", rest[i].sequence);
+            break;
+        }
+    }
+}
+
+void check_power_cuts(const Geometry &geometry, int cuts)
+{
+    HeapBlockDevice flash(8 * SampleLog::MIN_SECTOR_SIZE, 1, geometry.program, geometry.erase);
+    PowerCutDevice device(flash);
+    std::map<uint32_t, PayloadValues> stored; // appended and not acknowledged
+    uint32_t cutAppend = 0;                    // sequence of an append the power cut, may be there
+    PayloadValues cutValues;
+    uint32_t cutAck = 0;                       // ack the power cut, may have landed
+
+    for (int round = 0; round < cuts; round++) {
+        device.powerOn();
+        SampleLog log(device);
+        if (log.mount()) {
+            fail("mount after a power cut", round);
+            return;
+        }
+
+        std::vector<PayloadSample> samples = unsent(log);
+        std::map<uint32_t, PayloadValues> found;
+        for (size_t i = 0; i < samples.size(); i++) {
+            const PayloadSample &sample = samples[i];
+            auto it = stored.find(sample.sequence);
+            bool known = it != stored.end() ? same_values(it->second, sample.values)
+                         : sample.sequence == cutAppend && same_values(cutValues, sample.values);
+            if (!known) {
+                fail("acknowledged, unknown or damaged sample after a power cut", sample.sequence);
+            }
+            if (i > 0 && sample.sequence <= samples[i - 1].sequence) {
+                fail("samples out of order", sample.sequence);
+            }
+            found[sample.sequence] = sample.values;
+        }
+        for (const auto &entry : stored) {
+            if (entry.first > cutAck && !found.count(entry.first)) {
+                fail("sample lost by a power cut", entry.first);
+            }
+        }
+        if (log.stats().lost) {
+            fail("samples overwritten", log.stats().lost);
+        }
+        stored.swap(found);
+        cutAppend = 0;
+        cutAck = 0;
+
+        // Random appends and acks until the power goes, unsent samples well below the capacity
+        device.cutAfter(rand() % 200);
+        while (!device.off()) {
+            if (rand() % 4 && log.pending() < log.capacity() / 2) {
+                PayloadValues values = random_values();
+                uint32_t sequence = log.nextSequence();
+                if (log.append(static_cast<uint32_t>(round), values)) {
+                    stored[sequence] = values;
+                } else {
+                    cutAppend = sequence;
+                    cutValues = values;
+                }
+            } else if (!stored.empty()) {
+                auto last = stored.begin();
+                std::advance(last, rand() % stored.size());
+                uint32_t through = last->first;
+                if (log.acknowledge(through) && !device.off()) {
+                    stored.erase(stored.begin(), std::next(last));
+                } else {
+                    cutAck = through;
+                }
+            }
+        }
+    }
+}
+
+/** Appends samples with an uplink of six every six samples, prints the costs */
+void bench(const Geometry &geometry, long samples)
+{
+    HeapBlockDevice flash(DEVICE_SIZE, 1, geometry.program, geometry.erase);
+    SampleLog log(flash);
+    log.mount();
+    flash.resetStats();
+
+    std::vector<PayloadValues> pool;
+    for (int i = 0; i < 64; i++) {
+        pool.push_back(random_values());
+    }
+    PayloadSample storage[6];
+    PayloadBatch batch(storage, 6);
+    uint64_t appendNs = 0;
+    uint64_t fillNs = 0;
+    uint64_t ackNs = 0;
+    long uplinks = 0;
+    for (long i = 0; i < samples; i++) {
+        uint64_t start = now_ns();
+        log.append(static_cast<uint32_t>(i * 60000), pool[i % pool.size()]);
+        appendNs += now_ns() - start;
+        if (i % 6 == 5) {
+            start = now_ns();
+            log.fill(batch);
+            uint64_t filled = now_ns();
+            log.acknowledge(batch.at(batch.count() - 1).sequence);
+            fillNs += filled - start;
+            ackNs += now_ns() - filled;
+            uplinks++;
+        }
+    }
+    const HeapBlockDevice::Stats run = flash.stats();
+
+    // Recovery of the full ring
+    flash.resetStats();
+    SampleLog again(flash);
+    uint64_t start = now_ns();
+    again.mount();
+    uint64_t mountNs = now_ns() - start;
+
+    uint32_t least = UINT32_MAX;
+    uint32_t most = 0;
+    for (uint32_t count : flash.eraseCounts()) {
+        least = count < least ? count : least;
+        most = count > most ? count : most;
+    }
+    const double unitErasesPerSample = static_cast<double>(run.erases) / flash.eraseCounts().size() / samples;
+
+    printf("%s, %llu KB, %u samples at least:\n", geometry.name,
+           static_cast<unsigned long long>(DEVICE_SIZE / 1024), log.capacity());
+    printf("  append %6.0f ns, fill of 6 %6.0f ns, ack %6.0f ns, mount of the full log %.0f us (%llu bytes read)\n",
+           static_cast<double>(appendNs) / samples, static_cast<double>(fillNs) / uplinks,
+           static_cast<double>(ackNs) / uplinks, mountNs / 1000.0,
+           static_cast<unsigned long long>(flash.stats().readBytes));
+    printf("  per sample %.1f bytes programmed (with acks and headers), %.1f bytes erased\n",
+           static_cast<double>(run.programBytes) / samples,
+           static_cast<double>(run.erases) * geometry.erase / samples);
+    printf("  erases per page between %u and %u; at one sample a minute a page sees %.0f erases a year,"
+           " 10000 cycles last %.0f years\n",
+           least, most, unitErasesPerSample * 525600, 10000 / (unitErasesPerSample * 525600));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    long samples = 100000;
+    int cuts = 2000;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--self-test")) {
+            test = true;
+        } else if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--cuts") && i + 1 < argc) {
+            cuts = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--self-test] [--samples N] [--cuts N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    if (test) {
+        for (const Geometry &geometry : GEOMETRIES) {
+            check_basics(geometry);
+            check_power_cuts(geometry, cuts);
+        }
+        if (failures) {
+            printf("%d failures\n", failures);
+            return 1;
+        }
+        printf("ok\n");
+        return 0;
+    }
+    printf("%ld samples, an uplink with six every six samples\n", samples);
+    for (const Geometry &geometry : GEOMETRIES) {
+        bench(geometry, samples);
+    }
+    return 0;
+}
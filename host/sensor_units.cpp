@@ -0,0 +1,213 @@
+/*
+ * Check and benchmark of the integer conversions in sensor_units.h.
+ *
+ * --self-test compares them with the float conversions they replaced
+ * (the driver formula, then payload_quantize()), for every Si7021 and
+ * ADC code and every MMA8451 count. The Si7021 and single-count MMA8451
+ * conversions must be bit-exact with the float path, ties included. The
+ * ADC and the FIFO mean must be bit-exact with the exactly rounded value
+ * (computed in 64-bit integers). Where the old single-precision path
+ * rounds differently from that, it is reported but is not a failure.
+ *
+ * Without --self-test it times both paths over all codes, in TSC cycles
+ * on x86 and ns otherwise. The host has a hardware double FPU, so this is
+ * a lower bound for the gap. On a Cortex-M4F every double operation is
+ * a library call, and on a Cortex-M0 every float operation is.
+ *
+ *   sensor-units [--self-test] [--samples N] [--seed S]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "payload.h"
+#include "sensor_units.h"
+
+namespace {
+
+/** Time stamp for the conversion loops, cycles where the CPU has a TSC */
+uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+const char *const TICK_UNIT = "cycles";
+#else
+const char *const TICK_UNIT = "ns";
+#endif
+
+// The float conversions as the drivers did them before sensor_units.h
+
+int32_t float_humidity(uint16_t code)
+{
+    float humidity = ((125.0 * code) / 65536) - 6.0;
+    return payload_quantize(PAYLOAD_HUMID, humidity);
+}
+
+int32_t float_temperature(uint16_t code)
+{
+    float temperature = ((175.72 * code) / 65536) - 46.85;
+    return payload_quantize(PAYLOAD_TEMP, temperature);
+}
+
+int32_t float_acceleration(int32_t count)
+{
+    float acceleration = static_cast<float>(count) / 4096.0 * 9.81;
+    return payload_quantize(PAYLOAD_ACC_X, acceleration);
+}
+
+int32_t float_mean_acceleration(int32_t sum, int32_t samples)
+{
+    return payload_quantize(PAYLOAD_ACC_X, sum / (float)samples / 4096.0f * 9.81f);
+}
+
+int32_t float_adc_percent(uint16_t code)
+{
+    float fraction = code / 65535.0f; // AnalogIn::read()
+    return payload_quantize(PAYLOAD_LIGHT, fraction * 100.0f);
+}
+
+/** numerator / denominator rounded to nearest, ties away from zero */
+int64_t round_exact(int64_t numerator, int64_t denominator)
+{
+    const int64_t magnitude = ((numerator < 0 ? -numerator : numerator) * 2 + denominator) / (2 * denominator);
+    return numerator < 0 ? -magnitude : magnitude;
+}
+
+int failures;
+
+void check(const char *what, long input, int32_t expected, int32_t actual)
+{
+    if (expected != actual) {
+        if (failures++ < 10) {
+            printf("FAIL: %s(%ld) = %ld, expected %ld\n", what, input, static_cast<long>(actual),
+                   static_cast<long>(expected));
+        }
+    }
+}
+
+int self_test(long samples)
+{
+    for (uint32_t code = 0; code <= UINT16_MAX; code++) {
+        check("si7021_humidity_steps", code, float_humidity(code), si7021_humidity_steps(code));
+        check("si7021_temperature_steps", code, float_temperature(code), si7021_temperature_steps(code));
+    }
+    for (int32_t count = -8192; count < 8192; count++) {
+        check("mma8451_acceleration_steps", count, float_acceleration(count), mma8451_acceleration_steps(count));
+    }
+
+    int float_off = 0;
+    for (uint32_t code = 0; code <= UINT16_MAX; code++) {
+        int32_t exact = static_cast<int32_t>(round_exact(static_cast<int64_t>(code) * 1000, 65535));
+        check("adc_percent_steps", code, exact, adc_percent_steps(code));
+        float_off += float_adc_percent(code) != exact;
+    }
+    printf("adc: %u codes exact, float path off by one step at %d\n", UINT16_MAX + 1, float_off);
+
+    // FIFO means over up to a day at 50 Hz, around a random count with noise. Past a few
+    // hours the sums leave the 32-bit range, only the shorter ones can go the float path.
+    int mean_off = 0;
+    for (long i = 0; i < samples; i++) {
+        const int32_t n = 1 + (rand() % 2 ? rand() % (50 * 3600) : rand() % (50 * 86400));
+        const int64_t sum = static_cast<int64_t>(rand() % 16384 - 8192) * n + rand() % (2 * n + 1) - n;
+        int32_t exact = payload_clamp(PAYLOAD_ACC_X, round_exact(sum * 981, static_cast<int64_t>(n) * 4096));
+        check("mma8451_mean_acceleration_steps", static_cast<long>(sum), exact,
+              mma8451_mean_acceleration_steps(sum, n));
+        if (sum >= INT32_MIN && sum <= INT32_MAX) {
+            mean_off += float_mean_acceleration(static_cast<int32_t>(sum), n) != exact;
+        }
+    }
+    // 1 g for three hours at 50 Hz, just past INT32_MAX, and the full range for a day
+    const int32_t three_hours = 50 * 3 * 3600;
+    check("mma8451_mean_acceleration_steps", 4096L * three_hours, 981,
+          mma8451_mean_acceleration_steps(static_cast<int64_t>(4096) * three_hours, three_hours));
+    check("mma8451_mean_acceleration_steps", -8192L * 50 * 86400, -1962,
+          mma8451_mean_acceleration_steps(static_cast<int64_t>(-8192) * 50 * 86400, 50 * 86400));
+    printf("fifo mean: %ld sums exact, float path off by one step at %d\n", samples, mean_off);
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+volatile int32_t sink;
+
+template <typename F>
+double time_codes(uint32_t first, uint32_t last, F convert)
+{
+    int32_t total = 0;
+    uint64_t start = ticks();
+    for (int round = 0; round < 16; round++) {
+        for (uint32_t code = first; code <= last; code++) {
+            total += convert(code);
+        }
+    }
+    uint64_t stop = ticks();
+    sink = total;
+    return static_cast<double>(stop - start) / (16.0 * (last - first + 1));
+}
+
+void bench()
+{
+    printf("%-12s %10s %10s  (%s per conversion)\n", "conversion", "float", "integer", TICK_UNIT);
+    printf("%-12s %10.1f %10.1f\n", "humidity",
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return float_humidity(c); }),
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return si7021_humidity_steps(c); }));
+    printf("%-12s %10.1f %10.1f\n", "temperature",
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return float_temperature(c); }),
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return si7021_temperature_steps(c); }));
+    printf("%-12s %10.1f %10.1f\n", "acceleration",
+           time_codes(0, 16383, [](uint32_t c) { return float_acceleration(static_cast<int32_t>(c) - 8192); }),
+           time_codes(0, 16383, [](uint32_t c) { return mma8451_acceleration_steps(static_cast<int32_t>(c) - 8192); }));
+    printf("%-12s %10.1f %10.1f\n", "fifo mean",
+           time_codes(1, 3000, [](uint32_t n) { return float_mean_acceleration(4000 * n + n / 3, n); }),
+           time_codes(1, 3000, [](uint32_t n) { return mma8451_mean_acceleration_steps(4000 * n + n / 3, n); }));
+    printf("%-12s %10.1f %10.1f\n", "adc percent",
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return float_adc_percent(c); }),
+           time_codes(0, UINT16_MAX, [](uint32_t c) { return adc_percent_steps(c); }));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bool test = false;
+    long samples = 1000000;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--self-test")) {
+            test = true;
+        } else if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--self-test] [--samples N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    srand(seed);
+    if (test) {
+        return self_test(samples);
+    }
+    bench();
+    return 0;
+}
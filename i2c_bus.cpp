@@ -0,0 +1,190 @@
+#include "i2c_bus.h"
+#include "hal/us_ticker_api.h"
+#include "latency.h"
+
+// The raw HAL ticker counts ticks, 16 bits wide or not at 1 MHz on some targets
+static uint32_t bus_time_us()
+{
+    return static_cast<uint32_t>(ticker_read_us(get_us_ticker_data()));
+}
+
+I2CDevice::I2CDevice(I2CBus &bus, int address, const char *name)
+    : _bus(bus), _address(address), _name(name), _stats()
+{
+    _bus.add(this);
+}
+
+int I2CDevice::write(const char *data, int length)
+{
+    return _bus.transfer(*this, data, length, nullptr, 0);
+}
+
+int I2CDevice::read(char *data, int length)
+{
+    return _bus.transfer(*this, nullptr, 0, data, length);
+}
+
+int I2CDevice::writeRead(const char *tx, int txLength, char *rx, int rxLength)
+{
+    return _bus.transfer(*this, tx, txLength, rx, rxLength);
+}
+
+bool I2CDevice::submit(const char *tx, int txLength, char *rx, int rxLength, Callback<void(int)> done)
+{
+    return _bus.submit(*this, tx, txLength, rx, rxLength, done);
+}
+
+I2CBus::I2CBus(I2C &i2c)
+    : _i2c(i2c), _queue(nullptr), _deviceCount(0), _head(0), _count(0), _active(false),
+      _busy(false), _scheduled(false), _resultLost(false), _lostResult(0), _overflows(0)
+{
+}
+
+void I2CBus::add(I2CDevice *device)
+{
+    MBED_ASSERT(_deviceCount < MAX_DEVICES);
+    _devices[_deviceCount++] = device;
+}
+
+void I2CBus::start(EventQueue &queue)
+{
+    _queue = &queue;
+    if (_count) {
+        schedule();
+    }
+}
+
+bool I2CBus::submit(I2CDevice &device, const char *tx, int txLength, char *rx, int rxLength,
+                    Callback<void(int)> done)
+{
+    if (!_queue || _count == MAX_PENDING) {
+        _overflows++;
+        if (_queue) {
+            schedule(); // A lost result may be what keeps the queue full
+        }
+        return false;
+    }
+    Transaction &transaction = _pending[(_head + _count) % MAX_PENDING];
+    transaction.device = &device;
+    transaction.tx = tx;
+    transaction.txLength = txLength;
+    transaction.rx = rx;
+    transaction.rxLength = rxLength;
+    transaction.done = done;
+    transaction.submitted = bus_time_us();
+    _count++;
+    schedule();
+    return true;
+}
+
+int I2CBus::transfer(I2CDevice &device, const char *tx, int txLength, char *rx, int rxLength)
+{
+    const Transaction transaction = { &device, tx, txLength, rx, rxLength, nullptr, bus_time_us() };
+#if DEVICE_I2C_ASYNCH
+    // The interrupt of the transfer in flight frees the bus, its callback may come later
+    while (core_util_atomic_load_bool(&_busy)) {
+        ThisThread::sleep_for(1ms);
+    }
+#endif
+    int result = execute(transaction);
+    account(transaction, result);
+    return result;
+}
+
+void I2CBus::schedule()
+{
+#if DEVICE_I2C_ASYNCH
+    // The queue was full when the transfer ended, post its result now
+    if (core_util_atomic_exchange_bool(&_resultLost, false)
+            && _queue->call(this, &I2CBus::finish, _lostResult) == 0) {
+        core_util_atomic_store_bool(&_resultLost, true);
+    }
+#endif
+    // One event per transaction, so that other events get the queue in between
+    if (!_scheduled && !_active) {
+        _scheduled = _queue->call(this, &I2CBus::startNext) != 0;
+    }
+}
+
+void I2CBus::startNext()
+{
+    _scheduled = false;
+    if (_active || _count == 0) {
+        return;
+    }
+    _active = true;
+    const Transaction &transaction = _pending[_head];
+#if DEVICE_I2C_ASYNCH
+    core_util_atomic_store_bool(&_busy, true);
+    if (_i2c.transfer(transaction.device->address(), transaction.tx, transaction.txLength,
+                      transaction.rx, transaction.rxLength,
+                      callback(this, &I2CBus::transferDone), I2C_EVENT_ALL) != 0) {
+        core_util_atomic_store_bool(&_busy, false);
+        finish(-1);
+    }
+#else
+    finish(execute(transaction));
+#endif
+}
+
+#if DEVICE_I2C_ASYNCH
+// Interrupt context: free the bus and hand the result to the queue
+void I2CBus::transferDone(int event)
+{
+    const int failed = I2C_EVENT_ERROR | I2C_EVENT_ERROR_NO_SLAVE | I2C_EVENT_TRANSFER_EARLY_NACK;
+    const int result = (event & failed) ? -1 : 0;
+    core_util_atomic_store_bool(&_busy, false);
+    if (_queue->call(this, &I2CBus::finish, result) == 0) {
+        // Queue full: the bus stays active until schedule() gets the result through
+        _lostResult = result;
+        core_util_atomic_store_bool(&_resultLost, true);
+    }
+}
+#endif
+
+void I2CBus::finish(int result)
+{
+    Transaction &transaction = _pending[_head];
+    account(transaction, result);
+    Callback<void(int)> done = transaction.done;
+    _head = (_head + 1) % MAX_PENDING;
+    _count--;
+    _active = false;
+    if (_count) {
+        schedule();
+    }
+    // May submit the next transaction of the same device right away
+    if (done) {
+        done(result);
+    }
+}
+
+int I2CBus::execute(const Transaction &transaction)
+{
+    const int address = transaction.device->address();
+    int result = 0;
+    if (transaction.txLength > 0) {
+        result = _i2c.write(address, transaction.tx, transaction.txLength, transaction.rxLength > 0);
+    }
+    if (result == 0 && transaction.rxLength > 0) {
+        result = _i2c.read(address, transaction.rx, transaction.rxLength);
+    }
+    return result;
+}
+
+void I2CBus::account(const Transaction &transaction, int result)
+{
+    I2CDeviceStats &stats = transaction.device->_stats;
+    uint32_t latency = bus_time_us() - transaction.submitted;
+    stats.transactions++;
+    if (result != 0) {
+        stats.nacks++;
+    } else {
+        stats.bytes += transaction.txLength + transaction.rxLength;
+    }
+    stats.latencyUs += latency;
+    if (latency > stats.maxLatencyUs) {
+        stats.maxLatencyUs = latency;
+    }
+    latency_record_us(LATENCY_I2C, latency);
+}
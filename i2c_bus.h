@@ -0,0 +1,139 @@
+#ifndef APP_I2C_BUS_H_
+#define APP_I2C_BUS_H_
+
+#include <cstdint>
+#include "mbed.h"
+
+class I2CBus;
+
+/**
+ * Transaction counters of one device. latency is measured from submit()
+ * (or the blocking call) to the completion and includes the time spent
+ * waiting behind other devices' transactions.
+ */
+struct I2CDeviceStats {
+    uint32_t transactions;
+    uint32_t nacks;         // address or data NACK, bus error or bus busy
+    uint32_t bytes;         // written and read, successful transactions only
+    uint64_t latencyUs;     // sum over all transactions
+    uint32_t maxLatencyUs;
+};
+
+/**
+ * One device on an I2CBus, under its 8-bit address. The drivers talk to
+ * the bus only through this, so every transaction is arbitrated and
+ * counted per device.
+ */
+class I2CDevice {
+public:
+    I2CDevice(I2CBus &bus, int address, const char *name);
+
+    /** Blocking, returns 0 on success like mbed::I2C */
+    int write(const char *data, int length);
+    int read(char *data, int length);
+
+    /** Writes tx, then reads rx after a repeated start */
+    int writeRead(const char *tx, int txLength, char *rx, int rxLength);
+
+    /**
+     * Queues a transaction, see I2CBus::submit(). Either buffer may be
+     * empty. done gets 0 on success.
+     */
+    bool submit(const char *tx, int txLength, char *rx, int rxLength, Callback<void(int)> done);
+
+    int address() const { return _address; }
+    const char *name() const { return _name; }
+    const I2CDeviceStats &stats() const { return _stats; }
+
+private:
+    friend class I2CBus;
+
+    I2CBus &_bus;
+    int _address;
+    const char *_name;
+    I2CDeviceStats _stats;
+};
+
+/**
+ * Shared I2C bus with a queue of transactions from several drivers.
+ *
+ * submit() queues a write-then-read transaction and returns at once; the
+ * transactions run one after the other in the order submitted and each
+ * calls its done callback from the bus queue. With DEVICE_I2C_ASYNCH they
+ * run on the interrupt-driven I2C::transfer() and the queue is free for
+ * other events until the bus is done. Without it every transaction is a
+ * queue event of its own, so events of other devices can still run in
+ * between, e.g. while a sensor is converting.
+ *
+ * The blocking calls wait for a transfer in flight and then go ahead of
+ * the queued transactions. They are meant for configuration and for
+ * the few reads that are not worth a callback.
+ *
+ * submit() and the blocking calls must come from the bus queue's thread.
+ */
+class I2CBus {
+public:
+    static const int MAX_DEVICES = 8;
+    static const int MAX_PENDING = 8;
+
+    explicit I2CBus(I2C &i2c);
+
+    /** Queued transactions and their callbacks run on queue */
+    void start(EventQueue &queue);
+
+    /**
+     * Queues a transaction for device. tx and rx must stay valid until
+     * done is called. Returns false if the queue is full or the bus not
+     * started; done is not called then.
+     */
+    bool submit(I2CDevice &device, const char *tx, int txLength, char *rx, int rxLength,
+                Callback<void(int)> done);
+
+    /** Blocking transaction, returns 0 on success */
+    int transfer(I2CDevice &device, const char *tx, int txLength, char *rx, int rxLength);
+
+    int deviceCount() const { return _deviceCount; }
+    const I2CDevice &device(int index) const { return *_devices[index]; }
+
+    /** Transactions refused because the queue was full */
+    uint32_t overflows() const { return _overflows; }
+
+private:
+    friend class I2CDevice;
+
+    struct Transaction {
+        I2CDevice *device;
+        const char *tx;
+        int txLength;
+        char *rx;
+        int rxLength;
+        Callback<void(int)> done;
+        uint32_t submitted;   // µs, wraps after 71 min
+    };
+
+    void add(I2CDevice *device);
+    void schedule();
+    void startNext();
+    void finish(int result);
+    int execute(const Transaction &transaction);
+    void account(const Transaction &transaction, int result);
+#if DEVICE_I2C_ASYNCH
+    void transferDone(int event);
+#endif
+
+    I2C &_i2c;
+    EventQueue *_queue;
+    I2CDevice *_devices[MAX_DEVICES];
+    int _deviceCount;
+    Transaction _pending[MAX_PENDING];
+    int _head;
+    int _count;
+    bool _active;               // the head transaction was started
+    volatile bool _busy;        // I2C::transfer() in flight, cleared from its interrupt
+    bool _scheduled;            // a startNext() event is posted
+    volatile bool _resultLost;  // transferDone() could not post finish(), schedule() retries
+    int _lostResult;
+    uint32_t _overflows;
+};
+
+#endif /* APP_I2C_BUS_H_ */
@@ -0,0 +1,209 @@
+#include "latency.h"
+#include "deferred_log.h"
+
+#if defined(__MBED__)
+#include "hal/us_ticker_api.h"
+#if defined(DWT) && defined(__CORTEX_M) && (__CORTEX_M >= 3)
+#define LATENCY_DWT 1
+#endif
+#else
+#include <chrono>
+#endif
+
+#define LATENCY_SPAN_NAME(id, name) name,
+const char *const latency_span_names[LATENCY_SPAN_COUNT] = {
+    LATENCY_SPANS(LATENCY_SPAN_NAME)
+};
+#undef LATENCY_SPAN_NAME
+
+namespace {
+
+LatencyStats stats[LATENCY_SPAN_COUNT];
+
+const size_t SPAN_BYTES = 7;
+
+void put_span(uint8_t *p, unsigned span, const LatencyStats &s)
+{
+    const uint16_t count = s.count > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(s.count);
+    p[0] = static_cast<uint8_t>(span);
+    p[1] = static_cast<uint8_t>(count >> 8);
+    p[2] = static_cast<uint8_t>(count);
+    p[3] = static_cast<uint8_t>(latency_bucket(s.minUs));
+    p[4] = static_cast<uint8_t>(latency_bucket(static_cast<uint32_t>(s.sumUs / s.count)));
+    p[5] = static_cast<uint8_t>(latency_bucket(latency_quantile(s, 990)));
+    p[6] = static_cast<uint8_t>(latency_bucket(s.maxUs));
+}
+
+} // namespace
+
+uint32_t latency_ticks()
+{
+#if LATENCY_DWT
+    return DWT->CYCCNT;
+#elif defined(__MBED__)
+    // Not us_ticker_read(): that counts raw HAL ticks, only 16 bits wide on e.g. STM32L0
+    return static_cast<uint32_t>(ticker_read_us(get_us_ticker_data()));
+#else
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void latency_init()
+{
+#if LATENCY_DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void latency_record(LatencySpan span, uint32_t start)
+{
+    const uint32_t ticks = latency_ticks() - start;
+#if LATENCY_DWT
+    const uint32_t perUs = SystemCoreClock / 1000000;
+    latency_record_us(span, ticks / (perUs ? perUs : 1));
+#else
+    latency_record_us(span, ticks);
+#endif
+}
+
+void latency_record_us(LatencySpan span, uint32_t us)
+{
+    LatencyStats &s = stats[span];
+    const unsigned bucket = latency_bucket(us);
+    if (s.buckets[bucket] == UINT16_MAX) {
+        // Keeps the shape of the distribution, older samples weigh less
+        for (uint16_t &count : s.buckets) {
+            count /= 2;
+        }
+    }
+    s.buckets[bucket]++;
+    if (s.count == 0 || us < s.minUs) {
+        s.minUs = us;
+    }
+    if (us > s.maxUs) {
+        s.maxUs = us;
+    }
+    s.count++;
+    s.sumUs += us;
+}
+
+const LatencyStats &latency_stats(LatencySpan span)
+{
+    return stats[span];
+}
+
+void latency_reset()
+{
+    for (LatencyStats &s : stats) {
+        s = LatencyStats();
+    }
+}
+
+unsigned latency_bucket(uint32_t us)
+{
+    if (us < 4) {
+        return us;
+    }
+    unsigned exponent = 2;
+    while (exponent < 31 && (us >> (exponent + 1))) {
+        exponent++;
+    }
+    const unsigned bucket = 4 * (exponent - 1) + ((us >> (exponent - 2)) & 3);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+uint32_t latency_bucket_floor(unsigned bucket)
+{
+    if (bucket < 4) {
+        return bucket;
+    }
+    const unsigned exponent = bucket / 4 + 1;
+    return static_cast<uint32_t>(4 + bucket % 4) << (exponent - 2);
+}
+
+uint32_t latency_quantile(const LatencyStats &stats, unsigned permille)
+{
+    // The buckets, not count: they may have been halved
+    uint32_t total = 0;
+    for (uint16_t count : stats.buckets) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    const uint32_t rank = static_cast<uint32_t>((static_cast<uint64_t>(total) * permille + 999) / 1000);
+    uint32_t seen = 0;
+    unsigned bucket = 0;
+    for (; bucket < LATENCY_BUCKETS - 1; bucket++) {
+        seen += stats.buckets[bucket];
+        if (seen >= rank && seen > 0) {
+            break;
+        }
+    }
+    uint32_t us = bucket + 1 < LATENCY_BUCKETS ? latency_bucket_floor(bucket + 1) - 1 : stats.maxUs;
+    if (us > stats.maxUs) {
+        us = stats.maxUs;
+    }
+    if (us < stats.minUs) {
+        us = stats.minUs;
+    }
+    return us;
+}
+
+void latency_dump()
+{
+    for (unsigned span = 0; span < LATENCY_SPAN_COUNT; span++) {
+        const LatencyStats &s = stats[span];
+        if (!s.count) {
+            continue;
+        }
+        deferred_log(LOG_LATENCY, latency_span_names[span], s.count, s.minUs,
+                     static_cast<uint32_t>(s.sumUs / s.count), latency_quantile(s, 500),
+                     latency_quantile(s, 990), s.maxUs);
+    }
+}
+
+size_t latency_encode(uint8_t *buffer, size_t size)
+{
+    if (size < 1) {
+        return 0;
+    }
+    buffer[0] = LATENCY_FRAME_VERSION;
+    size_t length = 1;
+    for (unsigned span = 0; span < LATENCY_SPAN_COUNT && length + SPAN_BYTES <= size; span++) {
+        if (stats[span].count) {
+            put_span(buffer + length, span, stats[span]);
+            length += SPAN_BYTES;
+        }
+    }
+    return length;
+}
+
+int latency_decode(const uint8_t *buffer, size_t length, LatencyReport *out, size_t max)
+{
+    if (length < 1 || buffer[0] != LATENCY_FRAME_VERSION || (length - 1) % SPAN_BYTES) {
+        return -1;
+    }
+    const size_t spans = (length - 1) / SPAN_BYTES;
+    if (spans > max) {
+        return -1;
+    }
+    for (size_t i = 0; i < spans; i++) {
+        const uint8_t *p = buffer + 1 + i * SPAN_BYTES;
+        if (p[3] >= LATENCY_BUCKETS || p[4] >= LATENCY_BUCKETS || p[5] >= LATENCY_BUCKETS
+                || p[6] >= LATENCY_BUCKETS) {
+            return -1;
+        }
+        LatencyReport &report = out[i];
+        report.span = p[0];
+        report.count = static_cast<uint16_t>((p[1] << 8) | p[2]);
+        report.minUs = latency_bucket_floor(p[3]);
+        report.avgUs = latency_bucket_floor(p[4]);
+        report.p99Us = latency_bucket_floor(p[5]);
+        report.maxUs = latency_bucket_floor(p[6]);
+    }
+    return static_cast<int>(spans);
+}
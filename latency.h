@@ -0,0 +1,125 @@
+#ifndef APP_LATENCY_H_
+#define APP_LATENCY_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mbed.h"
+
+/**
+ * The timed stages of a cycle, in the order of the diagnostics frame.
+ * Adding one at the end keeps older frames decodable.
+ */
+#define LATENCY_SPANS(X)                                                      \
+    X(LATENCY_CLIMATE, "climate")   /* Si7021 read, start to result */        \
+    X(LATENCY_LIGHT, "light")       /* brightness, all oversampling bursts */ \
+    X(LATENCY_SOIL, "soil")         /* soil moisture, likewise */             \
+    X(LATENCY_COLOR, "color")       /* TCS34725 read, start to result */      \
+    X(LATENCY_ACCEL, "accel")       /* MMA8451 read or FIFO drain */          \
+    X(LATENCY_GPS, "gps")           /* GPS ring drain and fix check */        \
+    X(LATENCY_PACK, "pack")         /* get_all_sesnor_data() */               \
+    X(LATENCY_I2C, "i2c")           /* bus transaction, submit to done */     \
+    X(LATENCY_ENCODE, "encode")     /* uplink frame encoding */               \
+    X(LATENCY_SEND, "send")         /* lorawan.send() to TX_DONE, us at ms resolution */
+
+#define LATENCY_SPAN_ID(id, name) id,
+enum LatencySpan {
+    LATENCY_SPANS(LATENCY_SPAN_ID)
+    LATENCY_SPAN_COUNT
+};
+#undef LATENCY_SPAN_ID
+
+extern const char *const latency_span_names[LATENCY_SPAN_COUNT];
+
+/**
+ * Histogram buckets of a span. Durations are sorted in microseconds, up
+ * to 3 exactly, above that 4 buckets per power of two, so a bucket is at
+ * most 25 % wide. The last bucket takes everything from 58.7 s.
+ */
+const unsigned LATENCY_BUCKETS = 100;
+
+/** Counters of one span since the start or latency_reset() */
+struct LatencyStats {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t sumUs;
+    uint16_t buckets[LATENCY_BUCKETS];  // halved together when one is full
+};
+
+/**
+ * Running clock of the spans: the DWT cycle counter on Cortex-M3 and up,
+ * the us ticker converted to microseconds (ticker_read_us()) on smaller
+ * cores, steady_clock in microseconds on the host. It wraps at 32 bits,
+ * at 48 MHz after 89 s and at 120 MHz after 36 s, longer spans come out
+ * wrong: time those with Kernel::Clock and latency_record_us().
+ */
+uint32_t latency_ticks();
+
+/** Starts the cycle counter, call once at startup */
+void latency_init();
+
+/**
+ * Adds the time since start (from latency_ticks()) or a duration in
+ * microseconds to span. Each span should be recorded from one thread
+ * only; nothing is locked, so a dump from another thread may be off by
+ * the sample being recorded.
+ */
+void latency_record(LatencySpan span, uint32_t start);
+void latency_record_us(LatencySpan span, uint32_t us);
+
+/** Times the enclosing scope */
+class LatencyScope {
+public:
+    explicit LatencyScope(LatencySpan span) : _span(span), _start(latency_ticks()) {}
+    ~LatencyScope() { latency_record(_span, _start); }
+
+private:
+    LatencySpan _span;
+    uint32_t _start;
+};
+
+const LatencyStats &latency_stats(LatencySpan span);
+void latency_reset();
+
+/** Bucket of a duration, and the smallest duration in a bucket */
+unsigned latency_bucket(uint32_t us);
+uint32_t latency_bucket_floor(unsigned bucket);
+
+/**
+ * Duration below which permille of the samples of stats lie, the upper
+ * end of its bucket but within min and max. 0 without samples.
+ */
+uint32_t latency_quantile(const LatencyStats &stats, unsigned permille);
+
+/**
+ * Logs a line per span with samples to the deferred log: count, min,
+ * average, p50, p99 and max
+ */
+void latency_dump();
+
+/** First byte of the diagnostics frame, apart from the payload versions */
+const uint8_t LATENCY_FRAME_VERSION = 0x11;
+
+/**
+ * Diagnostics frame: the version byte, then for each span with samples
+ * its index, the count (16 bit big endian, saturated) and min, average,
+ * p99 and max as one byte each, the bucket of the duration. Spans that do
+ * not fit into size are left out. Returns the length, 0 if nothing fits.
+ */
+size_t latency_encode(uint8_t *buffer, size_t size);
+
+/** One span of a decoded diagnostics frame, durations as bucket floors */
+struct LatencyReport {
+    uint8_t span;
+    uint16_t count;
+    uint32_t minUs;
+    uint32_t avgUs;
+    uint32_t p99Us;
+    uint32_t maxUs;
+};
+
+/** Decodes a diagnostics frame into out, returns the number of spans or -1 */
+int latency_decode(const uint8_t *buffer, size_t length, LatencyReport *out, size_t max);
+
+#endif /* APP_LATENCY_H_ */
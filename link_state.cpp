@@ -0,0 +1,224 @@
+#include "link_state.h"
+#include "crc32.h"
+
+#include <cstring>
+
+namespace {
+
+// Record layout: magic, sequence, boots, joins, failedJoins (16 bit),
+// dataRate, a reserved byte, joinMs, firstUplinkMs, and the CRC of
+// everything before it in the last four bytes of the slot
+const uint32_t RECORD_SIZE = 32;
+const uint32_t RECORD_MAGIC = 0x014b4e4c; // "LNK" and the layout version 1
+
+void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bd_size_t round_up(bd_size_t value, bd_size_t unit)
+{
+    return (value + unit - 1) / unit * unit;
+}
+
+} // namespace
+
+LinkStateStore::LinkStateStore(BlockDevice &device)
+    : _device(device),
+      _mounted(false),
+      _sectorSize(0),
+      _sectorCount(0),
+      _slotSize(0),
+      _slotsPerSector(0),
+      _eraseValue(0xff),
+      _sector(0),
+      _slot(0),
+      _sequence(0),
+      _stats()
+{
+}
+
+int LinkStateStore::mount(LinkState &state)
+{
+    _mounted = false;
+    memset(&state, 0, sizeof(state));
+    int err = _device.init();
+    if (err) {
+        return err;
+    }
+
+    const bd_size_t eraseSize = _device.get_erase_size();
+    const bd_size_t unit = _device.get_program_size() > _device.get_read_size() ? _device.get_program_size()
+                           : _device.get_read_size();
+    _slotSize = round_up(RECORD_SIZE, unit);
+    _sectorSize = round_up(MIN_SECTOR_SIZE, eraseSize);
+    _sectorCount = _device.size() / _sectorSize;
+    _slotsPerSector = _sectorSize / _slotSize;
+    _eraseValue = _device.get_erase_value();
+    if (_slotSize > MAX_SLOT_SIZE || _sectorCount < 2) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    for (uint32_t sector = 0; sector < _sectorCount; sector++) {
+        if (_device.get_erase_size(sector * _sectorSize) != eraseSize) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+    }
+    memset(&_stats, 0, sizeof(_stats));
+
+    const uint8_t erased = _eraseValue < 0 ? 0xff : static_cast<uint8_t>(_eraseValue);
+    bool found = false;
+    uint32_t newestSector = 0;
+    for (uint32_t sector = 0; sector < _sectorCount; sector++) {
+        for (uint32_t slot = 0; slot < _slotsPerSector; slot++) {
+            if (_device.read(_buffer, address(sector, slot), _slotSize)) {
+                return BD_ERROR_DEVICE_ERROR;
+            }
+            uint32_t i = 0;
+            while (i < _slotSize && _buffer[i] == erased) {
+                i++;
+            }
+            if (i == _slotSize) {
+                continue;
+            }
+            if (get32(_buffer) != RECORD_MAGIC || get32(_buffer + _slotSize - 4) != crc32(_buffer, _slotSize - 4)) {
+                _stats.corrupt++;
+                continue;
+            }
+            const uint32_t sequence = get32(_buffer + 4);
+            if (found && sequence <= _sequence) {
+                continue;
+            }
+            found = true;
+            newestSector = sector;
+            _sequence = sequence;
+            state.boots = get32(_buffer + 8);
+            state.joins = get32(_buffer + 12);
+            state.failedJoins = static_cast<uint16_t>(_buffer[16] | (_buffer[17] << 8));
+            state.dataRate = _buffer[18];
+            state.joinMs = get32(_buffer + 20);
+            state.firstUplinkMs = get32(_buffer + 24);
+        }
+    }
+
+    if (found) {
+        // Behind the last written slot of the newest sector, torn ones included
+        _sector = newestSector;
+        _slot = 0;
+        for (uint32_t slot = 0; slot < _slotsPerSector; slot++) {
+            if (_device.read(_buffer, address(newestSector, slot), _slotSize)) {
+                return BD_ERROR_DEVICE_ERROR;
+            }
+            for (uint32_t i = 0; i < _slotSize; i++) {
+                if (_buffer[i] != erased) {
+                    _slot = slot + 1;
+                    break;
+                }
+            }
+        }
+    } else {
+        // Empty or foreign contents: the first save() erases sector 0
+        _sector = _sectorCount - 1;
+        _slot = _slotsPerSector;
+        _sequence = 0;
+    }
+    _mounted = true;
+    return BD_ERROR_OK;
+}
+
+bool LinkStateStore::save(const LinkState &state)
+{
+    if (!_mounted) {
+        return false;
+    }
+    if (_slot >= _slotsPerSector) {
+        const uint32_t sector = (_sector + 1) % _sectorCount;
+        if (!startSector(sector)) {
+            return false;
+        }
+        _sector = sector;
+        _slot = 0;
+    }
+
+    memset(_buffer, 0xff, _slotSize);
+    put32(_buffer, RECORD_MAGIC);
+    put32(_buffer + 4, _sequence + 1);
+    put32(_buffer + 8, state.boots);
+    put32(_buffer + 12, state.joins);
+    _buffer[16] = static_cast<uint8_t>(state.failedJoins);
+    _buffer[17] = static_cast<uint8_t>(state.failedJoins >> 8);
+    _buffer[18] = state.dataRate;
+    _buffer[19] = 0;
+    put32(_buffer + 20, state.joinMs);
+    put32(_buffer + 24, state.firstUplinkMs);
+    put32(_buffer + _slotSize - 4, crc32(_buffer, _slotSize - 4));
+
+    // A failed write may have left part of the slot programmed, it is skipped either way,
+    // and its sequence number is not used again
+    const uint32_t slot = _slot++;
+    _sequence++;
+    if (_device.program(_buffer, address(_sector, slot), _slotSize)) {
+        return false;
+    }
+    _stats.saves++;
+    return true;
+}
+
+bd_addr_t LinkStateStore::address(uint32_t sector, uint32_t slot) const
+{
+    return sector * _sectorSize + slot * _slotSize;
+}
+
+bool LinkStateStore::startSector(uint32_t sector)
+{
+    const bd_addr_t start = sector * _sectorSize;
+    if (_device.erase(start, _sectorSize)) {
+        return false;
+    }
+    _stats.sectorErases++;
+    if (_eraseValue < 0) {
+        // Erased contents undefined (e.g. HeapBlockDevice on Mbed): make them recognisable
+        memset(_buffer, 0xff, _slotSize);
+        for (bd_addr_t offset = 0; offset + _slotSize <= _sectorSize; offset += _slotSize) {
+            if (_device.program(_buffer, start + offset, _slotSize)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint32_t link_join_delay_ms(uint16_t failedJoins, uint32_t jitterMs, uint32_t backoffMinMs,
+                            uint32_t backoffMaxMs, uint32_t random)
+{
+    if (failedJoins == 0) {
+        return jitterMs ? random % (jitterMs + 1) : 0;
+    }
+    uint64_t ceiling = backoffMinMs;
+    for (uint16_t i = 1; i < failedJoins && ceiling < backoffMaxMs; i++) {
+        ceiling *= 2;
+    }
+    if (ceiling > backoffMaxMs) {
+        ceiling = backoffMaxMs;
+    }
+    const uint32_t half = static_cast<uint32_t>(ceiling / 2);
+    return static_cast<uint32_t>(ceiling) - half + random % (half + 1);
+}
+
+uint32_t link_mix(uint32_t x)
+{
+    // Finaliser of MurmurHash3
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
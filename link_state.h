@@ -0,0 +1,104 @@
+#ifndef APP_LINK_STATE_H_
+#define APP_LINK_STATE_H_
+
+#include <cstdint>
+#include "blockdevice/BlockDevice.h"
+
+/**
+ * What the node remembers about its LoRaWAN link across a reset.
+ *
+ * The session itself (DevAddr, session keys, frame counters, channel
+ * mask) stays inside the Mbed LoRaWAN stack: LoRaWANInterface can neither
+ * read it out after a join nor restore it with the frame counters, so
+ * every reset still costs a join. This keeps what makes that join cheap
+ * for the network: how often joins failed in a row, so that the backoff
+ * of link_join_delay_ms() continues across resets instead of starting
+ * over, the data rate of the last uplink, so that the first uplink is
+ * sized for it, and the timings to compare boots with.
+ */
+struct LinkState {
+    uint32_t boots;
+    uint32_t joins;          // successful joins
+    uint16_t failedJoins;    // connect() in a row that ended in JOIN_FAILURE
+    uint8_t dataRate;        // of the last uplink
+    uint32_t joinMs;         // connect() to CONNECTED of the last join
+    uint32_t firstUplinkMs;  // boot to the first TX_DONE, of the last boot that got there
+};
+
+/** Counters since mount() */
+struct LinkStateStats {
+    uint32_t saves;
+    uint32_t sectorErases;
+    uint32_t corrupt;   // torn or damaged records skipped by mount()
+};
+
+/**
+ * Keeps the newest LinkState on a BlockDevice.
+ *
+ * The device is used as a ring of sectors of at least MIN_SECTOR_SIZE
+ * (whole erase units) filled with fixed-size records, each with a
+ * sequence number and a CRC. save() programs the next slot; when the
+ * sector is full it erases the next one first, so the erases go round the
+ * ring and an erase never touches the newest record. mount() takes the
+ * valid record with the highest sequence. A reset in the middle of a
+ * save() leaves a record that fails its CRC, and the previous state is
+ * found instead.
+ */
+class LinkStateStore {
+public:
+    static const uint32_t MIN_SECTOR_SIZE = 256;
+    static const uint32_t MAX_SLOT_SIZE = 64;
+
+    explicit LinkStateStore(BlockDevice &device);
+
+    /**
+     * Initialises the device and reads the newest state into state, all
+     * zero if there is none. Returns 0 or a BlockDevice error.
+     */
+    int mount(LinkState &state);
+
+    bool mounted() const { return _mounted; }
+
+    /** Stores state as the newest one */
+    bool save(const LinkState &state);
+
+    const LinkStateStats &stats() const { return _stats; }
+
+private:
+    bd_addr_t address(uint32_t sector, uint32_t slot) const;
+    bool startSector(uint32_t sector);
+
+    BlockDevice &_device;
+    bool _mounted;
+    bd_size_t _sectorSize;
+    uint32_t _sectorCount;
+    uint32_t _slotSize;
+    uint32_t _slotsPerSector;
+    int _eraseValue;
+
+    uint32_t _sector;     // sector of the next free slot
+    uint32_t _slot;       // next free slot, _slotsPerSector when the sector is full
+    uint32_t _sequence;   // of the newest record
+    LinkStateStats _stats;
+
+    uint8_t _buffer[MAX_SLOT_SIZE];
+};
+
+/**
+ * Milliseconds to wait before the next connect().
+ *
+ * Without failures a random delay of up to jitterMs, so that nodes that
+ * were reset together (a power cut, a firmware update) do not all join
+ * at the same moment. After failures an exponential backoff: backoffMinMs
+ * after the first one, doubling with each further one up to backoffMaxMs,
+ * each time a random point in the upper half, so that nodes that failed
+ * together spread out further with every round. random is any uniformly
+ * distributed 32-bit number.
+ */
+uint32_t link_join_delay_ms(uint16_t failedJoins, uint32_t jitterMs, uint32_t backoffMinMs,
+                            uint32_t backoffMaxMs, uint32_t random);
+
+/** Scrambles x into a uniformly distributed number, for seeds such as EUI and boot count */
+uint32_t link_mix(uint32_t x);
+
+#endif /* APP_LINK_STATE_H_ */
@@ -28,22 +28,51 @@
 #include "DummySensor.h"
 #include "trace_helper.h"
 #include "lora_radio_helper.h"
-#include "brightness.h"
-#include "soil.h"
-#include "GPS.h"
-#include "temperatur.h"
-#include "color.h"
-#include "Accelerometer.h"
+#include "sensors.h"
+#include "payload_policy.h"
+#include "link_state.h"
+#include "crc32.h"
+#include "latency.h"
+#include "deferred_log.h"
 #include "RGB.h"
 
+#if MBED_CONF_APP_SAMPLE_LOG || MBED_CONF_APP_LINK_STATE
+#if !COMPONENT_FLASHIAP
+#error "sample-log and link-state need the FLASHIAP component, add it with target.components_add"
+#endif
+#include "FlashIAP/FlashIAPBlockDevice.h"
+#endif
+#if MBED_CONF_APP_SAMPLE_LOG
+#include "sample_log.h"
+#endif
+
 
 using namespace events;
 using namespace std::chrono_literals;
 
+/**
+ * Uplinks carry batches of samples, taken on their own timer or kept in
+ * the flash log until they were sent
+ */
+#define SEND_BATCHES (MBED_CONF_APP_SAMPLE_INTERVAL || MBED_CONF_APP_SAMPLE_LOG)
+
+/**
+ * The flash regions at the end of the internal flash: the sample log
+ * last, the link state directly below it
+ */
+#define SAMPLE_LOG_START (MBED_ROM_START + MBED_ROM_SIZE - MBED_CONF_APP_SAMPLE_LOG_SIZE)
+#define LINK_STATE_START ((MBED_CONF_APP_SAMPLE_LOG ? SAMPLE_LOG_START : MBED_ROM_START + MBED_ROM_SIZE) \
+                          - MBED_CONF_APP_LINK_STATE_SIZE)
+
 // Max payload size can be LORAMAC_PHY_MAXPAYLOAD.
-// This example only communicates with much shorter messages (<30 bytes).
+// A single sample is sized by the payload schema in payload.h, batches
+// fill up to the maximum of the current data rate.
 // If longer messages are used, these buffers must be changed accordingly.
-uint8_t tx_buffer[30];
+#if SEND_BATCHES
+uint8_t tx_buffer[222];
+#else
+uint8_t tx_buffer[PAYLOAD_MAX_SIZE];
+#endif
 uint8_t rx_buffer[30];
 
 /*
@@ -56,7 +85,22 @@ uint8_t rx_buffer[30];
  * 10 is the safe number for the stack events, however, if application
  * also uses the queue for whatever purposes, this number should be increased.
  */
-#define MAX_NUMBER_OF_EVENTS            10
+#define MAX_NUMBER_OF_EVENTS            12
+
+/**
+ * Events and stack of the acquisition thread. The sensor scheduler keeps
+ * one event per sensor pending, the sample log a few more that carry a
+ * sample each, the stack covers printf.
+ */
+#define SENSOR_NUMBER_OF_EVENTS         24
+#define SENSOR_THREAD_STACK_SIZE        4096
+
+/**
+ * Stack of the thread writing the deferred log and the trace ring, a
+ * record line, a trace line and stdio
+ */
+#define LOG_THREAD_STACK_SIZE           2048
+#define LOG_FLAG                        1
 
 /**
  * Maximum number of retries for CONFIRMED messages before giving up
@@ -69,47 +113,14 @@ uint8_t rx_buffer[30];
 #define PC_9                            0
 
 
-#define DEF_LATITUDE 52.5200
-#define DEF_LONGITUDE 13.4050
-//#define DEF_ALTITUDE 0
-
 /**
  * Dummy sensor class object
  */
- // Gemeinsame I2C-Instanz für alle Sensoren
-I2C i2c(PB_7, PB_6);  // Dieselben I2C-Pins für alle Sensoren
 DS1820  ds1820(PC_9);
-GPS gps(PA_9, PA_10, PA_12);
-Brightness light_sensor;
-SoilSensor soilmoisture;
-TemperatureSensor tempSensor(i2c);
-ColorSensor colorSensor(i2c);
-Accelerometer accel(i2c);
 RGB rgb;
 
 
 
-// globale Variablen
-// GPS
-int satelliteCount; 
-float latitude, longitude;
-
-// Temp humd
-float temperature, humidity;
-
-// Light sensor
-float brightness;
-
-// soil moisture
-float soil_moisture;
-
-// Color Sensor
-uint16_t clear, red, green, blue;
-
-// Accelerometer
-float x_Axis, y_Axis, z_Axis;
-
-
 /**
 * This event queue is the global event queue for both the
 * application and stack. To conserve memory, the stack is designed to run
@@ -119,6 +130,23 @@ float x_Axis, y_Axis, z_Axis;
 */
 static EventQueue ev_queue(MAX_NUMBER_OF_EVENTS *EVENTS_EVENT_SIZE);
 
+/**
+ * Sensor reads, bus transfers and the sensor interrupts run on their own
+ * queue in a thread below the priority of the one above, so that they can
+ * never delay a stack event. Values come over as a lock-free snapshot.
+ */
+static EventQueue sensor_queue(SENSOR_NUMBER_OF_EVENTS *EVENTS_EVENT_SIZE);
+static Thread sensor_thread(osPriorityBelowNormal, SENSOR_THREAD_STACK_SIZE, nullptr, "sensors");
+
+/**
+ * The sensor printouts only go into the deferred log (deferred_log.h),
+ * the stack traces into the trace ring (trace_helper.h); this thread
+ * writes both to the serial port. It runs below the sensors, so the UART
+ * never holds up the acquisition or the stack, and sleeps while both are
+ * empty.
+ */
+static Thread log_thread(osPriorityLow, LOG_THREAD_STACK_SIZE, nullptr, "log");
+
 /**
  * Event handler.
  *
@@ -138,116 +166,111 @@ static LoRaWANInterface lorawan(radio);
 static lorawan_app_callbacks_t callbacks;
 
 /**
- * Default and configured device EUI, application EUI and application key
+ * Decides between keyframe and delta frame, the baseline is committed on TX_DONE.
+ * Batches optionally go out as lossless history frames
  */
-static const uint8_t DEFAULT_DEV_EUI[] = {0x40, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
-//static uint8_t DEV_EUI[] = {0x7c, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
-//static uint8_t APP_EUI[] = {0x70, 0xb3, 0xd5, 0x7e, 0xd0, 0x00, 0xfc, 0x4d};
-//static uint8_t APP_KEY[] = {0xf3, 0x1c, 0x2e, 0x8b, 0xc6, 0x71, 0x28, 0x1d,
-//                            0x51, 0x16, 0xf0, 0x8f, 0xf0, 0xb7, 0x92, 0x8f};
-
-static uint8_t DEV_EUI[] = {0x7c, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
-static uint8_t APP_EUI[] = {0x70, 0xb3, 0xd5, 0x7e, 0xd0, 0x00, 0xac, 0x4a};
-static uint8_t APP_KEY[] = {0xf3, 0x1c, 0x2e, 0x8b, 0xc6, 0x71, 0x28, 0x1d,
-                            0x51, 0x16, 0xf0, 0x8f, 0xf0, 0xb7, 0x92, 0x8f};
-
+static PayloadPolicy payload_policy(MBED_CONF_APP_PAYLOAD_KEYFRAME_INTERVAL,
+                                    MBED_CONF_APP_PAYLOAD_COMPRESSION);
 
-// Define packed struct for GPS data
-struct __attribute__((packed)) sensor_data {
-    float lat;
-    float lon;
-    //int16_t alt;
+/**
+ * Maximum application payload per EU868 data rate (LoRaWAN Regional
+ * Parameters, without FOpts), indexed by the data rate of the last uplink
+ */
+static const uint8_t EU868_MAX_PAYLOAD[] = {51, 51, 51, 115, 222, 222, 222, 222};
+static uint8_t tx_data_rate;
 
-    int16_t temp;
-    int16_t humid;
+#if SEND_BATCHES
+/**
+ * Samples taken every sample-interval seconds independent of the uplinks,
+ * each uplink carries as many of them as fit. With the flash log this is
+ * refilled from the log with the oldest unsent samples before each uplink
+ */
+static PayloadSample batch_storage[MBED_CONF_APP_BATCH_CAPACITY];
+static PayloadBatch batch(batch_storage, MBED_CONF_APP_BATCH_CAPACITY);
+static bool send_after_sample;
 
-    int16_t light;
-    int16_t soil;
-    
-    int16_t clear;
-    int16_t red;
-    int16_t green;
-    int16_t blue;
+static void take_sample();
+#endif
 
-    int16_t acc_x;
-    int16_t acc_y;
-    int16_t acc_z;
-};
+#if MBED_CONF_APP_SAMPLE_LOG
+/**
+ * Samples that have not been sent survive a full batch and a reset in the
+ * last sample-log-size bytes of the internal flash
+ */
+static FlashIAPBlockDevice sample_log_flash(SAMPLE_LOG_START, MBED_CONF_APP_SAMPLE_LOG_SIZE);
+static SampleLog sample_log(sample_log_flash);
 
-struct sensor_data mySensor_data;
+/**
+ * Without an RTC the kernel clock starts at 0 after a reset, the sample
+ * timestamps continue after the newest one in the log instead
+ */
+static uint32_t sample_clock_offset;
 
-void get_all_sesnor_data()
-{
-    // GPS
-    gps.readAndProcessGPSData();
-    satelliteCount = gps.getNumSatellites();
-    latitude = gps.getLatitude();
-    longitude = gps.getLongitude();
-    //altitude = gps.getAltitude();
-
-    // Temp and Humid
-    temperature = tempSensor.readTemperature();
-    humidity = tempSensor.readHumidity();
-
-    // Light and Soil Mositure
-    brightness = light_sensor.read();
-    soil_moisture = soilmoisture.readMoisture();
-    
-    // Color Sensor
-    colorSensor.init();
-    colorSensor.readColorData(clear, red, green, blue);
-
-    // Accelerometer
-    accel.initialize();
-    x_Axis = accel.getAccX();
-    y_Axis = accel.getAccY();
-    z_Axis = accel.getAccZ();
-
-    // Print all sensor data
-    printf("\n--- Sensor Data ---\n");
-    printf("GPS: Satellites: %d, Latitude: %.6f, Longitude: %.6f\n", 
-           satelliteCount, latitude, longitude);
-    printf("Temperature: %.2f °C, Humidity: %.2f %%\n", temperature, humidity);
-    printf("Brightness: %.2f, Soil Moisture: %.2f\n", brightness, soil_moisture);
-    printf("Color: Clear: %d, Red: %d, Green: %d, Blue: %d\n", clear, red, green, blue);
-    printf("Accelerometer: X: %.2f, Y: %.2f, Z: %.2f\n", x_Axis, y_Axis, z_Axis);
-
-    // Default if no signal
-    if(latitude == 0.0)
-    {
-        mySensor_data.lat = DEF_LATITUDE;
-    }  
-    else mySensor_data.lat = latitude;
+/**
+ * After mount() the log is only used on sensor_queue, so that programming
+ * and erasing the flash never hold up a stack event. fill_batch() hands
+ * the batch and these counters over to ev_queue together with the uplink
+ */
+static uint32_t sample_log_pending;
+static uint32_t sample_log_lost;
+#endif
 
-    if(longitude == 0.0)
-    {
-        mySensor_data.lon = DEF_LONGITUDE;
-    }
-    else mySensor_data.lon = longitude;
+/**
+ * Failed joins in a row, the data rate and the timings of the link.
+ * With link-state they are kept in the flash, so that the join backoff
+ * goes on after a reset. LoRaWANInterface does not give out the session
+ * (DevAddr, keys, frame counters), so every reset still needs a join
+ */
+static LinkState link_state;
+#if MBED_CONF_APP_LINK_STATE
+static FlashIAPBlockDevice link_state_flash(LINK_STATE_START, MBED_CONF_APP_LINK_STATE_SIZE);
+static LinkStateStore link_state_store(link_state_flash);
+#endif
 
-    //if(altitude == 0.0)
-    //{
-    //    mySensor_data.alt = DEF_ALTITUDE;
-    //}
-    //else mySensor_data.alt = (int16_t)altitude;
+/**
+ * Parameters of the join, started by schedule_join() after the jitter or backoff
+ */
+static lorawan_connect_t connect_params;
+static uint32_t join_seed;
+static Kernel::Clock::time_point join_start;
+static bool first_uplink_sent;
 
+static void schedule_join();
+static void join_failed();
+static void save_link_state();
+static void wake_log();
+static void drain_log();
 
-    // Data to struct with numbers after ","
-    mySensor_data.temp = (int16_t)(temperature * 100.0f);
-    mySensor_data.humid = (int16_t)(humidity * 100.0f);
+/**
+ * Start of the pending transmission, TX_DONE closes the send span. In
+ * kernel ticks, not latency_ticks(): with the duty-cycle wait and the RX
+ * windows the span can outlast the wrap of the cycle counter.
+ */
+static Kernel::Clock::time_point send_started;
 
-    mySensor_data.soil = (int16_t)(soil_moisture * 100.0f);
-    mySensor_data.light = (int16_t)(brightness * 100.0f);
+#if MBED_CONF_APP_DIAGNOSTICS_INTERVAL
+/**
+ * Every diagnostics-interval uplinks one diagnostics frame with the
+ * latency histograms goes out on diagnostics-port instead of the data
+ */
+static uint16_t uplinks_since_diagnostics;
+static bool diagnostics_pending;
+static bool send_diagnostics();
+#endif
 
-    mySensor_data.clear = clear;
-    mySensor_data.red = red;
-    mySensor_data.green = green;
-    mySensor_data.blue = blue;
+/**
+ * Default and configured device EUI, application EUI and application key
+ */
+static const uint8_t DEFAULT_DEV_EUI[] = {0x40, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
+//static uint8_t DEV_EUI[] = {0x7c, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
+//static uint8_t APP_EUI[] = {0x70, 0xb3, 0xd5, 0x7e, 0xd0, 0x00, 0xfc, 0x4d};
+//static uint8_t APP_KEY[] = {0xf3, 0x1c, 0x2e, 0x8b, 0xc6, 0x71, 0x28, 0x1d,
+//                            0x51, 0x16, 0xf0, 0x8f, 0xf0, 0xb7, 0x92, 0x8f};
 
-    mySensor_data.acc_x = (int16_t)(x_Axis * 100.0f);
-    mySensor_data.acc_y = (int16_t)(y_Axis * 100.0f);
-    mySensor_data.acc_z = (int16_t)(z_Axis * 100.0f);
-}
+static uint8_t DEV_EUI[] = {0x7c, 0x39, 0x32, 0x35, 0x59, 0x37, 0x91, 0x94};
+static uint8_t APP_EUI[] = {0x70, 0xb3, 0xd5, 0x7e, 0xd0, 0x00, 0xac, 0x4a};
+static uint8_t APP_KEY[] = {0xf3, 0x1c, 0x2e, 0x8b, 0xc6, 0x71, 0x28, 0x1d,
+                            0x51, 0x16, 0xf0, 0x8f, 0xf0, 0xb7, 0x92, 0x8f};
 
 
 /**
@@ -255,6 +278,7 @@ void get_all_sesnor_data()
  */
 int main(void)
 {
+    latency_init();
     rgb.turn_off_led();
     printf("\r\n*** Sensor Networks @ ETSIST, UPM ***\r\n"
            "   Mbed (v%d.%d.%d) LoRaWAN example\r\n",
@@ -274,11 +298,51 @@ int main(void)
         return -1;
     }
 
+    deferred_log_attach(callback(wake_log));
+    log_thread.start(drain_log);
+
     // setup tracing
-    setup_trace();
+    setup_trace(callback(wake_log));
+
+#if MBED_CONF_APP_LINK_STATE
+    // Auch dieser Bereich muss hinter dem Programm liegen
+    if (LINK_STATE_START < FLASHIAP_APP_ROM_END_ADDR) {
+        printf("\r\n link state overlaps the application, not kept \r\n");
+    } else if (link_state_store.mount(link_state) != 0) {
+        printf("\r\n link state mount failed, not kept \r\n");
+    } else {
+        printf("\r\n link state: %lu boots, %lu joins, %u failed in a row, last join %lu ms,"
+               " first uplink %lu ms after boot \r\n",
+               (unsigned long)link_state.boots, (unsigned long)link_state.joins, link_state.failedJoins,
+               (unsigned long)link_state.joinMs, (unsigned long)link_state.firstUplinkMs);
+    }
+#endif
+    link_state.boots++;
+    save_link_state();
+    // Erster Uplink mit der Nutzlast der letzten Datenrate, bei LENGTH_ERROR mit der von DR0
+    tx_data_rate = link_state.dataRate;
+
+    // power up and configure the sensors once, then keep reading them in the background
+    init_sensors(sensor_queue);
+    sensor_thread.start(callback(&sensor_queue, &EventQueue::dispatch_forever));
+
+#if MBED_CONF_APP_SAMPLE_LOG
+    // Der Log muss hinter dem Programm liegen, sonst überschreibt er es
+    if (SAMPLE_LOG_START < FLASHIAP_APP_ROM_END_ADDR) {
+        printf("\r\n sample log overlaps the application, sending from RAM only \r\n");
+    } else if (sample_log.mount() != 0) {
+        printf("\r\n sample log mount failed, sending from RAM only \r\n");
+    } else {
+        sample_clock_offset = sample_log.lastTimestamp() + 1;
+        printf("\r\n sample log: %lu unsent samples, %lu damaged records skipped \r\n",
+               (unsigned long)sample_log.pending(), (unsigned long)sample_log.stats().corrupt);
+    }
+#endif
 
-    // stores the status of a call to LoRaWAN protocol
-    lorawan_status_t retcode;
+#if MBED_CONF_APP_SAMPLE_INTERVAL
+    // sampling runs from the start, also while joining
+    ev_queue.call_every(std::chrono::seconds(MBED_CONF_APP_SAMPLE_INTERVAL), take_sample);
+#endif
 
     // Initialize LoRaWAN stack
     if (lorawan.initialize(&ev_queue) != LORAWAN_STATUS_OK) {
@@ -310,23 +374,15 @@ int main(void)
 
     printf("\r\n Adaptive data  rate (ADR) - Enabled \r\n");
 
-    lorawan_connect_t connect_params;
     connect_params.connect_type = LORAWAN_CONNECTION_OTAA;
     connect_params.connection_u.otaa.dev_eui = DEV_EUI;
     connect_params.connection_u.otaa.app_eui = APP_EUI;
     connect_params.connection_u.otaa.app_key = APP_KEY;
     connect_params.connection_u.otaa.nb_trials = 3;
 
-    retcode = lorawan.connect(connect_params);
-
-    if (retcode == LORAWAN_STATUS_OK ||
-            retcode == LORAWAN_STATUS_CONNECT_IN_PROGRESS) {
-    } else {
-        printf("\r\n Connection error, code = %d \r\n", retcode);
-        return -1;
-    }
-
-    printf("\r\n Connection - In Progress ...\r\n");
+    // Zufällige Wartezeit je Gerät und Boot, damit nach einem Stromausfall nicht alle gleichzeitig joinen
+    join_seed = link_mix(crc32(DEV_EUI, sizeof(DEV_EUI)) ^ link_state.boots);
+    schedule_join();
 
     //ev_queue.call_every(5s, get_all_sesnor_data);
     //get_all_sesnor_data();
@@ -339,22 +395,255 @@ int main(void)
 
 
 
+static void send_sensor_data();
+
+/**
+ * Wakes the log thread, called from the producers
+ */
+static void wake_log()
+{
+    log_thread.flags_set(LOG_FLAG);
+}
+
+/**
+ * Log thread: prints the deferred records and the trace lines
+ */
+static void drain_log()
+{
+    uint32_t record[LOG_RECORD_MAX_WORDS];
+    char line[3 + 9 * LOG_RECORD_MAX_WORDS];
+    while (true) {
+        ThisThread::flags_wait_any(LOG_FLAG);
+        int words;
+        while ((words = deferred_log_next(record)) >= 0) {
+            fwrite(line, 1, deferred_log_line(record, words, line, sizeof(line)), stdout);
+        }
+        drain_trace();
+    }
+}
+
+/**
+ * Stores the link state, if it is kept in the flash
+ */
+static void save_link_state()
+{
+#if MBED_CONF_APP_LINK_STATE
+    if (link_state_store.mounted() && !link_state_store.save(link_state)) {
+        printf("\r\n link state: save failed \r\n");
+    }
+#endif
+}
+
+/**
+ * Starts the OTAA join with up to nb_trials join requests
+ */
+static void start_join()
+{
+    // keine Sensor-Reads, solange der Join die Queue braucht
+    hold_sensor_reads();
+    join_start = Kernel::Clock::now();
+    lorawan_status_t retcode = lorawan.connect(connect_params);
+
+    if (retcode == LORAWAN_STATUS_OK ||
+            retcode == LORAWAN_STATUS_CONNECT_IN_PROGRESS) {
+        printf("\r\n Connection - In Progress ...\r\n");
+        return;
+    }
+    printf("\r\n Connection error, code = %d \r\n", retcode);
+    release_sensor_reads();
+    join_failed();
+}
+
+/**
+ * Tries again after the backoff, which grows with every failure, also across a reset
+ */
+static void join_failed()
+{
+    if (link_state.failedJoins < UINT16_MAX) {
+        link_state.failedJoins++;
+    }
+    save_link_state();
+    schedule_join();
+}
+
+/**
+ * Starts the join after the jitter, after failed joins after the backoff (link_state.h)
+ */
+static void schedule_join()
+{
+    uint32_t delay = link_join_delay_ms(link_state.failedJoins, MBED_CONF_APP_JOIN_JITTER * 1000,
+                                        MBED_CONF_APP_JOIN_BACKOFF_MIN * 1000,
+                                        MBED_CONF_APP_JOIN_BACKOFF_MAX * 1000, link_mix(join_seed++));
+    printf("\r\n Join in %lu s (%u failed in a row) \r\n", (unsigned long)(delay / 1000), link_state.failedJoins);
+    if (ev_queue.call_in(std::chrono::milliseconds(delay), start_join) == 0) {
+        // Queue voll: lieber gleich als gar nicht
+        start_join();
+    }
+}
+
+#if SEND_BATCHES
+/**
+ * Time of the samples in ms
+ */
+static uint32_t sample_clock()
+{
+    uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+#if MBED_CONF_APP_SAMPLE_LOG
+    now += sample_clock_offset;
+#endif
+    return now;
+}
+
+#if MBED_CONF_APP_SAMPLE_LOG
+/**
+ * Fills the batch with the oldest unsent samples and sends them, on sensor_queue
+ */
+static void fill_batch()
+{
+    sample_log.fill(batch);
+    sample_log_pending = sample_log.pending();
+    sample_log_lost = sample_log.stats().lost;
+    ev_queue.call(send_sensor_data);
+}
+
+/**
+ * Appends a sample to the log, on sensor_queue. With send an uplink is waiting for it
+ */
+static void log_sample(uint32_t timestamp, PayloadValues values, bool send)
+{
+    if (!sample_log.append(timestamp, values)) {
+        printf("\r\n sample log: append failed \r\n");
+    }
+    if (send) {
+        fill_batch();
+    }
+}
+
+/**
+ * Marks all samples up to sequence as sent, on sensor_queue
+ */
+static void acknowledge_samples(uint32_t sequence)
+{
+    sample_log.acknowledge(sequence);
+}
+
+#if MBED_CONF_APP_SAMPLE_INTERVAL
+static void sample_then_send();
+
+/**
+ * Sends the unsent samples of the log, or takes a fresh one if there are none, on sensor_queue
+ */
+static void send_logged_samples()
+{
+    if (sample_log.pending() > 0) {
+        fill_batch();
+    } else {
+        ev_queue.call(sample_then_send);
+    }
+}
+#endif
+#endif
+
+/**
+ * Adds the last acquisition to the log or the batch, sends if an uplink was waiting for it
+ */
+static void store_sample()
+{
+    const bool send = send_after_sample;
+    send_after_sample = false;
+#if MBED_CONF_APP_SAMPLE_LOG
+    if (sample_log.mounted()) {
+        // Flash schreiben im Sensor-Thread, das Senden folgt von dort
+        if (sensor_queue.call(log_sample, sample_clock(), mySensor_data, send)) {
+            return;
+        }
+        printf("\r\n sample log: queue full, sample dropped \r\n");
+    } else
+#endif
+    {
+        batch.push(sample_clock(), mySensor_data);
+    }
+    if (send) {
+        send_sensor_data();
+    }
+}
+
+static void take_sample()
+{
+    start_sensor_acquisition(ev_queue, mbed::callback(store_sample));
+}
+
+/**
+ * Takes a fresh sample, the uplink follows once it is stored
+ */
+static void sample_then_send()
+{
+    send_after_sample = true;
+    take_sample();
+}
+#endif
+
 /**
  * Sends a message to the Network Server
+ *
+ * The sensors are read asynchronously on ev_queue, the actual
+ * transmission happens in send_sensor_data() once they are done.
+ * With sample-interval set the samples are already waiting in the batch,
+ * only an empty batch needs a fresh acquisition. With the flash log and
+ * without sample-interval every uplink takes a fresh acquisition into the
+ * log and carries as many unsent ones as fit, the oldest first.
  */
 static void send_message()
-{   
-    get_all_sesnor_data();
+{
+#if MBED_CONF_APP_DIAGNOSTICS_INTERVAL
+    if (uplinks_since_diagnostics >= MBED_CONF_APP_DIAGNOSTICS_INTERVAL && send_diagnostics()) {
+        return;
+    }
+#endif
+#if SEND_BATCHES
+#if MBED_CONF_APP_SAMPLE_INTERVAL
+#if MBED_CONF_APP_SAMPLE_LOG
+    if (sample_log.mounted()) {
+        // Ob Proben warten, weiß der Sensor-Thread, der den Log führt
+        sensor_queue.call(send_logged_samples);
+        return;
+    }
+#endif
+    if (!batch.empty()) {
+        send_sensor_data();
+        return;
+    }
+#endif
+    sample_then_send();
+#else
+    start_sensor_acquisition(ev_queue, mbed::callback(send_sensor_data));
+#endif
+}
 
+/**
+ * Sends the data of the last acquisition
+ */
+static void send_sensor_data()
+{
     uint16_t packet_len;
     int16_t retcode;
-   
-
-    // Send the struct directly as bytes
-    // Das struct wird durch (uint8_t*)&mySensor_data in einen Zeiger auf Byte-Array (uint8_t*) umgewandelt.
-    retcode = lorawan.send(MBED_CONF_LORA_APP_PORT, (uint8_t*)&mySensor_data, sizeof(mySensor_data), MSG_UNCONFIRMED_FLAG);
-
-    
+    size_t max_len = EU868_MAX_PAYLOAD[tx_data_rate < sizeof(EU868_MAX_PAYLOAD) ? tx_data_rate : 0];
+    if (max_len > sizeof(tx_buffer)) {
+        max_len = sizeof(tx_buffer);
+    }
+    const uint32_t encode_started = latency_ticks();
+
+    // Bit-packed nach dem Schema in payload.h, nur geänderte Felder außer im Keyframe
+#if SEND_BATCHES
+    // Mit dem Flash-Log hat fill_batch() die ältesten noch nicht gesendeten Proben geladen
+    // So viele Proben wie bei der aktuellen Datenrate passen, der Rest kommt mit dem nächsten Uplink
+    packet_len = payload_policy.encode(batch, sample_clock(), tx_buffer, max_len);
+#else
+    packet_len = payload_policy.encode(mySensor_data, tx_buffer, max_len);
+#endif
+    latency_record(LATENCY_ENCODE, encode_started);
+    send_started = Kernel::Clock::now();
+    retcode = lorawan.send(MBED_CONF_LORA_APP_PORT, tx_buffer, packet_len, MSG_UNCONFIRMED_FLAG);
 
     //retcode = lorawan.send(MBED_CONF_LORA_APP_PORT, tx_buffer, packet_len,
     //                       MSG_UNCONFIRMED_FLAG);
@@ -368,11 +657,31 @@ static void send_message()
             if (MBED_CONF_LORA_DUTY_CYCLE_ON) {
                 ev_queue.call_in(3s, send_message);
             }
+        } else if (retcode == LORAWAN_STATUS_LENGTH_ERROR && tx_data_rate != 0) {
+            // Datenrate inzwischen kleiner (ADR), mit der Nutzlast von DR0 neu packen
+            tx_data_rate = 0;
+            ev_queue.call(send_message);
         }
         return;
     }
 
-    printf("\r\n %d bytes scheduled for transmission \r\n", retcode);
+    // RX-Fenster folgen, bis TX_DONE keine Sensor-Reads auf der Queue
+    hold_sensor_reads();
+
+    printf("\r\n %d bytes scheduled for transmission (%s) \r\n", retcode,
+           payload_policy.lastWasKeyframe() ? "keyframe" : "delta");
+#if MBED_CONF_APP_SAMPLE_LOG
+    if (sample_log.mounted()) {
+        printf("\r\n %u of %lu unsent samples, %lu lost to a full log \r\n", payload_policy.lastSamples(),
+               (unsigned long)sample_log_pending, (unsigned long)sample_log_lost);
+    } else
+#endif
+#if SEND_BATCHES
+    {
+        printf("\r\n %u of %u samples, %lu lost to a full batch \r\n", payload_policy.lastSamples(),
+               batch.count(), (unsigned long)batch.overflows());
+    }
+#endif
 
     // Check and print GPS status
   if (satelliteCount == 0) 
@@ -383,6 +692,34 @@ static void send_message()
     memset(tx_buffer, 0, sizeof(tx_buffer));
 }
 
+#if MBED_CONF_APP_DIAGNOSTICS_INTERVAL
+/**
+ * Sends the latency histograms since the last diagnostics frame,
+ * returns false if it did not go out and the data should be sent instead
+ */
+static bool send_diagnostics()
+{
+    size_t max_len = EU868_MAX_PAYLOAD[tx_data_rate < sizeof(EU868_MAX_PAYLOAD) ? tx_data_rate : 0];
+    if (max_len > sizeof(tx_buffer)) {
+        max_len = sizeof(tx_buffer);
+    }
+    const size_t packet_len = latency_encode(tx_buffer, max_len);
+    send_started = Kernel::Clock::now();
+    const int16_t retcode = lorawan.send(MBED_CONF_APP_DIAGNOSTICS_PORT, tx_buffer, packet_len,
+                                         MSG_UNCONFIRMED_FLAG);
+    memset(tx_buffer, 0, sizeof(tx_buffer));
+    if (retcode < 0) {
+        printf("\r\n diagnostics send() - Error code %d \r\n", retcode);
+        return false;
+    }
+    hold_sensor_reads();
+    diagnostics_pending = true;
+    printf("\r\n %d bytes of diagnostics scheduled on port %d \r\n", retcode,
+           MBED_CONF_APP_DIAGNOSTICS_PORT);
+    return true;
+}
+#endif
+
 /**
  * Receive a message from the Network Server
  */
@@ -432,8 +769,15 @@ static void receive_message()
 static void lora_event_handler(lorawan_event_t event)
 {
     switch (event) {
-        case CONNECTED:
-            printf("\r\n Connection - Successful \r\n");
+        case CONNECTED: {
+            const uint32_t join_ms = (Kernel::Clock::now() - join_start).count();
+            printf("\r\n Connection - Successful after %lu ms \r\n", (unsigned long)join_ms);
+            release_sensor_reads();
+            link_state.joins++;
+            link_state.failedJoins = 0;
+            link_state.joinMs = join_ms;
+            save_link_state();
+            payload_policy.forceKeyframe(); // neue Session, der Server kennt noch nichts
             if (MBED_CONF_LORA_DUTY_CYCLE_ON) {
                 send_message();
             } else {
@@ -441,12 +785,61 @@ static void lora_event_handler(lorawan_event_t event)
             }
 
             break;
+        }
         case DISCONNECTED:
             ev_queue.break_dispatch();
             printf("\r\n Disconnected Successfully \r\n");
             break;
         case TX_DONE:
             printf("\r\n Message Sent to Network Server \r\n");
+            release_sensor_reads(); // RX-Fenster vorbei
+            {
+                // In ms gemessen, als µs auf 32 Bit begrenzt (71 min)
+                const uint64_t send_ms = (Kernel::Clock::now() - send_started).count();
+                latency_record_us(LATENCY_SEND, send_ms < UINT32_MAX / 1000 ? (uint32_t)(send_ms * 1000) : UINT32_MAX);
+
+                lorawan_tx_metadata metadata;
+                if (lorawan.get_tx_metadata(metadata) == LORAWAN_STATUS_OK) {
+                    tx_data_rate = metadata.data_rate;
+                }
+            }
+#if MBED_CONF_APP_DIAGNOSTICS_INTERVAL
+            if (diagnostics_pending) {
+                // Keine Messdaten: Baseline und Proben bleiben, der nächste Frame zählt von vorn
+                diagnostics_pending = false;
+                uplinks_since_diagnostics = 0;
+                latency_reset();
+                if (MBED_CONF_LORA_DUTY_CYCLE_ON) {
+                    send_message();
+                }
+                break;
+            }
+            uplinks_since_diagnostics++;
+#endif
+            if (!first_uplink_sent) {
+                // Gemessen vom Start des Kernels, mit Jitter, Join und Duty-Cycle-Wartezeit
+                first_uplink_sent = true;
+                link_state.firstUplinkMs = Kernel::Clock::now().time_since_epoch().count();
+                printf("\r\n First uplink %lu ms after boot (join %lu ms) \r\n",
+                       (unsigned long)link_state.firstUplinkMs, (unsigned long)link_state.joinMs);
+                link_state.dataRate = tx_data_rate;
+                save_link_state();
+            } else if (tx_data_rate != link_state.dataRate) {
+                // ADR hat die Datenrate geändert
+                link_state.dataRate = tx_data_rate;
+                save_link_state();
+            }
+            payload_policy.commit();
+#if SEND_BATCHES
+            if (payload_policy.lastSamples()) {
+                batch.dropThrough(payload_policy.lastSequence());
+#if MBED_CONF_APP_SAMPLE_LOG
+                // Gesendet, nach einem Reset nicht noch einmal. Dieselbe Queue wie fill_batch(),
+                // der nächste Uplink sieht die Bestätigung also schon
+                sensor_queue.call(acknowledge_samples, payload_policy.lastSequence());
+#endif
+            }
+#endif
             if (MBED_CONF_LORA_DUTY_CYCLE_ON) {
                 send_message();
             }
@@ -456,6 +849,10 @@ static void lora_event_handler(lorawan_event_t event)
         case TX_CRYPTO_ERROR:
         case TX_SCHEDULING_ERROR:
             printf("\r\n Transmission Error - EventCode = %d \r\n", event);
+            release_sensor_reads();
+#if MBED_CONF_APP_DIAGNOSTICS_INTERVAL
+            diagnostics_pending = false;
+#endif
             // try again
             if (MBED_CONF_LORA_DUTY_CYCLE_ON) {
                 send_message();
@@ -471,6 +868,8 @@ static void lora_event_handler(lorawan_event_t event)
             break;
         case JOIN_FAILURE:
             printf("\r\n OTAA Failed - Check Keys \r\n");
+            release_sensor_reads();
+            join_failed();
             break;
         case UPLINK_REQUIRED:
             printf("\r\n Uplink required by NS \r\n");
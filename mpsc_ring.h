@@ -0,0 +1,105 @@
+#ifndef APP_MPSC_RING_H_
+#define APP_MPSC_RING_H_
+
+#include <cstdint>
+
+#include "mbed.h"
+
+/**
+ * Lock-free ring buffer of variable-length records for any number of
+ * producers, threads or interrupt handlers, and one consumer.
+ *
+ * A producer reserves its words with a compare-and-swap on the write
+ * index, copies the record and then stores its header, which commits it.
+ * The consumer takes records in reservation order and clears their words
+ * before it frees them, so a header is never left over from an older
+ * record. A producer that is preempted between reservation and commit
+ * holds up the consumer, not the other producers.
+ *
+ * A record that does not fit is dropped and counted, nothing blocks.
+ * Size is the number of 32 bit words, a power of two; every record takes
+ * one more for its header.
+ */
+template <uint32_t Size>
+class MpscRing {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+    MpscRing() : _buffer(), _head(0), _tail(0), _dropped(0)
+    {
+    }
+
+    /** Producer side, returns false and counts the record if the ring is full */
+    bool write(const uint32_t *words, uint32_t count)
+    {
+        const uint32_t need = count + 1;
+        uint32_t head = core_util_atomic_load_u32(&_head);
+        do {
+            if (need > Size || head + need - core_util_atomic_load_u32(&_tail) > Size) {
+                core_util_atomic_incr_u32(&_dropped, 1);
+                return false;
+            }
+        } while (!core_util_atomic_cas_u32(&_head, &head, head + need));
+
+        for (uint32_t i = 0; i < count; i++) {
+            _buffer[(head + 1 + i) & (Size - 1)] = words[i];
+        }
+        core_util_atomic_store_u32(&_buffer[head & (Size - 1)], COMMITTED | count);
+        return true;
+    }
+
+    /**
+     * Consumer side: copies the oldest record, at most max words, and
+     * returns its length. -1 if the ring is empty or the oldest record is
+     * not committed yet.
+     */
+    int read(uint32_t *words, uint32_t max)
+    {
+        const uint32_t tail = _tail;
+        if (tail == core_util_atomic_load_u32(&_head)) {
+            return -1;
+        }
+        const uint32_t header = core_util_atomic_load_u32(&_buffer[tail & (Size - 1)]);
+        if (!(header & COMMITTED)) {
+            return -1;
+        }
+        const uint32_t count = header & ~COMMITTED;
+        for (uint32_t i = 0; i < count; i++) {
+            volatile uint32_t &word = _buffer[(tail + 1 + i) & (Size - 1)];
+            if (i < max) {
+                words[i] = word;
+            }
+            word = 0;
+        }
+        core_util_atomic_store_u32(&_buffer[tail & (Size - 1)], 0);
+        core_util_atomic_store_u32(&_tail, tail + count + 1);
+        return static_cast<int>(count);
+    }
+
+    /** Records lost to a full ring since the start */
+    uint32_t dropped() const
+    {
+        return core_util_atomic_load_u32(&_dropped);
+    }
+
+    /** Words in use, including reserved ones, only exact when called by the consumer */
+    uint32_t used() const
+    {
+        return core_util_atomic_load_u32(&_head) - core_util_atomic_load_u32(&_tail);
+    }
+
+    static constexpr uint32_t capacity()
+    {
+        return Size;
+    }
+
+private:
+    static const uint32_t COMMITTED = 0x80000000;
+
+    volatile uint32_t _buffer[Size];
+    volatile uint32_t _head;    // reserved up to here, advanced by the producers
+    volatile uint32_t _tail;    // written by the consumer only
+    volatile uint32_t _dropped;
+};
+
+#endif /* APP_MPSC_RING_H_ */
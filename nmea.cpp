@@ -0,0 +1,281 @@
+// nmea.cpp
+
+#include "nmea.h"
+
+#include <cstring>
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+NmeaParser::NmeaParser() {
+    memset(&current, 0, sizeof(current));
+    memset(&counters, 0, sizeof(counters));
+    reset();
+}
+
+void NmeaParser::reset() {
+    state = WAIT_START;
+    type = NMEA_NONE;
+    fieldIndex = 0;
+    length = 0;
+    fieldLength = 0;
+}
+
+int NmeaParser::feed(const char *data, int length) {
+    int sentences = 0;
+    for (int i = 0; i < length; i++) {
+        if (feed(data[i]) != NMEA_NONE) {
+            sentences++;
+        }
+    }
+    return sentences;
+}
+
+NmeaSentence NmeaParser::feed(char c) {
+    // '$' beginnt immer einen neuen Satz, auch mitten in einem abgebrochenen
+    if (c == '$') {
+        if (state != WAIT_START) {
+            counters.malformed++;
+        }
+        pending = current;
+        reset();
+        state = FIELDS;
+        checksum = 0;
+        length = 1;
+        return NMEA_NONE;
+    }
+    if (state == WAIT_START) {
+        return NMEA_NONE;
+    }
+    if (++length > NMEA_MAX_SENTENCE) {
+        counters.overlong++;
+        reset();
+        return NMEA_NONE;
+    }
+
+    switch (state) {
+        case FIELDS:
+            if (c == '*') {
+                if (!endField()) {
+                    reset();
+                } else {
+                    state = CHECKSUM_HI;
+                }
+            } else if (c == '\r' || c == '\n') {
+                counters.malformed++; // ohne Prüfsumme nehmen wir nichts an
+                reset();
+            } else {
+                checksum ^= static_cast<uint8_t>(c);
+                if (c == ',') {
+                    if (!endField()) {
+                        reset();
+                    }
+                } else if (type != NMEA_OTHER) {
+                    // Felder unbekannter Sätze werden nicht gespeichert, nur mitgezählt
+                    if (fieldLength >= NMEA_MAX_FIELD) {
+                        counters.overlong++;
+                        reset();
+                    } else {
+                        field[fieldLength++] = c;
+                    }
+                }
+            }
+            break;
+
+        case CHECKSUM_HI:
+        case CHECKSUM_LO: {
+            int nibble = hexValue(c);
+            if (nibble < 0) {
+                counters.malformed++;
+                reset();
+            } else if (state == CHECKSUM_HI) {
+                received = static_cast<uint8_t>(nibble << 4);
+                state = CHECKSUM_LO;
+            } else {
+                received |= static_cast<uint8_t>(nibble);
+                state = WAIT_END;
+            }
+            break;
+        }
+
+        case WAIT_END: {
+            if (c != '\r' && c != '\n') {
+                counters.malformed++;
+                reset();
+                break;
+            }
+            NmeaSentence done = type;
+            reset();
+            if (received != checksum) {
+                counters.checksumErrors++;
+                return NMEA_NONE;
+            }
+            counters.sentences++;
+            if (done != NMEA_OTHER) {
+                current = pending;
+            }
+            return done;
+        }
+
+        case WAIT_START:
+            break;
+    }
+    return NMEA_NONE;
+}
+
+// Wertet das gerade beendete Feld aus, false bricht den Satz ab
+bool NmeaParser::endField() {
+    field[fieldLength] = '\0';
+    const uint8_t index = fieldIndex++;
+    fieldLength = 0;
+
+    if (index == 0) {
+        // Adressfeld: Talker (2 Zeichen) + Satztyp, proprietäre Sätze ($P...) sind kürzer
+        int n = strlen(field);
+        const char *id = n >= 5 ? field + n - 3 : "";
+        if (!strcmp(field, "PMTK001")) {
+            type = NMEA_PMTK_ACK;
+        } else if (field[0] == 'P' || n != 5) {
+            type = NMEA_OTHER;
+        } else if (!strcmp(id, "GGA")) {
+            type = NMEA_GGA;
+        } else if (!strcmp(id, "RMC")) {
+            type = NMEA_RMC;
+        } else if (!strcmp(id, "GSA")) {
+            type = NMEA_GSA;
+        } else if (!strcmp(id, "VTG")) {
+            type = NMEA_VTG;
+        } else {
+            type = NMEA_OTHER;
+        }
+        return true;
+    }
+
+    int64_t value = 0;
+    int32_t coordinate = 0;
+    bool ok = true;
+
+    switch (type) {
+        case NMEA_GGA:
+            switch (index) {
+                case 1: ok = parseFixed(0, value); pending.time = value; break;
+                case 2: ok = parseCoordinate(coordinate); pending.latitude = coordinate; break;
+                case 3: if (field[0] == 'S') pending.latitude = -pending.latitude; break;
+                case 4: ok = parseCoordinate(coordinate); pending.longitude = coordinate; break;
+                case 5: if (field[0] == 'W') pending.longitude = -pending.longitude; break;
+                case 6: ok = parseFixed(0, value); pending.quality = value; break;
+                case 7: ok = parseFixed(0, value); pending.satellites = value; break;
+                case 8: ok = parseFixed(2, value); pending.hdop = value; break;
+                case 9: ok = parseFixed(2, value); pending.altitude = value; break;
+                case 10: pending.altitudeUnit = field[0]; break;
+            }
+            break;
+
+        case NMEA_RMC:
+            switch (index) {
+                case 1: ok = parseFixed(0, value); pending.time = value; break;
+                case 2: pending.status = field[0]; break;
+                case 3: ok = parseCoordinate(coordinate); pending.latitude = coordinate; break;
+                case 4: if (field[0] == 'S') pending.latitude = -pending.latitude; break;
+                case 5: ok = parseCoordinate(coordinate); pending.longitude = coordinate; break;
+                case 6: if (field[0] == 'W') pending.longitude = -pending.longitude; break;
+                case 7: ok = parseFixed(2, value); pending.speed = value * 1852 / 1000; break; // Knoten -> km/h
+                case 8: ok = parseFixed(2, value); pending.course = value; break;
+                case 9: ok = parseFixed(0, value); pending.date = value; break;
+            }
+            break;
+
+        case NMEA_GSA:
+            switch (index) {
+                case 2: ok = parseFixed(0, value); pending.fixType = value; break;
+                case 15: ok = parseFixed(2, value); pending.pdop = value; break;
+                case 16: ok = parseFixed(2, value); pending.hdop = value; break;
+                case 17: ok = parseFixed(2, value); pending.vdop = value; break;
+            }
+            break;
+
+        case NMEA_VTG:
+            switch (index) {
+                case 1: ok = parseFixed(2, value); pending.course = value; break;
+                case 7: ok = parseFixed(2, value); pending.speed = value; break;
+            }
+            break;
+
+        case NMEA_PMTK_ACK:
+            switch (index) {
+                case 1: ok = parseFixed(0, value); pending.ackCommand = value; break;
+                case 2: ok = parseFixed(0, value); pending.ackFlag = value; break;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (!ok) {
+        counters.malformed++;
+    }
+    return ok;
+}
+
+// Dezimalzahl mit optionalem Vorzeichen als Ganzzahl mit decimals Nachkommastellen,
+// überzählige Stellen werden abgeschnitten. Ein leeres Feld ergibt 0.
+bool NmeaParser::parseFixed(int decimals, int64_t &out) const {
+    const char *p = field;
+    bool negative = false;
+    if (*p == '-') {
+        negative = true;
+        p++;
+    }
+    int64_t value = 0;
+    int fraction = -1; // -1: noch kein Dezimalpunkt
+    for (; *p; p++) {
+        if (*p == '.' && fraction < 0) {
+            fraction = 0;
+        } else if (*p >= '0' && *p <= '9') {
+            if (fraction >= decimals) {
+                continue;
+            }
+            if (value >= 100000000000000LL) {
+                return false; // kein NMEA-Wert hat so viele Stellen
+            }
+            value = value * 10 + (*p - '0');
+            if (fraction >= 0) {
+                fraction++;
+            }
+        } else {
+            return false;
+        }
+    }
+    for (int i = fraction < 0 ? 0 : fraction; i < decimals; i++) {
+        value *= 10;
+    }
+    out = negative ? -value : value;
+    return true;
+}
+
+// NMEA-Koordinate (d)ddmm.mmmm in 1e-6 Grad
+bool NmeaParser::parseCoordinate(int32_t &out) const {
+    int64_t value;
+    if (!parseFixed(6, value) || value < 0 || value > 18100000000LL) {
+        return false;
+    }
+    int64_t degrees = value / 100000000;
+    int64_t minutes = value % 100000000; // Minuten * 1e6
+    out = static_cast<int32_t>(degrees * 1000000 + (minutes + 30) / 60);
+    return true;
+}
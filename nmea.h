@@ -0,0 +1,98 @@
+// nmea.h
+#ifndef APP_NMEA_H_
+#define APP_NMEA_H_
+
+#include <cstdint>
+
+// Längster erlaubter Satz laut NMEA 0183, inklusive '$' und CR LF
+#define NMEA_MAX_SENTENCE   82
+// Längstes Feld, das wir auswerten (z.B. "12345.6789")
+#define NMEA_MAX_FIELD      15
+
+enum NmeaSentence : uint8_t {
+    NMEA_NONE = 0,   // noch kein vollständiger, gültiger Satz
+    NMEA_GGA,
+    NMEA_RMC,
+    NMEA_GSA,
+    NMEA_VTG,
+    NMEA_PMTK_ACK,   // $PMTK001: Antwort des MTK-Moduls auf ein Kommando
+    NMEA_OTHER       // gültige Prüfsumme, aber Typ wird nicht ausgewertet (GSV, ...)
+};
+
+// Ganzzahlige Werte, damit beim Parsen kein float/atof nötig ist
+struct NmeaData {
+    uint32_t time;       // UTC hhmmss
+    uint32_t date;       // ddmmyy (RMC)
+    int32_t latitude;    // 1e-6 Grad, Süden negativ
+    int32_t longitude;   // 1e-6 Grad, Westen negativ
+    int32_t altitude;    // cm über Meeresspiegel (GGA)
+    uint32_t speed;      // 1/100 km/h (VTG)
+    uint16_t course;     // 1/100 Grad (RMC/VTG)
+    uint16_t pdop;       // DOP-Werte * 100 (GSA, HDOP auch aus GGA)
+    uint16_t hdop;
+    uint16_t vdop;
+    uint8_t satellites;  // benutzte Satelliten (GGA)
+    uint8_t quality;     // GGA Fix-Qualität, 0 = kein Fix
+    uint8_t fixType;     // GSA: 1 kein Fix, 2 = 2D, 3 = 3D
+    char status;         // RMC: 'A' gültig, 'V' ungültig
+    char altitudeUnit;   // GGA, normalerweise 'M'
+    uint16_t ackCommand; // PMTK001: bestätigtes Kommando, z.B. 314
+    uint8_t ackFlag;     // PMTK001: 0 ungültig, 1 nicht unterstützt, 2 fehlgeschlagen, 3 ok
+};
+
+// Zähler für Benchmark und Fehlersuche
+struct NmeaStats {
+    uint32_t sentences;  // gültige Sätze, auch nicht ausgewertete
+    uint32_t checksumErrors;
+    uint32_t overlong;   // länger als NMEA_MAX_SENTENCE oder Feld zu lang
+    uint32_t malformed;  // kein '*hh' oder unerwartetes Zeichen
+};
+
+// Byteweise arbeitender NMEA-Parser ohne dynamischen Speicher. Sätze dürfen
+// beliebig auf mehrere Aufrufe von feed() verteilt sein. Felder eines Satzes
+// landen zunächst in einer Kopie und werden erst übernommen, wenn die
+// Prüfsumme stimmt. Der Talker (GP, GN, GL, ...) wird ignoriert.
+class NmeaParser {
+public:
+    NmeaParser();
+
+    // Ein Zeichen verarbeiten. Gibt den Typ zurück, sobald ein Satz mit
+    // gültiger Prüfsumme abgeschlossen ist, sonst NMEA_NONE.
+    NmeaSentence feed(char c);
+
+    // Mehrere Zeichen verarbeiten, gibt die Anzahl gültiger Sätze zurück
+    int feed(const char *data, int length);
+
+    void reset();
+
+    const NmeaData &data() const { return current; }
+    const NmeaStats &stats() const { return counters; }
+
+private:
+    enum State : uint8_t {
+        WAIT_START,   // auf '$' warten
+        FIELDS,       // Adresse und Datenfelder, XOR läuft mit
+        CHECKSUM_HI,
+        CHECKSUM_LO,
+        WAIT_END      // auf CR/LF nach der Prüfsumme
+    };
+
+    bool endField();
+    bool parseFixed(int decimals, int64_t &out) const;
+    bool parseCoordinate(int32_t &out) const;
+
+    NmeaData current;    // letzter gültiger Stand
+    NmeaData pending;    // wird vom laufenden Satz beschrieben
+    NmeaStats counters;
+
+    State state;
+    NmeaSentence type;
+    uint8_t fieldIndex;
+    uint8_t length;      // Zeichen im laufenden Satz
+    uint8_t checksum;
+    uint8_t received;    // Prüfsumme aus '*hh'
+    uint8_t fieldLength;
+    char field[NMEA_MAX_FIELD + 1];
+};
+
+#endif /* APP_NMEA_H_ */
@@ -0,0 +1,257 @@
+#include "payload.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+int32_t clamp(const PayloadField &field, int64_t value)
+{
+    if (value < field.min) {
+        return field.min;
+    }
+    if (value > field.max) {
+        return field.max;
+    }
+    return static_cast<int32_t>(value);
+}
+
+} // namespace
+
+int32_t payload_quantize(PayloadFieldId id, float value)
+{
+    const PayloadField &field = payload_schema[id];
+    if (std::isnan(value)) {
+        return clamp(field, 0);
+    }
+    // Clamp in double first, a float sensor glitch must not overflow the cast
+    double steps = std::floor(static_cast<double>(value) * field.scale + 0.5);
+    if (steps < field.min) {
+        return field.min;
+    }
+    if (steps > field.max) {
+        return field.max;
+    }
+    return static_cast<int32_t>(steps);
+}
+
+void PayloadBitWriter::write(uint32_t value, unsigned bits)
+{
+    while (bits > 0) {
+        unsigned free = 8 - (_bit & 7);
+        unsigned n = bits < free ? bits : free;
+        if ((_bit >> 3) < _size) {
+            uint8_t chunk = static_cast<uint8_t>((value >> (bits - n)) & ((1u << n) - 1));
+            _buffer[_bit >> 3] |= static_cast<uint8_t>(chunk << (free - n));
+        }
+        _bit += n;
+        bits -= n;
+    }
+}
+
+void PayloadBitWriter::writeExpGolomb(uint32_t value)
+{
+    const uint64_t code = static_cast<uint64_t>(value) + 1;
+    const unsigned n = (expGolombBits(value) - 1) / 2;
+    write(0, n);
+    write(static_cast<uint32_t>(code >> 32), n >= 32 ? n - 31 : 0);
+    write(static_cast<uint32_t>(code), n >= 32 ? 32 : n + 1);
+}
+
+uint32_t PayloadBitReader::read(unsigned bits)
+{
+    uint32_t value = 0;
+    while (bits > 0) {
+        unsigned left = 8 - (_bit & 7);
+        unsigned n = bits < left ? bits : left;
+        uint32_t chunk = 0;
+        if ((_bit >> 3) < _size) {
+            chunk = (_buffer[_bit >> 3] >> (left - n)) & ((1u << n) - 1);
+        }
+        value = (value << n) | chunk;
+        _bit += n;
+        bits -= n;
+    }
+    return value;
+}
+
+uint32_t PayloadBitReader::readExpGolomb()
+{
+    unsigned n = 0;
+    while (read(1) == 0) {
+        if (++n > 32 || overrun()) {
+            _bit = _size * 8 + 1; // not a valid code
+            return 0;
+        }
+    }
+    const uint64_t code = (1ull << n) | (n > 0 ? read(n) : 0);
+    if (code - 1 > UINT32_MAX) {
+        _bit = _size * 8 + 1;
+        return 0;
+    }
+    return static_cast<uint32_t>(code - 1);
+}
+
+void payload_write_body(PayloadBitWriter &writer, const PayloadValues &values, bool keyframe,
+                        PayloadFieldMask present)
+{
+    const PayloadField &flagsField = payload_schema[PAYLOAD_FLAGS];
+    const uint8_t flags = static_cast<uint8_t>(clamp(flagsField, values.field[PAYLOAD_FLAGS]));
+    writer.write(flags, payload_field_bits(flagsField));
+
+    PayloadFieldMask fields = 0;
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS) {
+            continue;
+        }
+        bool sent = keyframe ? !(field.omitIf & flags) : (present & (1ul << field.id)) != 0;
+        if (!keyframe) {
+            writer.write(sent, 1);
+        }
+        if (sent) {
+            fields |= 1ul << field.id;
+        }
+    }
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS || !(fields & (1ul << field.id))) {
+            continue;
+        }
+        int32_t value = clamp(field, values.field[field.id]);
+        writer.write(static_cast<uint32_t>(static_cast<int64_t>(value) - field.min),
+                     payload_field_bits(field));
+    }
+}
+
+bool payload_read_body(PayloadBitReader &reader, bool keyframe, PayloadValues &values,
+                       PayloadFieldMask *present)
+{
+    const PayloadField &flagsField = payload_schema[PAYLOAD_FLAGS];
+    const uint8_t flags = static_cast<uint8_t>(reader.read(payload_field_bits(flagsField)));
+    if (flags > flagsField.max) {
+        return false;
+    }
+
+    PayloadFieldMask fields = 1ul << PAYLOAD_FLAGS;
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS) {
+            continue;
+        }
+        if (keyframe ? !(field.omitIf & flags) : reader.read(1) != 0) {
+            fields |= 1ul << field.id;
+        }
+    }
+
+    values.field[PAYLOAD_FLAGS] = flags;
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS || !(fields & (1ul << field.id))) {
+            continue;
+        }
+        int64_t value = static_cast<int64_t>(reader.read(payload_field_bits(field))) + field.min;
+        // Bit patterns above max only come from a foreign encoder
+        if (value > field.max) {
+            return false;
+        }
+        values.field[field.id] = static_cast<int32_t>(value);
+    }
+    if (present) {
+        *present = fields;
+    }
+    return !reader.overrun();
+}
+
+size_t payload_encode(const PayloadValues &values, uint8_t *buffer, size_t size)
+{
+    const uint8_t flags = static_cast<uint8_t>(clamp(payload_schema[PAYLOAD_FLAGS],
+                                                     values.field[PAYLOAD_FLAGS]));
+    const size_t length = payload_size(flags);
+    if (size < length) {
+        return 0;
+    }
+    memset(buffer, 0, length);
+    buffer[0] = PAYLOAD_VERSION;
+
+    PayloadBitWriter writer(buffer + 1, length - 1);
+    payload_write_body(writer, values, true, 0);
+    return length;
+}
+
+size_t payload_encode_delta(const PayloadValues &values, PayloadFieldMask present,
+                            uint8_t *buffer, size_t size)
+{
+    present &= PAYLOAD_ALL_FIELDS & ~(1ul << PAYLOAD_FLAGS);
+    const size_t length = payload_delta_size(present);
+    if (size < length) {
+        return 0;
+    }
+    memset(buffer, 0, length);
+    buffer[0] = PAYLOAD_VERSION | PAYLOAD_HEADER_DELTA;
+
+    PayloadBitWriter writer(buffer + 1, length - 1);
+    payload_write_body(writer, values, false, present);
+    return length;
+}
+
+bool payload_decode(const uint8_t *buffer, size_t length, PayloadValues &values,
+                    PayloadFieldMask *present)
+{
+    if (length < 1 || (buffer[0] & ~PAYLOAD_HEADER_DELTA) != PAYLOAD_VERSION) {
+        return false;
+    }
+    const bool keyframe = !(buffer[0] & PAYLOAD_HEADER_DELTA);
+
+    PayloadValues decoded = values;
+    PayloadFieldMask fields;
+    PayloadBitReader reader(buffer + 1, length - 1);
+    if (!payload_read_body(reader, keyframe, decoded, &fields)) {
+        return false;
+    }
+    // Exactly the computed length, trailing bytes point to a different encoder
+    const uint8_t flags = static_cast<uint8_t>(decoded.field[PAYLOAD_FLAGS]);
+    if (length != 1 + (payload_body_bits(flags, keyframe, fields) + 7) / 8) {
+        return false;
+    }
+    values = decoded;
+    if (present) {
+        *present = fields;
+    }
+    return true;
+}
+
+int payload_decode_batch(const uint8_t *buffer, size_t length, PayloadValues &state,
+                         PayloadDecodedSample *out, size_t max)
+{
+    if (length < 1 || buffer[0] != (PAYLOAD_VERSION | PAYLOAD_HEADER_BATCH)) {
+        return -1;
+    }
+    PayloadBitReader reader(buffer + 1, length - 1);
+    const uint32_t count = reader.read(6);
+    if (count == 0 || count > max) {
+        return -1;
+    }
+
+    PayloadValues values = state;
+    int64_t age = reader.readExpGolomb();
+    int64_t interval = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) {
+            interval += payload_unzigzag(reader.readExpGolomb());
+            age -= interval;
+            if (interval < 0 || age < 0) {
+                return -1;
+            }
+        }
+        PayloadDecodedSample &sample = out[i];
+        sample.age = static_cast<uint32_t>(age);
+        sample.keyframe = reader.read(1) != 0;
+        if (!payload_read_body(reader, sample.keyframe, values, &sample.present)) {
+            return -1;
+        }
+        sample.values = values;
+    }
+    // Only padding up to the end of the last byte
+    if (reader.overrun() || (reader.bits() + 7) / 8 != length - 1) {
+        return -1;
+    }
+    state = values;
+    return static_cast<int>(count);
+}
@@ -0,0 +1,307 @@
+#ifndef APP_PAYLOAD_H_
+#define APP_PAYLOAD_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Uplink payload schema and bit-packed codec.
+ *
+ * Every field is an integer in steps of 1/scale of its unit, limited to
+ * [min, max]. On the wire it is sent as (value - min) in just enough bits
+ * for max - min, so the widths follow from the schema at compile time.
+ *
+ * Keyframe layout: one header byte with the version, then all fields in
+ * schema order as one bit stream, most significant bit first (network
+ * byte order for fields wider than a byte), zero padded to a whole byte.
+ * A field whose omitIf mask matches the flags field is left out of the
+ * frame entirely; flags therefore comes first.
+ *
+ * Delta frames set PAYLOAD_HEADER_DELTA in the header byte. After the
+ * flags field follows a presence bitmap with one bit per remaining field
+ * in schema order, then only the fields whose bit is set, still as
+ * absolute values. Missing fields keep the value of an earlier frame.
+ *
+ * Batch frames set PAYLOAD_HEADER_BATCH and carry several samples, oldest
+ * first: a 6 bit sample count, the age of the oldest sample in seconds
+ * before encoding, then per sample one keyframe bit and the keyframe or
+ * delta body as above. Every sample after the first is preceded by the
+ * change of its interval to the previous one (zigzag), so evenly spaced
+ * samples cost one bit of time information. Ages and intervals use
+ * Exp-Golomb codes. A delta sample refers to the sample before it.
+ *
+ * Any change to the schema that alters the frame must bump
+ * PAYLOAD_VERSION.
+ */
+#define PAYLOAD_VERSION         1
+#define PAYLOAD_HEADER_DELTA    0x80
+#define PAYLOAD_HEADER_BATCH    0x40
+
+/** Samples per batch frame, limited by the 6 bit count */
+#define PAYLOAD_BATCH_MAX_SAMPLES   63
+
+/** lat/lon were reused from an earlier fix and are not sent */
+#define PAYLOAD_FLAG_GPS_CACHED 0x01
+
+enum PayloadFieldId : uint8_t {
+    PAYLOAD_FLAGS,
+    PAYLOAD_LAT,
+    PAYLOAD_LON,
+    PAYLOAD_TEMP,
+    PAYLOAD_HUMID,
+    PAYLOAD_LIGHT,
+    PAYLOAD_SOIL,
+    PAYLOAD_CLEAR,
+    PAYLOAD_RED,
+    PAYLOAD_GREEN,
+    PAYLOAD_BLUE,
+    PAYLOAD_ACC_X,
+    PAYLOAD_ACC_Y,
+    PAYLOAD_ACC_Z,
+    PAYLOAD_FIELD_COUNT
+};
+
+struct PayloadField {
+    PayloadFieldId id;
+    const char *name;
+    const char *unit;
+    int32_t min;       // in steps
+    int32_t max;       // in steps
+    int32_t scale;     // steps per unit
+    int32_t deadband;  // smaller changes are not sent in delta frames, in steps
+    uint8_t omitIf;    // PAYLOAD_FLAG_* that leave the field out
+};
+
+constexpr PayloadField payload_schema[] = {
+    {PAYLOAD_FLAGS, "flags", "",      0,          15,         1,       0,   0},
+    {PAYLOAD_LAT,   "lat",   "deg",   -90000000,  90000000,   1000000, 100, PAYLOAD_FLAG_GPS_CACHED}, // ~11 m
+    {PAYLOAD_LON,   "lon",   "deg",   -180000000, 180000000,  1000000, 100, PAYLOAD_FLAG_GPS_CACHED},
+    {PAYLOAD_TEMP,  "temp",  "C",     -400,       1250,       10,      2,   0}, // Si7021 range
+    {PAYLOAD_HUMID, "humid", "%",     0,          1000,       10,      10,  0},
+    {PAYLOAD_LIGHT, "light", "%",     0,          1000,       10,      50,  0},
+    {PAYLOAD_SOIL,  "soil",  "%",     0,          1000,       10,      10,  0},
+    {PAYLOAD_CLEAR, "clear", "",      0,          65535,      1,       512, 0}, // TCS34725 raw counts
+    {PAYLOAD_RED,   "red",   "",      0,          65535,      1,       512, 0},
+    {PAYLOAD_GREEN, "green", "",      0,          65535,      1,       512, 0},
+    {PAYLOAD_BLUE,  "blue",  "",      0,          65535,      1,       512, 0},
+    {PAYLOAD_ACC_X, "acc_x", "m/s^2", -2000,      2000,       100,     20,  0}, // MMA8451 in 2g mode
+    {PAYLOAD_ACC_Y, "acc_y", "m/s^2", -2000,      2000,       100,     20,  0},
+    {PAYLOAD_ACC_Z, "acc_z", "m/s^2", -2000,      2000,       100,     20,  0},
+};
+
+/** Bits needed for every value in [min, max] */
+constexpr unsigned payload_field_bits(const PayloadField &field)
+{
+    uint32_t span = static_cast<uint32_t>(static_cast<int64_t>(field.max) - field.min);
+    unsigned bits = 0;
+    while (bits < 32 && (span >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+/** Bits of all fields that are sent with the given flags */
+constexpr unsigned payload_bits(uint8_t flags)
+{
+    unsigned bits = 0;
+    for (const PayloadField &field : payload_schema) {
+        if (!(field.omitIf & flags)) {
+            bits += payload_field_bits(field);
+        }
+    }
+    return bits;
+}
+
+/** Frame size in bytes, including the version byte */
+constexpr size_t payload_size(uint8_t flags)
+{
+    return 1 + (payload_bits(flags) + 7) / 8;
+}
+
+constexpr bool payload_schema_valid()
+{
+    for (unsigned i = 0; i < PAYLOAD_FIELD_COUNT; i++) {
+        const PayloadField &field = payload_schema[i];
+        if (field.id != i || field.min > field.max || field.scale <= 0 || field.deadband < 0) {
+            return false;
+        }
+        if (field.omitIf & ~payload_schema[PAYLOAD_FLAGS].max) {
+            return false;
+        }
+    }
+    return payload_schema[PAYLOAD_FLAGS].omitIf == 0 && payload_schema[PAYLOAD_FLAGS].min == 0;
+}
+
+/** Mask with a bit (1 << id) for every field */
+typedef uint32_t PayloadFieldMask;
+
+constexpr PayloadFieldMask PAYLOAD_ALL_FIELDS = static_cast<PayloadFieldMask>((1ull << PAYLOAD_FIELD_COUNT) - 1);
+
+/** Bits of a keyframe or delta body, flags always included */
+constexpr unsigned payload_body_bits(uint8_t flags, bool keyframe, PayloadFieldMask present)
+{
+    if (keyframe) {
+        return payload_bits(flags);
+    }
+    unsigned bits = PAYLOAD_FIELD_COUNT - 1;
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS || (present & (1ul << field.id))) {
+            bits += payload_field_bits(field);
+        }
+    }
+    return bits;
+}
+
+/** Delta frame size in bytes for the fields in present */
+constexpr size_t payload_delta_size(PayloadFieldMask present)
+{
+    return 1 + (payload_body_bits(0, false, present) + 7) / 8;
+}
+
+/** Largest frame, with every field present */
+constexpr size_t PAYLOAD_MAX_SIZE = payload_size(0) > payload_delta_size(PAYLOAD_ALL_FIELDS)
+                                    ? payload_size(0) : payload_delta_size(PAYLOAD_ALL_FIELDS);
+
+static_assert(PAYLOAD_FIELD_COUNT <= 32, "PayloadFieldMask has one bit per field");
+static_assert(PAYLOAD_VERSION < PAYLOAD_HEADER_BATCH, "version collides with the header bits");
+static_assert(sizeof(payload_schema) / sizeof(payload_schema[0]) == PAYLOAD_FIELD_COUNT,
+              "payload_schema must list every PayloadFieldId");
+static_assert(payload_schema_valid(), "payload_schema out of order or with an empty range");
+// EU868 DR0 (SF12) allows 51 bytes of application payload
+static_assert(PAYLOAD_MAX_SIZE <= 51, "payload does not fit the smallest data rate");
+
+/** Field values in steps of their schema entry */
+struct PayloadValues {
+    int32_t field[PAYLOAD_FIELD_COUNT];
+};
+
+/** One sample of a batch frame */
+struct PayloadSample {
+    uint32_t timestamp;  // ms, Kernel::Clock on the device
+    uint32_t sequence;   // assigned by PayloadBatch
+    PayloadValues values;
+};
+
+/** Sample of a decoded batch frame */
+struct PayloadDecodedSample {
+    uint32_t age;        // seconds before the frame was encoded
+    bool keyframe;
+    PayloadFieldMask present;
+    PayloadValues values;  // full state after applying the sample
+};
+
+/**
+ * Writes bit fields MSB first into a zeroed buffer. Writes beyond size
+ * are dropped and flagged by overflow().
+ */
+class PayloadBitWriter {
+public:
+    PayloadBitWriter(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _bit(0)
+    {
+    }
+
+    void write(uint32_t value, unsigned bits);
+    /** Exp-Golomb code, 2 * floor(log2(value + 1)) + 1 bits */
+    void writeExpGolomb(uint32_t value);
+
+    size_t bits() const { return _bit; }
+    bool overflow() const { return _bit > _size * 8; }
+
+    static unsigned expGolombBits(uint32_t value)
+    {
+        unsigned n = 0;
+        for (uint64_t v = static_cast<uint64_t>(value) + 1; v > 1; v >>= 1) {
+            n++;
+        }
+        return 2 * n + 1;
+    }
+
+private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _bit;
+};
+
+/** Reads what PayloadBitWriter wrote, reads past the end yield 0 and set overrun() */
+class PayloadBitReader {
+public:
+    PayloadBitReader(const uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _bit(0)
+    {
+    }
+
+    uint32_t read(unsigned bits);
+    uint32_t readExpGolomb();
+
+    size_t bits() const { return _bit; }
+    bool overrun() const { return _bit > _size * 8; }
+
+private:
+    const uint8_t *_buffer;
+    size_t _size;
+    size_t _bit;
+};
+
+/** zigzag mapping of signed differences to small unsigned numbers */
+inline uint32_t payload_zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+inline int32_t payload_unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+/**
+ * Converts a value in the field's unit to steps, rounded to the nearest
+ * step and clamped to the schema range.
+ */
+int32_t payload_quantize(PayloadFieldId id, float value);
+
+/** Clamps a value that is already in steps to the schema range */
+inline int32_t payload_clamp(PayloadFieldId id, int64_t steps)
+{
+    const PayloadField &field = payload_schema[id];
+    return steps < field.min ? field.min : steps > field.max ? field.max : static_cast<int32_t>(steps);
+}
+
+/**
+ * Encodes values into buffer. Out-of-range values are clamped. Returns
+ * the frame length, or 0 if size is too small for it.
+ */
+size_t payload_encode(const PayloadValues &values, uint8_t *buffer, size_t size);
+
+/**
+ * Encodes the fields in present as a delta frame, flags is always sent.
+ * Returns the frame length, or 0 if size is too small for it.
+ */
+size_t payload_encode_delta(const PayloadValues &values, PayloadFieldMask present,
+                            uint8_t *buffer, size_t size);
+
+/**
+ * Decodes a keyframe or delta frame. Only the fields contained in the
+ * frame are written to values, they are reported in present if given.
+ * Returns false on an unknown version or a length that does not match
+ * the header, without touching values.
+ */
+bool payload_decode(const uint8_t *buffer, size_t length, PayloadValues &values,
+                    PayloadFieldMask *present = nullptr);
+
+/** Appends one keyframe or delta body, without the keyframe bit */
+void payload_write_body(PayloadBitWriter &writer, const PayloadValues &values, bool keyframe,
+                        PayloadFieldMask present);
+
+/** Reads one body into values, returns false on values outside the schema */
+bool payload_read_body(PayloadBitReader &reader, bool keyframe, PayloadValues &values,
+                       PayloadFieldMask *present);
+
+/**
+ * Decodes a batch frame, applying its samples to state one after the
+ * other. Returns the number of samples written to out, or -1 if the
+ * frame is not a valid batch frame or has more than max samples; state
+ * is only changed on success.
+ */
+int payload_decode_batch(const uint8_t *buffer, size_t length, PayloadValues &state,
+                         PayloadDecodedSample *out, size_t max);
+
+#endif /* APP_PAYLOAD_H_ */
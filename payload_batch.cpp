@@ -0,0 +1,45 @@
+#include "payload_batch.h"
+
+PayloadBatch::PayloadBatch(PayloadSample *storage, uint16_t capacity)
+    : _storage(storage),
+      _capacity(capacity),
+      _first(0),
+      _count(0),
+      _nextSequence(1),
+      _overflows(0)
+{
+}
+
+void PayloadBatch::push(uint32_t timestamp, const PayloadValues &values)
+{
+    PayloadSample sample;
+    sample.timestamp = timestamp;
+    sample.sequence = _nextSequence;
+    sample.values = values;
+    push(sample);
+}
+
+void PayloadBatch::push(const PayloadSample &sample)
+{
+    if (_count == _capacity) {
+        _first = (_first + 1) % _capacity;
+        _count--;
+        _overflows++;
+    }
+    _storage[(_first + _count) % _capacity] = sample;
+    _nextSequence = sample.sequence + 1;
+    _count++;
+}
+
+const PayloadSample &PayloadBatch::at(uint16_t i) const
+{
+    return _storage[(_first + i) % _capacity];
+}
+
+void PayloadBatch::dropThrough(uint32_t sequence)
+{
+    while (_count > 0 && static_cast<int32_t>(_storage[_first].sequence - sequence) <= 0) {
+        _first = (_first + 1) % _capacity;
+        _count--;
+    }
+}
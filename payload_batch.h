@@ -0,0 +1,52 @@
+#ifndef APP_PAYLOAD_BATCH_H_
+#define APP_PAYLOAD_BATCH_H_
+
+#include "payload.h"
+
+/**
+ * Timestamped samples waiting for an uplink, oldest first. The storage is
+ * provided by the caller. When it is full the oldest sample is dropped.
+ */
+class PayloadBatch {
+public:
+    PayloadBatch(PayloadSample *storage, uint16_t capacity);
+
+    void push(uint32_t timestamp, const PayloadValues &values);
+
+    /** Adds a sample that already has its sequence, e.g. from SampleLog */
+    void push(const PayloadSample &sample);
+
+    void clear() { _count = 0; }
+
+    /** i = 0 is the oldest sample */
+    const PayloadSample &at(uint16_t i) const;
+    uint16_t count() const { return _count; }
+    uint16_t capacity() const { return _capacity; }
+    bool empty() const { return _count == 0; }
+
+    /** Removes all samples up to and including sequence, i.e. those that were sent */
+    void dropThrough(uint32_t sequence);
+
+    /** Samples lost because the batch was full */
+    uint32_t overflows() const { return _overflows; }
+
+private:
+    PayloadSample *_storage;
+    uint16_t _capacity;
+    uint16_t _first;
+    uint16_t _count;
+    uint32_t _nextSequence;
+    uint32_t _overflows;
+};
+
+/**
+ * Age of a sample in whole seconds at now, rounded; samples from the
+ * future count as 0. Both times in ms of the same wrapping clock.
+ */
+inline uint32_t payload_age_seconds(uint32_t now, uint32_t timestamp)
+{
+    int32_t ms = static_cast<int32_t>(now - timestamp);
+    return ms > 0 ? (static_cast<uint32_t>(ms) + 500) / 1000 : 0;
+}
+
+#endif /* APP_PAYLOAD_BATCH_H_ */
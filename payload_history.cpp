@@ -0,0 +1,272 @@
+#include "payload_history.h"
+
+#include <cstring>
+
+namespace {
+
+enum HistoryMode : uint8_t {
+    HISTORY_CONSTANT,
+    HISTORY_DELTA,
+    HISTORY_LINEAR
+};
+
+struct ColumnCode {
+    HistoryMode mode;
+    uint8_t width;
+};
+
+int64_t clamp(const PayloadField &field, int64_t value)
+{
+    return value < field.min ? field.min : value > field.max ? field.max : value;
+}
+
+/**
+ * One field over the frame as the sequence the residuals are taken from:
+ * the reference value first if there is one, then the samples.
+ */
+class Column {
+public:
+    Column(const PayloadBatch &batch, uint16_t count, const PayloadValues *reference, const PayloadField &field)
+        : _batch(batch), _reference(reference), _field(field), _length(count + (reference ? 1 : 0))
+    {
+    }
+
+    unsigned length() const { return _length; }
+
+    int64_t at(unsigned i) const
+    {
+        if (_reference) {
+            return clamp(_field, i == 0 ? _reference->field[_field.id] : _batch.at(i - 1).values.field[_field.id]);
+        }
+        return clamp(_field, _batch.at(i).values.field[_field.id]);
+    }
+
+private:
+    const PayloadBatch &_batch;
+    const PayloadValues *_reference;
+    const PayloadField &_field;
+    unsigned _length;
+};
+
+uint64_t zigzag64(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag64(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+unsigned width_of(uint64_t value)
+{
+    unsigned bits = 0;
+    while (value >> bits) {
+        bits++;
+    }
+    return bits;
+}
+
+int64_t predict(HistoryMode mode, int64_t previous, int64_t before, unsigned i)
+{
+    if (mode == HISTORY_LINEAR && i >= 2) {
+        return 2 * previous - before;
+    }
+    return previous;
+}
+
+/** Cheapest mode for one column in a single pass, no buffer */
+ColumnCode choose(const Column &column)
+{
+    uint64_t deltaMax = 0;
+    uint64_t linearMax = 0;
+    int64_t before = 0;
+    int64_t previous = column.at(0);
+    for (unsigned i = 1; i < column.length(); i++) {
+        int64_t value = column.at(i);
+        uint64_t delta = zigzag64(value - previous);
+        uint64_t linear = zigzag64(value - predict(HISTORY_LINEAR, previous, before, i));
+        deltaMax = delta > deltaMax ? delta : deltaMax;
+        linearMax = linear > linearMax ? linear : linearMax;
+        before = previous;
+        previous = value;
+    }
+    if (deltaMax == 0) {
+        return {HISTORY_CONSTANT, 0};
+    }
+    unsigned delta = width_of(deltaMax);
+    unsigned linear = width_of(linearMax);
+    return linear < delta ? ColumnCode{HISTORY_LINEAR, static_cast<uint8_t>(linear)}
+           : ColumnCode{HISTORY_DELTA, static_cast<uint8_t>(delta)};
+}
+
+/** Writes or, with writer == nullptr, only counts the time information */
+unsigned times(const PayloadBatch &batch, uint16_t count, uint32_t now, PayloadBitWriter *writer)
+{
+    uint32_t age = payload_age_seconds(now, batch.at(0).timestamp);
+    unsigned bits = PayloadBitWriter::expGolombBits(age);
+    if (writer) {
+        writer->writeExpGolomb(age);
+    }
+    int32_t previousInterval = 0;
+    for (uint16_t i = 1; i < count; i++) {
+        uint32_t next = payload_age_seconds(now, batch.at(i).timestamp);
+        next = next > age ? age : next; // the format needs ascending timestamps
+        int32_t interval = static_cast<int32_t>(age - next);
+        uint32_t code = payload_zigzag(interval - previousInterval);
+        bits += PayloadBitWriter::expGolombBits(code);
+        if (writer) {
+            writer->writeExpGolomb(code);
+        }
+        previousInterval = interval;
+        age = next;
+    }
+    return bits;
+}
+
+} // namespace
+
+unsigned payload_history_bits(const PayloadBatch &batch, uint16_t count, uint32_t now,
+                              const PayloadValues *reference)
+{
+    if (count == 0 || count > batch.count()) {
+        return 0;
+    }
+    unsigned bits = 6 + 1 + times(batch, count, now, nullptr);
+    for (const PayloadField &field : payload_schema) {
+        Column column(batch, count, reference, field);
+        ColumnCode code = choose(column);
+        bits += 2 + (reference ? 0 : payload_field_bits(field));
+        if (code.mode != HISTORY_CONSTANT) {
+            bits += 6 + code.width * (column.length() - 1);
+        }
+    }
+    return bits;
+}
+
+uint16_t payload_history_fit(const PayloadBatch &batch, uint32_t now, size_t size,
+                             const PayloadValues *reference)
+{
+    if (size < 1) {
+        return 0;
+    }
+    const size_t budget = (size - 1) * 8;
+    uint16_t low = 0;
+    uint16_t high = batch.count() < PAYLOAD_BATCH_MAX_SAMPLES ? batch.count() : PAYLOAD_BATCH_MAX_SAMPLES;
+    // More samples never make the frame smaller, so a binary search will do
+    while (low < high) {
+        uint16_t mid = static_cast<uint16_t>((low + high + 1) / 2);
+        if (payload_history_bits(batch, mid, now, reference) <= budget) {
+            low = mid;
+        } else {
+            high = static_cast<uint16_t>(mid - 1);
+        }
+    }
+    return low;
+}
+
+size_t payload_encode_history(const PayloadBatch &batch, uint16_t count, uint32_t now,
+                              const PayloadValues *reference, uint8_t *buffer, size_t size)
+{
+    if (count == 0 || count > batch.count() || count > PAYLOAD_BATCH_MAX_SAMPLES) {
+        return 0;
+    }
+    const size_t length = 1 + (payload_history_bits(batch, count, now, reference) + 7) / 8;
+    if (size < length) {
+        return 0;
+    }
+    memset(buffer, 0, length);
+    buffer[0] = PAYLOAD_VERSION | PAYLOAD_HEADER_HISTORY;
+
+    PayloadBitWriter writer(buffer + 1, length - 1);
+    writer.write(count, 6);
+    writer.write(reference == nullptr, 1);
+    times(batch, count, now, &writer);
+    for (const PayloadField &field : payload_schema) {
+        Column column(batch, count, reference, field);
+        ColumnCode code = choose(column);
+        int64_t previous = column.at(0);
+        int64_t before = 0;
+        writer.write(code.mode, 2);
+        if (!reference) {
+            writer.write(static_cast<uint32_t>(previous - field.min), payload_field_bits(field));
+        }
+        if (code.mode == HISTORY_CONSTANT) {
+            continue;
+        }
+        writer.write(code.width, 6);
+        for (unsigned i = 1; i < column.length(); i++) {
+            int64_t value = column.at(i);
+            writer.write(static_cast<uint32_t>(zigzag64(value - predict(code.mode, previous, before, i))),
+                         code.width);
+            before = previous;
+            previous = value;
+        }
+    }
+    return length;
+}
+
+int payload_decode_history(const uint8_t *buffer, size_t length, PayloadValues &state,
+                           PayloadDecodedSample *out, size_t max)
+{
+    if (length < 1 || buffer[0] != (PAYLOAD_VERSION | PAYLOAD_HEADER_HISTORY)) {
+        return -1;
+    }
+    PayloadBitReader reader(buffer + 1, length - 1);
+    const uint32_t count = reader.read(6);
+    const bool keyframe = reader.read(1) != 0;
+    if (count == 0 || count > max) {
+        return -1;
+    }
+
+    int64_t age = reader.readExpGolomb();
+    int64_t interval = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (i > 0) {
+            interval += payload_unzigzag(reader.readExpGolomb());
+            age -= interval;
+            if (interval < 0 || age < 0) {
+                return -1;
+            }
+        }
+        out[i].age = static_cast<uint32_t>(age);
+        out[i].keyframe = keyframe;
+        out[i].present = PAYLOAD_ALL_FIELDS;
+    }
+
+    // Sample i is element i + first of the column, element 0 is the reference in a delta frame
+    const unsigned first = keyframe ? 0 : 1;
+    for (const PayloadField &field : payload_schema) {
+        HistoryMode mode = static_cast<HistoryMode>(reader.read(2));
+        int64_t previous = keyframe ? static_cast<int64_t>(reader.read(payload_field_bits(field))) + field.min
+                           : clamp(field, state.field[field.id]);
+        int64_t before = 0;
+        if (mode > HISTORY_LINEAR || previous > field.max) {
+            return -1;
+        }
+        unsigned width = mode == HISTORY_CONSTANT ? 0 : reader.read(6);
+        if (width > 32) {
+            return -1;
+        }
+        if (keyframe) {
+            out[0].values.field[field.id] = static_cast<int32_t>(previous);
+        }
+        for (unsigned i = 1; i < count + first; i++) {
+            int64_t value = previous;
+            if (mode != HISTORY_CONSTANT) {
+                value = predict(mode, previous, before, i) + unzigzag64(reader.read(width));
+            }
+            if (value < field.min || value > field.max) {
+                return -1;
+            }
+            out[i - first].values.field[field.id] = static_cast<int32_t>(value);
+            before = previous;
+            previous = value;
+        }
+    }
+    if (reader.overrun() || (reader.bits() + 7) / 8 != length - 1) {
+        return -1;
+    }
+    state = out[count - 1].values;
+    return static_cast<int>(count);
+}
@@ -0,0 +1,66 @@
+#ifndef APP_PAYLOAD_HISTORY_H_
+#define APP_PAYLOAD_HISTORY_H_
+
+#include "payload.h"
+#include "payload_batch.h"
+
+/**
+ * Lossless compression of sample histories into history frames.
+ *
+ * The samples of a frame are stored column by column. A column is the
+ * sequence of one field over the samples, preceded by the reference value
+ * in a delta frame: the baseline the server already has, as for delta and
+ * batch frames (payload_policy.h). A keyframe has no reference and starts
+ * the column with the first value in its schema width instead. The rest of
+ * the column are residuals against a predictor, zigzag mapped and
+ * bit-packed with one width for the whole column. Per column the encoder
+ * picks the cheapest of
+ *
+ *   0  constant, no residuals
+ *   1  delta, prediction is the previous value
+ *   2  linear, prediction is 2 * previous - the one before
+ *
+ * Frame layout (bit stream MSB first as in payload.h): header byte
+ * PAYLOAD_VERSION | PAYLOAD_HEADER_HISTORY, 6 bit sample count, keyframe
+ * bit, the times as in batch frames (age of the oldest sample, then zigzag
+ * interval changes, Exp-Golomb), then per field a 2 bit mode, in a
+ * keyframe the first value and, unless constant, a 6 bit residual width
+ * and the residuals.
+ *
+ * Unlike batch frames no deadband applies, every field of every sample is
+ * restored exactly. Everything works on the batch in place, without a heap
+ * or scratch buffers.
+ */
+#define PAYLOAD_HEADER_HISTORY  0x20
+
+static_assert(PAYLOAD_VERSION < PAYLOAD_HEADER_HISTORY, "version collides with the header bits");
+
+/**
+ * Bits after the header byte for the oldest count samples of batch,
+ * reference nullptr for a keyframe
+ */
+unsigned payload_history_bits(const PayloadBatch &batch, uint16_t count, uint32_t now,
+                              const PayloadValues *reference);
+
+/** Most samples, oldest first, whose history frame fits into size bytes */
+uint16_t payload_history_fit(const PayloadBatch &batch, uint32_t now, size_t size,
+                             const PayloadValues *reference);
+
+/**
+ * Encodes the oldest count samples of batch, relative to reference or as
+ * keyframe if it is nullptr. Returns the frame length, or 0 if it does
+ * not fit into size.
+ */
+size_t payload_encode_history(const PayloadBatch &batch, uint16_t count, uint32_t now,
+                              const PayloadValues *reference, uint8_t *buffer, size_t size);
+
+/**
+ * Decodes a history frame into out, oldest sample first. state is the
+ * reference of a delta frame and becomes the newest sample. Returns the
+ * number of samples, or -1 with state unchanged if the frame is invalid
+ * or has more than max.
+ */
+int payload_decode_history(const uint8_t *buffer, size_t length, PayloadValues &state,
+                           PayloadDecodedSample *out, size_t max);
+
+#endif /* APP_PAYLOAD_HISTORY_H_ */
@@ -0,0 +1,187 @@
+#include "payload_policy.h"
+#include "payload_history.h"
+
+#include <cstring>
+
+PayloadPolicy::PayloadPolicy(uint16_t keyframeInterval, bool compressHistory)
+    : _pendingKeyframe(false),
+      _hasPending(false),
+      _needKeyframe(true),
+      _pendingSamples(0),
+      _pendingSequence(0),
+      _keyframeInterval(keyframeInterval ? keyframeInterval : 1),
+      _sinceKeyframe(0),
+      _compressHistory(compressHistory)
+{
+    memset(&_baseline, 0, sizeof(_baseline));
+    memset(&_pending, 0, sizeof(_pending));
+}
+
+PayloadFieldMask PayloadPolicy::changedFields(const PayloadValues &from, const PayloadValues &to) const
+{
+    const uint8_t flags = static_cast<uint8_t>(to.field[PAYLOAD_FLAGS]);
+    PayloadFieldMask changed = 0;
+    for (const PayloadField &field : payload_schema) {
+        if (field.id == PAYLOAD_FLAGS || (field.omitIf & flags)) {
+            continue;
+        }
+        int64_t diff = static_cast<int64_t>(to.field[field.id]) - from.field[field.id];
+        if (diff > field.deadband || -diff > field.deadband) {
+            changed |= 1ul << field.id;
+        }
+    }
+    return changed;
+}
+
+bool PayloadPolicy::keyframeDue(uint8_t flags, PayloadFieldMask changed) const
+{
+    return _needKeyframe || _sinceKeyframe + 1 >= _keyframeInterval
+           || payload_body_bits(flags, false, changed) >= payload_body_bits(flags, true, 0);
+}
+
+namespace {
+
+/** Applies the fields that are sent to state, the way the server decodes them */
+void apply(PayloadValues &state, const PayloadValues &values, bool keyframe, PayloadFieldMask changed)
+{
+    const uint8_t flags = static_cast<uint8_t>(values.field[PAYLOAD_FLAGS]);
+    for (const PayloadField &field : payload_schema) {
+        bool sent = field.id == PAYLOAD_FLAGS
+                    || (keyframe ? !(field.omitIf & flags) : (changed & (1ul << field.id)) != 0);
+        if (sent) {
+            state.field[field.id] = values.field[field.id];
+        }
+    }
+}
+
+} // namespace
+
+size_t PayloadPolicy::encode(const PayloadValues &values, uint8_t *buffer, size_t size)
+{
+    const uint8_t flags = static_cast<uint8_t>(values.field[PAYLOAD_FLAGS]);
+    const PayloadFieldMask changed = changedFields(_baseline, values);
+    const bool keyframe = keyframeDue(flags, changed);
+    size_t length = keyframe ? payload_encode(values, buffer, size)
+                    : payload_encode_delta(values, changed, buffer, size);
+
+    _pending = _baseline;
+    apply(_pending, values, keyframe, changed);
+    _pendingKeyframe = keyframe;
+    _pendingSamples = 0;
+    _hasPending = length > 0;
+    return length;
+}
+
+size_t PayloadPolicy::encode(const PayloadBatch &batch, uint32_t now, uint8_t *buffer, size_t size)
+{
+    if (batch.empty()) {
+        _hasPending = false;
+        return 0;
+    }
+    if (batch.count() == 1) {
+        size_t length = encode(batch.at(0).values, buffer, size);
+        _pendingSamples = length ? 1 : 0;
+        _pendingSequence = batch.at(0).sequence;
+        return length;
+    }
+    if (size < 1) {
+        _hasPending = false;
+        return 0;
+    }
+    memset(buffer, 0, size);
+    buffer[0] = PAYLOAD_VERSION | PAYLOAD_HEADER_BATCH;
+    PayloadBitWriter writer(buffer + 1, size - 1);
+    writer.write(0, 6); // sample count, filled in at the end
+
+    PayloadValues state = _baseline;
+    bool anyKeyframe = false;
+    uint16_t samples = 0;
+    uint32_t previousAge = 0;
+    int32_t previousInterval = 0;
+    const uint16_t limit = batch.count() < PAYLOAD_BATCH_MAX_SAMPLES ? batch.count() : PAYLOAD_BATCH_MAX_SAMPLES;
+
+    for (uint16_t i = 0; i < limit; i++) {
+        const PayloadSample &sample = batch.at(i);
+        const uint8_t flags = static_cast<uint8_t>(sample.values.field[PAYLOAD_FLAGS]);
+        const PayloadFieldMask changed = changedFields(state, sample.values);
+        // Only the first sample follows the keyframe interval, the others refer to their predecessor
+        const bool keyframe = i == 0 ? keyframeDue(flags, changed)
+                              : payload_body_bits(flags, false, changed) >= payload_body_bits(flags, true, 0);
+
+        uint32_t age = payload_age_seconds(now, sample.timestamp);
+        if (i > 0 && age > previousAge) {
+            age = previousAge; // the format needs ascending timestamps
+        }
+        int32_t interval = static_cast<int32_t>(previousAge - age);
+
+        unsigned bits = (i == 0 ? PayloadBitWriter::expGolombBits(age)
+                         : PayloadBitWriter::expGolombBits(payload_zigzag(interval - previousInterval)))
+                        + 1 + payload_body_bits(flags, keyframe, changed);
+        if (writer.bits() + bits > (size - 1) * 8) {
+            break;
+        }
+
+        if (i == 0) {
+            writer.writeExpGolomb(age);
+        } else {
+            writer.writeExpGolomb(payload_zigzag(interval - previousInterval));
+            previousInterval = interval;
+        }
+        writer.write(keyframe, 1);
+        payload_write_body(writer, sample.values, keyframe, changed);
+        apply(state, sample.values, keyframe, changed);
+
+        anyKeyframe |= keyframe;
+        previousAge = age;
+        samples++;
+    }
+
+    if (_compressHistory) {
+        // Lossless whenever that does not cost samples, noisy readings pack tighter with the deadband
+        const bool keyframe = _needKeyframe || _sinceKeyframe + 1 >= _keyframeInterval;
+        const PayloadValues *reference = keyframe ? nullptr : &_baseline;
+        const uint16_t lossless = payload_history_fit(batch, now, size, reference);
+        if (lossless >= 2 && lossless >= samples) {
+            _pending = batch.at(lossless - 1).values;
+            _pendingKeyframe = keyframe;
+            _pendingSamples = lossless;
+            _pendingSequence = batch.at(lossless - 1).sequence;
+            size_t length = payload_encode_history(batch, lossless, now, reference, buffer, size);
+            _hasPending = length > 0;
+            return length;
+        }
+    }
+    if (samples == 0) {
+        _hasPending = false;
+        return 0;
+    }
+    PayloadBitWriter count(buffer + 1, size - 1);
+    count.write(samples, 6);
+
+    _pending = state;
+    _pendingKeyframe = anyKeyframe;
+    _pendingSamples = samples;
+    _pendingSequence = batch.at(samples - 1).sequence;
+    _hasPending = true;
+    return 1 + (writer.bits() + 7) / 8;
+}
+
+void PayloadPolicy::commit()
+{
+    if (!_hasPending) {
+        return;
+    }
+    _baseline = _pending;
+    if (_pendingKeyframe) {
+        _needKeyframe = false;
+        _sinceKeyframe = 0;
+    } else {
+        _sinceKeyframe++;
+    }
+    _hasPending = false;
+}
+
+void PayloadPolicy::forceKeyframe()
+{
+    _needKeyframe = true;
+}
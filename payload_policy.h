@@ -0,0 +1,72 @@
+#ifndef APP_PAYLOAD_POLICY_H_
+#define APP_PAYLOAD_POLICY_H_
+
+#include "payload.h"
+#include "payload_batch.h"
+
+/**
+ * Send-on-change policy between the acquisition and lorawan.send().
+ *
+ * Each frame is compared with the baseline, the values the network
+ * server last received. Only fields that moved further than their schema
+ * deadband go into a delta frame. A keyframe with every field is sent
+ * first, every keyframeInterval frames, after forceKeyframe() and
+ * whenever it would not be larger than the delta.
+ *
+ * With compressHistory a batch goes out as lossless history frame
+ * (payload_history.h) whenever that carries at least as many samples as
+ * the batch frame. It has every field of every sample, and like the first
+ * sample of a batch frame it is coded against the baseline except when a
+ * keyframe is due.
+ *
+ * encode() does not change the baseline; call commit() once the frame
+ * has actually gone out (TX_DONE), so that a failed transmission is
+ * compared against the same baseline again.
+ */
+class PayloadPolicy {
+public:
+    /** keyframeInterval 1 sends keyframes only */
+    explicit PayloadPolicy(uint16_t keyframeInterval, bool compressHistory = false);
+
+    /** Builds the next frame, returns its length or 0 if size is too small */
+    size_t encode(const PayloadValues &values, uint8_t *buffer, size_t size);
+
+    /**
+     * Packs as many samples of batch as fit into size bytes, oldest first,
+     * as one batch or history frame (a single frame if only one sample is
+     * waiting).
+     * now is the current time in the clock of the sample timestamps.
+     * Returns the frame length, 0 if batch is empty or size too small.
+     */
+    size_t encode(const PayloadBatch &batch, uint32_t now, uint8_t *buffer, size_t size);
+
+    /** The frame of the last encode() was transmitted */
+    void commit();
+
+    /** The next frame is a keyframe, e.g. after a new join */
+    void forceKeyframe();
+
+    /** Whether the last encode() produced or contained a keyframe */
+    bool lastWasKeyframe() const { return _pendingKeyframe; }
+
+    /** Samples in the last batch frame and the sequence of the newest one */
+    uint16_t lastSamples() const { return _pendingSamples; }
+    uint32_t lastSequence() const { return _pendingSequence; }
+
+private:
+    bool keyframeDue(uint8_t flags, PayloadFieldMask changed) const;
+    PayloadFieldMask changedFields(const PayloadValues &from, const PayloadValues &to) const;
+
+    PayloadValues _baseline;
+    PayloadValues _pending;   // baseline after the pending frame
+    bool _pendingKeyframe;
+    bool _hasPending;
+    bool _needKeyframe;
+    uint16_t _pendingSamples;
+    uint32_t _pendingSequence;
+    uint16_t _keyframeInterval;
+    uint16_t _sinceKeyframe;  // committed delta frames since the last keyframe
+    bool _compressHistory;
+};
+
+#endif /* APP_PAYLOAD_POLICY_H_ */
@@ -0,0 +1,372 @@
+#include "sample_log.h"
+#include "crc32.h"
+
+#include <cstring>
+
+namespace {
+
+// Slot layout: kind, length, two reserved bytes, two 32-bit words, the
+// payload and the CRC of everything before it in the last four bytes
+const uint8_t KIND_HEADER = 0xa5;
+const uint8_t KIND_SAMPLE = 0x5a;
+const uint8_t KIND_ACK = 0x3c;
+const uint32_t RECORD_OVERHEAD = 16;
+const uint32_t PAYLOAD_OFFSET = 12;
+
+const uint32_t HEADER_MAGIC = 0x01474c53; // "SLG" and the layout version 1
+
+void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bd_size_t round_up(bd_size_t value, bd_size_t unit)
+{
+    return (value + unit - 1) / unit * unit;
+}
+
+} // namespace
+
+SampleLog::SampleLog(BlockDevice &device)
+    : _device(device),
+      _mounted(false),
+      _sectorSize(0),
+      _sectorCount(0),
+      _slotSize(0),
+      _slotsPerSector(0),
+      _eraseValue(0xff),
+      _tailSector(0),
+      _headGeneration(0),
+      _head{0, 0},
+      _cursor{0, 0},
+      _nextSequence(1),
+      _acked(0),
+      _pending(0),
+      _lastTimestamp(0),
+      _stats()
+{
+}
+
+int SampleLog::mount()
+{
+    _mounted = false;
+    int err = _device.init();
+    if (err) {
+        return err;
+    }
+
+    const bd_size_t eraseSize = _device.get_erase_size();
+    const bd_size_t unit = _device.get_program_size() > _device.get_read_size() ? _device.get_program_size()
+                           : _device.get_read_size();
+    _slotSize = round_up(RECORD_OVERHEAD + PAYLOAD_MAX_SIZE, unit);
+    _sectorSize = round_up(MIN_SECTOR_SIZE, eraseSize);
+    _sectorCount = _device.size() / _sectorSize;
+    _slotsPerSector = _sectorSize / _slotSize;
+    _eraseValue = _device.get_erase_value();
+    if (_slotSize > MAX_SLOT_SIZE || _sectorCount < 2 || _slotsPerSector < 2) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    // Sectors of different size (some FlashIAP regions) would break the ring
+    for (uint32_t sector = 0; sector < _sectorCount; sector++) {
+        if (_device.get_erase_size(sector * _sectorSize) != eraseSize) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+    }
+    memset(&_stats, 0, sizeof(_stats));
+
+    // The newest sector, then back along the generations to the oldest
+    bool found = false;
+    uint32_t headSector = 0;
+    for (uint32_t sector = 0; sector < _sectorCount; sector++) {
+        uint32_t generation;
+        if (sectorGeneration(sector, generation) && (!found || generation > _headGeneration)) {
+            found = true;
+            headSector = sector;
+            _headGeneration = generation;
+        }
+    }
+    if (!found) {
+        // Empty or foreign contents: start a new log
+        _tailSector = 0;
+        _headGeneration = 1;
+        _head = {0, 1};
+        _cursor = _head;
+        _nextSequence = 1;
+        _acked = 0;
+        _pending = 0;
+        _lastTimestamp = 0;
+        if (!startSector(0, _headGeneration)) {
+            return BD_ERROR_DEVICE_ERROR;
+        }
+        _mounted = true;
+        return BD_ERROR_OK;
+    }
+    _tailSector = headSector;
+    for (uint32_t generation = _headGeneration, i = 1; i < _sectorCount; i++) {
+        uint32_t previous = (_tailSector + _sectorCount - 1) % _sectorCount;
+        uint32_t previousGeneration;
+        if (!sectorGeneration(previous, previousGeneration) || previousGeneration != generation - 1) {
+            break;
+        }
+        _tailSector = previous;
+        generation = previousGeneration;
+    }
+
+    // Newest sequence, ack and timestamp, and the first free slot of the head sector
+    bool haveSample = false;
+    bool haveAck = false;
+    uint32_t firstSequence = 0;
+    uint32_t lastSequence = 0;
+    uint32_t acked = 0;
+    uint32_t samples = 0;
+    uint32_t headSlot = 1;
+    for (uint32_t sector = _tailSector;; sector = (sector + 1) % _sectorCount) {
+        for (uint32_t slot = 1; slot < _slotsPerSector; slot++) {
+            Record record;
+            SlotState state = readSlot({sector, slot}, record);
+            if (state == SLOT_CORRUPT) {
+                _stats.corrupt++;
+            } else if (state == SLOT_VALID && record.kind == KIND_SAMPLE) {
+                firstSequence = haveSample ? firstSequence : record.sequence;
+                lastSequence = record.sequence;
+                _lastTimestamp = record.timestamp;
+                haveSample = true;
+                samples++;
+            } else if (state == SLOT_VALID && record.kind == KIND_ACK) {
+                acked = haveAck && acked > record.sequence ? acked : record.sequence;
+                haveAck = true;
+            }
+            if (sector == headSector && state != SLOT_ERASED) {
+                headSlot = slot + 1;
+            }
+        }
+        if (sector == headSector) {
+            break;
+        }
+    }
+    _head = {headSector, headSlot};
+    _acked = haveAck ? acked : (haveSample ? firstSequence - 1 : 0);
+    _nextSequence = (haveSample && lastSequence > _acked ? lastSequence : _acked) + 1;
+
+    // Skip what was already sent
+    _cursor = {_tailSector, 1};
+    _pending = samples;
+    skipAcknowledged();
+    _mounted = true;
+    return BD_ERROR_OK;
+}
+
+bool SampleLog::append(uint32_t timestamp, const PayloadValues &values)
+{
+    if (!_mounted) {
+        return false;
+    }
+    uint8_t payload[PAYLOAD_MAX_SIZE];
+    size_t length = payload_encode(values, payload, sizeof(payload));
+    if (length == 0 || !appendRecord(KIND_SAMPLE, _nextSequence, timestamp, payload, length)) {
+        return false;
+    }
+    _nextSequence++;
+    _pending++;
+    _lastTimestamp = timestamp;
+    _stats.appends++;
+    return true;
+}
+
+bool SampleLog::acknowledge(uint32_t sequence)
+{
+    if (!_mounted) {
+        return false;
+    }
+    if (sequence <= _acked) {
+        return true;
+    }
+    // In RAM even if the record fails, then the samples are only sent again after a reset
+    bool written = appendRecord(KIND_ACK, sequence, 0, nullptr, 0);
+    _acked = sequence;
+    _stats.acks++;
+    skipAcknowledged();
+    return written;
+}
+
+uint16_t SampleLog::fill(PayloadBatch &batch)
+{
+    batch.clear();
+    if (!_mounted) {
+        return 0;
+    }
+    for (Position position = _cursor; !atHead(position) && batch.count() < batch.capacity(); next(position)) {
+        Record record;
+        if (readSlot(position, record) != SLOT_VALID || record.kind != KIND_SAMPLE || record.sequence <= _acked) {
+            continue;
+        }
+        PayloadSample sample;
+        sample.timestamp = record.timestamp;
+        sample.sequence = record.sequence;
+        memset(&sample.values, 0, sizeof(sample.values));
+        if (payload_decode(record.payload, record.length, sample.values)) {
+            batch.push(sample);
+        }
+    }
+    return batch.count();
+}
+
+bd_addr_t SampleLog::address(const Position &position) const
+{
+    return position.sector * _sectorSize + position.slot * _slotSize;
+}
+
+SampleLog::SlotState SampleLog::readSlot(const Position &position, Record &record)
+{
+    if (_device.read(_buffer, address(position), _slotSize)) {
+        return SLOT_CORRUPT;
+    }
+    const uint8_t erased = _eraseValue < 0 ? 0xff : static_cast<uint8_t>(_eraseValue);
+    uint32_t i = 0;
+    while (i < _slotSize && _buffer[i] == erased) {
+        i++;
+    }
+    if (i == _slotSize) {
+        return SLOT_ERASED;
+    }
+    if (get32(_buffer + _slotSize - 4) != crc32(_buffer, _slotSize - 4)) {
+        return SLOT_CORRUPT;
+    }
+    record.kind = _buffer[0];
+    record.length = _buffer[1];
+    record.sequence = get32(_buffer + 4);
+    record.timestamp = get32(_buffer + 8);
+    record.payload = _buffer + PAYLOAD_OFFSET;
+    if ((record.kind != KIND_SAMPLE && record.kind != KIND_ACK && record.kind != KIND_HEADER)
+            || record.length > _slotSize - RECORD_OVERHEAD) {
+        return SLOT_CORRUPT;
+    }
+    return SLOT_VALID;
+}
+
+bool SampleLog::writeSlot(const Position &position, uint8_t kind, uint32_t sequence, uint32_t timestamp,
+                          const uint8_t *payload, uint8_t length)
+{
+    memset(_buffer, 0xff, _slotSize);
+    _buffer[0] = kind;
+    _buffer[1] = length;
+    _buffer[2] = 0;
+    _buffer[3] = 0;
+    put32(_buffer + 4, sequence);
+    put32(_buffer + 8, timestamp);
+    if (length) {
+        memcpy(_buffer + PAYLOAD_OFFSET, payload, length);
+    }
+    put32(_buffer + _slotSize - 4, crc32(_buffer, _slotSize - 4));
+    return _device.program(_buffer, address(position), _slotSize) == BD_ERROR_OK;
+}
+
+bool SampleLog::startSector(uint32_t sector, uint32_t generation)
+{
+    const bd_addr_t start = sector * _sectorSize;
+    if (_device.erase(start, _sectorSize)) {
+        return false;
+    }
+    _stats.sectorErases++;
+    if (_eraseValue < 0) {
+        // Erased contents undefined (e.g. HeapBlockDevice on Mbed): make them recognisable
+        memset(_buffer, 0xff, _slotSize);
+        for (bd_addr_t offset = 0; offset + _slotSize <= _sectorSize; offset += _slotSize) {
+            if (_device.program(_buffer, start + offset, _slotSize)) {
+                return false;
+            }
+        }
+    }
+    // Header: the generation as sequence, the slot size as timestamp and the magic as payload
+    uint8_t magic[4];
+    put32(magic, HEADER_MAGIC);
+    return writeSlot({sector, 0}, KIND_HEADER, generation, _slotSize, magic, sizeof(magic));
+}
+
+bool SampleLog::sectorGeneration(uint32_t sector, uint32_t &generation)
+{
+    Record record;
+    if (readSlot({sector, 0}, record) != SLOT_VALID || record.kind != KIND_HEADER
+            || record.length != 4 || get32(record.payload) != HEADER_MAGIC || record.timestamp != _slotSize) {
+        return false;
+    }
+    generation = record.sequence;
+    return true;
+}
+
+bool SampleLog::appendRecord(uint8_t kind, uint32_t sequence, uint32_t timestamp, const uint8_t *payload,
+                             uint8_t length)
+{
+    if (_head.slot >= _slotsPerSector) {
+        // Sector full: erase the next one, the oldest if the ring is full
+        const uint32_t sector = (_head.sector + 1) % _sectorCount;
+        if (sector == _tailSector) {
+            dropOldestSector();
+        }
+        const bool nothingPending = atHead(_cursor);
+        if (!startSector(sector, _headGeneration + 1)) {
+            return false;
+        }
+        _headGeneration++;
+        _head = {sector, 1};
+        if (nothingPending) {
+            _cursor = _head;
+        }
+    }
+    // A failed write may have left part of the slot programmed, it is skipped either way
+    const Position position = _head;
+    _head.slot++;
+    return writeSlot(position, kind, sequence, timestamp, payload, length);
+}
+
+void SampleLog::dropOldestSector()
+{
+    for (uint32_t slot = 1; slot < _slotsPerSector; slot++) {
+        Record record;
+        if (readSlot({_tailSector, slot}, record) == SLOT_VALID && record.kind == KIND_SAMPLE
+                && record.sequence > _acked) {
+            _stats.lost++;
+            _pending--;
+        }
+    }
+    if (_cursor.sector == _tailSector) {
+        _cursor = {(_tailSector + 1) % _sectorCount, 1};
+    }
+    _tailSector = (_tailSector + 1) % _sectorCount;
+}
+
+void SampleLog::skipAcknowledged()
+{
+    for (; !atHead(_cursor); next(_cursor)) {
+        Record record;
+        if (readSlot(_cursor, record) != SLOT_VALID || record.kind != KIND_SAMPLE) {
+            continue;
+        }
+        if (record.sequence > _acked) {
+            break;
+        }
+        _pending--;
+    }
+}
+
+bool SampleLog::atHead(const Position &position) const
+{
+    return position.sector == _head.sector && position.slot == _head.slot;
+}
+
+void SampleLog::next(Position &position) const
+{
+    // The head sector is the last one, its end is where the log ends
+    if (++position.slot >= _slotsPerSector && position.sector != _head.sector) {
+        position.sector = (position.sector + 1) % _sectorCount;
+        position.slot = 1;
+    }
+}
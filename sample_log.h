@@ -0,0 +1,141 @@
+#ifndef APP_SAMPLE_LOG_H_
+#define APP_SAMPLE_LOG_H_
+
+#include <cstdint>
+#include "blockdevice/BlockDevice.h"
+#include "payload.h"
+#include "payload_batch.h"
+
+/** Counters since mount() */
+struct SampleLogStats {
+    uint32_t appends;
+    uint32_t acks;
+    uint32_t sectorErases;
+    uint32_t lost;      // unsent samples overwritten because the log was full
+    uint32_t corrupt;   // torn or damaged records skipped by mount()
+};
+
+/**
+ * Store-and-forward log of samples on a BlockDevice, so that samples
+ * that could not be sent survive a full RAM batch and a reset.
+ *
+ * The device is used as a ring of sectors of at least MIN_SECTOR_SIZE
+ * (whole erase units). Each sector starts with a header that carries its
+ * generation, one more than that of the sector before it, followed by
+ * fixed-size record slots written strictly in order. A sample record
+ * holds the sequence, the timestamp and the sample as keyframe
+ * (payload_encode()); acknowledge() appends an ack record for everything
+ * up to a sequence, since flash cannot be rewritten in place. Every
+ * record and header has a CRC.
+ *
+ * append() programs one slot, and erases the next sector when the
+ * current one is full; when that is the oldest sector its unsent samples
+ * are lost. The sectors are erased strictly in turn, so the wear is
+ * spread evenly over the whole device.
+ *
+ * mount() finds the newest header and follows the generations back to
+ * the oldest sector. A reset in the middle of a write leaves a record or
+ * header that fails its CRC: a torn record is skipped, a torn header
+ * makes its sector free again. A lost ack record only means that its
+ * samples are sent once more (at least once, never lost). A device
+ * without a valid header is formatted.
+ *
+ * Timestamps are whatever clock the caller uses. Without an RTC the
+ * kernel clock restarts at 0 with every reset, so the caller should
+ * continue from lastTimestamp(); the time the node was off is then
+ * missing from the age of older samples.
+ */
+class SampleLog {
+public:
+    static const uint32_t MIN_SECTOR_SIZE = 1024;
+    static const uint32_t MAX_SLOT_SIZE = 128;
+
+    explicit SampleLog(BlockDevice &device);
+
+    /** Initialises the device and recovers the log, 0 or a BlockDevice error */
+    int mount();
+
+    bool mounted() const { return _mounted; }
+
+    /** Stores a sample under the next sequence number */
+    bool append(uint32_t timestamp, const PayloadValues &values);
+
+    /** All samples up to and including sequence were sent */
+    bool acknowledge(uint32_t sequence);
+
+    /**
+     * Replaces the contents of batch with the oldest unsent samples, as
+     * many as it holds. Returns their number.
+     */
+    uint16_t fill(PayloadBatch &batch);
+
+    /** Sequence number the next append() uses */
+    uint32_t nextSequence() const { return _nextSequence; }
+
+    /** Samples not acknowledged yet */
+    uint32_t pending() const { return _pending; }
+
+    /** Samples the log holds at least before the oldest ones are overwritten */
+    uint32_t capacity() const { return (_sectorCount - 1) * (_slotsPerSector - 1); }
+
+    /** Timestamp of the newest sample, 0 for an empty log */
+    uint32_t lastTimestamp() const { return _lastTimestamp; }
+
+    const SampleLogStats &stats() const { return _stats; }
+
+private:
+    struct Position {
+        uint32_t sector;
+        uint32_t slot;
+    };
+
+    enum SlotState {
+        SLOT_ERASED,
+        SLOT_VALID,
+        SLOT_CORRUPT
+    };
+
+    struct Record {
+        uint8_t kind;
+        uint8_t length;
+        uint32_t sequence;
+        uint32_t timestamp;
+        const uint8_t *payload;
+    };
+
+    bd_addr_t address(const Position &position) const;
+    SlotState readSlot(const Position &position, Record &record);
+    bool writeSlot(const Position &position, uint8_t kind, uint32_t sequence, uint32_t timestamp,
+                   const uint8_t *payload, uint8_t length);
+    bool startSector(uint32_t sector, uint32_t generation);
+    bool sectorGeneration(uint32_t sector, uint32_t &generation);
+    bool appendRecord(uint8_t kind, uint32_t sequence, uint32_t timestamp, const uint8_t *payload,
+                      uint8_t length);
+    void dropOldestSector();
+    void skipAcknowledged();
+    bool atHead(const Position &position) const;
+    void next(Position &position) const;
+
+    BlockDevice &_device;
+    bool _mounted;
+    bd_size_t _sectorSize;
+    uint32_t _sectorCount;
+    uint32_t _slotSize;
+    uint32_t _slotsPerSector;
+    int _eraseValue;
+
+    uint32_t _tailSector;     // oldest sector of the log
+    uint32_t _headGeneration;
+    Position _head;           // next free slot
+    Position _cursor;         // no unsent sample before this
+
+    uint32_t _nextSequence;
+    uint32_t _acked;
+    uint32_t _pending;
+    uint32_t _lastTimestamp;
+    SampleLogStats _stats;
+
+    uint8_t _buffer[MAX_SLOT_SIZE];
+};
+
+#endif /* APP_SAMPLE_LOG_H_ */
@@ -0,0 +1,121 @@
+#include "sensor_scheduler.h"
+
+namespace {
+
+uint32_t now_ms()
+{
+    return Kernel::Clock::now().time_since_epoch().count();
+}
+
+} // namespace
+
+SensorScheduler::SensorScheduler()
+    : _queue(nullptr),
+      _tasks(),
+      _count(0),
+      _held(false),
+      _releaseEvent(0)
+{
+}
+
+int SensorScheduler::add(const char *name, uint32_t period_ms, uint32_t phase_ms, Callback<void()> read)
+{
+    if (_count >= MAX_TASKS || period_ms == 0) {
+        return -1;
+    }
+    Task &task = _tasks[_count];
+    task.name = name;
+    task.period = period_ms;
+    task.phase = phase_ms;
+    task.read = read;
+    task.deferred = false;
+    task.stats = TaskStats();
+    return _count++;
+}
+
+void SensorScheduler::start(EventQueue &queue)
+{
+    _queue = &queue;
+    const uint32_t now = now_ms();
+    for (int id = 0; id < _count; id++) {
+        _tasks[id].due = now + _tasks[id].phase;
+        schedule(id);
+    }
+}
+
+void SensorScheduler::schedule(int id)
+{
+    int32_t delay = static_cast<int32_t>(_tasks[id].due - now_ms());
+    if (!_queue->call_in(std::chrono::milliseconds(delay > 0 ? delay : 0), this, &SensorScheduler::run, id)) {
+        // Queue full: try again a period later rather than losing the task
+        _tasks[id].due += _tasks[id].period;
+        _queue->call_in(std::chrono::milliseconds(_tasks[id].period), this, &SensorScheduler::run, id);
+    }
+}
+
+void SensorScheduler::run(int id)
+{
+    Task &task = _tasks[id];
+    // Next run from the anchor, skipping whole periods that were missed
+    const uint32_t now = now_ms();
+    do {
+        task.due += task.period;
+    } while (static_cast<int32_t>(task.due - now) <= 0);
+    schedule(id);
+
+    if (_held) {
+        if (!task.deferred) {
+            task.deferred = true;
+            task.stats.deferred++;
+        }
+        return;
+    }
+    execute(id);
+}
+
+void SensorScheduler::execute(int id)
+{
+    Task &task = _tasks[id];
+    task.stats.runs++;
+    task.stats.lastRun = now_ms();
+    if (task.read) {
+        task.read();
+    }
+}
+
+void SensorScheduler::hold(uint32_t max_ms)
+{
+    if (!_queue) {
+        return;
+    }
+    if (_releaseEvent) {
+        _queue->cancel(_releaseEvent);
+    }
+    _held = true;
+    _releaseEvent = _queue->call_in(std::chrono::milliseconds(max_ms), this, &SensorScheduler::holdTimeout);
+}
+
+void SensorScheduler::holdTimeout()
+{
+    _releaseEvent = 0;
+    release();
+}
+
+void SensorScheduler::release()
+{
+    if (_releaseEvent) {
+        _queue->cancel(_releaseEvent);
+        _releaseEvent = 0;
+    }
+    if (!_held) {
+        return;
+    }
+    _held = false;
+    // Each deferred read as its own event, the stack's events can run in between
+    for (int id = 0; id < _count; id++) {
+        if (_tasks[id].deferred) {
+            _tasks[id].deferred = false;
+            _queue->call(this, &SensorScheduler::execute, id);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef APP_SENSOR_SCHEDULER_H_
+#define APP_SENSOR_SCHEDULER_H_
+
+#include <cstdint>
+#include "mbed.h"
+
+/**
+ * Runs sensor reads on the application event queue, each at its own
+ * period and phase, instead of reading every sensor when an uplink is due.
+ *
+ * A read is one queue event and is expected to store its result where
+ * the uplink path picks it up without touching the bus. Periods are
+ * anchored to the first run, a late event does not shift the ones after
+ * it. Give reads of the same period different phases so that they do not
+ * run back to back.
+ *
+ * While held (hold()/release(), around the LoRaWAN RX windows) due reads
+ * are not run but remembered, and run once each after the release.
+ */
+class SensorScheduler {
+public:
+    static const int MAX_TASKS = 8;
+
+    struct TaskStats {
+        uint32_t runs;
+        uint32_t deferred;  // due while held, run after the release
+        uint32_t lastRun;   // Kernel clock in ms, 0 = never
+    };
+
+    SensorScheduler();
+
+    /**
+     * Registers read to run every period_ms, the first time phase_ms after
+     * start(). Returns the task id, or -1 if all MAX_TASKS are taken.
+     */
+    int add(const char *name, uint32_t period_ms, uint32_t phase_ms, Callback<void()> read);
+
+    /** Schedules the first run of every task on queue */
+    void start(EventQueue &queue);
+
+    /**
+     * Holds all reads until release(), at most for max_ms in case the
+     * release never comes
+     */
+    void hold(uint32_t max_ms);
+    void release();
+    bool held() const { return _held; }
+
+    int count() const { return _count; }
+    const char *name(int id) const { return _tasks[id].name; }
+    const TaskStats &stats(int id) const { return _tasks[id].stats; }
+
+private:
+    struct Task {
+        const char *name;
+        uint32_t period;
+        uint32_t phase;
+        uint32_t due;       // Kernel clock in ms of the next run
+        Callback<void()> read;
+        bool deferred;
+        TaskStats stats;
+    };
+
+    void schedule(int id);
+    void run(int id);
+    void execute(int id);
+    void holdTimeout();
+
+    EventQueue *_queue;
+    Task _tasks[MAX_TASKS];
+    int _count;
+    bool _held;
+    int _releaseEvent;
+};
+
+/**
+ * Latest result of a scheduled read and when it was taken. Written and
+ * read on the same queue, so no locking.
+ */
+template <typename T>
+struct SensorSlot {
+    T value;
+    uint32_t timestamp;  // Kernel clock in ms, 0 = never filled
+
+    void store(const T &result)
+    {
+        value = result;
+        timestamp = Kernel::Clock::now().time_since_epoch().count();
+        timestamp = timestamp ? timestamp : 1;
+    }
+
+    bool filled() const { return timestamp != 0; }
+};
+
+#endif /* APP_SENSOR_SCHEDULER_H_ */
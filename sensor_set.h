@@ -0,0 +1,100 @@
+#ifndef APP_SENSOR_SET_H_
+#define APP_SENSOR_SET_H_
+
+#include <type_traits>
+#include "mbed.h"
+#include "payload.h"
+#include "sensor_scheduler.h"
+
+/**
+ * Placeholder for a sensor that is switched off in the configuration. A
+ * SensorSet skips it: it takes no storage and generates no code.
+ */
+struct NoSensor {
+};
+
+/** Sensor if enabled, NoSensor otherwise */
+template <bool Enabled, typename Sensor>
+using OptionalSensor = typename std::conditional<Enabled, Sensor, NoSensor>::type;
+
+/**
+ * The sensors of the node, composed at compile time.
+ *
+ * Every member is a plain class that owns its driver and its latest value
+ * and provides
+ *
+ *     void init(EventQueue &queue);          // one-time setup, on the acquisition queue
+ *     void start(SensorScheduler &scheduler); // registers its periodic collect()
+ *     void collect();                        // takes a reading, may complete later
+ *     void encode(PayloadValues &values);    // latest value into its schema fields
+ *     void print();                          // after each uplink
+ *     void taken();                          // an uplink took the values
+ *
+ * encode() must not touch the bus: it runs whenever any sensor published.
+ * Each call on the set is expanded into a direct call per member, in the
+ * order of the template arguments, without virtual dispatch.
+ */
+template <typename... Sensors>
+class SensorSet;
+
+template <>
+class SensorSet<> {
+public:
+    void init(EventQueue &queue) {}
+    void start(SensorScheduler &scheduler) {}
+    void collect() {}
+    void encode(PayloadValues &values) {}
+    void print() {}
+    void taken() {}
+};
+
+template <typename... Rest>
+class SensorSet<NoSensor, Rest...> : public SensorSet<Rest...> {
+};
+
+template <typename First, typename... Rest>
+class SensorSet<First, Rest...> : private SensorSet<Rest...> {
+    using Others = SensorSet<Rest...>;
+
+public:
+    void init(EventQueue &queue)
+    {
+        _sensor.init(queue);
+        Others::init(queue);
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+        _sensor.start(scheduler);
+        Others::start(scheduler);
+    }
+
+    void collect()
+    {
+        _sensor.collect();
+        Others::collect();
+    }
+
+    void encode(PayloadValues &values)
+    {
+        _sensor.encode(values);
+        Others::encode(values);
+    }
+
+    void print()
+    {
+        _sensor.print();
+        Others::print();
+    }
+
+    void taken()
+    {
+        _sensor.taken();
+        Others::taken();
+    }
+
+private:
+    First _sensor;
+};
+
+#endif /* APP_SENSOR_SET_H_ */
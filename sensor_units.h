@@ -0,0 +1,68 @@
+#ifndef APP_SENSOR_UNITS_H_
+#define APP_SENSOR_UNITS_H_
+
+#include <cstdint>
+#include "payload.h"
+
+/**
+ * Integer conversions from raw sensor codes straight to payload schema
+ * steps, without float or double math.
+ *
+ * The Si7021 and MMA8451 single-reading conversions give the same steps
+ * as the float conversions they replace followed by payload_quantize(),
+ * for every possible code. That includes the half-step ties, where the
+ * float path's rounding error decides the direction. The ADC conversion
+ * and the FIFO mean round exactly. The single-precision float ADC path
+ * was one step off at 2 of the 65536 codes. host/sensor_units.cpp checks
+ * all of it (sensor-units --self-test). Intermediate products fit in 32
+ * bits except where noted.
+ */
+
+/** Si7021 relative humidity code to 0.1 % (PAYLOAD_HUMID), datasheet: 125 * code / 65536 - 6 */
+inline int32_t si7021_humidity_steps(uint16_t code)
+{
+    // 1250 / 65536 steps per code, +0.5 step for rounding, -60 steps offset
+    return payload_clamp(PAYLOAD_HUMID, ((int32_t)(1250 * (uint32_t)code + 32768) >> 16) - 60);
+}
+
+/** Si7021 temperature code to 0.1 °C (PAYLOAD_TEMP), datasheet: 175.72 * code / 65536 - 46.85 */
+inline int32_t si7021_temperature_steps(uint16_t code)
+{
+    // 17572 / 655360 steps per code: -468.5 steps offset and +0.5 for rounding cancel to -468
+    return payload_clamp(PAYLOAD_TEMP, (int32_t)(17572 * (uint32_t)code / 655360) - 468);
+}
+
+/** MMA8451 count in 2g mode (4096 per g) to 0.01 m/s^2 (PAYLOAD_ACC_*) */
+inline int32_t mma8451_acceleration_steps(int32_t count)
+{
+    // 981 / 4096 steps per count, ties away from zero like the float path
+    const uint32_t magnitude = ((uint32_t)(count < 0 ? -count : count) * 981 + 2048) >> 12;
+    return payload_clamp(PAYLOAD_ACC_X, count < 0 ? -(int32_t)magnitude : (int32_t)magnitude);
+}
+
+/**
+ * Mean of samples MMA8451 counts summing to sum, in 0.01 m/s^2. Rounded
+ * exactly, ties away from zero; 64-bit intermediates. The sum is 64 bit:
+ * at 1 g a 32-bit sum overflows after 3 h at 50 Hz.
+ */
+inline int32_t mma8451_mean_acceleration_steps(int64_t sum, int32_t samples)
+{
+    if (samples <= 0) {
+        return 0;
+    }
+    const uint64_t divisor = (uint64_t)samples * 4096;
+    const uint64_t magnitude = ((uint64_t)(sum < 0 ? -sum : sum) * 981 + divisor / 2) / divisor;
+    return payload_clamp(PAYLOAD_ACC_X, sum < 0 ? -(int64_t)magnitude : (int64_t)magnitude);
+}
+
+/**
+ * 16-bit ADC reading (AnalogIn::read_u16()) to 0.1 % of full scale
+ * (PAYLOAD_LIGHT, PAYLOAD_SOIL). Rounded exactly; there are no ties since
+ * 65535 is odd.
+ */
+inline int32_t adc_percent_steps(uint16_t code)
+{
+    return (int32_t)((2000 * (uint32_t)code + 65535) / 131070);
+}
+
+#endif /* APP_SENSOR_UNITS_H_ */
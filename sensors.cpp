@@ -0,0 +1,680 @@
+#include <cstdint>
+#include <cstdio>
+#include "mbed.h"
+
+#include "sensors.h"
+#include "brightness.h"
+#include "soil.h"
+#include "GPS.h"
+#include "temperatur.h"
+#include "color.h"
+#include "Accelerometer.h"
+#include "i2c_bus.h"
+#include "sensor_scheduler.h"
+#include "sensor_set.h"
+#include "snapshot_buffer.h"
+#include "sensor_units.h"
+#include "adc_oversampler.h"
+#include "latency.h"
+#include "deferred_log.h"
+
+
+// Position ohne Fix, in 1e-6 Grad wie PAYLOAD_LAT/PAYLOAD_LON (static_assert unten)
+#define DEF_LATITUDE 52520000
+#define DEF_LONGITUDE 13405000
+//#define DEF_ALTITUDE 0
+#define GPS_MAX_FIX_AGE_MS  (5 * 60 * 1000)  // ältere Positionen gelten als kein Fix
+
+#if MBED_CONF_APP_GPS_MOTION_GATED && !(MBED_CONF_APP_GPS_DUTY_CYCLE && MBED_CONF_APP_ACCEL_EVENTS)
+#error "gps-motion-gated needs gps-duty-cycle and accel-events"
+#endif
+#if (MBED_CONF_APP_ACCEL_FIFO || MBED_CONF_APP_ACCEL_EVENTS) && !MBED_CONF_APP_SENSOR_ACCEL
+#error "accel-fifo and accel-events need sensor-accel"
+#endif
+#if MBED_CONF_APP_ADC_GROUPS < 1 || MBED_CONF_APP_ADC_GROUPS > 15 || MBED_CONF_APP_ADC_DECIMATION < 1
+#error "adc-groups must be 1 to 15 and adc-decimation at least 1"
+#endif
+
+// Versatz der Sensoren im Scheduler, damit nie zwei Reads direkt hintereinander laufen
+#define CLIMATE_PHASE_MS    1000
+#define LIGHT_PHASE_MS      3000
+#define SOIL_PHASE_MS       5000
+#define COLOR_PHASE_MS      7000
+#define ACCEL_PHASE_MS      10
+#define GPS_PHASE_MS        500
+// Längste Sperre für Reads um die RX-Fenster: TX bei SF12 (2.8 s) plus RX2 (2 s + 1 s), mit Reserve
+#define SENSOR_HOLD_MAX_MS  10000
+
+// Gemeinsame I2C-Instanz für alle Sensoren
+I2C i2c(PB_7, PB_6);  // Dieselben I2C-Pins für alle Sensoren
+I2CBus i2c_bus(i2c);  // Transaktionen der Sensoren nacheinander, muss vor den Sensoren stehen
+GPS gps(PA_9, PA_10, PA_12);
+
+#if MBED_CONF_APP_ACCEL_FIFO || MBED_CONF_APP_ACCEL_EVENTS
+// FIFO und Event-Erkennung melden beide über INT1 und laufen mit derselben Datenrate
+#define ACC_RATE            ACC_ODR_50HZ
+#endif
+
+#if MBED_CONF_APP_ACCEL_EVENTS
+// Schwellen in 0.063 g, Entprellung in Samples bei 50 Hz (20 ms)
+static const AccEventConfig acc_event_config = {
+    8,      // Stoß ab 0.5 g Änderung
+    2,      // ... für 40 ms
+    4,      // Freifall: alle Achsen unter 0.25 g
+    6,      // ... für 120 ms
+    true,
+    true,   // Lageänderung
+    25      // ... stabil für 0.5 s
+};
+#endif
+
+#if MBED_CONF_APP_ACCEL_FIFO
+// Beschleunigung wird dauerhaft über den FIFO gesammelt, ins Uplink geht der Mittelwert
+#define ACC_FIFO_WATERMARK  25  // alle 0.5 s ein Burst
+#endif
+
+
+
+// globale Variablen
+// GPS
+int satelliteCount;
+
+// Accelerometer
+uint8_t accEventFlags;
+
+
+PayloadValues mySensor_data;
+
+// Vom Sensor-Thread fertig gepackt, der LoRaWAN-Thread holt sich nur den jeweils neuesten
+struct SensorSnapshot {
+    PayloadValues values;
+    int satellites;
+};
+static SnapshotBuffer<SensorSnapshot> snapshot;
+
+// Stand des letzten Snapshots, für die Ausgabe nach dem Uplink
+static uint32_t snapshot_fix_age;
+static uint8_t snapshot_flags;
+static uint32_t snapshot_fix_ms;
+static int snapshot_satellites;
+static int32_t snapshot_latitude;   // 1e-6 Grad
+static int32_t snapshot_longitude;
+
+// Die Formate in deferred_log.h geben Schritte mit fester Nachkommazahl aus
+static_assert(payload_schema[PAYLOAD_LAT].scale == 1000000 && payload_schema[PAYLOAD_LON].scale == 1000000,
+              "LOG_GPS prints 1e-6 degrees, DEF_LATITUDE and DEF_LONGITUDE are given in them");
+static_assert(payload_schema[PAYLOAD_TEMP].scale == 10 && payload_schema[PAYLOAD_HUMID].scale == 10
+              && payload_schema[PAYLOAD_LIGHT].scale == 10 && payload_schema[PAYLOAD_SOIL].scale == 10,
+              "LOG_CLIMATE, LOG_LIGHT and LOG_SOIL print steps of 0.1");
+static_assert(payload_schema[PAYLOAD_ACC_X].scale == 100 && payload_schema[PAYLOAD_ACC_Y].scale == 100
+              && payload_schema[PAYLOAD_ACC_Z].scale == 100, "LOG_ACCEL prints steps of 0.01");
+
+static SensorScheduler scheduler;
+static EventQueue *sensor_queue;
+
+// Kernel-Uhr in ms der letzten Erfassung (0 = noch keine) und Abstand der letzten beiden
+static uint32_t last_acquisition_ms;
+static uint32_t acquisition_interval_ms;
+
+#if MBED_CONF_APP_GPS_MOTION_GATED
+// Zeitpunkt des letzten Accelerometer-Events, 0 = seit dem Start keins
+static uint32_t last_motion_ms;
+
+// Ohne Bewegung seit dem letzten Fix ist eine neue Position überflüssig
+static bool moved_since_fix()
+{
+    GpsFix fix;
+    if (!gps.getLatestFix(fix)) {
+        return true;
+    }
+    return last_motion_ms && (int32_t)(last_motion_ms - fix.timestamp) >= 0;
+}
+#endif
+
+#if MBED_CONF_APP_ACCEL_EVENTS
+// Läuft aus der Queue, der Zeitstempel stammt aus dem Interrupt
+static void on_accel_event(AccEvent event)
+{
+    static const char *const names[] = { "shock", "motion", "freefall", "orientation" };
+    accEventFlags |= 1 << event.source;
+    deferred_log(LOG_ACCEL_EVENT, names[event.source], event.timestamp, event.status);
+
+#if MBED_CONF_APP_GPS_MOTION_GATED
+    // Bewegt: rechtzeitig vor dem nächsten Uplink eine neue Position holen
+    last_motion_ms = event.timestamp;
+    if (acquisition_interval_ms) {
+        uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+        int32_t until = (int32_t)(last_acquisition_ms + acquisition_interval_ms - now);
+        gps.planNextFix(until > 0 ? until : 0);
+    }
+#endif
+}
+#endif
+
+// Die Sensoren für sensor_set.h: jeder besitzt seinen Treiber und seinen letzten Wert.
+// Der Scheduler ruft collect(), encode() liest nur den Slot und nie den Bus.
+
+// Si7021: Temperatur und Luftfeuchte aus einer Wandlung
+class ClimateSource {
+public:
+    ClimateSource() : sensor(i2c_bus), queue(nullptr), started(0) {}
+
+    void init(EventQueue &queue)
+    {
+        this->queue = &queue;
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+        scheduler.add("climate", MBED_CONF_APP_CLIMATE_PERIOD * 1000, CLIMATE_PHASE_MS,
+                      callback(this, &ClimateSource::collect));
+    }
+
+    void collect()
+    {
+        // Wandlung läuft im Hintergrund, done() übernimmt das Ergebnis
+        const uint32_t now = latency_ticks();
+        if (sensor.startMeasurement(*queue, callback(this, &ClimateSource::done))) {
+            started = now;
+        }
+    }
+
+    void encode(PayloadValues &values)
+    {
+        values.field[PAYLOAD_TEMP] = slot.value.temperature;
+        values.field[PAYLOAD_HUMID] = slot.value.humidity;
+    }
+
+    void print()
+    {
+        // Die Ausgabe übernimmt der Log-Thread, %.1f sind hier Schritte von 0.1
+        deferred_log(LOG_CLIMATE, slot.value.temperature, slot.value.humidity);
+    }
+
+    void taken() {}
+
+private:
+    struct Climate {
+        int32_t temperature;  // Schritte des Payload-Schemas
+        int32_t humidity;
+    };
+
+    void done()
+    {
+        latency_record(LATENCY_CLIMATE, started);
+        slot.store({sensor.getTempSteps(), sensor.getHumidSteps()});
+        get_all_sesnor_data();
+    }
+
+    TemperatureSensor sensor;
+    EventQueue *queue;
+    SensorSlot<Climate> slot;
+    uint32_t started;  // latency_ticks() des Starts
+};
+
+// Helligkeit über den ADC, überabgetastet im Hintergrund
+class LightSource {
+public:
+    LightSource()
+        : sampler(sensor.input(), MBED_CONF_APP_ADC_GROUPS, MBED_CONF_APP_ADC_DECIMATION,
+                  MBED_CONF_APP_ADC_GROUP_INTERVAL_MS),
+          queue(nullptr),
+          started(0)
+    {
+    }
+
+    void init(EventQueue &queue)
+    {
+        this->queue = &queue;
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+        scheduler.add("light", MBED_CONF_APP_LIGHT_PERIOD * 1000, LIGHT_PHASE_MS,
+                      callback(this, &LightSource::collect));
+    }
+
+    void collect()
+    {
+        // Die Bursts laufen als eigene Events, done() übernimmt den Median
+        const uint32_t now = latency_ticks();
+        if (sampler.start(*queue, callback(this, &LightSource::done))) {
+            started = now;
+        }
+    }
+
+    void encode(PayloadValues &values)
+    {
+        values.field[PAYLOAD_LIGHT] = slot.value;
+    }
+
+    void print()
+    {
+        deferred_log(LOG_LIGHT, slot.value);
+    }
+
+    void taken() {}
+
+private:
+    void done(uint16_t code)
+    {
+        latency_record(LATENCY_LIGHT, started);
+        slot.store(adc_percent_steps(code));
+        get_all_sesnor_data();
+    }
+
+    Brightness sensor;
+    AdcOversampler sampler;
+    EventQueue *queue;
+    SensorSlot<int32_t> slot;  // 0.1 %
+    uint32_t started;
+};
+
+// Bodenfeuchte über den ADC, überabgetastet wie die Helligkeit
+class SoilSource {
+public:
+    SoilSource()
+        : sampler(sensor.input(), MBED_CONF_APP_ADC_GROUPS, MBED_CONF_APP_ADC_DECIMATION,
+                  MBED_CONF_APP_ADC_GROUP_INTERVAL_MS),
+          queue(nullptr),
+          started(0)
+    {
+    }
+
+    void init(EventQueue &queue)
+    {
+        this->queue = &queue;
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+        scheduler.add("soil", MBED_CONF_APP_SOIL_PERIOD * 1000, SOIL_PHASE_MS,
+                      callback(this, &SoilSource::collect));
+    }
+
+    void collect()
+    {
+        const uint32_t now = latency_ticks();
+        if (sampler.start(*queue, callback(this, &SoilSource::done))) {
+            started = now;
+        }
+    }
+
+    void encode(PayloadValues &values)
+    {
+        values.field[PAYLOAD_SOIL] = slot.value;
+    }
+
+    void print()
+    {
+        deferred_log(LOG_SOIL, slot.value);
+    }
+
+    void taken() {}
+
+private:
+    void done(uint16_t code)
+    {
+        latency_record(LATENCY_SOIL, started);
+        slot.store(adc_percent_steps(code));
+        get_all_sesnor_data();
+    }
+
+    SoilSensor sensor;
+    AdcOversampler sampler;
+    EventQueue *queue;
+    SensorSlot<int32_t> slot;  // 0.1 %
+    uint32_t started;
+};
+
+// TCS34725: alle vier Kanäle aus einer Integration
+class ColorSource {
+public:
+    ColorSource() : sensor(i2c_bus), started(0) {}
+
+    void init(EventQueue &queue)
+    {
+        sensor.init();
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+        scheduler.add("color", MBED_CONF_APP_COLOR_PERIOD * 1000, COLOR_PHASE_MS,
+                      callback(this, &ColorSource::collect));
+    }
+
+    void collect()
+    {
+        // Läuft als Transaktion in der Bus-Queue, done() übernimmt das Ergebnis
+        const uint32_t now = latency_ticks();
+        if (sensor.startRead(callback(this, &ColorSource::done))) {
+            started = now;
+        } else {
+            sensor.init(); // falls der Sensor beim Start nicht geantwortet hat
+        }
+    }
+
+    void encode(PayloadValues &values)
+    {
+        values.field[PAYLOAD_CLEAR] = slot.value.clear;
+        values.field[PAYLOAD_RED] = slot.value.red;
+        values.field[PAYLOAD_GREEN] = slot.value.green;
+        values.field[PAYLOAD_BLUE] = slot.value.blue;
+    }
+
+    void print()
+    {
+        deferred_log(LOG_COLOR, slot.value.clear, slot.value.red, slot.value.green, slot.value.blue);
+    }
+
+    void taken() {}
+
+private:
+    struct Color {
+        uint16_t clear, red, green, blue;
+    };
+
+    void done(bool valid)
+    {
+        if (valid) {
+            latency_record(LATENCY_COLOR, started);
+            slot.store({(uint16_t)sensor.getClear(), (uint16_t)sensor.getRed(),
+                        (uint16_t)sensor.getGreen(), (uint16_t)sensor.getBlue()});
+            get_all_sesnor_data();
+        }
+    }
+
+    ColorSensor sensor;
+    SensorSlot<Color> slot;
+    uint32_t started;
+};
+
+// MMA8451: Mittelwert aus dem FIFO oder regelmäßig gelesen, dazu die Events über INT1
+class AccelSource {
+public:
+    AccelSource()
+        : sensor(i2c_bus),
+#if MBED_CONF_APP_ACCEL_FIFO || MBED_CONF_APP_ACCEL_EVENTS
+          irq(MBED_CONF_APP_ACCEL_INT1_PIN),
+#endif
+          steps{0, 0, 0}
+    {
+    }
+
+    void init(EventQueue &queue)
+    {
+#if MBED_CONF_APP_ACCEL_EVENTS
+        if (!sensor.enableEvents(irq, queue, ACC_RATE, acc_event_config, callback(on_accel_event))) {
+            printf("Accelerometer event setup failed\n");
+        }
+#endif
+#if MBED_CONF_APP_ACCEL_FIFO
+        if (!sensor.enableFifo(irq, queue, ACC_RATE, ACC_FIFO_WATERMARK,
+                               callback(this, &AccelSource::drain))) {
+            printf("Accelerometer FIFO setup failed\n");
+        }
+#endif
+#if !MBED_CONF_APP_ACCEL_FIFO && !MBED_CONF_APP_ACCEL_EVENTS
+        sensor.initialize();
+#endif
+    }
+
+    void start(SensorScheduler &scheduler)
+    {
+#if !MBED_CONF_APP_ACCEL_FIFO
+        scheduler.add("accel", MBED_CONF_APP_ACCEL_PERIOD_MS, ACCEL_PHASE_MS,
+                      callback(this, &AccelSource::collect));
+#endif
+    }
+
+    void collect()
+    {
+#if !MBED_CONF_APP_ACCEL_FIFO
+        LatencyScope span(LATENCY_ACCEL);
+        AccSample sample;
+        if (sensor.readAxes(sample)) {
+            steps[0] = mma8451_acceleration_steps(sample.x);
+            steps[1] = mma8451_acceleration_steps(sample.y);
+            steps[2] = mma8451_acceleration_steps(sample.z);
+            get_all_sesnor_data();
+        }
+#endif
+    }
+
+    void encode(PayloadValues &values)
+    {
+#if MBED_CONF_APP_ACCEL_FIFO
+        // Samples seit dem letzten Watermark kommen mit dem nächsten Uplink
+        if (samples > 0) {
+            // Mittelwert über alle Samples seit dem letzten Uplink, 4096 pro g
+            for (int axis = 0; axis < 3; axis++) {
+                steps[axis] = mma8451_mean_acceleration_steps(sum[axis], samples);
+            }
+        }
+#endif
+        values.field[PAYLOAD_ACC_X] = steps[0];
+        values.field[PAYLOAD_ACC_Y] = steps[1];
+        values.field[PAYLOAD_ACC_Z] = steps[2];
+    }
+
+    void print()
+    {
+        deferred_log(LOG_ACCEL, steps[0], steps[1], steps[2]);
+#if MBED_CONF_APP_ACCEL_EVENTS
+        deferred_log(LOG_ACCEL_FLAGS, accEventFlags);
+#endif
+    }
+
+    void taken()
+    {
+#if MBED_CONF_APP_ACCEL_FIFO
+        // Der nächste Mittelwert beginnt hier
+        sum[0] = sum[1] = sum[2] = 0;
+        samples = 0;
+#endif
+#if MBED_CONF_APP_ACCEL_EVENTS
+        accEventFlags = 0;
+#endif
+    }
+
+private:
+#if MBED_CONF_APP_ACCEL_FIFO
+    // Watermark-Handler: ein Burst-Read pro Batch, aufsummiert bis zum nächsten Uplink
+    void drain(const AccSample *batch, int count)
+    {
+        LatencyScope span(LATENCY_ACCEL);
+        for (int i = 0; i < count; i++) {
+            sum[0] += batch[i].x;
+            sum[1] += batch[i].y;
+            sum[2] += batch[i].z;
+        }
+        if (count > 0) {
+            samples += count;
+            get_all_sesnor_data();
+        }
+    }
+
+    // 64 bit: ohne Uplink (z. B. Join-Backoff) liefe eine 32-Bit-Summe bei 1 g nach 3 h über
+    int64_t sum[3] = {0, 0, 0};
+    int32_t samples = 0;
+#endif
+
+    Accelerometer sensor;
+#if MBED_CONF_APP_ACCEL_FIFO || MBED_CONF_APP_ACCEL_EVENTS
+    InterruptIn irq;
+#endif
+    int32_t steps[3];  // 0.01 m/s^2
+};
+
+// Welche Sensoren bestückt sind, steht in mbed_app.json. Abgeschaltete belegen weder RAM noch Flash.
+using Sensors = SensorSet<
+    OptionalSensor<MBED_CONF_APP_SENSOR_CLIMATE, ClimateSource>,
+    OptionalSensor<MBED_CONF_APP_SENSOR_LIGHT, LightSource>,
+    OptionalSensor<MBED_CONF_APP_SENSOR_SOIL, SoilSource>,
+    OptionalSensor<MBED_CONF_APP_SENSOR_COLOR, ColorSource>,
+    OptionalSensor<MBED_CONF_APP_SENSOR_ACCEL, AccelSource>>;
+static Sensors sensors;
+
+void get_all_sesnor_data()
+{
+    LatencyScope span(LATENCY_PACK);
+    // GPS: der Ringpuffer wird im Hintergrund geleert, hier nur der Rest und die letzte Position
+    gps.readAndProcessGPSData();
+    GpsFix fix;
+    int satellites;
+    uint32_t fixAge = gps.getFixAge();
+    bool usable = gps.getLatestFix(fix) && fixAge <= GPS_MAX_FIX_AGE_MS;
+#if MBED_CONF_APP_GPS_MOTION_GATED
+    usable = gps.getLatestFix(fix) && (fixAge <= GPS_MAX_FIX_AGE_MS || !moved_since_fix());
+#endif
+    uint8_t flags = 0;
+    if (usable) {
+        satellites = fix.satellites;
+        // Position stammt aus einem früheren Zyklus
+        if (last_acquisition_ms && (int32_t)(fix.timestamp - last_acquisition_ms) < 0) {
+            flags |= PAYLOAD_FLAG_GPS_CACHED;
+        }
+    } else {
+        satellites = 0;
+    }
+    //altitude = gps.getAltitude();
+
+    snapshot_fix_age = fixAge;
+    snapshot_fix_ms = usable ? fix.timestamp : 0;
+    snapshot_flags = flags;
+    snapshot_satellites = satellites;
+
+    // In Schritte des Payload-Schemas, gerundet und auf den Wertebereich begrenzt
+    SensorSnapshot &next = snapshot.back();
+    PayloadValues &values = next.values;
+    next.satellites = satellites;
+    values.field[PAYLOAD_FLAGS] = flags;
+    if (usable) {
+        values.field[PAYLOAD_LAT] = fix.latitude; // schon in 1e-6 Grad, ohne Umweg über float
+        values.field[PAYLOAD_LON] = fix.longitude;
+    } else {
+        // Default if no signal
+        values.field[PAYLOAD_LAT] = DEF_LATITUDE;
+        values.field[PAYLOAD_LON] = DEF_LONGITUDE;
+    }
+    snapshot_latitude = values.field[PAYLOAD_LAT];
+    snapshot_longitude = values.field[PAYLOAD_LON];
+
+    // Die übrigen Sensoren aus ihren letzten Werten, abgeschaltete bleiben 0
+    sensors.encode(values);
+    snapshot.publish();
+}
+
+// Gibt den Stand nach jedem Uplink aus: GPS aus dem letzten Snapshot, der Rest die letzten Werte.
+// Nur ins Log, formatiert wird erst auf dem Host (log-decode), die UART blockiert hier nicht.
+static void print_sensor_data()
+{
+    deferred_log(LOG_SENSOR_HEADER);
+    deferred_log(LOG_GPS, snapshot_satellites, snapshot_latitude, snapshot_longitude, snapshot_fix_age,
+                 (snapshot_flags & PAYLOAD_FLAG_GPS_CACHED) ? " (cached)" : "");
+#if MBED_CONF_APP_GPS_DUTY_CYCLE
+    const GpsPowerStats &power = gps.getPowerStats();
+    deferred_log(LOG_GPS_POWER, power.lastTtff, power.avgTtff, power.lastOnTime, power.leadTime,
+                 power.timeouts);
+#endif
+    sensors.print();
+    // Summen seit dem Start, Latenz inklusive Warten auf den Bus
+    for (int i = 0; i < i2c_bus.deviceCount(); i++) {
+        const I2CDevice &device = i2c_bus.device(i);
+        const I2CDeviceStats &stats = device.stats();
+        deferred_log(LOG_I2C, device.name(), stats.transactions, stats.nacks,
+                     static_cast<uint32_t>(stats.transactions ? stats.latencyUs / stats.transactions : 0),
+                     stats.maxLatencyUs);
+    }
+#if MBED_CONF_APP_LATENCY_DUMP_INTERVAL
+    // Die Histogramme sind länger, daher nur jeden n-ten Uplink
+    static uint32_t uplinks;
+    if (++uplinks % MBED_CONF_APP_LATENCY_DUMP_INTERVAL == 0) {
+        latency_dump();
+    }
+#endif
+}
+
+// Neue GPS-Position: der Ringpuffer wird schon im Hintergrund geleert, hier nur der Snapshot
+static void read_gps()
+{
+    LatencyScope span(LATENCY_GPS);
+    GpsFix fix;
+    gps.readAndProcessGPSData();
+    if (gps.getLatestFix(fix) && fix.timestamp != snapshot_fix_ms) {
+        get_all_sesnor_data();
+    }
+}
+
+// Kommen aus dem LoRaWAN-Thread, der Scheduler gehört dem Sensor-Thread
+void hold_sensor_reads()
+{
+    sensor_queue->call(&scheduler, &SensorScheduler::hold, (uint32_t)SENSOR_HOLD_MAX_MS);
+}
+
+void release_sensor_reads()
+{
+    sensor_queue->call(&scheduler, &SensorScheduler::release);
+}
+
+void init_sensors(EventQueue &queue)
+{
+    sensor_queue = &queue;
+    i2c_bus.start(queue);
+
+    // GPS: nur GGA/RMC, Rate und Baudrate setzen, danach Empfang im Hintergrund
+    gps.initialize(MBED_CONF_APP_GPS_UPDATE_INTERVAL, MBED_CONF_APP_GPS_BAUD);
+    gps.start(queue);
+#if MBED_CONF_APP_GPS_DUTY_CYCLE
+    gps.enableDutyCycle(true);
+#endif
+    sensors.init(queue);
+
+    // GPS und Accelerometer-FIFO laufen schon über ihre Interrupts, der Rest nach Plan
+    scheduler.add("gps", MBED_CONF_APP_GPS_UPDATE_INTERVAL, GPS_PHASE_MS, callback(read_gps));
+    sensors.start(scheduler);
+
+    // Einmal sofort, damit schon der erste Uplink Werte hat
+    sensors.collect();
+    get_all_sesnor_data();
+    scheduler.start(queue);
+}
+
+// Läuft im Sensor-Thread, nachdem ein Uplink den Snapshot übernommen hat
+static void acquisition_taken()
+{
+    print_sensor_data();
+    sensors.taken();
+
+    // Der nächste Uplink kommt voraussichtlich im gleichen Abstand wie dieser
+    uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+    if (last_acquisition_ms) {
+        acquisition_interval_ms = now - last_acquisition_ms;
+#if MBED_CONF_APP_GPS_DUTY_CYCLE
+#if MBED_CONF_APP_GPS_MOTION_GATED
+        // Steht der Knoten still, bleibt das GPS aus und die letzte Position gilt weiter
+        if (!moved_since_fix()) {
+            gps.skipNextFix();
+        } else
+#endif
+        {
+            gps.planNextFix(acquisition_interval_ms);
+        }
+#endif
+    }
+    last_acquisition_ms = now;
+
+    // Neuer Bezug für PAYLOAD_FLAG_GPS_CACHED
+    get_all_sesnor_data();
+}
+
+void start_sensor_acquisition(EventQueue &queue, Callback<void()> done)
+{
+    // Nur der neueste fertige Snapshot, der Funkpfad wartet nie auf einen Sensor
+    snapshot.update();
+    mySensor_data = snapshot.front().values;
+    satelliteCount = snapshot.front().satellites;
+
+    sensor_queue->call(acquisition_taken);
+    queue.call(done);
+}
@@ -0,0 +1,65 @@
+#ifndef APP_SENSORS_H_
+#define APP_SENSORS_H_
+
+#include <cstdint>
+#include "mbed.h"
+#include "payload.h"
+
+/**
+ * Values of the last acquisition in payload schema steps, see payload.h.
+ * send_message() encodes them with payload_encode(). Only written by
+ * start_sensor_acquisition(), in the caller's thread.
+ */
+extern PayloadValues mySensor_data;
+
+/**
+ * Number of satellites of the last GPS fix (0 means no fix), same as
+ * mySensor_data
+ */
+extern int satelliteCount;
+
+/**
+ * Accelerometer events seen since the last acquisition, bit
+ * (1 << AccEventSource) per source. Only set with accel-events enabled.
+ */
+extern uint8_t accEventFlags;
+
+/**
+ * One-time configuration of the sensors, call once at startup before
+ * queue is dispatched. queue is the acquisition queue, normally run by
+ * its own low-priority thread: sensor interrupts are deferred onto it,
+ * and every sensor is read once and then periodically on it by a
+ * SensorScheduler (sensor_scheduler.h), each at the period from
+ * mbed_app.json. GPS and the accelerometer FIFO are driven by their
+ * interrupts instead.
+ */
+void init_sensors(EventQueue &queue);
+
+/**
+ * Packs the latest value of each sensor, without touching the bus, and
+ * publishes it as snapshot for start_sensor_acquisition(). Runs on the
+ * acquisition queue after every read.
+ *
+ * Kept free of any LoRaWAN dependency so that it can also be built
+ * for the host against the mock HAL in host/.
+ */
+void get_all_sesnor_data();
+
+/**
+ * Copies the newest published snapshot into mySensor_data and calls done
+ * from queue, the caller's queue. Never waits for the acquisition queue:
+ * the snapshot is handed over lock-free (snapshot_buffer.h). Printing
+ * and GPS planning for the next uplink follow on the acquisition queue.
+ */
+void start_sensor_acquisition(EventQueue &queue, Callback<void()> done);
+
+/**
+ * Holds the scheduled reads while the LoRaWAN stack needs to be on time,
+ * i.e. from send() or connect() until TX_DONE, an error or the join
+ * result. Due reads run after the release; without one they resume after
+ * 10 s. Can be called from any thread.
+ */
+void hold_sensor_reads();
+void release_sensor_reads();
+
+#endif /* APP_SENSORS_H_ */
@@ -0,0 +1,72 @@
+#ifndef APP_SNAPSHOT_BUFFER_H_
+#define APP_SNAPSHOT_BUFFER_H_
+
+#include <cstdint>
+
+#include "mbed.h"
+
+/**
+ * Lock-free hand-over of the latest value from one writer thread to one
+ * reader thread (triple buffer). Unlike SpscRing nothing queues up: the
+ * reader always gets the newest complete value and neither side ever
+ * waits for the other.
+ *
+ * The writer fills back() and calls publish(), the reader calls update()
+ * and then reads front(). Each side owns one of the three slots, the
+ * third is handed over with a single atomic exchange, so a slot is never
+ * written and read at the same time.
+ */
+template <typename T>
+class SnapshotBuffer {
+public:
+    SnapshotBuffer() : _back(0), _middle(1), _front(2), _published(0)
+    {
+    }
+
+    /** Writer side: the slot to fill */
+    T &back()
+    {
+        return _slots[_back];
+    }
+
+    /** Writer side: hands back() to the reader */
+    void publish()
+    {
+        _back = core_util_atomic_exchange_u32(&_middle, _back | FRESH) & INDEX;
+        core_util_atomic_incr_u32(&_published, 1);
+    }
+
+    /** Reader side: switches front() to the newest value, false if there is none since the last call */
+    bool update()
+    {
+        if (!(core_util_atomic_load_u32(&_middle) & FRESH)) {
+            return false;
+        }
+        _front = core_util_atomic_exchange_u32(&_middle, _front) & INDEX;
+        return true;
+    }
+
+    /** Reader side: the value of the last successful update() */
+    const T &front() const
+    {
+        return _slots[_front];
+    }
+
+    /** Values published so far, from either side */
+    uint32_t published() const
+    {
+        return core_util_atomic_load_u32(&_published);
+    }
+
+private:
+    static const uint32_t INDEX = 0x3;
+    static const uint32_t FRESH = 0x4;
+
+    T _slots[3];
+    uint32_t _back;             // writer only
+    volatile uint32_t _middle;  // index of the handed-over slot, FRESH until the reader takes it
+    uint32_t _front;            // reader only
+    volatile uint32_t _published;
+};
+
+#endif /* APP_SNAPSHOT_BUFFER_H_ */
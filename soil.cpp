@@ -1,4 +1,5 @@
 #include "soil.h"
+#include "sensor_units.h"
 AnalogIn _sensorPin(A0);
 
 
@@ -10,3 +11,11 @@ float SoilSensor::readMoisture() {
     return sens_val;  // Wandelt die analoge Eingabe in Prozent um
 }
 
+int32_t SoilSensor::readMoistureSteps() {
+    return adc_percent_steps(_sensorPin.read_u16());
+}
+
+AnalogIn &SoilSensor::input() {
+    return _sensorPin;
+}
+
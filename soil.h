@@ -10,6 +10,8 @@ public:
     
     // Methode zum Lesen der Bodenfeuchtigkeit in Prozent
     float readMoisture();
+    int32_t readMoistureSteps(); // in 0.1 % ohne Gleitkomma, siehe adc_percent_steps()
+    AnalogIn &input();           // für das Oversampling im Hintergrund (adc_oversampler.h)
     
 };
 
@@ -0,0 +1,73 @@
+#ifndef APP_SPSC_RING_H_
+#define APP_SPSC_RING_H_
+
+#include <cstdint>
+
+#include "mbed.h"
+
+/**
+ * Lock-free ring buffer for exactly one producer and one consumer, e.g.
+ * an interrupt handler and a thread. Each side only writes its own index,
+ * so no critical section is needed; the atomic loads and stores order the
+ * element accesses against the index updates.
+ *
+ * Size must be a power of two, one slot is never used to tell full from
+ * empty apart.
+ */
+template <typename T, uint32_t Size>
+class SpscRing {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+    SpscRing() : _head(0), _tail(0)
+    {
+    }
+
+    /** Producer side, returns false if the ring is full */
+    bool push(const T &item)
+    {
+        const uint32_t head = _head;
+        const uint32_t next = (head + 1) & (Size - 1);
+        if (next == core_util_atomic_load_u32(&_tail)) {
+            return false;
+        }
+        _buffer[head] = item;
+        core_util_atomic_store_u32(&_head, next);
+        return true;
+    }
+
+    /** Consumer side, returns false if the ring is empty */
+    bool pop(T &item)
+    {
+        const uint32_t tail = _tail;
+        if (tail == core_util_atomic_load_u32(&_head)) {
+            return false;
+        }
+        item = _buffer[tail];
+        core_util_atomic_store_u32(&_tail, (tail + 1) & (Size - 1));
+        return true;
+    }
+
+    /** Number of items, only exact when called by the consumer */
+    uint32_t count() const
+    {
+        return (core_util_atomic_load_u32(&_head) - core_util_atomic_load_u32(&_tail)) & (Size - 1);
+    }
+
+    bool empty() const
+    {
+        return count() == 0;
+    }
+
+    static constexpr uint32_t capacity()
+    {
+        return Size - 1;
+    }
+
+private:
+    T _buffer[Size];
+    volatile uint32_t _head; // written by the producer only
+    volatile uint32_t _tail; // written by the consumer only
+};
+
+#endif /* APP_SPSC_RING_H_ */
@@ -1,8 +1,10 @@
 #include "temperatur.h"
 // temp 14 bit resolution humid 12?
 
-// Konstruktor: speichert die I2C-Referenz
-TemperatureSensor::TemperatureSensor(I2C &i2c_instance) : i2c(i2c_instance)
+// Konstruktor: meldet den Sensor am Bus an
+TemperatureSensor::TemperatureSensor(I2CBus &bus)
+    : device(bus, SI7021_ADDRESS, "Si7021"), temperatureCode(0), humidityCode(0), measured(false),
+      state(IDLE), retries(0), queue(nullptr)
 {
     
 }
@@ -12,15 +14,14 @@ float TemperatureSensor::readHumidity() {
     char cmd[1] = { CMD_MEASURE_HUMIDITY }; // i2c cmd Measure temperature register
     char data[2] = { 0 };
     
-    i2c.write(SI7021_ADDRESS, cmd, 1); // Befehl zum Messen der Luftfeuchtigkeit senden 1--> Anzahl der Bytes
+    device.write(cmd, 1);              // Befehl zum Messen der Luftfeuchtigkeit senden 1--> Anzahl der Bytes
     ThisThread::sleep_for(20ms);       // Warten auf die Messung
-    i2c.read(SI7021_ADDRESS, data, 2); // 2 Bytes für die Luftfeuchtigkeit lesen
+    device.read(data, 2);              // 2 Bytes für die Luftfeuchtigkeit lesen
 
     // verbindet die beiden gelesenen Bytes zu einem 16-Bit-Rohwert.
-    int humidity_raw = (data[0] << 8) | data[1];
-    humidity = ((125.0 * humidity_raw) / 65536) - 6.0; // Umwandlung in %
-
-    return humidity;
+    humidityCode = (data[0] << 8) | data[1];
+    measured = true;
+    return getHumid(); // Umwandlung in %
 }
 
 // Methode zur Messung der Temperatur
@@ -28,19 +29,83 @@ float TemperatureSensor::readTemperature() {
     char cmd[1] = { CMD_MEASURE_TEMPERATURE };
     char data[2] = { 0 };
     
-    i2c.write(SI7021_ADDRESS, cmd, 1); // Befehl zum Messen der Temperatur senden
+    device.write(cmd, 1);              // Befehl zum Messen der Temperatur senden
     ThisThread::sleep_for(20ms);       // Warten auf die Messung
-    i2c.read(SI7021_ADDRESS, data, 2); // 2 Bytes für die Temperatur lesen
+    device.read(data, 2);              // 2 Bytes für die Temperatur lesen
 
-    int temperature_raw = (data[0] << 8) | data[1]; // sechzehn
-    temperature = ((175.72 * temperature_raw) / 65536) - 46.85; // Umwandlung in °C
-    
-    return temperature;
+    temperatureCode = (data[0] << 8) | data[1]; // sechzehn
+    measured = true;
+    return getTemp(); // Umwandlung in °C
 }
 
+// Startet eine RH-Messung (misst die Temperatur intern mit) ohne zu blockieren
+bool TemperatureSensor::startMeasurement(EventQueue &queue, Callback<void()> done) {
+    if (state != IDLE) {
+        return false;
+    }
+
+    txBuffer[0] = CMD_MEASURE_HUMIDITY;
+    if (!device.submit(txBuffer, 1, nullptr, 0, callback(this, &TemperatureSensor::commandSent))) {
+        return false; // Bus-Queue voll
+    }
 
+    this->queue = &queue;
+    this->done = done;
+    retries = 0;
+    state = CONVERTING;
+    return true;
+}
 
+// Befehl ist raus: jetzt wandelt der Sensor, der Bus gehört solange den anderen
+void TemperatureSensor::commandSent(int result) {
+    if (result != 0) {
+        finishMeasurement(); // Sensor antwortet nicht
+        return;
+    }
+    if (!queue->call_in(SI7021_RH_CONVERSION_TIME, this, &TemperatureSensor::completeMeasurement)) {
+        finishMeasurement(); // Queue voll, sonst bliebe state auf CONVERTING
+    }
+}
 
+// Läuft aus der EventQueue: RH lesen, dann Temperatur der gleichen Wandlung (0xE0)
+void TemperatureSensor::completeMeasurement() {
+    if (!device.submit(nullptr, 0, rxBuffer, 2, callback(this, &TemperatureSensor::humidityRead))) {
+        finishMeasurement();
+    }
+}
 
+void TemperatureSensor::humidityRead(int result) {
+    if (result != 0) {
+        // Wandlung noch nicht fertig (NACK), kurz danach nochmal versuchen
+        if (++retries <= SI7021_MAX_RETRIES
+                && queue->call_in(SI7021_RETRY_TIME, this, &TemperatureSensor::completeMeasurement)) {
+            return;
+        }
+        finishMeasurement(); // aufgeben, alte Werte bleiben stehen
+        return;
+    }
 
+    // Nur die Rohwerte, umgerechnet wird erst beim Abholen
+    humidityCode = (rxBuffer[0] << 8) | rxBuffer[1];
 
+    // Temperatur aus der letzten RH-Messung, braucht keine eigene Wandlung
+    txBuffer[0] = CMD_READ_PREV_TEMPERATURE;
+    if (!device.submit(txBuffer, 1, rxBuffer, 2, callback(this, &TemperatureSensor::temperatureRead))) {
+        finishMeasurement();
+    }
+}
+
+void TemperatureSensor::temperatureRead(int result) {
+    if (result == 0) {
+        temperatureCode = (rxBuffer[0] << 8) | rxBuffer[1];
+        measured = true; // erst mit beiden Werten, sonst ginge temperatureCode 0 als -46.85 °C raus
+    }
+    finishMeasurement();
+}
+
+void TemperatureSensor::finishMeasurement() {
+    state = IDLE;
+    if (done) {
+        done();
+    }
+}
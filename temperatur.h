@@ -1,20 +1,55 @@
 #include "mbed.h"
+#include "i2c_bus.h"
+#include "sensor_units.h"
 
 #define CMD_MEASURE_HUMIDITY 0xF5       // Measure humidity register 
 #define CMD_MEASURE_TEMPERATURE 0xF3    // Measure temperature register
+#define CMD_READ_PREV_TEMPERATURE 0xE0  // Temperatur der letzten RH-Messung lesen (keine neue Wandlung)
 #define SI7021_ADDRESS 0x40 << 1        // Temperature and Humidity I2C address shift weil i2c mit write read bit benötigt
 
+#define SI7021_RH_CONVERSION_TIME 23ms  // RH 12 bit (12 ms) + Temperatur 14 bit (10.8 ms), max. laut Datenblatt
+#define SI7021_RETRY_TIME 2ms           // Sensor NACKt, solange die Wandlung läuft
+#define SI7021_MAX_RETRIES 5
+
 class TemperatureSensor {
 private:
-    I2C &i2c; // Referenz auf die I2C-Instanz
-    float temperature, humidity;
+    I2CDevice device; // am gemeinsamen Bus
+    uint16_t temperatureCode, humidityCode; // Rohwerte der letzten Messung
+    bool measured;
+
+    // Zustand der asynchronen Messung
+    enum State { IDLE, CONVERTING };
+    State state;
+    int retries;
+    EventQueue *queue;
+    Callback<void()> done;
+    char txBuffer[1]; // Puffer der laufenden Transaktion, müssen bis zum Callback leben
+    char rxBuffer[2];
+
+    void commandSent(int result);
+    void completeMeasurement();
+    void humidityRead(int result);
+    void temperatureRead(int result);
+    void finishMeasurement();
   
 public:
-    TemperatureSensor(I2C &i2c_instance);  // Konstruktor mit I2C-Referenz
+    TemperatureSensor(I2CBus &bus);  // Konstruktor mit dem gemeinsamen Bus
     float readHumidity();
     float readTemperature();
 
-    float getTemp(){return temperature;}
-    float getHumid(){return humidity;}
+    // Asynchrone Messung: startet eine RH-Wandlung und kehrt sofort zurück.
+    // Alle Transaktionen laufen über die Queue des Busses, während der Wandlung
+    // ist der Bus für die anderen Sensoren frei. Danach wird done aufgerufen und
+    // getTemp()/getHumid() liefern die neuen Werte (bei Fehler die alten).
+    // false, wenn schon eine läuft oder die Bus-Queue voll ist.
+    bool startMeasurement(EventQueue &queue, Callback<void()> done);
+    bool isBusy(){return state != IDLE;}
+
+    float getTemp(){return measured ? ((175.72 * temperatureCode) / 65536) - 46.85 : 0;} // in °C
+    float getHumid(){return measured ? ((125.0 * humidityCode) / 65536) - 6.0 : 0;}       // in %
+
+    // Ohne Gleitkomma direkt in Schritten des Payload-Schemas (0.1 °C, 0.1 %), 0 vor der ersten Messung
+    int32_t getTempSteps(){return measured ? si7021_temperature_steps(temperatureCode) : 0;}
+    int32_t getHumidSteps(){return measured ? si7021_humidity_steps(humidityCode) : 0;}
 
 };
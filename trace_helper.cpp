@@ -22,9 +22,13 @@
  */
 
 #include "mbed_trace.h"
+#include "trace_helper.h"
 
 #ifdef FEA_TRACE_SUPPORT
 #include "platform/PlatformMutex.h"
+#if MBED_CONF_APP_TRACE_RING_SIZE
+#include "mpsc_ring.h"
+#endif
 
 /**
  * Local mutex object for synchronization
@@ -34,19 +38,99 @@ static PlatformMutex mutex;
 static void serial_lock();
 static void serial_unlock();
 
+#if MBED_CONF_APP_TRACE_RING_SIZE
+/**
+ * Longest trace line kept in the ring, the rest is cut off
+ */
+#define TRACE_LINE_MAX  160
+#define TRACE_LINE_WORDS (1 + (TRACE_LINE_MAX + 3) / 4)
+
+/**
+ * Trace lines waiting for drain_trace(): the length, then the characters
+ * four to a word
+ */
+static MpscRing<MBED_CONF_APP_TRACE_RING_SIZE> ring;
+static mbed::Callback<void()> drain_wakeup;
+static uint32_t reported_overflows;
+
+static void ring_print(const char *line);
+#endif
+
 /**
  * Sets up trace for the application
  * Wouldn't do anything if the FEATURE_COMMON_PAL is not added
  * or if the trace is disabled using mbed_app.json
  */
-void setup_trace()
+void setup_trace(mbed::Callback<void()> wakeup)
 {
     // setting up Mbed trace.
+    // The mutex stays in both modes, mbed-trace formats every line in one shared buffer
     mbed_trace_mutex_wait_function_set(serial_lock);
     mbed_trace_mutex_release_function_set(serial_unlock);
     mbed_trace_init();
+#if MBED_CONF_APP_TRACE_RING_SIZE
+    // After init, which installs the default print function
+    drain_wakeup = wakeup;
+    mbed_trace_print_function_set(ring_print);
+#else
+    (void)wakeup;
+#endif
+}
+
+int drain_trace()
+{
+    int lines = 0;
+#if MBED_CONF_APP_TRACE_RING_SIZE
+    const uint32_t overflows = ring.dropped();
+    if (overflows != reported_overflows) {
+        printf("[trace] %lu lines lost to a full ring\n", (unsigned long)(overflows - reported_overflows));
+        reported_overflows = overflows;
+    }
+
+    uint32_t words[TRACE_LINE_WORDS];
+    char line[TRACE_LINE_MAX + 1];
+    while (ring.read(words, TRACE_LINE_WORDS) > 0) {
+        const uint32_t length = words[0] < TRACE_LINE_MAX ? words[0] : TRACE_LINE_MAX;
+        for (uint32_t i = 0; i < length; i++) {
+            line[i] = (char)(words[1 + i / 4] >> (8 * (i % 4)));
+        }
+        line[length] = '\n';
+        fwrite(line, 1, length + 1, stdout);
+        lines++;
+    }
+#endif
+    return lines;
 }
 
+uint32_t trace_overflows()
+{
+#if MBED_CONF_APP_TRACE_RING_SIZE
+    return ring.dropped();
+#else
+    return 0;
+#endif
+}
+
+#if MBED_CONF_APP_TRACE_RING_SIZE
+/**
+ * Print function in ring mode: copies the line and returns, the serial
+ * port is written by drain_trace()
+ */
+static void ring_print(const char *line)
+{
+    uint32_t words[TRACE_LINE_WORDS] = {};
+    uint32_t length = 0;
+    while (length < TRACE_LINE_MAX && line[length]) {
+        words[1 + length / 4] |= (uint32_t)(uint8_t)line[length] << (8 * (length % 4));
+        length++;
+    }
+    words[0] = length;
+    if (ring.write(words, 1 + (length + 3) / 4) && drain_wakeup) {
+        drain_wakeup();
+    }
+}
+#endif
+
 /**
  * Lock provided for serial printing used by trace library
  */
@@ -63,10 +147,19 @@ static void serial_unlock()
     mutex.unlock();
 }
 #else
-void setup_trace()
+void setup_trace(mbed::Callback<void()> wakeup)
+{
+    (void)wakeup;
+}
+
+int drain_trace()
 {
+    return 0;
+}
 
+uint32_t trace_overflows()
+{
+    return 0;
 }
 #endif
 
-
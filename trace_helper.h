@@ -18,11 +18,30 @@
 #ifndef APP_TRACE_HELPER_H_
 #define APP_TRACE_HELPER_H_
 
+#include <cstdint>
+
+#include "platform/Callback.h"
+
 /**
  * Helper function for the application to setup Mbed trace.
  * It Wouldn't do anything if the FEATURE_COMMON_PAL is not added
  * or if the trace is disabled using mbed_app.json
+ *
+ * With trace-ring-size set the trace lines only go into a lock-free ring
+ * and the thread tracing never waits for the serial port; wakeup is
+ * called after each line, and the lines are written out by drain_trace().
+ * Without it every line is printed directly, under the trace mutex.
  */
-void setup_trace();
+void setup_trace(mbed::Callback<void()> wakeup = nullptr);
+
+/**
+ * Writes the trace lines in the ring to stdout, preceded by a note if
+ * lines were lost to a full ring. Call from one low-priority thread.
+ * Returns the number of lines.
+ */
+int drain_trace();
+
+/** Trace lines lost to a full ring since the start */
+uint32_t trace_overflows();
 
 #endif /* APP_TRACE_HELPER_H_ */